@@ -18,6 +18,7 @@
 #include <cassert>
 #include <stxxl/bits/verbose.h>
 #include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/common/huge_pages.h>
 
 #ifndef STXXL_VERBOSE_ALIGNED_ALLOC
 #define STXXL_VERBOSE_ALIGNED_ALLOC STXXL_VERBOSE2
@@ -44,10 +45,26 @@ bool aligned_alloc_settings<MustBeInt>::may_use_realloc = true;
 //                     pointer to buffer
 // (---) unallocated, (===) allocated memory
 
+//
+// Large allocations may instead be mapped with huge pages, see
+// huge_pages_alloc(). The pointer in front of the result is then tagged by
+// setting its lowest bit, which is never set for a malloc() buffer.
+
 template <size_t Alignment>
-inline void * aligned_alloc(size_t size, size_t meta_info_size = 0)
+inline void * aligned_alloc(size_t size, size_t meta_info_size = 0,
+                            huge_pages_mode huge_pages = HUGE_PAGES_DEFAULT)
 {
     STXXL_VERBOSE2("stxxl::aligned_alloc<" << Alignment << ">(), size = " << size << ", meta info size = " << meta_info_size);
+    if (huge_pages != HUGE_PAGES_NONE) {
+        void* result = huge_pages_alloc(size, meta_info_size, huge_pages);
+        if (result) {
+            STXXL_VERBOSE_ALIGNED_ALLOC(
+                "stxxl::aligned_alloc<" << Alignment <<
+                ">(size = " << size << ", meta info size = " << meta_info_size <<
+                ") => huge pages, ptr = " << result);
+            return result;
+        }
+    }
 #if !defined(STXXL_WASTE_MORE_MEMORY_FOR_IMPROVED_ACCESS_AFTER_ALLOCATED_MEMORY_CHECKS)
     // malloc()/realloc() variant that frees the unused amount of memory
     // after the data area of size 'size'. realloc() from valgrind does not
@@ -95,7 +112,7 @@ inline void * aligned_alloc(size_t size, size_t meta_info_size = 0)
             STXXL_ERRMSG("stxxl::aligned_alloc: disabling realloc()");
             std::free(realloced);
             aligned_alloc_settings<int>::may_use_realloc = false;
-            return aligned_alloc<Alignment>(size, meta_info_size);
+            return aligned_alloc<Alignment>(size, meta_info_size, HUGE_PAGES_NONE);
         }
         assert(result + size <= buffer + realloc_size);
     }
@@ -120,7 +137,10 @@ aligned_dealloc(void* ptr)
         return;
     char* buffer = *(((char**)ptr) - 1);
     STXXL_VERBOSE_ALIGNED_ALLOC("stxxl::aligned_dealloc<" << Alignment << ">(), ptr = " << ptr << ", buffer = " << (void*)buffer);
-    std::free(buffer);
+    if ((unsigned_type)buffer & 1)
+        huge_pages_free(buffer - 1);
+    else
+        std::free(buffer);
 }
 
 STXXL_END_NAMESPACE
@@ -0,0 +1,34 @@
+/***************************************************************************
+ *  include/stxxl/bits/common/crc32c.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_COMMON_CRC32C_HEADER
+#define STXXL_COMMON_CRC32C_HEADER
+
+#include <cstddef>
+
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/namespace.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup support
+//! \{
+
+//! Computes the CRC-32C (Castagnoli) checksum of size bytes at data. A
+//! checksum over several pieces is computed by passing the result of the
+//! previous piece as crc.
+uint32 crc32c(const void* data, size_t size, uint32 crc = 0);
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_COMMON_CRC32C_HEADER
+// vim: et:ts=4:sw=4
@@ -0,0 +1,68 @@
+/***************************************************************************
+ *  include/stxxl/bits/common/huge_pages.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_COMMON_HUGE_PAGES_HEADER
+#define STXXL_COMMON_HUGE_PAGES_HEADER
+
+#include <cstddef>
+
+#include <stxxl/bits/config.h>
+#include <stxxl/bits/namespace.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup support
+//! \{
+
+//! Backing of large aligned allocations like block buffers.
+enum huge_pages_mode
+{
+    HUGE_PAGES_DEFAULT,     //!< the process-wide default, see set_huge_pages()
+    HUGE_PAGES_NONE,        //!< normal pages from malloc()
+    HUGE_PAGES_TRANSPARENT, //!< mmap() advised for transparent huge pages
+    HUGE_PAGES_2MIB,        //!< mmap() of explicit 2 MiB huge pages
+    HUGE_PAGES_1GIB         //!< mmap() of explicit 1 GiB huge pages
+};
+
+//! Sets the process-wide backing of aligned allocations of at least min_size
+//! bytes. Initially taken from the STXXLHUGEPAGES environment variable
+//! ("none", "thp", "2m" or "1g"), otherwise HUGE_PAGES_NONE.
+void set_huge_pages(huge_pages_mode mode, size_t min_size = 2 * 1024 * 1024);
+
+//! Returns the process-wide backing of large aligned allocations.
+huge_pages_mode get_huge_pages();
+
+//! Returns a printable name of mode.
+const char * get_huge_pages_name(huge_pages_mode mode);
+
+//! Returns the number of bytes currently mapped with mode, which may be
+//! fewer than requested if mapping them failed.
+size_t get_huge_pages_mapped(huge_pages_mode mode);
+
+//! Maps an area for aligned_alloc() backed by huge pages as selected by mode.
+//! The data area of size bytes starts at a huge page boundary and is
+//! preceded by meta_info_size bytes, the returned pointer, and a normal page
+//! holding the mapping's length. Pages larger than size are never used: 1 GiB
+//! pages are only taken for allocations of at least 1 GiB, and allocations
+//! below 2 MiB get normal pages. If explicit huge pages are not available,
+//! smaller and then transparent huge pages are tried.
+//! \return NULL if mode is none, size is too small, or mapping failed
+void * huge_pages_alloc(size_t size, size_t meta_info_size, huge_pages_mode mode);
+
+//! Unmaps an area mapped by huge_pages_alloc(), given the beginning of the
+//! normal page in front of it.
+void huge_pages_free(void* base);
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_COMMON_HUGE_PAGES_HEADER
+// vim: et:ts=4:sw=4
@@ -0,0 +1,39 @@
+/***************************************************************************
+ *  include/stxxl/bits/common/lz_codec.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_COMMON_LZ_CODEC_HEADER
+#define STXXL_COMMON_LZ_CODEC_HEADER
+
+#include <cstddef>
+
+#include <stxxl/bits/namespace.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup support
+//! \{
+
+//! Compresses size bytes from src into at most capacity bytes at dst using a
+//! fast byte-oriented LZ77 scheme (greedy hash matching, LZ4-like sequence
+//! format), which trades compression ratio for speed.
+//! \return compressed size, or 0 if the result does not fit into capacity
+size_t lz_compress(const void* src, size_t size, void* dst, size_t capacity);
+
+//! Decompresses the output of lz_compress() from src into exactly size bytes
+//! at dst. All accesses are bounds checked, so corrupt input is detected.
+//! \return false if src is corrupt or does not decompress to size bytes
+bool lz_decompress(const void* src, size_t src_size, void* dst, size_t size);
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_COMMON_LZ_CODEC_HEADER
+// vim: et:ts=4:sw=4
@@ -148,6 +148,14 @@ public:
             m_mutex.unlock();
         }
     }
+    //! lock mutex again after unlock()
+    void lock()
+    {
+        if (!is_locked) {
+            m_mutex.lock();
+            is_locked = true;
+        }
+    }
     //! return platform specific handle
     pthread_mutex_t & native_handle()
     {
@@ -159,6 +167,46 @@ typedef scoped_mutex_lock scoped_fast_mutex_lock;
 
 #endif
 
+//! Aquire a lock that's valid until the end of scope, but only if enabled,
+//! for objects which are optionally shared between threads.
+class scoped_optional_mutex_lock
+{
+    //! mutex pointer, NULL if locking is disabled
+    mutex* m_mutex;
+
+    //! marker if currently locked by this thread
+    bool is_locked;
+
+public:
+    //! lock mutex if enabled
+    scoped_optional_mutex_lock(mutex& m, bool enabled)
+        : m_mutex(enabled ? &m : NULL), is_locked(false)
+    {
+        lock();
+    }
+    //! unlock mutex hold when object goes out of scope.
+    ~scoped_optional_mutex_lock()
+    {
+        unlock();
+    }
+    //! unlock mutex hold prematurely
+    void unlock()
+    {
+        if (is_locked) {
+            is_locked = false;
+            m_mutex->unlock();
+        }
+    }
+    //! lock mutex again after unlock()
+    void lock()
+    {
+        if (m_mutex && !is_locked) {
+            m_mutex->lock();
+            is_locked = true;
+        }
+    }
+};
+
 #if STXXL_STD_THREADS && STXXL_WINDOWS && STXXL_MSVC >= 1700
 
 class spin_lock
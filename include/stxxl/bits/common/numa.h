@@ -0,0 +1,49 @@
+/***************************************************************************
+ *  include/stxxl/bits/common/numa.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_COMMON_NUMA_HEADER
+#define STXXL_COMMON_NUMA_HEADER
+
+#include <cstddef>
+
+#include <stxxl/bits/config.h>
+#include <stxxl/bits/namespace.h>
+
+#if STXXL_HAVE_NUMA
+ #include <pthread.h>
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup support
+//! \{
+
+//! Returns the number of NUMA nodes of the system, 1 if NUMA is not
+//! supported.
+int numa_num_nodes();
+
+//! Prefers NUMA node for the pages lying completely inside [ptr, ptr + size)
+//! and migrates pages which were already touched. Block buffers are page
+//! aligned, so this should be called right after allocating them.
+//! \return false if NUMA is not supported or the call failed
+bool numa_bind_memory(void* ptr, size_t size, int node);
+
+#if STXXL_HAVE_NUMA
+//! Restricts a thread to the CPUs of NUMA node.
+//! \return false if the node has no CPUs or the call failed
+bool numa_pin_thread(pthread_t thread, int node);
+#endif
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_COMMON_NUMA_HEADER
+// vim: et:ts=4:sw=4
@@ -46,6 +46,16 @@ public:
         m_cond.notify_one();
         return res;
     }
+    //! function increments the semaphore by delta and signals all threads
+    //! that are blocked waiting a change in the semaphore
+    int increment(int delta)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        int res = (v += delta);
+        lock.unlock();
+        m_cond.notify_all();
+        return res;
+    }
     //! function decrements the semaphore and blocks if the semaphore is <= 0
     //! until another thread signals a change
     int operator -- (int)
@@ -17,6 +17,7 @@
 #include <stxxl/bits/compat/hash_map.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/mng/block_manager.h>
+#include <stxxl/bits/mng/memory_manager.h>
 #include <stxxl/bits/mng/typed_block.h>
 #include <stxxl/bits/containers/pager.h>
 #include <stxxl/bits/common/error_handling.h>
@@ -91,6 +92,8 @@ private:
     pager_type m_pager;
     block_manager* m_bm;
     alloc_strategy_type m_alloc_strategy;
+    //! accounts the blocks of the nodes
+    memory_consumer m_memory;
 
     int64 n_found;
     int64 n_not_found;
@@ -117,6 +120,7 @@ public:
         : m_btree(btree),
           m_cmp(cmp),
           m_bm(block_manager::get_instance()),
+          m_memory("map"),
           n_found(0),
           n_not_found(0),
           n_created(0),
@@ -136,6 +140,7 @@ public:
         m_free_nodes.reserve(nnodes);
         m_fixed.resize(nnodes, false);
         m_dirty.resize(nnodes, true);
+        m_memory.acquire(nnodes * block_type::raw_size);
         for (unsigned_type i = 0; i < nnodes; ++i)
         {
             m_nodes.push_back(new node_type(m_btree, m_cmp));
@@ -568,6 +573,7 @@ public:
         std::swap(m_free_nodes, obj.m_free_nodes);
         std::swap(m_bid2node, obj.m_bid2node);
         std::swap(m_pager, obj.m_pager);
+        m_memory.swap_bytes(obj.m_memory);
         std::swap(m_alloc_strategy, obj.m_alloc_strategy);
         std::swap(n_found, obj.n_found);
         std::swap(n_not_found, obj.n_found);
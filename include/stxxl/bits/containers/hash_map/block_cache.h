@@ -21,6 +21,8 @@
 #include <stxxl/bits/noncopyable.h>
 #include <stxxl/bits/compat/hash_map.h>
 #include <stxxl/bits/mng/block_manager.h>
+#include <stxxl/bits/mng/memory_manager.h>
+#include <stxxl/bits/mng/shared_block_cache.h>
 #include <stxxl/bits/containers/pager.h>
 
 #include <vector>
@@ -39,6 +41,8 @@ public:
     typedef typename block_type::bid_type bid_type;
 
 protected:
+    //! hands out the buffers
+    memory_consumer memory_;
     std::vector<block_type*> blocks_;
     std::vector<request_ptr> reqs_;
     std::vector<unsigned_type> free_blocks_;
@@ -46,13 +50,14 @@ protected:
 
 public:
     block_cache_write_buffer(unsigned_type size)
+        : memory_("hash_map")
     {
         blocks_.reserve(size);
         free_blocks_.reserve(size);
         reqs_.resize(size);
 
         for (unsigned_type i = 0; i < size; i++) {
-            blocks_.push_back(new block_type());
+            blocks_.push_back(memory_.new_block<block_type>());
             free_blocks_.push_back(i);
         }
     }
@@ -98,6 +103,7 @@ public:
 
     void swap(block_cache_write_buffer& obj)
     {
+        memory_.swap_bytes(obj.memory_);
         std::swap(blocks_, obj.blocks_);
         std::swap(reqs_, obj.reqs_);
         std::swap(free_blocks_, obj.free_blocks_);
@@ -108,12 +114,13 @@ public:
     {
         flush();
         for (unsigned_type i = 0; i < blocks_.size(); i++)
-            delete blocks_[i];
+            memory_.delete_block(blocks_[i]);
     }
 };
 
 //! Cache of blocks contained in an external memory hash map. Uses the
-//! stxxl::lru_pager as eviction algorithm.
+//! stxxl::lru_pager as eviction algorithm, or the blocks of a
+//! shared_block_cache, see use_shared_cache().
 template <class BlockType>
 class block_cache : private noncopyable
 {
@@ -122,6 +129,7 @@ public:
     typedef typename block_type::bid_type bid_type;
     typedef typename block_type::value_type subblock_type;
     typedef typename subblock_type::bid_type subblock_bid_type;
+    typedef shared_block_cache<block_type::raw_size> shared_cache_type;
 
 protected:
     struct bid_eq
@@ -162,6 +170,9 @@ protected:
 
     write_buffer_type write_buffer_;
 
+    //! hands out the cached blocks
+    memory_consumer memory_;
+
     //! cached blocks
     std::vector<block_type*> blocks_;
     //! bids of cached blocks
@@ -181,6 +192,13 @@ protected:
     bid_map_type bid_map_;
     pager_type pager_;
 
+    //! cache used instead of blocks_, or NULL
+    shared_cache_type* shared_cache_;
+    typename shared_cache_type::owner_type owner_;
+    //! true if the block of the last get_subblock() is pinned in shared_cache_
+    bool pinned_;
+    bid_type pinned_bid_;
+
     /* statistics */
     int64 n_found;
     int64 n_not_found;
@@ -194,6 +212,7 @@ public:
     //! \param cache_size cache-size in number of blocks
     block_cache(unsigned_type cache_size)
         : write_buffer_(config::get_instance()->disks_number() * 2),
+          memory_("hash_map"),
           blocks_(cache_size),
           bids_(cache_size),
           retain_count_(cache_size),
@@ -202,6 +221,9 @@ public:
           free_blocks_(cache_size),
           reqs_(cache_size),
           pager_(cache_size),
+          shared_cache_(NULL),
+          owner_(0),
+          pinned_(false),
           n_found(0),
           n_not_found(0),
           n_read(0),
@@ -211,7 +233,7 @@ public:
     {
         for (unsigned_type i = 0; i < cache_size; i++)
         {
-            blocks_[i] = new block_type();
+            blocks_[i] = memory_.new_block<block_type>();
             free_blocks_[i] = i;
         }
     }
@@ -226,6 +248,12 @@ public:
     {
         STXXL_VERBOSE1("hash_map::block_cache destructor addr=" << this);
 
+        if (shared_cache_) {
+            unpin_subblock();
+            shared_cache_->flush(owner_);
+            shared_cache_->discard_owner(owner_);
+        }
+
         for (typename bid_map_type::const_iterator i = bid_map_.begin();
              i != bid_map_.end(); ++i)
         {
@@ -241,8 +269,10 @@ public:
         }
         write_buffer_.flush();
 
-        for (unsigned_type i = 0; i < size(); ++i)
-            delete blocks_[i];
+        for (unsigned_type i = 0; i < size(); ++i) {
+            if (blocks_[i])
+                memory_.delete_block(blocks_[i]);
+        }
     }
 
 protected:
@@ -295,6 +325,9 @@ public:
     //! \return true if block was cached, false otherwise
     bool retain_block(const bid_type& bid)
     {
+        if (shared_cache_)
+            return shared_cache_->template pin_cached<block_type>(bid) != NULL;
+
         typename bid_map_type::const_iterator it = bid_map_.find(bid);
         if (it == bid_map_.end())
             return false;
@@ -312,6 +345,9 @@ public:
     //!         retain-count > 0), false otherwise
     bool release_block(const bid_type& bid)
     {
+        if (shared_cache_)
+            return shared_cache_->unpin(bid);
+
         typename bid_map_type::const_iterator it = bid_map_.find(bid);
         if (it == bid_map_.end())
             return false;
@@ -330,6 +366,9 @@ public:
     //! \return true if block cached, false otherwise
     bool make_dirty(const bid_type& bid)
     {
+        if (shared_cache_)
+            return shared_cache_->make_dirty(bid);
+
         typename bid_map_type::const_iterator it = bid_map_.find(bid);
         if (it == bid_map_.end())
             return false;
@@ -364,6 +403,21 @@ public:
         unsigned_type i_block;
         n_read++;
 
+        // the shared cache always loads complete blocks
+        if (shared_cache_)
+        {
+            if (shared_cache_->is_cached(bid))
+                ++n_found;
+            else
+                ++n_not_found;
+
+            block = shared_cache_->template pin<block_type>(bid, owner_);
+            unpin_subblock();
+            pinned_ = true;
+            pinned_bid_ = bid;
+            return &((*block)[i_subblock]);
+        }
+
         // block (partly) cached?
         typename bid_map_type::const_iterator it = bid_map_.find(bid);
         if (it != bid_map_.end())
@@ -432,6 +486,11 @@ public:
     //! \param bid Identifier of the block to load
     void prefetch_block(const bid_type& bid)
     {
+        if (shared_cache_) {
+            shared_cache_->prefetch(bid, owner_);
+            return;
+        }
+
         unsigned_type i_block;
 
         // cached
@@ -471,6 +530,11 @@ public:
     //! Write all dirty blocks back to disk
     void flush()
     {
+        if (shared_cache_) {
+            shared_cache_->flush(owner_);
+            return;
+        }
+
         for (typename bid_map_type::const_iterator i = bid_map_.begin();
              i != bid_map_.end(); ++i)
         {
@@ -489,6 +553,12 @@ public:
     //! Empty cache; don't write back dirty blocks
     void clear()
     {
+        if (shared_cache_) {
+            pinned_ = false;
+            shared_cache_->discard_owner(owner_);
+            return;
+        }
+
         free_blocks_.clear();
         for (unsigned_type i = 0; i < size(); i++)
         {
@@ -512,6 +582,8 @@ public:
         o << "Blocks written                    : " << n_written << std::endl;
         o << "Clean blocks forced from the cache: " << n_clean_forced << std::endl;
         o << "Wrong subblock cached             : " << n_wrong_subblock << std::endl;
+        if (shared_cache_)
+            shared_cache_->print_statistics(o);
     }
 
     //! Reset all counters to zero
@@ -530,6 +602,7 @@ public:
     void swap(block_cache& obj)
     {
         write_buffer_.swap(obj.write_buffer_);
+        memory_.swap_bytes(obj.memory_);
         std::swap(blocks_, obj.blocks_);
         std::swap(bids_, obj.bids_);
         std::swap(retain_count_, obj.retain_count_);
@@ -543,6 +616,11 @@ public:
         std::swap(bid_map_, obj.bid_map_);
         std::swap(pager_, obj.pager_);
 
+        std::swap(shared_cache_, obj.shared_cache_);
+        std::swap(owner_, obj.owner_);
+        std::swap(pinned_, obj.pinned_);
+        std::swap(pinned_bid_, obj.pinned_bid_);
+
         std::swap(n_found, obj.n_found);
         std::swap(n_not_found, obj.n_found);
         std::swap(n_read, obj.n_read);
@@ -551,6 +629,41 @@ public:
         std::swap(n_wrong_subblock, obj.n_wrong_subblock);
     }
 
+    //! Use the blocks of a shared_block_cache instead of the own ones, which
+    //! are freed, or the own ones again if cache is NULL. Dirty blocks are
+    //! written back first, no block may be retained. Blocks are always read
+    //! completely from a shared cache.
+    void use_shared_cache(shared_cache_type* cache)
+    {
+        flush();
+        clear();
+
+        if (cache && !shared_cache_) {
+            for (unsigned_type i = 0; i < size(); ++i) {
+                memory_.delete_block(blocks_[i]);
+                blocks_[i] = NULL;
+            }
+        }
+        else if (!cache && shared_cache_) {
+            for (unsigned_type i = 0; i < size(); ++i)
+                blocks_[i] = memory_.new_block<block_type>();
+        }
+
+        shared_cache_ = cache;
+        owner_ = cache ? cache->new_owner() : 0;
+    }
+
+protected:
+    //! unpins the block of the last get_subblock() from the shared cache
+    void unpin_subblock()
+    {
+        if (pinned_) {
+            shared_cache_->unpin(pinned_bid_);
+            pinned_ = false;
+        }
+    }
+
+public:
 #if 0   // for debugging, requires data items to be ostream-able.
 
     //! Show currently cached blocks
@@ -132,6 +132,9 @@ public:
     typedef iterator_map<self_type> iterator_map_type;
 
     typedef block_cache<block_type> block_cache_type;
+    //! cache which several containers with blocks of block_raw_size bytes
+    //! may share, see use_shared_cache()
+    typedef typename block_cache_type::shared_cache_type shared_cache_type;
 
     typedef buffered_reader<block_cache_type, bid_iterator_type> reader_type;
 
@@ -589,6 +592,14 @@ public:
         std::swap(block_cache_, obj.block_cache_);
     }
 
+    //! Keep the blocks of the hash-map in a shared_block_cache instead of a
+    //! cache of its own, or in its own again if cache is NULL. May not be
+    //! called while iterators exist.
+    void use_shared_cache(shared_cache_type* cache)
+    {
+        block_cache_.use_shared_cache(cache);
+    }
+
 protected:
     // find statistics
     mutable external_size_type n_subblocks_loaded;
@@ -24,6 +24,7 @@
 #include <stxxl/bits/containers/pq_mergers.h>
 #include <stxxl/bits/containers/pq_int_merger.h>
 #include <stxxl/bits/containers/pq_ext_merger.h>
+#include <stxxl/bits/mng/memory_manager.h>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -162,9 +163,15 @@ protected:
     // total size not counting insert_heap and delete_buffer
     size_type size_;
 
+    //! accounts mem_cons() and an owned pool
+    memory_consumer m_memory;
+
 private:
     void init();
 
+    //! updates the accounted memory after segments were allocated or freed
+    void account_memory();
+
     void refill_delete_buffer();
     size_type refill_group_buffer(unsigned_type k);
 
@@ -353,8 +360,10 @@ inline void priority_queue<ConfigType>::pop()
     {
         assert(delete_buffer_current_min < delete_buffer_end);
         ++delete_buffer_current_min;
-        if (delete_buffer_current_min == delete_buffer_end)
+        if (delete_buffer_current_min == delete_buffer_end) {
             refill_delete_buffer();
+            account_memory();
+        }
     }
 }
 
@@ -363,8 +372,10 @@ inline void priority_queue<ConfigType>::push(const value_type& obj)
 {
     //STXXL_VERBOSE3("priority_queue::push("<< obj <<")");
     assert(!int_mergers->is_sentinel(obj));
-    if (insert_heap.size() == N + 1)
+    if (insert_heap.size() == N + 1) {
         empty_insert_heap();
+        account_memory();
+    }
 
     assert(!insert_heap.empty());
 
@@ -379,7 +390,8 @@ priority_queue<ConfigType>::priority_queue(pool_type& pool_)
       pool_owned(false),
       delete_buffer_end(delete_buffer + delete_buffer_size),
       insert_heap(N + 2),
-      num_active_groups(0), size_(0)
+      num_active_groups(0), size_(0),
+      m_memory("priority_queue")
 {
     STXXL_VERBOSE_PQ("priority_queue(pool)");
     init();
@@ -392,7 +404,8 @@ priority_queue<ConfigType>::priority_queue(prefetch_pool<block_type>& p_pool_, w
       pool_owned(true),
       delete_buffer_end(delete_buffer + delete_buffer_size),
       insert_heap(N + 2),
-      num_active_groups(0), size_(0)
+      num_active_groups(0), size_(0),
+      m_memory("priority_queue")
 {
     STXXL_VERBOSE_PQ("priority_queue(p_pool, w_pool)");
     init();
@@ -404,7 +417,8 @@ priority_queue<ConfigType>::priority_queue(unsigned_type p_pool_mem, unsigned_ty
       pool_owned(true),
       delete_buffer_end(delete_buffer + delete_buffer_size),
       insert_heap(N + 2),
-      num_active_groups(0), size_(0)
+      num_active_groups(0), size_(0),
+      m_memory("priority_queue")
 {
     STXXL_VERBOSE_PQ("priority_queue(pool sizes)");
     init();
@@ -430,6 +444,21 @@ void priority_queue<ConfigType>::init()
         group_buffers[i][N] = sentinel;                        // sentinel
         group_buffer_current_mins[i] = &(group_buffers[i][N]); // empty
     }
+
+    account_memory();
+}
+
+template <class ConfigType>
+void priority_queue<ConfigType>::account_memory()
+{
+    uint64 bytes = mem_cons();
+    if (pool_owned)
+        bytes += uint64(pool->size_prefetch() + pool->size_write()) * block_type::raw_size;
+
+    if (bytes > m_memory.get_bytes())
+        m_memory.acquire(bytes - m_memory.get_bytes());
+    else
+        m_memory.release(m_memory.get_bytes() - bytes);
 }
 
 template <class ConfigType>
@@ -102,6 +102,9 @@ public:
     //! constructed equality predicate for key
     typedef typename impl_type::key_equal key_equal;
 
+    //! block cache which may be shared with other containers
+    typedef typename impl_type::shared_cache_type shared_cache_type;
+
     //! \}
 
     //! \name Constructors
@@ -444,6 +447,19 @@ public:
 
     //! \}
 
+    //! \name Block Cache
+    //! \{
+
+    //! Keep the external blocks in a shared_block_cache, which may be used by
+    //! other containers too, instead of a cache of their own. NULL restores
+    //! the own cache. May not be called while iterators exist.
+    void use_shared_cache(shared_cache_type* cache)
+    {
+        impl.use_shared_cache(cache);
+    }
+
+    //! \}
+
     //! \name Statistics
     //! \{
 
@@ -23,9 +23,12 @@
 #include <stxxl/bits/deprecated.h>
 #include <stxxl/bits/io/request_operations.h>
 #include <stxxl/bits/mng/block_manager.h>
+#include <stxxl/bits/mng/memory_manager.h>
+#include <stxxl/bits/mng/shared_block_cache.h>
 #include <stxxl/bits/mng/typed_block.h>
 #include <stxxl/bits/common/tmeta.h>
 #include <stxxl/bits/containers/pager.h>
+#include <stxxl/bits/containers/vector_superblock.h>
 #include <stxxl/bits/common/is_sorted.h>
 #include <stxxl/bits/mng/buf_istream.h>
 #include <stxxl/bits/mng/buf_istream_reverse.h>
@@ -814,7 +817,8 @@ public:
 //! \tparam AllocStr one of allocation strategies: \c striping , \c RC , \c SR , or \c FR
 //!  default is RC
 //!
-//! Memory consumption: BlockSize*x*PageSize bytes
+//! Memory consumption: BlockSize*x*PageSize bytes, unless the pages are kept
+//! in a shared_block_cache, see use_shared_cache()
 //! \warning Do not store references to the elements of an external vector. Such references
 //! might be invalidated during any following access to elements of the vector
 template <
@@ -900,6 +904,8 @@ public:
     typedef typed_block<BlockSize, ValueType> block_type;
     //! double-index type to reference individual elements in a block
     typedef double_blocked_index<SizeType, PageSize, block_type::size> blocked_index_type;
+    //! cache the vector may keep its pages in, see use_shared_cache()
+    typedef shared_block_cache<block_type::raw_size> shared_cache_type;
 
     //! \}
 
@@ -907,6 +913,8 @@ private:
     alloc_strategy_type m_alloc_strategy;
     size_type m_size;
     bids_container_type m_bids;
+    //! contiguous extents reserved for the blocks appended when growing
+    extent_reservation m_extents;
     mutable pager_type m_pager;
 
     // enum specifying status of a page of the vector
@@ -916,10 +924,60 @@ private:
     mutable std::vector<int_type> m_page_to_slot;
     mutable simple_vector<int_type> m_slot_to_page;
     mutable std::queue<int_type> m_free_slots;
-    mutable simple_vector<block_type>* m_cache;
+    //! blocks of the cache slots, page_size per slot, NULL while a slot has
+    //! no buffers
+    mutable simple_vector<block_type*> m_cache;
+    //! slot of the page accessed last, -1 for none
+    mutable int_type m_last_slot;
+    //! shared cache the pages are pinned in instead of m_cache's own blocks,
+    //! or NULL
+    shared_cache_type* m_shared_cache;
+    typename shared_cache_type::owner_type m_shared_owner;
     file* m_from;
     block_manager* m_bm;
     bool m_exported;
+    //! opened with open(), owns m_from and keeps a superblock in it
+    bool m_persistent;
+    //! offset of the first block in m_from, behind the superblocks
+    stxxl::uint64 m_file_offset;
+    //! last superblock written to m_from
+    vector_superblock m_superblock;
+
+    //! hands out the blocks of the page cache. If the memory_manager asks
+    //! for memory, pages are released at the next page fault, as elements
+    //! of all pages may be referenced until then.
+    class cache_memory_consumer : public memory_consumer
+    {
+        mutex m_mutex;
+        //! bytes the memory_manager asked for
+        stxxl::uint64 m_requested;
+
+    public:
+        cache_memory_consumer()
+            : memory_consumer("vector"), m_requested(0)
+        { }
+
+        ~cache_memory_consumer()
+        {
+            unregister();
+        }
+
+        void shrink(stxxl::uint64 bytes)
+        {
+            scoped_mutex_lock lock(m_mutex);
+            m_requested = std::max(m_requested, bytes);
+        }
+
+        //! returns and resets the bytes asked for
+        stxxl::uint64 take_requested()
+        {
+            scoped_mutex_lock lock(m_mutex);
+            stxxl::uint64 bytes = m_requested;
+            m_requested = 0;
+            return bytes;
+        }
+    };
+    mutable cache_memory_consumer m_cache_memory;
 
     size_type size_from_file_length(stxxl::uint64 file_length) const
     {
@@ -957,12 +1015,20 @@ public:
           m_page_status(div_ceil(m_bids.size(), page_size)),
           m_page_to_slot(div_ceil(m_bids.size(), page_size)),
           m_slot_to_page(npages),
-          m_cache(NULL),
+          m_cache(npages * page_size),
+          m_last_slot(-1),
+          m_shared_cache(NULL),
+          m_shared_owner(0),
           m_from(NULL),
-          m_exported(false)
+          m_exported(false),
+          m_persistent(false),
+          m_file_offset(0),
+          m_superblock(),
+          m_cache_memory()
     {
         m_bm = block_manager::get_instance();
 
+        std::fill(m_cache.begin(), m_cache.end(), (block_type*)NULL);
         allocate_page_cache();
 
         for (size_t i = 0; i < m_page_status.size(); ++i)
@@ -974,7 +1040,8 @@ public:
         for (unsigned_type i = 0; i < numpages(); ++i)
             m_free_slots.push(i);
 
-        m_bm->new_blocks(m_alloc_strategy, m_bids.begin(), m_bids.end(), 0);
+        m_bm->new_blocks(m_alloc_strategy, m_bids.begin(), m_bids.end(), 0,
+                         m_extents);
     }
 
     //! \}
@@ -988,14 +1055,22 @@ public:
         std::swap(m_alloc_strategy, obj.m_alloc_strategy);
         std::swap(m_size, obj.m_size);
         std::swap(m_bids, obj.m_bids);
+        m_extents.swap(obj.m_extents);
         std::swap(m_pager, obj.m_pager);
         std::swap(m_page_status, obj.m_page_status);
         std::swap(m_page_to_slot, obj.m_page_to_slot);
         std::swap(m_slot_to_page, obj.m_slot_to_page);
         std::swap(m_free_slots, obj.m_free_slots);
         std::swap(m_cache, obj.m_cache);
+        std::swap(m_last_slot, obj.m_last_slot);
+        std::swap(m_shared_cache, obj.m_shared_cache);
+        std::swap(m_shared_owner, obj.m_shared_owner);
         std::swap(m_from, obj.m_from);
         std::swap(m_exported, obj.m_exported);
+        std::swap(m_persistent, obj.m_persistent);
+        std::swap(m_file_offset, obj.m_file_offset);
+        std::swap(m_superblock, obj.m_superblock);
+        m_cache_memory.swap_bytes(obj.m_cache_memory);
     }
 
     //! \}
@@ -1003,21 +1078,33 @@ public:
     //! \name Miscellaneous
     //! \{
 
-    //! Allocate page cache, must be called to allow access to elements.
+    //! Allocates the buffers of all cache pages, which are otherwise
+    //! allocated when a page is loaded into them.
     void allocate_page_cache() const
     {
-        //  numpages() might be zero
-        if (!m_cache && numpages() > 0)
-            m_cache = new simple_vector<block_type>(numpages() * page_size);
+        for (unsigned_type i = 0; i < numpages(); ++i)
+            allocate_slot(i);
     }
 
-    //! allows to free the cache, but you may not access any element until call
-    //! allocate_page_cache() again
+    //! Frees the cache after writing dirty pages, it is allocated again when
+    //! an element not in the cache is accessed.
     void deallocate_page_cache() const
     {
         flush();
-        delete m_cache;
-        m_cache = NULL;
+        for (unsigned_type i = 0; i < numpages(); ++i)
+            free_slot(i);
+        m_last_slot = -1;
+    }
+
+    //! Keep the pages in a shared_block_cache instead of the own cache, whose
+    //! buffers are freed, or in the own cache again if cache is NULL. The
+    //! blocks of the cached pages are pinned in the shared cache, which must
+    //! hold more than numpages() pages. All pages are flushed first.
+    void use_shared_cache(shared_cache_type* cache)
+    {
+        deallocate_page_cache();
+        m_shared_cache = cache;
+        m_shared_owner = cache ? cache->new_owner() : 0;
     }
 
     //! \name Size and Capacity
@@ -1070,11 +1157,12 @@ public:
         {
             m_bm->new_blocks(m_alloc_strategy,
                              m_bids.begin() + old_bids_size, m_bids.end(),
-                             old_bids_size);
+                             old_bids_size, m_extents);
         }
         else
         {
-            size_type offset = size_type(old_bids_size) * size_type(block_type::raw_size);
+            size_type offset = size_type(old_bids_size) * size_type(block_type::raw_size)
+                               + m_file_offset;
             for (bids_container_iterator it = m_bids.begin() + old_bids_size;
                  it != m_bids.end(); ++it, offset += size_type(block_type::raw_size))
             {
@@ -1117,6 +1205,7 @@ private:
             unsigned_type first_page_to_evict = (unsigned_type)div_ceil(n, block_type::size * page_size);
             for (size_t i = first_page_to_evict; i < m_page_status.size(); ++i) {
                 if (m_page_to_slot[i] != on_disk) {
+                    unpin_page(i, m_page_to_slot[i], false);
                     m_free_slots.push(m_page_to_slot[i]);
                     m_page_to_slot[i] = on_disk;
                 }
@@ -1145,11 +1234,20 @@ private:
                                  m_page_status.size() << " to " <<
                                  new_pages_size << " pages");
 
-            // release blocks
-            if (m_from != NULL)
-                m_from->set_size(new_bids_size * block_type::raw_size);
-            else
-                m_bm->delete_blocks(m_bids.begin() + old_bids_size, m_bids.end());
+            // a shared cache must not keep the released blocks
+            if (m_shared_cache)
+                flush();
+
+            // release blocks, a persistent vector truncates its file in
+            // sync() after committing the new size
+            if (m_from != NULL) {
+                if (!m_persistent)
+                    m_from->set_size(new_bids_size * block_type::raw_size);
+            }
+            else {
+                m_bm->delete_blocks(m_bids.begin() + new_bids_size, m_bids.end());
+                m_extents.release();
+            }
 
             m_bids.resize(new_bids_size);
 
@@ -1174,8 +1272,12 @@ public:
     void clear()
     {
         m_size = 0;
-        if (m_from == NULL)
+        if (m_shared_cache)
+            discard_shared_pages();
+        if (m_from == NULL) {
             m_bm->delete_blocks(m_bids.begin(), m_bids.end());
+            m_extents.release();
+        }
 
         m_bids.clear();
         m_page_status.clear();
@@ -1248,9 +1350,16 @@ public:
           m_page_status(div_ceil(m_bids.size(), page_size)),
           m_page_to_slot(div_ceil(m_bids.size(), page_size)),
           m_slot_to_page(npages),
-          m_cache(NULL),
+          m_cache(npages * page_size),
+          m_last_slot(-1),
+          m_shared_cache(NULL),
+          m_shared_owner(0),
           m_from(from),
-          m_exported(false)
+          m_exported(false),
+          m_persistent(false),
+          m_file_offset(0),
+          m_superblock(),
+          m_cache_memory()
     {
         // initialize from file
         if (!block_type::has_only_data)
@@ -1263,6 +1372,7 @@ public:
 
         m_bm = block_manager::get_instance();
 
+        std::fill(m_cache.begin(), m_cache.end(), (block_type*)NULL);
         allocate_page_cache();
 
         for (size_t i = 0; i < m_page_status.size(); ++i)
@@ -1293,13 +1403,21 @@ public:
           m_page_status(div_ceil(m_bids.size(), page_size)),
           m_page_to_slot(div_ceil(m_bids.size(), page_size)),
           m_slot_to_page(obj.numpages()),
-          m_cache(NULL),
+          m_cache(obj.numpages() * page_size),
+          m_last_slot(-1),
+          m_shared_cache(NULL),
+          m_shared_owner(0),
           m_from(NULL),
-          m_exported(false)
+          m_exported(false),
+          m_persistent(false),
+          m_file_offset(0),
+          m_superblock(),
+          m_cache_memory()
     {
         assert(!obj.m_exported);
         m_bm = block_manager::get_instance();
 
+        std::fill(m_cache.begin(), m_cache.end(), (block_type*)NULL);
         allocate_page_cache();
 
         for (size_t i = 0; i < m_page_status.size(); ++i)
@@ -1311,7 +1429,8 @@ public:
         for (unsigned_type i = 0; i < numpages(); ++i)
             m_free_slots.push(i);
 
-        m_bm->new_blocks(m_alloc_strategy, m_bids.begin(), m_bids.end(), 0);
+        m_bm->new_blocks(m_alloc_strategy, m_bids.begin(), m_bids.end(), 0,
+                         m_extents);
 
         const_iterator inbegin = obj.begin();
         const_iterator inend = obj.end();
@@ -1441,7 +1560,9 @@ public:
     //! \name Modifiers
     //! \{
 
-    //! Flushes the cache pages to the external memory.
+    //! Flushes the cache pages to the external memory. The vector's blocks in
+    //! a shared cache are written and dropped as well, since algorithms
+    //! access the blocks on disk afterwards.
     void flush() const
     {
         simple_vector<bool> non_free_slots(numpages());
@@ -1468,6 +1589,12 @@ public:
                 m_page_to_slot[page_no] = on_disk;
             }
         }
+
+        if (m_shared_cache)
+        {
+            m_shared_cache->flush(m_shared_owner);
+            m_shared_cache->discard_owner(m_shared_owner);
+        }
     }
 
     //! \}
@@ -1490,8 +1617,23 @@ public:
         {
             STXXL_ERRMSG("Exception thrown in ~vector()");
         }
+        if (m_shared_cache)
+            discard_shared_pages();
 
-        if (!m_exported)
+        if (m_persistent)
+        {
+            // commit the size and close the file
+            try
+            {
+                sync();
+            }
+            catch (std::exception& e)
+            {
+                STXXL_ERRMSG("Exception thrown in ~vector()...sync(): " << e.what());
+            }
+            delete m_from;
+        }
+        else if (!m_exported)
         {
             if (m_from == NULL) {
                 m_bm->delete_blocks(m_bids.begin(), m_bids.end());
@@ -1511,7 +1653,8 @@ public:
                 }
             }
         }
-        delete m_cache;
+        for (unsigned_type i = 0; i < numpages(); ++i)
+            free_slot(i);
     }
 
     //! \}
@@ -1543,6 +1686,104 @@ public:
         return m_from;
     }
 
+    //! Attaches the empty vector to a persistent file, see sync().
+    //!
+    //! If the file is empty, it becomes a new persistent vector. Otherwise
+    //! the size is restored from the file's superblock as of the last sync()
+    //! without reading the elements, whose blocks follow the superblock in
+    //! order. The vector owns the file, syncs and closes it on destruction.
+    //! \param path file name
+    //! \param io_impl file implementation, see create_file()
+    //! \throws io_error if the file has no valid superblock or was written
+    //! for another element type or block size
+    void open(const std::string& path, const std::string& io_impl = "syscall")
+    {
+        if (!block_type::has_only_data)
+            STXXL_THROW_INVALID_ARGUMENT(
+                "The block size for a persistent vector must be a multiple "
+                "of the element size (" << sizeof(value_type) <<
+                ") and the page size (4096).");
+        if (m_from != NULL || !m_bids.empty())
+            STXXL_THROW_INVALID_ARGUMENT(
+                "Only an empty vector without a file can be opened.");
+
+        file* from = create_file(io_impl, path,
+                                 file::RDWR | file::CREAT | file::DIRECT);
+        vector_superblock superblock;
+        try
+        {
+            from->lock();
+            if (superblock.read(from))
+            {
+                if (!superblock.template matches<value_type>(block_type::raw_size))
+                    STXXL_THROW(io_error, "The persistent vector in " << path <<
+                                " was written with another element type or "
+                                "block size.");
+            }
+            else if (from->size() == 0)
+            {
+                superblock.template init<value_type>(block_type::raw_size);
+                from->set_size(vector_superblock::area_size);
+                superblock.write(from);
+                from->sync();
+            }
+            else
+            {
+                STXXL_THROW(io_error, "The file " << path << " has no valid "
+                            "superblock of a persistent vector.");
+            }
+        }
+        catch (...)
+        {
+            delete from;
+            throw;
+        }
+
+        m_from = from;
+        m_persistent = true;
+        m_file_offset = vector_superblock::area_size;
+        m_superblock = superblock;
+
+        m_size = (size_type)superblock.size;
+        m_bids.resize((size_t)div_ceil(m_size, size_type(block_type::size)));
+        m_page_status.assign(div_ceil(m_bids.size(), page_size), valid_on_disk);
+        m_page_to_slot.assign(div_ceil(m_bids.size(), page_size), on_disk);
+
+        size_type offset = m_file_offset;
+        for (bids_container_iterator it = m_bids.begin();
+             it != m_bids.end(); ++it, offset += size_type(block_type::raw_size))
+        {
+            (*it).storage = m_from;
+            (*it).offset = offset;
+        }
+        if (m_from->size() < (file::offset_type)offset)
+            m_from->set_size(offset);
+    }
+
+    //! Writes the modified pages to the file and waits until the device has
+    //! them. For a vector opened with open(), the current size is then
+    //! committed in a new superblock: open() after a crash restores the
+    //! vector as of the last sync(), later writes to its elements may or may
+    //! not be visible.
+    void sync()
+    {
+        flush();
+        if (m_from == NULL)
+            return;
+        m_from->sync();
+        if (!m_persistent)
+            return;
+
+        m_superblock.size = m_size;
+        m_superblock.write(m_from);
+        m_from->sync();
+
+        // blocks released by shrinking are cut off once the new size is
+        // committed
+        m_from->set_size(m_file_offset +
+                         stxxl::uint64(m_bids.size()) * block_type::raw_size);
+    }
+
     //! \}
 
     //! \name Capacity
@@ -1596,9 +1837,121 @@ private:
                 (offset.get_block2() * PageSize + offset.get_block1()));
     }
 
+    //! allocates the blocks of a cache slot if it has none
+    void allocate_slot(int_type cache_slot) const
+    {
+        block_type** blocks = m_cache.begin() + cache_slot * page_size;
+        if (m_shared_cache || blocks[0])
+            return;
+        unsigned_type j = 0;
+        try {
+            for ( ; j < page_size; ++j)
+                blocks[j] = m_cache_memory.template new_block<block_type>();
+        }
+        catch (...) {
+            while (j > 0) {
+                --j;
+                m_cache_memory.delete_block(blocks[j]);
+                blocks[j] = NULL;
+            }
+            throw;
+        }
+    }
+
+    //! frees the blocks of a cache slot, which must not hold a page
+    void free_slot(int_type cache_slot) const
+    {
+        if (m_shared_cache)
+            return;
+        block_type** blocks = m_cache.begin() + cache_slot * page_size;
+        for (unsigned_type j = 0; j < page_size && blocks[j]; ++j)
+        {
+            m_cache_memory.delete_block(blocks[j]);
+            blocks[j] = NULL;
+        }
+    }
+
+    //! Releases the memory the memory_manager asked for, on a page fault.
+    //! Pages are written back and their slots freed, as the pager would
+    //! evict them, but the page accessed last is kept: its elements may
+    //! still be referenced, e.g. in a[i] = a[j].
+    void release_requested_memory() const
+    {
+        stxxl::uint64 requested = m_cache_memory.take_requested();
+        if (m_shared_cache)
+            return;
+        for (unsigned_type i = 0; i < numpages() && requested > 0; ++i)
+        {
+            if ((int_type)i == m_last_slot || !m_cache[i * page_size])
+                continue;
+
+            int_type page_no = m_slot_to_page[i];
+            if (page_no >= 0 && page_no < (int_type)m_page_to_slot.size() &&
+                m_page_to_slot[page_no] == (int_type)i)
+            {
+                write_page(page_no, i);
+                m_page_to_slot[page_no] = on_disk;
+                m_free_slots.push(i);
+            }
+            free_slot(i);
+            requested -= std::min<stxxl::uint64>(
+                requested, stxxl::uint64(page_size) * block_type::raw_size);
+        }
+    }
+
+    //! pins the blocks of a page in the shared cache, which reads them
+    //! unless the page is uninitialized
+    void pin_page(int_type page_no, int_type cache_slot) const
+    {
+        block_type** blocks = m_cache.begin() + cache_slot * page_size;
+        const bool read = (m_page_status[page_no] != uninitialized);
+        int_type block_no = page_no * page_size;
+        int_type last_block = STXXL_MIN(block_no + page_size, int_type(m_bids.size()));
+        int_type j = 0;
+        try {
+            for ( ; block_no + j < last_block; ++j)
+                blocks[j] = m_shared_cache->template pin<block_type>(
+                    m_bids[block_no + j], m_shared_owner, read);
+        }
+        catch (...) {
+            while (j > 0) {
+                --j;
+                m_shared_cache->unpin(m_bids[block_no + j]);
+                blocks[j] = NULL;
+            }
+            m_page_to_slot[page_no] = on_disk;
+            m_free_slots.push(cache_slot);
+            throw;
+        }
+    }
+
+    //! unpins the blocks of a page from the shared cache, if any
+    void unpin_page(int_type page_no, int_type cache_slot, bool modified) const
+    {
+        if (!m_shared_cache)
+            return;
+        block_type** blocks = m_cache.begin() + cache_slot * page_size;
+        int_type block_no = page_no * page_size;
+        for (unsigned_type j = 0; j < page_size && blocks[j]; ++j, ++block_no)
+        {
+            m_shared_cache->unpin(m_bids[block_no], modified);
+            blocks[j] = NULL;
+        }
+    }
+
+    //! drops the vector's blocks from the shared cache without writing them
+    void discard_shared_pages() const
+    {
+        m_shared_cache->discard_owner(m_shared_owner);
+        std::fill(m_cache.begin(), m_cache.end(), (block_type*)NULL);
+        m_last_slot = -1;
+    }
+
     void read_page(int_type page_no, int_type cache_slot) const
     {
         assert(page_no < (int_type)m_page_status.size());
+        if (m_shared_cache)
+            return pin_page(page_no, cache_slot);
         if (m_page_status[page_no] == uninitialized)
             return;
         STXXL_VERBOSE_VECTOR("read_page(): page_no=" << page_no << " cache_slot=" << cache_slot);
@@ -1608,7 +1961,7 @@ private:
         int_type i = cache_slot * page_size, j = 0;
         for ( ; block_no < last_block; ++block_no, ++i, ++j)
         {
-            reqs[j] = (*m_cache)[i].read(m_bids[block_no]);
+            reqs[j] = m_cache[i]->read(m_bids[block_no]);
         }
         assert(last_block - page_no * page_size > 0);
         wait_all(reqs, last_block - page_no * page_size);
@@ -1617,6 +1970,13 @@ private:
     void write_page(int_type page_no, int_type cache_slot) const
     {
         assert(page_no < (int_type)m_page_status.size());
+        if (m_shared_cache)
+        {
+            // the shared cache writes the page back when replacing it
+            unpin_page(page_no, cache_slot, (m_page_status[page_no] & dirty) != 0);
+            m_page_status[page_no] = valid_on_disk;
+            return;
+        }
         if (!(m_page_status[page_no] & dirty))
             return;
         STXXL_VERBOSE_VECTOR("write_page(): page_no=" << page_no << " cache_slot=" << cache_slot);
@@ -1627,7 +1987,7 @@ private:
         int_type i = cache_slot * page_size, j = 0;
         for ( ; block_no < last_block; ++block_no, ++i, ++j)
         {
-            reqs[j] = (*m_cache)[i].write(m_bids[block_no]);
+            reqs[j] = m_cache[i]->write(m_bids[block_no]);
         }
         m_page_status[page_no] = valid_on_disk;
         assert(last_block - page_no * page_size > 0);
@@ -1653,10 +2013,12 @@ private:
         int_type cache_slot = m_page_to_slot[page_no];
         if (cache_slot < 0)                        // == on_disk
         {
+            release_requested_memory();
             if (m_free_slots.empty())              // has to kick
             {
                 int_type kicked_slot = m_pager.kick();
                 m_pager.hit(kicked_slot);
+                m_last_slot = kicked_slot;
                 int_type old_page_no = m_slot_to_page[kicked_slot];
                 m_page_to_slot[page_no] = kicked_slot;
                 m_page_to_slot[old_page_no] = on_disk;
@@ -1667,13 +2029,15 @@ private:
 
                 m_page_status[page_no] = dirty;
 
-                return (*m_cache)[kicked_slot * page_size + offset.get_block1()][offset.get_offset()];
+                return (*m_cache[kicked_slot * page_size + offset.get_block1()])[offset.get_offset()];
             }
             else
             {
                 int_type free_slot = m_free_slots.front();
+                allocate_slot(free_slot);
                 m_free_slots.pop();
                 m_pager.hit(free_slot);
+                m_last_slot = free_slot;
                 m_page_to_slot[page_no] = free_slot;
                 m_slot_to_page[free_slot] = page_no;
 
@@ -1681,14 +2045,15 @@ private:
 
                 m_page_status[page_no] = dirty;
 
-                return (*m_cache)[free_slot * page_size + offset.get_block1()][offset.get_offset()];
+                return (*m_cache[free_slot * page_size + offset.get_block1()])[offset.get_offset()];
             }
         }
         else
         {
             m_page_status[page_no] = dirty;
             m_pager.hit(cache_slot);
-            return (*m_cache)[cache_slot * page_size + offset.get_block1()][offset.get_offset()];
+            m_last_slot = cache_slot;
+            return (*m_cache[cache_slot * page_size + offset.get_block1()])[offset.get_offset()];
         }
     }
 
@@ -1701,6 +2066,7 @@ private:
         assert(!(m_page_status[page_no] & dirty));
         if (m_page_to_slot[page_no] != on_disk) {
             // remove page from cache
+            unpin_page(page_no, m_page_to_slot[page_no], false);
             m_free_slots.push(m_page_to_slot[page_no]);
             m_page_to_slot[page_no] = on_disk;
             STXXL_VERBOSE_VECTOR("page_externally_updated(): page_no=" << page_no << " flushed from cache.");
@@ -1708,6 +2074,12 @@ private:
         else {
             STXXL_VERBOSE_VECTOR("page_externally_updated(): page_no=" << page_no << " no need to flush.");
         }
+        if (m_shared_cache)
+        {
+            unsigned_type last_block = STXXL_MIN((page_no + 1) * page_size, (unsigned_type)m_bids.size());
+            for (unsigned_type b = page_no * page_size; b < last_block; ++b)
+                m_shared_cache->discard(m_bids[b]);
+        }
         m_page_status[page_no] = valid_on_disk;
     }
 
@@ -1735,10 +2107,12 @@ private:
         int_type cache_slot = m_page_to_slot[page_no];
         if (cache_slot < 0)                        // == on_disk
         {
+            release_requested_memory();
             if (m_free_slots.empty())              // has to kick
             {
                 int_type kicked_slot = m_pager.kick();
                 m_pager.hit(kicked_slot);
+                m_last_slot = kicked_slot;
                 int_type old_page_no = m_slot_to_page[kicked_slot];
                 m_page_to_slot[page_no] = kicked_slot;
                 m_page_to_slot[old_page_no] = on_disk;
@@ -1747,25 +2121,28 @@ private:
                 write_page(old_page_no, kicked_slot);
                 read_page(page_no, kicked_slot);
 
-                return (*m_cache)[kicked_slot * page_size + offset.get_block1()][offset.get_offset()];
+                return (*m_cache[kicked_slot * page_size + offset.get_block1()])[offset.get_offset()];
             }
             else
             {
                 int_type free_slot = m_free_slots.front();
+                allocate_slot(free_slot);
                 m_free_slots.pop();
                 m_pager.hit(free_slot);
+                m_last_slot = free_slot;
                 m_page_to_slot[page_no] = free_slot;
                 m_slot_to_page[free_slot] = page_no;
 
                 read_page(page_no, free_slot);
 
-                return (*m_cache)[free_slot * page_size + offset.get_block1()][offset.get_offset()];
+                return (*m_cache[free_slot * page_size + offset.get_block1()])[offset.get_offset()];
             }
         }
         else
         {
             m_pager.hit(cache_slot);
-            return (*m_cache)[cache_slot * page_size + offset.get_block1()][offset.get_offset()];
+            m_last_slot = cache_slot;
+            return (*m_cache[cache_slot * page_size + offset.get_block1()])[offset.get_offset()];
         }
     }
 
@@ -1914,6 +2291,10 @@ class vector_bufreader_iterator;
  * Note that this buffered reader is inefficient for reading small ranges. This
  * is intentional, as one can just use operator[] on the vector for that.
  *
+ * If the blocks are stored in files which can map their data into memory
+ * (see file::map_read()), the reader borrows the blocks from the mapping
+ * instead of reading them into buffers, until a block cannot be mapped.
+ *
  * See \ref tutorial_vector_buf
  */
 template <typename VectorIterator>
@@ -1960,6 +2341,15 @@ protected:
     //! number of blocks to use as buffers.
     unsigned_type m_nbuffers;
 
+    //! block borrowed from a file mapping, used instead of m_bufin.
+    const block_type* m_mapped;
+
+    //! BID of the borrowed block.
+    bids_container_iterator m_mapped_bid;
+
+    //! index of the current item in the borrowed block.
+    unsigned_type m_mapped_pos;
+
     //! allow vector_bufreader_iterator to check m_iter against its current value
     friend class vector_bufreader_iterator<vector_bufreader>;
 
@@ -1972,7 +2362,8 @@ public:
                      unsigned_type nbuffers = 0)
         : m_begin(begin), m_end(end),
           m_bufin(NULL),
-          m_nbuffers(nbuffers)
+          m_nbuffers(nbuffers),
+          m_mapped(NULL)
     {
         m_begin.flush(); // flush container
 
@@ -1988,7 +2379,8 @@ public:
     vector_bufreader(const vector_type& vec, unsigned_type nbuffers = 0)
         : m_begin(vec.begin()), m_end(vec.end()),
           m_bufin(NULL),
-          m_nbuffers(nbuffers)
+          m_nbuffers(nbuffers),
+          m_mapped(NULL)
     {
         m_begin.flush(); // flush container
 
@@ -2003,15 +2395,16 @@ public:
     void rewind()
     {
         m_iter = m_begin;
+        release();
         if (empty()) return;
 
-        if (m_bufin) delete m_bufin;
-
-        // find last bid to read
-        bids_container_iterator end_bid = m_end.bid() + (m_end.block_offset() ? 1 : 0);
+        // borrow the first block from the file mapping if possible
+        if (map_block(m_begin.bid())) {
+            m_mapped_pos = m_begin.block_offset();
+            return;
+        }
 
-        // construct buffered istream for range
-        m_bufin = new buf_istream_type(m_begin.bid(), end_bid, m_nbuffers);
+        open_bufin(m_begin.bid());
 
         // skip the beginning of the block, up to real beginning
         vector_iterator curr = m_begin - m_begin.block_offset();
@@ -2023,19 +2416,74 @@ public:
     //! Finish reading and free buffered reader.
     ~vector_bufreader()
     {
+        release();
+    }
+
+protected:
+    //! Borrow the block bid from its file's mapping, returns false if the
+    //! file cannot map it.
+    bool map_block(bids_container_iterator bid)
+    {
+        const void* ptr = bid->storage->map_read(bid->offset, block_type::raw_size);
+        if (!ptr) return false;
+
+        m_mapped = static_cast<const block_type*>(ptr);
+        m_mapped_bid = bid;
+        m_mapped_pos = 0;
+        return true;
+    }
+
+    //! Return the borrowed block to its file.
+    void unmap_block()
+    {
+        m_mapped_bid->storage->unmap_read(m_mapped, m_mapped_bid->offset,
+                                          block_type::raw_size);
+        m_mapped = NULL;
+    }
+
+    //! Return the BID following the last block to read.
+    bids_container_iterator end_bid() const
+    {
+        return m_end.bid() + (m_end.block_offset() ? 1 : 0);
+    }
+
+    //! Read the remaining range with overlapped I/O, starting at block bid.
+    void open_bufin(bids_container_iterator bid)
+    {
+        // construct buffered istream for range
+        m_bufin = new buf_istream_type(bid, end_bid(), m_nbuffers);
+    }
+
+    //! Continue with the block following the borrowed one.
+    void next_mapped_block()
+    {
+        bids_container_iterator bid = m_mapped_bid + 1;
+        unmap_block();
+        if (bid != end_bid() && !map_block(bid))
+            open_bufin(bid);
+    }
+
+    //! Release the borrowed block or the buffered reader.
+    void release()
+    {
+        if (m_mapped) unmap_block();
         if (m_bufin) delete m_bufin;
+        m_bufin = NULL;
     }
 
+public:
     //! Return constant reference to current item
     const value_type& operator * () const
     {
+        if (m_mapped)
+            return (*m_mapped)[m_mapped_pos];
         return *(*m_bufin);
     }
 
     //! Return constant pointer to current item
     const value_type* operator -> () const
     {
-        return &(*(*m_bufin));
+        return &operator * ();
     }
 
     //! Advance to next item (asserts if !empty()).
@@ -2043,6 +2491,16 @@ public:
     {
         assert(!empty());
         ++m_iter;
+
+        if (m_mapped)
+        {
+            if (UNLIKELY(empty()))
+                unmap_block();
+            else if (UNLIKELY(++m_mapped_pos == block_type::size))
+                next_mapped_block();
+            return *this;
+        }
+
         ++(*m_bufin);
 
         if (UNLIKELY(empty())) {
@@ -2090,12 +2548,16 @@ public:
     //! Return reference to the current block
     const block_type& block() const
     {
+        if (m_mapped)
+            return *m_mapped;
         return m_bufin->block();
     }
 
     //! Read the next block (do not intermix with operator++ !)
     void next_block()
     {
+        if (m_mapped)
+            return next_mapped_block();
         return m_bufin->next_block();
     }
 };
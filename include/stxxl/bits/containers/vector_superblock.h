@@ -0,0 +1,161 @@
+/***************************************************************************
+ *  include/stxxl/bits/containers/vector_superblock.h
+ *
+ *  metadata of a persistent vector stored in front of its blocks
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_CONTAINERS_VECTOR_SUPERBLOCK_HEADER
+#define STXXL_CONTAINERS_VECTOR_SUPERBLOCK_HEADER
+
+#include <cstring>
+#include <typeinfo>
+
+#include <stxxl/bits/common/aligned_alloc.h>
+#include <stxxl/bits/common/crc32c.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/io/file.h>
+#include <stxxl/bits/io/request.h>
+#include <stxxl/bits/namespace.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup stlcont_vector
+//! \{
+
+//! Superblock of a persistent vector, see vector::open().
+//!
+//! Two copies are kept at the start of the file and written alternately,
+//! the valid one with the higher sequence number counts. A crash while
+//! writing one thus leaves the previous one.
+struct vector_superblock
+{
+    //! bytes reserved for each copy, a multiple of the block alignment
+    static const unsigned_type slot_size = 4096;
+    //! number of copies
+    static const unsigned_type slots = 2;
+    //! bytes in front of the first block of the vector
+    static const unsigned_type area_size = slots * slot_size;
+
+    //! "STXXLVEC"
+    char magic[8];
+    uint32 version;
+    //! CRC-32C of the superblock with checksum set to zero
+    uint32 checksum;
+    //! incremented by each write, selects the copy
+    uint64 sequence;
+    //! number of elements
+    uint64 size;
+    //! bytes per block in the file
+    uint64 block_size;
+    //! sizeof() and hash of the element type
+    uint64 value_size;
+    uint64 type_hash;
+
+    //! Initializes a superblock of an empty vector.
+    template <typename ValueType>
+    void init(uint64 raw_block_size)
+    {
+        std::memset(this, 0, sizeof(*this));
+        std::memcpy(magic, "STXXLVEC", sizeof(magic));
+        version = 1;
+        block_size = raw_block_size;
+        value_size = sizeof(ValueType);
+        type_hash = hash_type_name(typeid(ValueType).name());
+    }
+
+    //! Returns true if the superblock was written for a vector of
+    //! ValueType with blocks of raw_block_size bytes.
+    template <typename ValueType>
+    bool matches(uint64 raw_block_size) const
+    {
+        return block_size == raw_block_size &&
+               value_size == sizeof(ValueType) &&
+               type_hash == hash_type_name(typeid(ValueType).name());
+    }
+
+    //! FNV-1a hash of the name of a type
+    static uint64 hash_type_name(const char* name)
+    {
+        uint64 hash = 14695981039346656037ull;
+        for ( ; *name; ++name)
+            hash = (hash ^ (unsigned char)*name) * 1099511628211ull;
+        return hash;
+    }
+
+    uint32 compute_checksum() const
+    {
+        vector_superblock copy = *this;
+        copy.checksum = 0;
+        return crc32c(&copy, sizeof(copy));
+    }
+
+    bool valid() const
+    {
+        return std::memcmp(magic, "STXXLVEC", sizeof(magic)) == 0 &&
+               version == 1 && checksum == compute_checksum();
+    }
+
+    //! Increments the sequence number and writes the superblock to the copy
+    //! it selects.
+    void write(file* f)
+    {
+        ++sequence;
+        checksum = 0;
+        checksum = compute_checksum();
+
+        char* buffer = static_cast<char*>(aligned_alloc<STXXL_BLOCK_ALIGN>(slot_size));
+        std::memset(buffer, 0, slot_size);
+        std::memcpy(buffer, this, sizeof(*this));
+        try {
+            f->awrite(buffer, (sequence % slots) * slot_size, slot_size)->wait();
+        }
+        catch (...) {
+            aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+            throw;
+        }
+        aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+    }
+
+    //! Reads the valid copy with the highest sequence number. Returns false
+    //! if there is none.
+    bool read(file* f)
+    {
+        if (f->size() < (file::offset_type)area_size)
+            return false;
+
+        char* buffer = static_cast<char*>(aligned_alloc<STXXL_BLOCK_ALIGN>(area_size));
+        try {
+            f->aread(buffer, 0, area_size)->wait();
+        }
+        catch (...) {
+            aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+            throw;
+        }
+
+        bool found = false;
+        for (unsigned_type i = 0; i < slots; ++i)
+        {
+            vector_superblock copy;
+            std::memcpy(&copy, buffer + i * slot_size, sizeof(copy));
+            if (copy.valid() && (!found || copy.sequence > sequence)) {
+                *this = copy;
+                found = true;
+            }
+        }
+        aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+        return found;
+    }
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_CONTAINERS_VECTOR_SUPERBLOCK_HEADER
+// vim: et:ts=4:sw=4
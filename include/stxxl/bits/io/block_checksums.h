@@ -0,0 +1,86 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/block_checksums.h
+ *
+ *  CRC-32C checksums of the blocks written to a file
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_BLOCK_CHECKSUMS_HEADER
+#define STXXL_IO_BLOCK_CHECKSUMS_HEADER
+
+#include <map>
+
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/noncopyable.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup iolayer
+//! \{
+
+//! Checksums of the data written to a file, see file::enable_checksums().
+//!
+//! The thread completing a write request records the CRC-32C of its data,
+//! the one completing a read request of the same range verifies it, such
+//! that waiting for the request reports corrupted data. The checksums are
+//! kept in memory, ranges which were not written as a whole are not
+//! verified.
+class block_checksums : private noncopyable
+{
+public:
+    typedef external_size_type offset_type;
+    typedef internal_size_type size_type;
+
+private:
+    struct entry
+    {
+        size_type bytes;
+        uint32 crc;
+    };
+
+    typedef std::map<offset_type, entry> map_type;
+
+    //! checksums by offset of the written ranges, which do not overlap
+    map_type m_map;
+    mutex m_mutex;
+
+    //! number of verified reads and of mismatches found
+    uint64 m_verified, m_mismatches;
+
+    //! m_mutex has to be acquired by caller
+    void erase_overlapping(offset_type offset, size_type bytes);
+
+public:
+    block_checksums();
+
+    //! Records the checksum of the data written to [offset, offset + bytes)
+    //! and forgets the ones of overlapping ranges.
+    void record(offset_type offset, size_type bytes, const void* data);
+
+    //! Verifies the data read from [offset, offset + bytes). Returns false
+    //! if the range was written as a whole and its checksum differs.
+    bool verify(offset_type offset, size_type bytes, const void* data);
+
+    //! Forgets the checksums of the ranges overlapping the freed region.
+    void forget(offset_type offset, size_type bytes);
+
+    //! Returns the number of reads verified.
+    uint64 get_verified();
+
+    //! Returns the number of reads whose data did not match.
+    uint64 get_mismatches();
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_IO_BLOCK_CHECKSUMS_HEADER
+// vim: et:ts=4:sw=4
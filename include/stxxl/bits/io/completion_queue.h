@@ -0,0 +1,113 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/completion_queue.h
+ *
+ *  collects completed requests for a single thread driving many of them
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_COMPLETION_QUEUE_HEADER
+#define STXXL_IO_COMPLETION_QUEUE_HEADER
+
+#include <deque>
+#include <map>
+
+#include <stxxl/bits/common/condition_variable.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/io/request.h>
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/noncopyable.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup reqlayer
+//! \{
+
+//! Queue of completed requests.
+//!
+//! Requests handed to watch() are appended to the queue when they complete,
+//! in order of completion, and are taken out with poll() or wait(). This
+//! lets one thread drive any number of outstanding requests without
+//! waiting for each of them. The queue holds a reference to each watched
+//! request, requests still pending when the queue is destroyed are
+//! unwatched.
+//!
+//! For event loops, get_fd() returns an eventfd which is readable while
+//! completed requests are queued (where supported).
+class completion_queue : private noncopyable
+{
+    friend class request_with_waiters;
+
+    typedef std::map<request*, request_ptr> watched_type;
+
+    mutex m_mutex;
+    condition_variable m_cond;
+
+    //! watched requests which did not complete yet
+    watched_type m_watched;
+    //! completed requests, oldest first
+    std::deque<request_ptr> m_completed;
+
+    //! eventfd signaling a non-empty m_completed, created by the first
+    //! get_fd() call, or -1
+    int m_eventfd;
+
+    //! called by a watched request when it completes
+    void notify(request* req);
+
+    //! adjusts the eventfd after m_completed became (non-)empty
+    void signal_fd(bool readable);
+
+public:
+    completion_queue();
+
+    //! Unwatches all pending requests.
+    ~completion_queue();
+
+    //! Adds a request to watch. If it is already completed it is queued
+    //! immediately.
+    void watch(const request_ptr& req);
+
+    //! Adds a sequence of requests to watch.
+    template <class RequestIterator>
+    void watch(RequestIterator reqs_begin, RequestIterator reqs_end)
+    {
+        for ( ; reqs_begin != reqs_end; ++reqs_begin)
+            watch(request_ptr(*reqs_begin));
+    }
+
+    //! Stops watching a request. Returns false if it already completed, it
+    //! is then still returned by poll() or wait().
+    bool unwatch(const request_ptr& req);
+
+    //! Takes out the oldest completed request, or returns an empty pointer
+    //! if there is none.
+    request_ptr poll();
+
+    //! Takes out the oldest completed request, waiting for one if necessary.
+    //! Returns an empty pointer if no requests are watched.
+    request_ptr wait();
+
+    //! number of watched requests that did not complete yet
+    size_t num_pending();
+
+    //! number of completed requests not taken out yet
+    size_t num_completed();
+
+    //! File descriptor which is readable while completed requests are
+    //! queued, for select(), poll() or epoll. Returns -1 if eventfd() is not
+    //! available. The descriptor is created by the first call.
+    //! \throws io_error if eventfd() fails
+    int get_fd();
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_IO_COMPLETION_QUEUE_HEADER
+// vim: et:ts=4:sw=4
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/compress_file.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_COMPRESS_FILE_HEADER
+#define STXXL_IO_COMPRESS_FILE_HEADER
+
+#include <map>
+#include <string>
+
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/io/disk_queued_file.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup fileimpl
+//! \{
+
+//! Implementation of file based on another file, which compresses each block
+//! written with lz_compress().
+//!
+//! The compressed blocks are padded to STXXL_BLOCK_ALIGN and appended to the
+//! base file in log-structured fashion, reusing space of overwritten and
+//! discarded blocks. The location of each block is kept in an in-memory
+//! offset map, hence blocks must be read with the offsets they were written
+//! at (or a part of them), and the contents are lost when the file is closed.
+//! Blocks which do not shrink are stored uncompressed.
+template <class base_file_type>
+class compress_file : public disk_queued_file
+{
+    //! location of a written block in the base file
+    struct extent
+    {
+        //! offset in the base file
+        offset_type physical;
+        //! logical (uncompressed) size of the block
+        size_type bytes;
+        //! number of bytes stored, without padding
+        size_type stored;
+        //! whether the block is stored compressed
+        bool compressed;
+    };
+
+    typedef std::map<offset_type, extent> extent_map;
+    typedef std::map<offset_type, offset_type> free_map;
+
+    base_file_type storage;
+    offset_type current_size;
+
+    mutex mapping_mutex;
+    //! logical offset to location in the base file
+    extent_map address_mapping;
+    //! free regions (offset, size) in the base file
+    free_map free_space;
+    //! end of the used part of the base file
+    offset_type storage_end;
+    //! size of the base file
+    offset_type storage_size;
+
+    //! scratch buffer for (de)compression
+    mutex buffer_mutex;
+    char* buffer;
+    size_type buffer_size;
+
+    static offset_type padded(offset_type bytes)
+    {
+        return (bytes + STXXL_BLOCK_ALIGN - 1) / STXXL_BLOCK_ALIGN * STXXL_BLOCK_ALIGN;
+    }
+
+    //! returns a scratch buffer of at least size bytes, call with buffer_mutex
+    char * get_buffer(size_type size);
+
+    //! allocates size bytes in the base file, call with mapping_mutex
+    offset_type allocate(offset_type size);
+
+    //! adds a free region of the base file, call with mapping_mutex
+    void add_free_region(offset_type offset, offset_type size);
+
+    void sread(void* buffer, offset_type offset, size_type bytes);
+    void swrite(void* buffer, offset_type offset, size_type bytes);
+
+public:
+    //! Constructs file object.
+    //! param filename path of the base file
+    //! param mode open mode, see \c file::open_modes
+    compress_file(
+        const std::string& filename,
+        int mode,
+        int queue_id = DEFAULT_QUEUE,
+        int allocator_id = NO_ALLOCATOR,
+        unsigned int device_id = DEFAULT_DEVICE_ID);
+
+    virtual ~compress_file();
+
+    virtual void serve(void* buffer, offset_type offset, size_type bytes,
+                       request::request_type type);
+
+    //! Changes the (logical) size of the file.
+    //! \param new_size value of the new file size
+    virtual void set_size(offset_type new_size) { current_size = new_size; }
+
+    //! Returns (logical) size of the file.
+    //! \return file size in length
+    virtual offset_type size() { return current_size; }
+
+    virtual void lock();
+
+    //! Frees the space of the block written at offset.
+    virtual void discard(offset_type offset, offset_type length);
+
+    virtual void close_remove();
+
+    const char * io_type() const;
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_IO_COMPRESS_FILE_HEADER
+// vim: et:ts=4:sw=4
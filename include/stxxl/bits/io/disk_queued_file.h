@@ -48,6 +48,13 @@ public:
         size_type bytes,
         const completion_handler& on_cmpl = completion_handler());
 
+    void aread_batch(request_ptr* reqs, void* const* buffers,
+                     const offset_type* pos, const size_type* bytes, size_t n,
+                     const completion_handler& on_cmpl = completion_handler());
+    void awrite_batch(request_ptr* reqs, void* const* buffers,
+                      const offset_type* pos, const size_type* bytes, size_t n,
+                      const completion_handler& on_cmpl = completion_handler());
+
     virtual int get_queue_id() const
     {
         return m_queue_id;
@@ -17,14 +17,20 @@
 #define STXXL_IO_DISK_QUEUES_HEADER
 
 #include <map>
+#include <string>
 
 #include <stxxl/bits/namespace.h>
 #include <stxxl/bits/singleton.h>
 #include <stxxl/bits/io/iostats.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/io/request_queue_impl_qwqr.h>
+#include <stxxl/bits/io/request_queue_impl_1q.h>
+#include <stxxl/bits/io/request_queue_impl_elevator.h>
+#include <stxxl/bits/io/request_queue_impl_mpsc.h>
 #include <stxxl/bits/io/linuxaio_queue.h>
 #include <stxxl/bits/io/linuxaio_request.h>
+#include <stxxl/bits/io/iouring_queue.h>
+#include <stxxl/bits/io/iouring_request.h>
 #include <stxxl/bits/io/serving_request.h>
 
 STXXL_BEGIN_NAMESPACE
@@ -40,38 +46,131 @@ class disk_queues : public singleton<disk_queues>
 
     typedef stxxl::int64 DISKID;
     typedef std::map<DISKID, request_queue*> request_queue_map;
+    typedef std::map<DISKID, std::string> queue_impl_map;
+    typedef std::map<DISKID, int> numa_node_map;
 
 protected:
     request_queue_map queues;
+    //! request queue implementations selected by set_queue_impl()
+    queue_impl_map queue_impls;
+    //! NUMA nodes of queue threads selected by set_queue_numa_node()
+    numa_node_map numa_nodes;
     disk_queues()
     {
         stxxl::stats::get_instance(); // initialize stats before ourselves
     }
 
+private:
+    //! Returns the queue for disk, creating a queue fitting the type of req
+    //! on first use.
+    request_queue * get_or_create_queue(request_ptr& req, DISKID disk)
+    {
+        request_queue_map::iterator qi = queues.find(disk);
+        if (qi != queues.end())
+            return qi->second;
+
+        request_queue* q = queues[disk] = create_queue(req, disk);
+
+        numa_node_map::const_iterator ni = numa_nodes.find(disk);
+        if (ni != numa_nodes.end())
+            q->set_numa_node(ni->second);
+
+        return q;
+    }
+
+    //! Creates a new queue for disk fitting the type of req
+    request_queue * create_queue(request_ptr& req, DISKID disk)
+    {
+#if STXXL_HAVE_LINUXAIO_FILE
+        if (dynamic_cast<linuxaio_request*>(req.get()))
+            return new linuxaio_queue(
+                dynamic_cast<linuxaio_file*>(req->get_file())->get_desired_queue_length());
+#endif
+#if STXXL_HAVE_IOURING_FILE
+        if (dynamic_cast<iouring_request*>(req.get()))
+            return new iouring_queue(
+                dynamic_cast<iouring_file*>(req->get_file())->get_desired_queue_length());
+#endif
+        queue_impl_map::const_iterator ii = queue_impls.find(disk);
+        if (ii != queue_impls.end())
+        {
+            if (ii->second == "1q")
+                return new request_queue_impl_1q();
+            if (ii->second == "elevator")
+                return new request_queue_impl_elevator();
+#if STXXL_HAVE_FUTEX
+            if (ii->second == "mpsc")
+                return new request_queue_impl_mpsc();
+#endif
+        }
+        return new request_queue_impl_qwqr();
+    }
+
 public:
     void add_request(request_ptr& req, DISKID disk)
     {
 #ifdef STXXL_HACK_SINGLE_IO_THREAD
         disk = 42;
 #endif
-        request_queue_map::iterator qi = queues.find(disk);
-        request_queue* q;
-        if (qi == queues.end())
-        {
-            // create new request queue
-#if STXXL_HAVE_LINUXAIO_FILE
-            if (dynamic_cast<linuxaio_request*>(req.get()))
-                q = queues[disk] = new linuxaio_queue(
-                        dynamic_cast<linuxaio_file*>(req->get_file())->get_desired_queue_length()
-                        );
-            else
+        stats::get_instance()->request_submitted(req->get_file()->get_device_id());
+        get_or_create_queue(req, disk)->add_request(req);
+    }
+
+    //! Add a range of requests which all belong to the same disk. The queue
+    //! is locked and its worker woken only once for the whole range.
+    //! \param begin first request of the range
+    //! \param end end of the range
+    //! \param disk disk number all requests are scheduled on
+    void add_requests(request_ptr* begin, request_ptr* end, DISKID disk)
+    {
+#ifdef STXXL_HACK_SINGLE_IO_THREAD
+        disk = 42;
 #endif
-            q = queues[disk] = new request_queue_impl_qwqr();
-        }
-        else
-            q = qi->second;
+        if (begin == end) return;
+        for (request_ptr* r = begin; r != end; ++r)
+            stats::get_instance()->request_submitted((*r)->get_file()->get_device_id());
+        get_or_create_queue(*begin, disk)->add_requests(begin, end);
+    }
+
+    //! Select the request queue implementation for a disk: "qwqr" (the
+    //! default), "1q", "elevator" or "mpsc". This only affects disks using
+    //! the generic queues and must be called before the first request to the
+    //! disk.
+    void set_queue_impl(DISKID disk, const std::string& impl)
+    {
+#ifdef STXXL_HACK_SINGLE_IO_THREAD
+        disk = 42;
+#endif
+        if (!is_valid_queue_impl(impl))
+            STXXL_THROW_INVALID_ARGUMENT("Unknown request queue implementation '" << impl << "'.");
+        if (queues.find(disk) != queues.end())
+            STXXL_THROW_INVALID_ARGUMENT("Request queue of disk " << disk << " is already running.");
+
+        queue_impls[disk] = impl;
+    }
+
+    //! Pins the threads of the disk's request queue to the CPUs of a NUMA
+    //! node, now or when the queue is created.
+    void set_queue_numa_node(DISKID disk, int node)
+    {
+#ifdef STXXL_HACK_SINGLE_IO_THREAD
+        disk = 42;
+#endif
+        numa_nodes[disk] = node;
 
-        q->add_request(req);
+        request_queue_map::iterator qi = queues.find(disk);
+        if (qi != queues.end())
+            qi->second->set_numa_node(node);
+    }
+
+    //! Returns true if impl names a request queue implementation available
+    //! in this build, see set_queue_impl().
+    static bool is_valid_queue_impl(const std::string& impl)
+    {
+#if STXXL_HAVE_FUTEX
+        if (impl == "mpsc") return true;
+#endif
+        return (impl == "qwqr" || impl == "1q" || impl == "elevator");
     }
 
     //! Cancel a request.
@@ -29,6 +29,7 @@
 #include <stxxl/bits/common/exceptions.h>
 #include <stxxl/bits/common/counting_ptr.h>
 #include <stxxl/bits/common/types.h>
+#include <stxxl/bits/io/block_checksums.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/io/request_interface.h>
 #include <stxxl/bits/libstxxl.h>
@@ -81,12 +82,14 @@ public:
 
     static const int DEFAULT_QUEUE = -1;
     static const int DEFAULT_LINUXAIO_QUEUE = -2;
+    static const int DEFAULT_IOURING_QUEUE = -3;
     static const int NO_ALLOCATOR = -1;
     static const unsigned int DEFAULT_DEVICE_ID = (unsigned int)(-1);
 
     //! Construct a new file, usually called by a subclass.
     file(unsigned int device_id = DEFAULT_DEVICE_ID)
-        : m_device_id(device_id)
+        : m_device_id(device_id),
+          m_checksums(NULL)
     { }
 
     //! Schedules an asynchronous read request to the file.
@@ -110,9 +113,52 @@ public:
     virtual request_ptr awrite(void* buffer, offset_type pos, size_type bytes,
                                const completion_handler& on_cmpl = completion_handler()) = 0;
 
+    //! Schedules a batch of asynchronous read requests to the file. The
+    //! requests are handed to the disk queue at once, which saves locking and
+    //! waking the I/O thread for each of them.
+    //! \param reqs array of n request pointers receiving the request objects
+    //! \param buffers array of n memory buffers to read into
+    //! \param pos array of n file positions to start reads from
+    //! \param bytes array of n numbers of bytes to transfer
+    //! \param n number of requests
+    //! \param on_cmpl I/O completion handler called for each request
+    virtual void aread_batch(request_ptr* reqs, void* const* buffers,
+                             const offset_type* pos, const size_type* bytes,
+                             size_t n,
+                             const completion_handler& on_cmpl = completion_handler())
+    {
+        for (size_t i = 0; i < n; ++i)
+            reqs[i] = aread(buffers[i], pos[i], bytes[i], on_cmpl);
+    }
+
+    //! Schedules a batch of asynchronous write requests to the file, see
+    //! aread_batch().
+    virtual void awrite_batch(request_ptr* reqs, void* const* buffers,
+                              const offset_type* pos, const size_type* bytes,
+                              size_t n,
+                              const completion_handler& on_cmpl = completion_handler())
+    {
+        for (size_t i = 0; i < n; ++i)
+            reqs[i] = awrite(buffers[i], pos[i], bytes[i], on_cmpl);
+    }
+
     virtual void serve(void* buffer, offset_type offset, size_type bytes,
                        request::request_type type) = 0;
 
+    //! Serves n adjacent transfers starting at offset, with buffer i holding
+    //! bytes[i] bytes. Used by the request queues to coalesce requests for
+    //! contiguous blocks, files may override it with scatter/gather I/O.
+    virtual void serve_vector(void* const* buffers, const size_type* bytes,
+                              size_t n, offset_type offset,
+                              request::request_type type)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            serve(buffers[i], offset, bytes[i], type);
+            offset += bytes[i];
+        }
+    }
+
     //! Changes the size of the file.
     //! \param newsize new file size
     virtual void set_size(offset_type newsize) = 0;
@@ -140,6 +186,30 @@ public:
         STXXL_UNUSED(size);
     }
 
+    //! Writes the data of completed writes, which the operating system may
+    //! still buffer, to the device such that it survives a crash.
+    virtual void sync() { }
+
+    //! Returns a pointer through which the bytes at [offset, offset + bytes)
+    //! can be read without copying them, or NULL if the file type does not
+    //! support this for the range. The pointer stays valid until unmap_read()
+    //! is called with it, the data must not be written in between.
+    //! \throws io_error if checksums are enabled and the data does not match
+    virtual const void * map_read(offset_type offset, size_type bytes)
+    {
+        STXXL_UNUSED(offset);
+        STXXL_UNUSED(bytes);
+        return NULL;
+    }
+
+    //! Releases a pointer returned by map_read().
+    virtual void unmap_read(const void* ptr, offset_type offset, size_type bytes)
+    {
+        STXXL_UNUSED(ptr);
+        STXXL_UNUSED(offset);
+        STXXL_UNUSED(bytes);
+    }
+
     virtual void export_files(offset_type offset, offset_type length,
                               std::string prefix)
     {
@@ -158,6 +228,7 @@ public:
             STXXL_ERRMSG("stxxl::file is being deleted while there are "
                          "still " << nr << " (unfinished) requests "
                          "referencing it");
+        delete m_checksums;
     }
 
     //! Identifies the type of I/O implementation.
@@ -177,6 +248,23 @@ public:
         return m_device_id;
     }
 
+private:
+    //! checksums of the data written, NULL unless enabled
+    block_checksums* m_checksums;
+
+public:
+    //! Enables recording a CRC-32C checksum of the data of each completed
+    //! write request and verifying it when a read request of the same range
+    //! completes, a mismatch fails the read with an io_error. Must be called
+    //! before the first request.
+    void enable_checksums();
+
+    //! Returns the checksums of the file, or NULL if not enabled.
+    block_checksums * get_checksums() const
+    {
+        return m_checksums;
+    }
+
 protected:
     //! count the number of requests referencing this file
     atomic_counted_object m_request_ref;
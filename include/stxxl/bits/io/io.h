@@ -23,11 +23,15 @@
 #include <stxxl/bits/io/boostfd_file.h>
 #include <stxxl/bits/io/mem_file.h>
 #include <stxxl/bits/io/fileperblock_file.h>
+#include <stxxl/bits/io/compress_file.h>
 #include <stxxl/bits/io/wbtl_file.h>
+#include <stxxl/bits/io/tiered_file.h>
 #include <stxxl/bits/io/linuxaio_file.h>
+#include <stxxl/bits/io/iouring_file.h>
 #include <stxxl/bits/io/create_file.h>
 #include <stxxl/bits/io/disk_queues.h>
 #include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/io/stats_sampler.h>
 #include <stxxl/bits/namespace.h>
 
 //! \c STXXL library namespace
@@ -19,17 +19,24 @@
  #define STXXL_IO_STATS 1
 #endif
 
+#ifndef STXXL_IO_STATS_MAX_DISKS
+//! number of device ids for which separate counters are kept
+ #define STXXL_IO_STATS_MAX_DISKS 64
+#endif
+
 #include <stxxl/bits/namespace.h>
 #include <stxxl/bits/deprecated.h>
 #include <stxxl/bits/common/mutex.h>
 #include <stxxl/bits/common/timer.h>
 #include <stxxl/bits/common/types.h>
 #include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/io/latency_histogram.h>
 #include <stxxl/bits/unused.h>
 #include <stxxl/bits/singleton.h>
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -37,6 +44,108 @@ STXXL_BEGIN_NAMESPACE
 //!
 //! \{
 
+//! I/O counters of the files with one device id, see stats::get_disk_stats().
+struct disk_stats
+{
+    //! number of operations
+    unsigned reads, writes;
+    //! number of bytes read/written
+    int64 volume_read, volume_written;
+    //! seconds spent in operations
+    double t_reads, t_writes;
+    //! seconds in which at least one operation was running (busy time)
+    double p_ios;
+    //! integral of the number of submitted requests over time, divided by
+    //! the elapsed time this is the average queue depth
+    double t_queue;
+    //! number of submitted and not yet completed requests
+    int queue_depth;
+    //! latency histograms of the requests served by request queues
+    disk_latency latency;
+
+    disk_stats()
+        : reads(0), writes(0),
+          volume_read(0), volume_written(0),
+          t_reads(0.0), t_writes(0.0),
+          p_ios(0.0), t_queue(0.0),
+          queue_depth(0)
+    { }
+
+    disk_stats& operator += (const disk_stats& a)
+    {
+        reads += a.reads;
+        writes += a.writes;
+        volume_read += a.volume_read;
+        volume_written += a.volume_written;
+        t_reads += a.t_reads;
+        t_writes += a.t_writes;
+        p_ios += a.p_ios;
+        t_queue += a.t_queue;
+        queue_depth += a.queue_depth;
+        latency += a.latency;
+        return *this;
+    }
+
+    //! Subtracts the counters of an earlier snapshot, the queue depth is the
+    //! current one.
+    disk_stats& operator -= (const disk_stats& a)
+    {
+        reads -= a.reads;
+        writes -= a.writes;
+        volume_read -= a.volume_read;
+        volume_written -= a.volume_written;
+        t_reads -= a.t_reads;
+        t_writes -= a.t_writes;
+        p_ios -= a.p_ios;
+        t_queue -= a.t_queue;
+        latency -= a.latency;
+        return *this;
+    }
+};
+
+//! Disk space counters of the blocks allocated with one allocation_tag, see
+//! stats::get_allocation_stats().
+struct allocation_stats
+{
+    //! name of the tag
+    std::string name;
+    //! limit of the currently allocated bytes, 0 for none
+    int64 quota;
+    //! number of bytes allocated and not yet freed
+    int64 current;
+    //! largest number of bytes allocated at the same time
+    int64 maximum;
+    //! number of bytes ever allocated
+    int64 total;
+    //! number of allocations refused because they exceeded the quota
+    unsigned refused;
+
+    allocation_stats()
+        : quota(0), current(0), maximum(0), total(0), refused(0)
+    { }
+
+    allocation_stats& operator += (const allocation_stats& a)
+    {
+        if (name.empty()) name = a.name;
+        quota += a.quota;
+        current += a.current;
+        maximum += a.maximum;
+        total += a.total;
+        refused += a.refused;
+        return *this;
+    }
+
+    //! Subtracts the counters of an earlier snapshot, the quota and the
+    //! current and maximum allocation are the current ones.
+    allocation_stats& operator -= (const allocation_stats& a)
+    {
+        if (name.empty()) name = a.name;
+        total -= a.total;
+        refused -= a.refused;
+        return *this;
+    }
+};
+
 //! Collects various I/O statistics.
 //! \remarks is a singleton
 class stats : public singleton<stats>
@@ -47,6 +156,7 @@ class stats : public singleton<stats>
     int64 volume_read, volume_written;          // number of bytes read/written
     unsigned c_reads, c_writes;                 // number of cached operations
     int64 c_volume_read, c_volume_written;      // number of bytes read/written from/to cache
+    int64 z_volume_in, z_volume_out;            // number of bytes passed to/stored by compressing files
     double t_reads, t_writes;                   // seconds spent in operations
     double p_reads, p_writes;                   // seconds spent in parallel operations
     double p_begin_read, p_begin_write;         // start time of parallel operation
@@ -65,9 +175,40 @@ class stats : public singleton<stats>
     double last_reset;
     mutex read_mutex, write_mutex, io_mutex, wait_mutex;
 
+    disk_latency m_latency;                     // latencies of all disks
+
+    //! counters of one device id and the state to update them
+    struct disk_state
+    {
+        disk_stats counters;
+        int acc_reads, acc_writes;              // number of running operations
+        double p_begin;                         // time of the last update
+        mutex mtx;
+
+        disk_state(double now)
+            : acc_reads(0), acc_writes(0), p_begin(now)
+        { }
+
+        //! advance the time integrals to now, call with mtx locked
+        void update(double now);
+    };
+    disk_state* m_disks[STXXL_IO_STATS_MAX_DISKS]; // per device id, allocated on first use
+    mutex disks_mutex;
+
+    //! returns the state of the device id, or NULL if it is not tracked
+    disk_state * get_disk_state(unsigned disk);
+
+    //! counters of the allocation tags, indexed by their ids
+    std::vector<allocation_stats> m_allocations;
+    mutable mutex allocations_mutex;
+
     stats();
+    ~stats();
 
 public:
+    //! device id of I/Os not accounted to a disk, equals file::DEFAULT_DEVICE_ID
+    static const unsigned no_disk = (unsigned)(-1);
+
     enum wait_op_type {
         WAIT_OP_ANY,
         WAIT_OP_READ,
@@ -81,15 +222,20 @@ public:
         bool is_write;
 #if STXXL_IO_STATS
         bool running;
+        unsigned disk;
 #endif
 
     public:
-        scoped_read_write_timer(size_type size, bool is_write = false)
+        scoped_read_write_timer(size_type size, bool is_write = false,
+                                unsigned disk = no_disk)
             : is_write(is_write)
 #if STXXL_IO_STATS
-              , running(false)
+              , running(false), disk(disk)
 #endif
         {
+#if !STXXL_IO_STATS
+            STXXL_UNUSED(disk);
+#endif
             start(size);
         }
 
@@ -104,9 +250,9 @@ public:
             if (!running) {
                 running = true;
                 if (is_write)
-                    stats::get_instance()->write_started(size);
+                    stats::get_instance()->write_started(size, 0.0, disk);
                 else
-                    stats::get_instance()->read_started(size);
+                    stats::get_instance()->read_started(size, 0.0, disk);
             }
 #else
             STXXL_UNUSED(size);
@@ -118,9 +264,9 @@ public:
 #if STXXL_IO_STATS
             if (running) {
                 if (is_write)
-                    stats::get_instance()->write_finished();
+                    stats::get_instance()->write_finished(disk);
                 else
-                    stats::get_instance()->read_finished();
+                    stats::get_instance()->read_finished(disk);
                 running = false;
             }
 #endif
@@ -133,14 +279,18 @@ public:
 
 #if STXXL_IO_STATS
         bool running;
+        unsigned disk;
 #endif
 
     public:
-        scoped_write_timer(size_type size)
+        scoped_write_timer(size_type size, unsigned disk = no_disk)
 #if STXXL_IO_STATS
-            : running(false)
+            : running(false), disk(disk)
 #endif
         {
+#if !STXXL_IO_STATS
+            STXXL_UNUSED(disk);
+#endif
             start(size);
         }
 
@@ -154,7 +304,7 @@ public:
 #if STXXL_IO_STATS
             if (!running) {
                 running = true;
-                stats::get_instance()->write_started(size);
+                stats::get_instance()->write_started(size, 0.0, disk);
             }
 #else
             STXXL_UNUSED(size);
@@ -165,7 +315,7 @@ public:
         {
 #if STXXL_IO_STATS
             if (running) {
-                stats::get_instance()->write_finished();
+                stats::get_instance()->write_finished(disk);
                 running = false;
             }
 #endif
@@ -178,14 +328,18 @@ public:
 
 #if STXXL_IO_STATS
         bool running;
+        unsigned disk;
 #endif
 
     public:
-        scoped_read_timer(size_type size)
+        scoped_read_timer(size_type size, unsigned disk = no_disk)
 #if STXXL_IO_STATS
-            : running(false)
+            : running(false), disk(disk)
 #endif
         {
+#if !STXXL_IO_STATS
+            STXXL_UNUSED(disk);
+#endif
             start(size);
         }
 
@@ -199,7 +353,7 @@ public:
 #if STXXL_IO_STATS
             if (!running) {
                 running = true;
-                stats::get_instance()->read_started(size);
+                stats::get_instance()->read_started(size, 0.0, disk);
             }
 #else
             STXXL_UNUSED(size);
@@ -210,7 +364,7 @@ public:
         {
 #if STXXL_IO_STATS
             if (running) {
-                stats::get_instance()->read_finished();
+                stats::get_instance()->read_finished(disk);
                 running = false;
             }
 #endif
@@ -317,6 +471,20 @@ public:
         return c_volume_written;
     }
 
+    //! Returns number of bytes passed to compressing files for writing.
+    //! \return number of uncompressed bytes
+    int64 get_compressed_input_volume() const
+    {
+        return z_volume_in;
+    }
+
+    //! Returns number of bytes compressing files stored for the input.
+    //! \return number of compressed bytes
+    int64 get_compressed_output_volume() const
+    {
+        return z_volume_out;
+    }
+
     //! Time that would be spent in read syscalls if all parallel reads were serialized.
     //! \return seconds spent in reading
     double get_read_time() const
@@ -377,6 +545,38 @@ public:
         return last_reset;
     }
 
+    //! Returns the latency histograms of all requests served by request
+    //! queues.
+    const disk_latency & get_latency() const
+    {
+        return m_latency;
+    }
+
+    //! Copies the counters of the files with the given device id, returns
+    //! false if no requests were submitted to them.
+    bool get_disk_stats(unsigned disk, disk_stats& out) const;
+
+    //! Returns the id of the counters of the allocation tags with the given
+    //! name, they are created on first use and kept until the end of the
+    //! program.
+    unsigned register_allocation_tag(const std::string& name);
+
+    //! Sets the limit of the bytes allocated with the tag, 0 for none.
+    void set_allocation_quota(unsigned tag, int64 quota);
+
+    //! Accounts bytes allocated with the tag. Returns false and counts a
+    //! refused allocation instead, if they would exceed the tag's quota.
+    bool allocation_added(unsigned tag, int64 bytes);
+
+    //! Accounts bytes of the tag which are freed.
+    void allocation_removed(unsigned tag, int64 bytes);
+
+    //! Returns the number of registered allocation tags.
+    unsigned get_allocation_tags() const;
+
+    //! Returns the counters of the allocation tag with the given id.
+    allocation_stats get_allocation_stats(unsigned tag) const;
+
 #ifndef STXXL_IO_STATS_RESET_FORBIDDEN
     //! Resets I/O time counters (including I/O wait counter).
     STXXL_DEPRECATED(void reset());
@@ -386,39 +586,73 @@ public:
     STXXL_DEPRECATED(void _reset_io_wait_time());
 
     // for library use
-    void write_started(unsigned_type size_, double now = 0.0);
-    void write_canceled(unsigned_type size_);
-    void write_finished();
+    void write_started(unsigned_type size_, double now = 0.0, unsigned disk = no_disk);
+    void write_canceled(unsigned_type size_, unsigned disk = no_disk);
+    void write_finished(unsigned disk = no_disk);
     void write_cached(unsigned_type size_);
-    void read_started(unsigned_type size_, double now = 0.0);
-    void read_canceled(unsigned_type size_);
-    void read_finished();
+    void read_started(unsigned_type size_, double now = 0.0, unsigned disk = no_disk);
+    void read_canceled(unsigned_type size_, unsigned disk = no_disk);
+    void read_finished(unsigned disk = no_disk);
     void read_cached(unsigned_type size_);
+    void request_submitted(unsigned disk);
+    void request_completed(unsigned disk);
+    void write_compressed(unsigned_type size_in, unsigned_type size_out);
+    void request_served(unsigned disk, bool is_write,
+                        double queue_time, double service_time);
     void wait_started(wait_op_type wait_op);
     void wait_finished(wait_op_type wait_op);
 };
 
 #if !STXXL_IO_STATS
-inline void stats::write_started(unsigned_type size_, double now)
+inline void stats::write_started(unsigned_type size_, double now, unsigned disk)
 {
     STXXL_UNUSED(size_);
     STXXL_UNUSED(now);
+    STXXL_UNUSED(disk);
 }
 inline void stats::write_cached(unsigned_type size_)
 {
     STXXL_UNUSED(size_);
 }
-inline void stats::write_finished() { }
-inline void stats::read_started(unsigned_type size_, double now)
+inline void stats::write_finished(unsigned disk)
+{
+    STXXL_UNUSED(disk);
+}
+inline void stats::read_started(unsigned_type size_, double now, unsigned disk)
 {
     STXXL_UNUSED(size_);
     STXXL_UNUSED(now);
+    STXXL_UNUSED(disk);
 }
 inline void stats::read_cached(unsigned_type size_)
 {
     STXXL_UNUSED(size_);
 }
-inline void stats::read_finished() { }
+inline void stats::read_finished(unsigned disk)
+{
+    STXXL_UNUSED(disk);
+}
+inline void stats::request_submitted(unsigned disk)
+{
+    STXXL_UNUSED(disk);
+}
+inline void stats::request_completed(unsigned disk)
+{
+    STXXL_UNUSED(disk);
+}
+inline void stats::write_compressed(unsigned_type size_in, unsigned_type size_out)
+{
+    STXXL_UNUSED(size_in);
+    STXXL_UNUSED(size_out);
+}
+inline void stats::request_served(unsigned disk, bool is_write,
+                                  double queue_time, double service_time)
+{
+    STXXL_UNUSED(disk);
+    STXXL_UNUSED(is_write);
+    STXXL_UNUSED(queue_time);
+    STXXL_UNUSED(service_time);
+}
 #endif
 #ifdef STXXL_DO_NOT_COUNT_WAIT_TIME
 inline void stats::wait_started(wait_op_type) { }
@@ -435,6 +669,8 @@ class stats_data
     unsigned c_reads, c_writes;
     //! number of bytes read/written from/to cache
     int64 c_volume_read, c_volume_written;
+    //! number of bytes passed to/stored by compressing files
+    int64 z_volume_in, z_volume_out;
     //! seconds spent in operations
     double t_reads, t_writes;
     //! seconds spent in parallel operations
@@ -445,6 +681,12 @@ class stats_data
     double t_wait;
     double t_wait_read, t_wait_write;
     double elapsed;
+    //! latency histograms of all disks
+    disk_latency latency;
+    //! counters per device id
+    std::vector<disk_stats> disks;
+    //! counters per allocation tag id
+    std::vector<allocation_stats> allocations;
 
 public:
     stats_data()
@@ -456,6 +698,8 @@ public:
           c_writes(0),
           c_volume_read(0),
           c_volume_written(0),
+          z_volume_in(0),
+          z_volume_out(0),
           t_reads(0.0),
           t_writes(0.0),
           p_reads(0.0),
@@ -476,6 +720,8 @@ public:
           c_writes(s.get_cached_writes()),
           c_volume_read(s.get_cached_read_volume()),
           c_volume_written(s.get_cached_written_volume()),
+          z_volume_in(s.get_compressed_input_volume()),
+          z_volume_out(s.get_compressed_output_volume()),
           t_reads(s.get_read_time()),
           t_writes(s.get_write_time()),
           p_reads(s.get_pread_time()),
@@ -484,8 +730,21 @@ public:
           t_wait(s.get_io_wait_time()),
           t_wait_read(s.get_wait_read_time()),
           t_wait_write(s.get_wait_write_time()),
-          elapsed(timestamp() - s.get_last_reset_time())
-    { }
+          elapsed(timestamp() - s.get_last_reset_time()),
+          latency(s.get_latency())
+    {
+        disk_stats ds;
+        for (unsigned d = 0; d < STXXL_IO_STATS_MAX_DISKS; ++d)
+        {
+            if (!s.get_disk_stats(d, ds)) continue;
+            disks.resize(d + 1);
+            disks[d] = ds;
+        }
+
+        allocations.resize(s.get_allocation_tags());
+        for (unsigned t = 0; t < allocations.size(); ++t)
+            allocations[t] = s.get_allocation_stats(t);
+    }
 
     stats_data operator + (const stats_data& a) const
     {
@@ -498,6 +757,8 @@ public:
         s.c_writes = c_writes + a.c_writes;
         s.c_volume_read = c_volume_read + a.c_volume_read;
         s.c_volume_written = c_volume_written + a.c_volume_written;
+        s.z_volume_in = z_volume_in + a.z_volume_in;
+        s.z_volume_out = z_volume_out + a.z_volume_out;
         s.t_reads = t_reads + a.t_reads;
         s.t_writes = t_writes + a.t_writes;
         s.p_reads = p_reads + a.p_reads;
@@ -507,6 +768,18 @@ public:
         s.t_wait_read = t_wait_read + a.t_wait_read;
         s.t_wait_write = t_wait_write + a.t_wait_write;
         s.elapsed = elapsed + a.elapsed;
+        s.latency = latency;
+        s.latency += a.latency;
+        s.disks = disks;
+        if (s.disks.size() < a.disks.size())
+            s.disks.resize(a.disks.size());
+        for (size_t d = 0; d < a.disks.size(); ++d)
+            s.disks[d] += a.disks[d];
+        s.allocations = allocations;
+        if (s.allocations.size() < a.allocations.size())
+            s.allocations.resize(a.allocations.size());
+        for (size_t t = 0; t < a.allocations.size(); ++t)
+            s.allocations[t] += a.allocations[t];
         return s;
     }
 
@@ -521,6 +794,8 @@ public:
         s.c_writes = c_writes - a.c_writes;
         s.c_volume_read = c_volume_read - a.c_volume_read;
         s.c_volume_written = c_volume_written - a.c_volume_written;
+        s.z_volume_in = z_volume_in - a.z_volume_in;
+        s.z_volume_out = z_volume_out - a.z_volume_out;
         s.t_reads = t_reads - a.t_reads;
         s.t_writes = t_writes - a.t_writes;
         s.p_reads = p_reads - a.p_reads;
@@ -530,6 +805,18 @@ public:
         s.t_wait_read = t_wait_read - a.t_wait_read;
         s.t_wait_write = t_wait_write - a.t_wait_write;
         s.elapsed = elapsed - a.elapsed;
+        s.latency = latency;
+        s.latency -= a.latency;
+        s.disks = disks;
+        if (s.disks.size() < a.disks.size())
+            s.disks.resize(a.disks.size());
+        for (size_t d = 0; d < a.disks.size(); ++d)
+            s.disks[d] -= a.disks[d];
+        s.allocations = allocations;
+        if (s.allocations.size() < a.allocations.size())
+            s.allocations.resize(a.allocations.size());
+        for (size_t t = 0; t < a.allocations.size(); ++t)
+            s.allocations[t] -= a.allocations[t];
         return s;
     }
 
@@ -573,6 +860,22 @@ public:
         return c_volume_written;
     }
 
+    int64 get_compressed_input_volume() const
+    {
+        return z_volume_in;
+    }
+
+    int64 get_compressed_output_volume() const
+    {
+        return z_volume_out;
+    }
+
+    //! Returns the ratio of uncompressed to stored bytes of compressing files.
+    double get_compression_ratio() const
+    {
+        return z_volume_out ? (double)z_volume_in / (double)z_volume_out : 1.0;
+    }
+
     double get_read_time() const
     {
         return t_reads;
@@ -617,6 +920,65 @@ public:
     {
         return t_wait_write;
     }
+
+    //! Returns the latency histograms of all requests served by request
+    //! queues.
+    const disk_latency & get_latency() const
+    {
+        return latency;
+    }
+
+    //! Returns one more than the largest device id with counters.
+    unsigned get_disks() const
+    {
+        return (unsigned)disks.size();
+    }
+
+    //! Returns the counters of the files with the given device id.
+    const disk_stats & get_disk(unsigned disk) const
+    {
+        return disks[disk];
+    }
+
+    //! Returns the average number of submitted and not yet completed
+    //! requests to the files with the given device id.
+    double get_disk_average_queue_depth(unsigned disk) const
+    {
+        return (elapsed > 0.0) ? disks[disk].t_queue / elapsed : 0.0;
+    }
+
+    //! Returns the number of allocation tags with counters.
+    unsigned get_allocation_tags() const
+    {
+        return (unsigned)allocations.size();
+    }
+
+    //! Returns the disk space counters of the allocation tag with the given
+    //! id.
+    const allocation_stats & get_allocation(unsigned tag) const
+    {
+        return allocations[tag];
+    }
+
+    //! Prints the volume, busy time, queue depth and p50/p99/p99.9 of the
+    //! queueing and service times of each disk.
+    void print_disks(std::ostream& o) const;
+
+    //! Prints the current, maximum and total allocation and the quota of
+    //! each allocation tag.
+    void print_allocations(std::ostream& o) const;
+
+    //! Writes all counters and latency percentiles as one JSON object, with
+    //! the per-disk values in the array "disks" and the allocation tags in
+    //! "allocations". Times are in seconds.
+    void to_json(std::ostream& o) const;
+
+    //! Writes the column names of to_csv(), starting with "time,disk".
+    static void csv_header(std::ostream& o);
+
+    //! Writes one CSV row with disk "all" for the totals and one for each
+    //! disk with requests, each starting with the given time.
+    void to_csv(std::ostream& o, double time) const;
 };
 
 std::ostream& operator << (std::ostream& o, const stats_data& s);
@@ -0,0 +1,155 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/iouring_queue.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_IOURING_QUEUE_HEADER
+#define STXXL_IO_IOURING_QUEUE_HEADER
+
+#include <stxxl/bits/io/iouring_file.h>
+
+#if STXXL_HAVE_IOURING_FILE
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <list>
+#include <vector>
+
+#include <stxxl/bits/io/request_queue_impl_worker.h>
+#include <stxxl/bits/common/mutex.h>
+
+STXXL_BEGIN_NAMESPACE
+
+class iouring_request;
+
+//! \addtogroup reqlayer
+//! \{
+
+//! Queue for iouring_file(s)
+//!
+//! All io_uring files are created on DEFAULT_IOURING_QUEUE, hence they share
+//! one ring and one worker thread. The worker both submits requests and reaps
+//! their completions: it sleeps inside io_uring_enter() until either an I/O
+//! finishes or add_request() signals new work via an eventfd which is polled
+//! by the ring itself. All requests collected in the meantime are submitted
+//! with one system call. Requests whose buffer lies inside a region announced
+//! with register_buffer() are submitted as READ_FIXED/WRITE_FIXED.
+class iouring_queue : public request_queue_impl_worker
+{
+    friend class iouring_request;
+
+    typedef iouring_queue self_type;
+
+private:
+    //! ring file descriptor
+    int ring_fd;
+
+    //! eventfd used to wake the worker thread when requests arrive
+    int wakeup_fd;
+
+    //! \name Memory Mapped Submission and Completion Rings
+    //! \{
+    void* sq_ring_ptr, * cq_ring_ptr;
+    size_t sq_ring_size, cq_ring_size;
+    unsigned* sq_head, * sq_tail, * sq_ring_mask, * sq_array;
+    unsigned* cq_head, * cq_tail, * cq_ring_mask;
+    io_uring_sqe* sqes;
+    io_uring_cqe* cqes;
+    unsigned sq_entries;
+    //! local copy of the submission tail, only touched by the worker
+    unsigned sq_local_tail;
+    //! \}
+
+    //! storing iouring_request* would drop ownership
+    typedef std::list<request_ptr> queue_type;
+
+    //! requests submitted to this queue, but not yet to the kernel
+    mutex waiting_mtx;
+    queue_type waiting_requests;
+
+    //! true if the wakeup eventfd was already written and the worker has not
+    //! yet collected the waiting requests. Protected by waiting_mtx.
+    bool wakeup_pending;
+
+    //! max number of requests in flight in the kernel
+    int max_events;
+    //! number of requests in flight, only touched by the worker
+    int num_posted;
+    //! number of requests in flight using registered buffers
+    int num_posted_fixed;
+    //! number of entries accepted by the kernel whose completion was not yet
+    //! reaped, including the wakeup poll, only touched by the worker
+    unsigned num_in_kernel;
+    //! whether a failure to register buffers was already reported
+    bool register_failed;
+
+    thread_type worker_thread;
+    state<thread_state> worker_thread_state;
+
+    //! \name Registered Buffers
+    //! \{
+
+    //! registered buffer regions, sorted by address, owned by the worker
+    std::vector<iovec> registered;
+    //! generation of the global buffer list which was last registered
+    unsigned registered_generation;
+
+    //! global list of buffers to register, see register_buffer()
+    static mutex s_buffers_mtx;
+    static std::vector<iovec> s_buffers;
+    static unsigned s_buffers_generation;
+
+    //! re-register buffers with the kernel if the global list changed
+    void update_registered_buffers();
+    //! return index of registered buffer containing the region, or -1
+    int find_registered_buffer(const void* buffer, size_t bytes) const;
+
+    //! \}
+
+    static void * worker(void* arg);   // thread start callback
+    void work();
+
+    io_uring_sqe * get_sqe();
+    void post(iouring_request* req, void* user_data, bool first_post);
+    unsigned reap_completions();
+    void handle_completion(const io_uring_cqe* cqe);
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+    void backoff();
+    void wakeup();
+    //! unmaps the rings and closes the file descriptors set up so far
+    void release_ring();
+
+public:
+    //! Construct queue. Requests max number of requests simultaneously
+    //! submitted to disk, 0 means a default of 64.
+    iouring_queue(int desired_queue_length = 0);
+
+    void add_request(request_ptr& req);
+    void add_requests(request_ptr* begin, request_ptr* end);
+    bool cancel_request(request_ptr& req);
+    ~iouring_queue();
+
+    //! Announce a buffer (usually a block or a pool of blocks from
+    //! aligned_alloc) which is used for I/O repeatedly. Requests entirely
+    //! inside registered buffers skip the per-request page pinning in the
+    //! kernel. Registration is lazy and falls back to normal I/O on failure.
+    //! \warning The buffer must not be freed before unregister_buffer().
+    static void register_buffer(void* buffer, size_t size);
+
+    //! Remove a buffer previously announced by register_buffer().
+    static void unregister_buffer(void* buffer);
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_IOURING_FILE
+
+#endif // !STXXL_IO_IOURING_QUEUE_HEADER
+// vim: et:ts=4:sw=4
@@ -0,0 +1,177 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/latency_histogram.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_LATENCY_HISTOGRAM_HEADER
+#define STXXL_IO_LATENCY_HISTOGRAM_HEADER
+
+#include <cstring>
+
+#include <stxxl/bits/config.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/namespace.h>
+
+#if STXXL_MSVC
+ #include <intrin.h>
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup iolayer
+//! \{
+
+//! Histogram of latencies in microseconds with logarithmic buckets, each split
+//! into sub_count linear sub-buckets (as in HdrHistogram), giving a relative
+//! error of at most 1/sub_count. Samples are added with atomic increments, so
+//! any number of threads may call add() concurrently.
+class latency_histogram
+{
+public:
+    //! number of linear sub-buckets per power of two
+    static const unsigned sub_bits = 4;
+    static const unsigned sub_count = 1 << sub_bits;
+    //! largest power of two of a latency in microseconds (about 19 hours)
+    static const unsigned max_bits = 36;
+    static const unsigned num_buckets = (max_bits - sub_bits + 2) * sub_count;
+
+protected:
+    uint64 m_count[num_buckets];
+
+    static void atomic_inc(uint64& x)
+    {
+#if STXXL_MSVC
+        _InterlockedIncrement64(reinterpret_cast<volatile __int64*>(&x));
+#elif STXXL_HAVE_SYNC_ADD_AND_FETCH
+        __sync_add_and_fetch(&x, 1);
+#else
+        ++x;            // may lose a concurrent sample
+#endif
+    }
+
+public:
+    latency_histogram()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        memset(m_count, 0, sizeof(m_count));
+    }
+
+    //! Returns the bucket of a latency in microseconds.
+    static unsigned bucket(uint64 usec)
+    {
+        if (usec < 2 * sub_count)
+            return (unsigned)usec;
+
+        unsigned msb = 0;
+        for (uint64 v = usec; v > 1; v >>= 1)
+            ++msb;
+        if (msb > max_bits)
+            return num_buckets - 1;
+
+        unsigned shift = msb - sub_bits;
+        return (shift + 1) * sub_count + (unsigned)(usec >> shift) - sub_count;
+    }
+
+    //! Returns the largest latency in microseconds falling into a bucket.
+    static uint64 bucket_upper(unsigned b)
+    {
+        if (b < 2 * sub_count)
+            return b;
+
+        unsigned shift = b / sub_count - 1;
+        return (((uint64)(sub_count + b % sub_count) + 1) << shift) - 1;
+    }
+
+    //! Adds a latency sample given in seconds.
+    void add(double seconds)
+    {
+        uint64 usec = (seconds > 0.0) ? (uint64)(seconds * 1e6) : 0;
+        atomic_inc(m_count[bucket(usec)]);
+    }
+
+    //! Returns the number of samples.
+    uint64 count() const
+    {
+        uint64 n = 0;
+        for (unsigned b = 0; b < num_buckets; ++b)
+            n += m_count[b];
+        return n;
+    }
+
+    //! Returns the latency in seconds below which a fraction q of the samples
+    //! lie, up to the bucket precision. Returns 0 without samples.
+    double percentile(double q) const
+    {
+        uint64 total = count();
+        if (total == 0)
+            return 0.0;
+
+        uint64 rank = (uint64)(q * (double)total + 0.5);
+        if (rank == 0) rank = 1;
+
+        uint64 n = 0;
+        for (unsigned b = 0; b < num_buckets; ++b)
+        {
+            n += m_count[b];
+            if (n >= rank)
+                return (double)bucket_upper(b) * 1e-6;
+        }
+        return (double)bucket_upper(num_buckets - 1) * 1e-6;
+    }
+
+    latency_histogram& operator += (const latency_histogram& h)
+    {
+        for (unsigned b = 0; b < num_buckets; ++b)
+            m_count[b] += h.m_count[b];
+        return *this;
+    }
+
+    latency_histogram& operator -= (const latency_histogram& h)
+    {
+        for (unsigned b = 0; b < num_buckets; ++b)
+            m_count[b] -= h.m_count[b];
+        return *this;
+    }
+};
+
+//! Latency histograms of the requests of one disk: the time spent waiting in
+//! the disk queue and the time spent serving, for reads and writes.
+struct disk_latency
+{
+    latency_histogram read_queue, read_service;
+    latency_histogram write_queue, write_service;
+
+    disk_latency& operator += (const disk_latency& d)
+    {
+        read_queue += d.read_queue;
+        read_service += d.read_service;
+        write_queue += d.write_queue;
+        write_service += d.write_service;
+        return *this;
+    }
+
+    disk_latency& operator -= (const disk_latency& d)
+    {
+        read_queue -= d.read_queue;
+        read_service -= d.read_service;
+        write_queue -= d.write_queue;
+        write_service -= d.write_service;
+        return *this;
+    }
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_IO_LATENCY_HISTOGRAM_HEADER
+// vim: et:ts=4:sw=4
@@ -64,6 +64,12 @@ public:
                       const completion_handler& on_cmpl = completion_handler());
     request_ptr awrite(void* buffer, offset_type pos, size_type bytes,
                        const completion_handler& on_cmpl = completion_handler());
+    void aread_batch(request_ptr* reqs, void* const* buffers,
+                     const offset_type* pos, const size_type* bytes, size_t n,
+                     const completion_handler& on_cmpl = completion_handler());
+    void awrite_batch(request_ptr* reqs, void* const* buffers,
+                      const offset_type* pos, const size_type* bytes, size_t n,
+                      const completion_handler& on_cmpl = completion_handler());
     const char * io_type() const;
 
     int get_desired_queue_length() const
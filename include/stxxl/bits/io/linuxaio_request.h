@@ -19,6 +19,7 @@
 #if STXXL_HAVE_LINUXAIO_FILE
 
 #include <linux/aio_abi.h>
+#include <stxxl/bits/io/iostats.h>
 #include <stxxl/bits/io/request_with_state.h>
 
 #define STXXL_VERBOSE_LINUXAIO(msg) STXXL_VERBOSE2(msg)
@@ -33,10 +34,15 @@ class linuxaio_request : public request_with_state
 {
     template <class base_file_type>
     friend class fileperblock_file;
+    friend class linuxaio_queue;
 
     //! control block of async request
     iocb cb;
 
+    //! times of submission to the queue and of io_submit(), for the latency
+    //! histograms
+    double m_submit_time, m_post_time;
+
     void fill_control_block();
 
 public:
@@ -47,7 +53,13 @@ public:
         offset_type offset,
         size_type bytes,
         request_type type)
-        : request_with_state(on_cmpl, file, buffer, offset, bytes, type)
+        : request_with_state(on_cmpl, file, buffer, offset, bytes, type),
+#if STXXL_IO_STATS
+          m_submit_time(timestamp()),
+#else
+          m_submit_time(0.0),
+#endif
+          m_post_time(0.0)
     {
         assert(dynamic_cast<linuxaio_file*>(file));
         STXXL_VERBOSE_LINUXAIO("linuxaio_request[" << this << "]" <<
@@ -57,7 +69,6 @@ public:
                                " type=" << type << ")");
     }
 
-    bool post();
     bool cancel();
     bool cancel_aio();
     void completed(bool posted, bool canceled);
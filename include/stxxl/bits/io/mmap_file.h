@@ -19,17 +19,70 @@
 
 #if STXXL_HAVE_MMAP_FILE
 
+#include <vector>
+
 #include <stxxl/bits/io/ufs_file_base.h>
 #include <stxxl/bits/io/disk_queued_file.h>
 
+#ifndef STXXL_MMAP_WINDOW_SIZE
+//! size of the regions of the file mmap_file maps at once, a multiple of the
+//! page size
+ #define STXXL_MMAP_WINDOW_SIZE (64 * 1024 * 1024)
+#endif
+
+#ifndef STXXL_MMAP_MAX_WINDOWS
+//! number of regions mmap_file keeps mapped
+ #define STXXL_MMAP_MAX_WINDOWS 16
+#endif
+
 STXXL_BEGIN_NAMESPACE
 
 //! \addtogroup fileimpl
 //! \{
 
 //! Implementation of memory mapped access file.
+//!
+//! The file is mapped in windows of STXXL_MMAP_WINDOW_SIZE bytes, which stay
+//! mapped until they are evicted in least recently used order. The access
+//! pattern is passed to the kernel with madvise(). Reads can also be served
+//! without a copy by borrowing a pointer into the mapping with map_read().
 class mmap_file : public ufs_file_base, public disk_queued_file
 {
+    //! a mapped region of the file
+    struct window
+    {
+        //! start of the mapping
+        char* base;
+        //! file offset of base, a multiple of the window size
+        offset_type offset;
+        //! number of bytes mapped
+        size_type length;
+        //! number of copies in progress and pointers borrowed by map_read()
+        int pins;
+        //! madvise() advice last given for the window
+        int advice;
+        //! value of m_use_counter at the last access
+        unsigned_type last_use;
+    };
+
+    //! mapped windows, at most STXXL_MMAP_MAX_WINDOWS unless all are pinned
+    std::vector<window*> m_windows;
+    //! counts accesses, orders the windows for eviction
+    unsigned_type m_use_counter;
+    //! file size as of the last check
+    offset_type m_size;
+    //! end of the previous access, to detect sequential access
+    offset_type m_last_end;
+
+    //! returns a window containing [offset, offset + bytes), which must not
+    //! cross a window boundary, call with fd_mutex locked
+    window * get_window(offset_type offset, size_type bytes, bool is_write);
+    //! passes the access pattern to the kernel, call with fd_mutex locked
+    void advise(window* w, offset_type offset, size_type bytes);
+    //! unmaps all unpinned windows reaching beyond size, or all of them
+    void unmap_windows(offset_type size);
+    static void unmap_window(window* w);
+
 public:
     //! Constructs file object.
     //! \param filename path of file
@@ -45,10 +98,16 @@ public:
         unsigned int device_id = DEFAULT_DEVICE_ID)
         : file(device_id),
           ufs_file_base(filename, mode),
-          disk_queued_file(queue_id, allocator_id)
+          disk_queued_file(queue_id, allocator_id),
+          m_use_counter(0), m_size(0), m_last_end(0)
     { }
+    ~mmap_file();
     void serve(void* buffer, offset_type offset, size_type bytes,
                request::request_type type);
+    void set_size(offset_type newsize);
+    void close_remove();
+    const void * map_read(offset_type offset, size_type bytes);
+    void unmap_read(const void* ptr, offset_type offset, size_type bytes);
     const char * io_type() const;
 };
 
@@ -0,0 +1,117 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/request_batch.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_REQUEST_BATCH_HEADER
+#define STXXL_IO_REQUEST_BATCH_HEADER
+
+#include <vector>
+
+#include <stxxl/bits/noncopyable.h>
+#include <stxxl/bits/io/request.h>
+
+STXXL_BEGIN_NAMESPACE
+
+class file;
+
+//! \addtogroup reqlayer
+//! \{
+
+//! Collects asynchronous I/O requests to one or more files and submits them
+//! with one file::aread_batch() or file::awrite_batch() call per file and
+//! direction. Hence each disk queue is locked and its I/O thread woken only
+//! once per batch instead of once per block.
+//!
+//! The request objects are stored into the request_ptr references given to
+//! aread() and awrite() when submit() is called, which also happens on
+//! destruction. Until then the references keep their previous value.
+class request_batch : private noncopyable
+{
+public:
+    typedef request::offset_type offset_type;
+    typedef request::size_type size_type;
+
+private:
+    struct entry
+    {
+        file* m_file;
+        request::request_type m_type;
+        void* m_buffer;
+        offset_type m_offset;
+        size_type m_bytes;
+        request_ptr* m_req;
+    };
+
+    struct entry_file_less;
+
+    typedef std::vector<entry> entry_vector_type;
+
+    //! requests collected since the last submit()
+    entry_vector_type m_entries;
+
+    //! \name Scratch Arrays passed to the files
+    //! \{
+    std::vector<request_ptr> m_reqs;
+    std::vector<void*> m_buffers;
+    std::vector<offset_type> m_offsets;
+    std::vector<size_type> m_bytes;
+    //! \}
+
+    void add(file* f, request::request_type type, void* buffer,
+             offset_type pos, size_type bytes, request_ptr& req);
+
+public:
+    request_batch()
+    { }
+
+    //! Submits all collected requests.
+    ~request_batch() noexcept(false)
+    {
+        submit();
+    }
+
+    //! Schedules an asynchronous read request, see file::aread().
+    //! \param req receives the request object on submit()
+    void aread(file* f, void* buffer, offset_type pos, size_type bytes,
+               request_ptr& req)
+    {
+        add(f, request::READ, buffer, pos, bytes, req);
+    }
+
+    //! Schedules an asynchronous write request, see file::awrite().
+    //! \param req receives the request object on submit()
+    void awrite(file* f, void* buffer, offset_type pos, size_type bytes,
+                request_ptr& req)
+    {
+        add(f, request::WRITE, buffer, pos, bytes, req);
+    }
+
+    //! Hands all collected requests to their files' disk queues. Requests to
+    //! the same file keep their relative order.
+    void submit();
+
+    //! Returns the number of requests collected since the last submit().
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+
+    //! Returns true if no requests are pending submission.
+    bool empty() const
+    {
+        return m_entries.empty();
+    }
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_IO_REQUEST_BATCH_HEADER
+// vim: et:ts=4:sw=4
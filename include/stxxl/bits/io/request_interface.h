@@ -26,7 +26,7 @@ STXXL_BEGIN_NAMESPACE
 //! \addtogroup reqlayer
 //! \{
 
-class onoff_switch;
+class completion_queue;
 
 //! Functional interface of a request.
 //!
@@ -41,8 +41,11 @@ public:
     enum request_type { READ, WRITE };
 
 public:
-    virtual bool add_waiter(onoff_switch* sw) = 0;
-    virtual void delete_waiter(onoff_switch* sw) = 0;
+    //! Registers a completion queue which is notified when the request
+    //! completes. Returns true if it already completed, then the queue is
+    //! not registered.
+    virtual bool add_waiter(completion_queue* queue) = 0;
+    virtual void delete_waiter(completion_queue* queue) = 0;
 
 protected:
     virtual void notify_waiters() = 0;
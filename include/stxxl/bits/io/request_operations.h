@@ -16,9 +16,9 @@
 #define STXXL_IO_REQUEST_OPERATIONS_HEADER
 
 #include <stxxl/bits/namespace.h>
+#include <stxxl/bits/io/completion_queue.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/io/iostats.h>
-#include <stxxl/bits/common/onoff_switch.h>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -33,8 +33,32 @@ STXXL_BEGIN_NAMESPACE
 template <class RequestIterator>
 void wait_all(RequestIterator reqs_begin, RequestIterator reqs_end)
 {
+    {
+        completion_queue queue;
+        bool reads = false, writes = false;
+        for (RequestIterator cur = reqs_begin; cur != reqs_end; ++cur)
+        {
+            request_ptr req(*cur);
+            if (req->get_type() == request::READ)
+                reads = true;
+            else
+                writes = true;
+            queue.watch(req);
+        }
+
+        // account the time like request::wait() if all requests are alike
+        stats::scoped_wait_timer wait_timer(
+            !writes ? stats::WAIT_OP_READ :
+            !reads ? stats::WAIT_OP_WRITE : stats::WAIT_OP_ANY,
+            reads || writes);
+
+        while (request_ptr req = queue.wait())
+            req->check_errors();
+    }
+
+    // the requests are done, wait until they released their files
     for ( ; reqs_begin != reqs_end; ++reqs_begin)
-        (request_ptr(*reqs_begin))->wait();
+        (request_ptr(*reqs_begin))->wait(false);
 }
 
 //! Suspends calling thread until \b all given requests are completed.
@@ -105,41 +129,26 @@ RequestIterator wait_any(RequestIterator reqs_begin, RequestIterator reqs_end)
 {
     stats::scoped_wait_timer wait_timer(stats::WAIT_OP_ANY);
 
-    onoff_switch sw;
-
-    RequestIterator cur = reqs_begin, result = reqs_end;
-
-    for ( ; cur != reqs_end; cur++)
+    completion_queue queue;
+    for (RequestIterator cur = reqs_begin; cur != reqs_end; ++cur)
     {
-        if ((request_ptr(*cur))->add_waiter(&sw))
-        {
-            // request is already done, no waiter was added to the request
-            result = cur;
-
-            if (cur != reqs_begin)
-            {
-                while (--cur != reqs_begin)
-                    (request_ptr(*cur))->delete_waiter(&sw);
-
-                (request_ptr(*cur))->delete_waiter(&sw);
-            }
-
-            (request_ptr(*result))->check_errors();
-
-            return result;
-        }
+        queue.watch(request_ptr(*cur));
+        if (queue.num_completed() != 0)
+            break;
     }
 
-    sw.wait_for_on();
+    request_ptr done = queue.wait();
+    if (!done)
+        return reqs_end;
 
-    for (cur = reqs_begin; cur != reqs_end; cur++)
+    for ( ; reqs_begin != reqs_end; ++reqs_begin)
     {
-        (request_ptr(*cur))->delete_waiter(&sw);
-        if (result == reqs_end && (request_ptr(*cur))->poll())
-            result = cur;
+        if (request_ptr(*reqs_begin) == done)
+            break;
     }
+    done->check_errors();
 
-    return result;
+    return reqs_begin;
 }
 
 //! Suspends calling thread until \b any of requests is completed.
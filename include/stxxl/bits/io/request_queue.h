@@ -30,9 +30,18 @@ public:
 
 public:
     virtual void add_request(request_ptr& req) = 0;
+    //! Add a range of requests at once. Implementations should take their
+    //! locks and wake their worker only once per batch.
+    virtual void add_requests(request_ptr* begin, request_ptr* end)
+    {
+        for ( ; begin != end; ++begin)
+            add_request(*begin);
+    }
     virtual bool cancel_request(request_ptr& req) = 0;
     virtual ~request_queue() noexcept(false) { }
     virtual void set_priority_op(priority_op p) { STXXL_UNUSED(p); }
+    //! Pin the queue's threads to the CPUs of a NUMA node.
+    virtual void set_numa_node(int node) { STXXL_UNUSED(node); }
 };
 
 //! \}
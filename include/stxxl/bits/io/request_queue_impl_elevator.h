@@ -0,0 +1,105 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/request_queue_impl_elevator.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_REQUEST_QUEUE_IMPL_ELEVATOR_HEADER
+#define STXXL_IO_REQUEST_QUEUE_IMPL_ELEVATOR_HEADER
+
+#include <deque>
+#include <map>
+
+#include <stxxl/bits/io/request_queue_impl_worker.h>
+#include <stxxl/bits/common/mutex.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup reqlayer
+//! \{
+
+//! Implementation of a local request queue which serves pending requests in
+//! the order of their file offsets, like the C-SCAN elevator of a disk.
+//!
+//! The single worker thread sweeps upward through the pending read and write
+//! requests, ordered by file and offset, and restarts at the lowest offset
+//! after serving the highest one. This turns many randomly submitted requests
+//! into mostly ascending accesses, which helps rotating disks and RAID
+//! controllers without own reordering.
+//!
+//! To bound starvation of requests far behind the head position, a request
+//! pending longer than max_delay seconds is served next regardless of its
+//! offset, and the sweep continues from there.
+class request_queue_impl_elevator : public request_queue_impl_worker
+{
+private:
+    typedef request_queue_impl_elevator self;
+
+    //! sort key of pending requests, seq keeps equal offsets in FIFO order
+    struct key_type
+    {
+        file* f;
+        request::offset_type offset;
+        unsigned_type seq;
+
+        bool operator < (const key_type& b) const
+        {
+            if (f != b.f) return f < b.f;
+            if (offset != b.offset) return offset < b.offset;
+            return seq < b.seq;
+        }
+    };
+
+    struct entry_type
+    {
+        request_ptr req;
+        //! timestamp() after which the request is served next
+        double deadline;
+    };
+
+    typedef std::map<key_type, entry_type> queue_type;
+    //! keys in arrival order, may contain keys of already served requests
+    typedef std::deque<key_type> arrival_type;
+
+    mutex m_queue_mutex;
+    queue_type m_queue;
+    arrival_type m_arrival;
+    //! position of the last served request
+    key_type m_head;
+    //! sequence number of the next submitted request
+    unsigned_type m_seq;
+    double m_max_delay;
+
+    state<thread_state> m_thread_state;
+    thread_type m_thread;
+    semaphore m_sem;
+
+    static void * worker(void* arg);
+
+    //! insert a request into the sweep order, needs m_queue_mutex
+    void insert(request_ptr& req, double now);
+    //! remove the next request to serve and adjacent ones following it,
+    //! returns their number, needs m_queue_mutex
+    size_t next_requests(request_ptr* reqs);
+
+public:
+    // \param n max number of requests simultaneously submitted to disk
+    // \param max_delay seconds after which a pending request is served next
+    request_queue_impl_elevator(int n = 1, double max_delay = 0.5);
+
+    void add_request(request_ptr& req);
+    void add_requests(request_ptr* begin, request_ptr* end);
+    bool cancel_request(request_ptr& req);
+    ~request_queue_impl_elevator();
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_IO_REQUEST_QUEUE_IMPL_ELEVATOR_HEADER
+// vim: et:ts=4:sw=4
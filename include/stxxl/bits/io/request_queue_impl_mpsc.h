@@ -0,0 +1,112 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/request_queue_impl_mpsc.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_REQUEST_QUEUE_IMPL_MPSC_HEADER
+#define STXXL_IO_REQUEST_QUEUE_IMPL_MPSC_HEADER
+
+#include <stxxl/bits/config.h>
+
+#if STXXL_HAVE_FUTEX
+
+#include <deque>
+
+#include <stxxl/bits/io/request_queue_impl_worker.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup reqlayer
+//! \{
+
+//! Implementation of a local request queue without locks on the submission
+//! path. Like request_queue_impl_qwqr it serves write requests before read
+//! requests with a single worker thread.
+//!
+//! Submitting threads push requests onto one of two lock-free stacks with a
+//! compare-and-swap. The worker takes each whole stack with one atomic
+//! exchange, reverses it into a private FIFO queue, and sleeps on a futex
+//! when both are empty. The futex is only touched by submitters if the
+//! worker is actually sleeping.
+//!
+//! Pending requests cannot be erased from the stacks, hence cancel_request()
+//! and the worker race to mark the request as dequeued and the worker skips
+//! requests which were canceled. Checking for pending requests to the same
+//! block on submission (STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION) is
+//! not done by this queue.
+class request_queue_impl_mpsc : public request_queue_impl_worker
+{
+private:
+    typedef request_queue_impl_mpsc self;
+
+    //! element of the submission stacks
+    struct node
+    {
+        request_ptr req;
+        node* next;
+    };
+
+    //! \name Shared by Submitters and Worker
+    //! \{
+
+    //! lock-free stacks of submitted requests, newest first
+    node* m_write_stack;
+    node* m_read_stack;
+
+    //! futex word: 1 if the worker is (about to go) sleeping
+    int m_parked;
+
+    //! set to 1 in the destructor to stop the worker
+    int m_terminate;
+
+    //! \}
+
+    //! \name Private to Worker
+    //! \{
+    typedef std::deque<request_ptr> queue_type;
+    queue_type m_write_queue;
+    queue_type m_read_queue;
+    //! \}
+
+    state<thread_state> m_thread_state;
+    thread_type m_thread;
+
+    static void * worker(void* arg);
+    void work();
+
+    //! push a chain of nodes onto a stack with a single compare-and-swap
+    static void push(node*& stack, node* first, node* last);
+    //! move all requests from a stack to the end of a FIFO queue
+    static void drain(node*& stack, queue_type& queue);
+
+    //! race with the worker or cancel_request() to take req, true if won
+    static bool mark_dequeued(const request_ptr& req);
+
+    //! wake the worker if it is sleeping
+    void wakeup();
+    //! put the worker to sleep until wakeup() unless there is work
+    void park();
+
+public:
+    // \param n max number of requests simultaneously submitted to disk
+    request_queue_impl_mpsc(int n = 1);
+
+    void add_request(request_ptr& req);
+    void add_requests(request_ptr* begin, request_ptr* end);
+    bool cancel_request(request_ptr& req);
+    ~request_queue_impl_mpsc();
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_FUTEX
+
+#endif // !STXXL_IO_REQUEST_QUEUE_IMPL_MPSC_HEADER
+// vim: et:ts=4:sw=4
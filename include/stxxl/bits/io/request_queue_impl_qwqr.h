@@ -62,6 +62,7 @@ public:
         STXXL_UNUSED(op);
     }
     void add_request(request_ptr& req);
+    void add_requests(request_ptr* begin, request_ptr* end);
     bool cancel_request(request_ptr& req);
     ~request_queue_impl_qwqr();
 };
@@ -28,7 +28,10 @@
  #error "Thread implementation not detected."
 #endif
 
+#include <vector>
+
 #include <stxxl/bits/io/request_queue.h>
+#include <stxxl/bits/io/serving_request.h>
 #include <stxxl/bits/common/semaphore.h>
 #include <stxxl/bits/common/state.h>
 
@@ -53,9 +56,47 @@ protected:
     typedef pthread_t thread_type;
 #endif
 
+private:
+    //! threads started by start_thread() and not joined yet
+    std::vector<thread_type*> m_threads;
+
 protected:
     void start_thread(void* (*worker)(void*), void* arg, thread_type& t, state<thread_state>& s);
     void stop_thread(thread_type& t, state<thread_state>& s, semaphore& sem);
+    //! join a worker thread which was already told to terminate by other
+    //! means than a semaphore.
+    void join_thread(thread_type& t, state<thread_state>& s);
+
+public:
+    //! Pin all worker threads of the queue to the CPUs of a NUMA node.
+    void set_numa_node(int node);
+
+protected:
+
+    //! Returns true if request b directly continues request a, i.e. both read
+    //! or write the same file and b starts where a ends.
+    static bool is_adjacent(const request_ptr& a, const request_ptr& b)
+    {
+        return a->get_file() == b->get_file() &&
+               a->get_type() == b->get_type() &&
+               a->get_offset() + a->get_size() == b->get_offset();
+    }
+
+    //! Moves the front request of a FIFO queue and up to
+    //! STXXL_MAX_COALESCED_REQUESTS - 1 adjacent successors into reqs, such
+    //! that they can be served with serving_request::serve_coalesced().
+    //! \return number of requests taken from the queue
+    template <typename Queue>
+    static size_t pop_adjacent(Queue& queue, request_ptr* reqs)
+    {
+        size_t n = 0;
+        do {
+            reqs[n++] = queue.front();
+            queue.pop_front();
+        } while (n < STXXL_MAX_COALESCED_REQUESTS && !queue.empty() &&
+                 is_adjacent(reqs[n - 1], queue.front()));
+        return n;
+    }
 };
 
 //! \}
@@ -17,7 +17,6 @@
 #include <set>
 
 #include <stxxl/bits/common/mutex.h>
-#include <stxxl/bits/common/onoff_switch.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/namespace.h>
 
@@ -26,15 +25,17 @@ STXXL_BEGIN_NAMESPACE
 //! \addtogroup reqlayer
 //! \{
 
-//! Request that is aware of threads waiting for it to complete.
+class completion_queue;
+
+//! Request that is aware of completion queues waiting for it to complete.
 class request_with_waiters : public request
 {
     mutex m_waiters_mutex;
-    std::set<onoff_switch*> m_waiters;
+    std::set<completion_queue*> m_waiters;
 
 protected:
-    bool add_waiter(onoff_switch* sw);
-    void delete_waiter(onoff_switch* sw);
+    bool add_waiter(completion_queue* queue);
+    void delete_waiter(completion_queue* queue);
     void notify_waiters();
 
     //! returns number of waiters
@@ -16,6 +16,12 @@
 
 #include <stxxl/bits/io/request_with_state.h>
 
+#ifndef STXXL_MAX_COALESCED_REQUESTS
+//! maximum number of adjacent requests the request queues serve with one I/O
+//! operation, 1 disables coalescing.
+#define STXXL_MAX_COALESCED_REQUESTS 32
+#endif
+
 STXXL_BEGIN_NAMESPACE
 
 //! \addtogroup reqlayer
@@ -28,6 +34,15 @@ class serving_request : public request_with_state
     friend class fileperblock_file;
     friend class request_queue_impl_qwqr;
     friend class request_queue_impl_1q;
+    friend class request_queue_impl_elevator;
+    friend class request_queue_impl_mpsc;
+
+    //! set once the request was taken from a lock-free queue, either for
+    //! serving or by cancel(), since these cannot erase it from the middle.
+    int m_dequeued;
+
+    //! time of submission to the disk queue, for the latency histograms
+    double m_submit_time;
 
 public:
     serving_request(
@@ -41,6 +56,11 @@ public:
 protected:
     virtual void serve();
 
+    //! Serves n requests for adjacent bytes of the same file with a single
+    //! file::serve_vector() call, then completes each of them. An I/O error
+    //! is reported to all n requests.
+    static void serve_coalesced(const request_ptr* reqs, size_t n);
+
 public:
     const char * io_type() const;
 };
@@ -0,0 +1,96 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/stats_sampler.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_STATS_SAMPLER_HEADER
+#define STXXL_IO_STATS_SAMPLER_HEADER
+
+#include <stxxl/bits/config.h>
+
+#if STXXL_STD_THREADS
+ #include <thread>
+#elif STXXL_BOOST_THREADS
+ #include <boost/thread/thread.hpp>
+#elif STXXL_POSIX_THREADS
+ #include <pthread.h>
+#else
+ #error "Thread implementation not detected."
+#endif
+
+#include <fstream>
+#include <string>
+
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/noncopyable.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup iolayer
+//! \{
+
+//! Background thread which periodically appends the change of the I/O
+//! statistics to a file, either as one JSON object per line or as CSV rows
+//! (see stats_data::to_json() and stats_data::to_csv()). A final sample is
+//! written when the sampler is destroyed.
+class stats_sampler : private noncopyable
+{
+public:
+    enum format_type { JSON, CSV };
+
+protected:
+#if STXXL_STD_THREADS
+    typedef std::thread* thread_type;
+#elif STXXL_BOOST_THREADS
+    typedef boost::thread* thread_type;
+#else
+    typedef pthread_t thread_type;
+#endif
+
+    std::ofstream m_out;
+    double m_interval;
+    format_type m_format;
+
+    //! time the sampler was started
+    double m_start;
+    //! statistics at the previous sample
+    stats_data m_last;
+
+    mutex m_mutex;
+    bool m_stop;
+    thread_type m_thread;
+
+    //! write the change since the previous sample
+    void sample();
+
+    static void * worker(void* arg);
+
+public:
+    //! Starts sampling to path every interval seconds.
+    stats_sampler(const std::string& path, double interval,
+                  format_type format = JSON);
+
+    //! Stops the thread and writes a final sample.
+    ~stats_sampler();
+
+    //! Starts a sampler if the environment variable STXXLSTATSFILE names an
+    //! output file, which is written as CSV if it ends with ".csv" and as
+    //! JSON otherwise. STXXLSTATSINTERVAL sets the interval in seconds
+    //! (default: 1).
+    //! \return the new sampler or NULL
+    static stats_sampler * start_from_environment();
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_IO_STATS_SAMPLER_HEADER
+// vim: et:ts=4:sw=4
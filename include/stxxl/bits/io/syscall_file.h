@@ -16,6 +16,7 @@
 #ifndef STXXL_IO_SYSCALL_FILE_HEADER
 #define STXXL_IO_SYSCALL_FILE_HEADER
 
+#include <stxxl/bits/config.h>
 #include <stxxl/bits/io/ufs_file_base.h>
 #include <stxxl/bits/io/disk_queued_file.h>
 
@@ -46,6 +47,12 @@ public:
     { }
     void serve(void* buffer, offset_type offset, size_type bytes,
                request::request_type type);
+#if STXXL_HAVE_PREADV
+    //! Serves adjacent transfers with preadv()/pwritev().
+    void serve_vector(void* const* buffers, const size_type* bytes,
+                      size_t n, offset_type offset,
+                      request::request_type type);
+#endif
     const char * io_type() const;
 };
 
@@ -0,0 +1,194 @@
+/***************************************************************************
+ *  include/stxxl/bits/io/tiered_file.h
+ *
+ *  a pseudo file keeping hot blocks on a fast and cold blocks on a slow
+ *  backend
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_IO_TIERED_FILE_HEADER
+#define STXXL_IO_TIERED_FILE_HEADER
+
+#include <stxxl/bits/config.h>
+
+#if STXXL_STD_THREADS
+ #include <thread>
+#elif STXXL_BOOST_THREADS
+ #include <boost/thread/thread.hpp>
+#elif STXXL_POSIX_THREADS
+ #include <pthread.h>
+#else
+ #error "Thread implementation not detected."
+#endif
+
+#include <map>
+#include <vector>
+
+#include <stxxl/bits/common/condition_variable.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/io/disk_queued_file.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup fileimpl
+//! \{
+
+//! Implementation of file which places blocks on a fast backend (e.g. an
+//! NVMe drive) when they are written and lets a background thread migrate
+//! the least accessed ones to a slow backend (e.g. a RAID of hard disks).
+//!
+//! The slow backend holds every block at its logical offset, blocks on the
+//! fast tier are found through a translation table. The table takes
+//! precedence, thus offsets (and the BIDs of the block_manager) stay valid
+//! when blocks move. Rewriting a block on the slow tier places it on the
+//! fast tier again, if there is room.
+//!
+//! Requests are not served by the file's own disk queue: aread() and
+//! awrite() translate the offset and forward the request to the backend,
+//! whose completion handler completes it. Thus requests on both tiers are in
+//! flight at the same time.
+class tiered_file : public disk_queued_file
+{
+    class tiered_request;
+    struct forward_handler;
+
+#if STXXL_STD_THREADS
+    typedef std::thread* thread_type;
+#elif STXXL_BOOST_THREADS
+    typedef boost::thread* thread_type;
+#else
+    typedef pthread_t thread_type;
+#endif
+
+    //! marks unused addresses
+    static const offset_type unmapped = offset_type(-1);
+
+    //! a block on the fast tier
+    struct fast_block
+    {
+        //! offset in the fast backend
+        offset_type physical;
+        size_type bytes;
+        //! number of reads and writes, halved after each migration pass
+        unsigned accesses;
+        //! sequence number of the last write, to detect writes which raced
+        //! with migrating the block
+        uint64 version;
+        //! number of reads and writes in progress
+        unsigned pins;
+    };
+
+    typedef std::map<offset_type, fast_block> fast_map_type;
+
+    file* m_fast;
+    file* m_slow;
+    offset_type m_size;
+
+    //! protects all of the following
+    mutex m_mutex;
+
+    //! logical offset -> location of the blocks on the fast tier
+    fast_map_type m_fast_blocks;
+    //! capacity of the fast backend, bytes used in it and the end of the
+    //! part of it ever used
+    offset_type m_fast_capacity, m_fast_used, m_fast_end;
+    //! freed regions of the fast backend by size
+    std::map<size_type, std::vector<offset_type> > m_fast_free;
+    //! source of fast_block::version
+    uint64 m_write_seq;
+
+    //! logical offset of the block being migrated, unmapped if none
+    offset_type m_moving;
+    //! signals the end of a migration to writers waiting for the block
+    condition_variable m_moved_cond;
+    //! signals that the last request on a fast region finished, to writers
+    //! of a block of another size waiting to replace the region
+    condition_variable m_unpinned_cond;
+
+    //! wakes the mover when the fast tier fills up or on termination
+    condition_variable m_mover_cond;
+    bool m_mover_stop;
+    thread_type m_mover_thread;
+
+    //! bytes of the fast tier which wake the mover and which it keeps free
+    offset_type m_high_water, m_low_water;
+
+    //! m_mutex has to be acquired by caller
+    offset_type allocate_fast(size_type bytes);
+    //! m_mutex has to be acquired by caller
+    void free_fast(offset_type physical, size_type bytes);
+
+    //! Translates the offset, pins a fast region and forwards the request to
+    //! the backend.
+    request_ptr submit(void* buffer, offset_type offset, size_type bytes,
+                       request::request_type type,
+                       const completion_handler& on_cmpl);
+
+    //! Releases the pin of a request on the fast region physical.
+    void unpin(offset_type offset, offset_type physical);
+
+    //! Copies the block at logical to the slow tier and frees its fast
+    //! region, unless it was written or discarded meanwhile. Returns the
+    //! number of bytes moved.
+    size_type migrate(offset_type logical);
+
+    static void * mover(void* arg);
+
+public:
+    //! Constructs file object.
+    //! \param fast_file backend for recently written blocks, deleted in
+    //! ~tiered_file()
+    //! \param slow_file backend holding all other blocks, deleted in
+    //! ~tiered_file()
+    //! \param fast_capacity number of bytes to use on fast_file
+    //! \param queue_id disk queue identifier
+    //! \param allocator_id linked disk_allocator
+    tiered_file(
+        file* fast_file,
+        file* slow_file,
+        offset_type fast_capacity,
+        int queue_id = DEFAULT_QUEUE,
+        int allocator_id = NO_ALLOCATOR);
+    ~tiered_file();
+    offset_type size();
+    void set_size(offset_type newsize);
+    void lock();
+    request_ptr aread(void* buffer, offset_type pos, size_type bytes,
+                      const completion_handler& on_cmpl = completion_handler());
+    request_ptr awrite(void* buffer, offset_type pos, size_type bytes,
+                       const completion_handler& on_cmpl = completion_handler());
+    void aread_batch(request_ptr* reqs, void* const* buffers,
+                     const offset_type* pos, const size_type* bytes, size_t n,
+                     const completion_handler& on_cmpl = completion_handler());
+    void awrite_batch(request_ptr* reqs, void* const* buffers,
+                      const offset_type* pos, const size_type* bytes, size_t n,
+                      const completion_handler& on_cmpl = completion_handler());
+    void serve(void* buffer, offset_type offset, size_type bytes,
+               request::request_type type);
+    void discard(offset_type offset, offset_type size);
+    void sync();
+    const char * io_type() const;
+
+    //! Migrates the least accessed blocks to the slow tier until at most
+    //! max_fast_bytes are used on the fast tier, and ages the access counts
+    //! of the remaining ones. Returns the number of bytes moved.
+    offset_type demote(offset_type max_fast_bytes);
+
+    //! Returns the number of bytes of blocks on the fast tier.
+    offset_type get_fast_bytes();
+
+    //! Returns true if the block at offset is on the fast tier.
+    bool is_fast(offset_type offset);
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_IO_TIERED_FILE_HEADER
+// vim: et:ts=4:sw=4
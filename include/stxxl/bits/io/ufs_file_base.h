@@ -38,6 +38,7 @@ protected:
     int m_mode;            // open mode
     const std::string filename;
     bool m_is_device;      //!< is special device node
+    bool m_discard;        //!< discard() tells the device about freed regions
     ufs_file_base(const std::string& filename, int mode);
     void _after_open();
     offset_type _size();
@@ -55,6 +56,14 @@ public:
     void unlink();
     //! return true if file is special device node
     bool is_device() const;
+    //! Enables discard(): freed regions are punched out of regular files
+    //! and discarded (TRIM) on raw block devices, if the platform supports
+    //! it.
+    void set_discard(bool enable);
+    //! Deallocates the region on the device if enabled by set_discard(),
+    //! reading it afterwards returns zeros or undefined data.
+    void discard(offset_type offset, offset_type size);
+    void sync();
 };
 
 //! \}
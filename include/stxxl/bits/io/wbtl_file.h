@@ -22,8 +22,23 @@
 
 #if STXXL_HAVE_WBTL_FILE
 
+#include <stxxl/bits/config.h>
+
+#if STXXL_STD_THREADS
+ #include <thread>
+#elif STXXL_BOOST_THREADS
+ #include <boost/thread/thread.hpp>
+#elif STXXL_POSIX_THREADS
+ #include <pthread.h>
+#else
+ #error "Thread implementation not detected."
+#endif
+
 #include <map>
+#include <vector>
 
+#include <stxxl/bits/common/condition_variable.h>
+#include <stxxl/bits/common/mutex.h>
 #include <stxxl/bits/io/disk_queued_file.h>
 
 STXXL_BEGIN_NAMESPACE
@@ -33,51 +48,136 @@ STXXL_BEGIN_NAMESPACE
 
 //! Implementation of file based on buffered writes and block remapping via a
 //! translation layer.
+//!
+//! Blocks are appended to one of several write buffers, each of which fills a
+//! segment of the backend file and is flushed asynchronously once full. The
+//! backend space is managed in segments of the write buffer size, which
+//! become free when all their blocks were discarded or overwritten. A
+//! background thread relocates the live blocks of mostly dead segments to
+//! keep enough free segments for sequential writing.
 class wbtl_file : public disk_queued_file
 {
-    typedef std::pair<offset_type, offset_type> place;
-    typedef std::map<offset_type, offset_type> sortseq;
-    typedef std::map<offset_type, place> place_map;
+#if STXXL_STD_THREADS
+    typedef std::thread* thread_type;
+#elif STXXL_BOOST_THREADS
+    typedef boost::thread* thread_type;
+#else
+    typedef pthread_t thread_type;
+#endif
+
+    //! marks logical addresses without physical block and unused buffers
+    static const offset_type unmapped = offset_type(-1);
+
+    //! Logical to physical address translation. Blocks with the size of the
+    //! first mapped block at offsets aligned to it are kept in a two-level
+    //! radix table indexed by offset / block size, which is compact for the
+    //! usual case of one block size. Other blocks go into a map.
+    class address_table : private stxxl::noncopyable
+    {
+        //! number of index bits resolved in a leaf of the radix table
+        static const unsigned leaf_bits = 12;
+
+        //! size of blocks in the radix table, 0 until the first insert()
+        size_type m_block_size;
+        //! leaves of the radix table, allocated on first use
+        std::vector<offset_type*> m_leaves;
+        //! logical offset -> (physical offset, size) of other blocks
+        std::map<offset_type, std::pair<offset_type, size_type> > m_others;
+
+        //! return the radix table entry of logical or NULL if there is none
+        offset_type * entry(offset_type logical, bool create);
+
+    public:
+        address_table()
+            : m_block_size(0)
+        { }
+
+        ~address_table();
+
+        //! return physical offset of the block at logical, or unmapped
+        offset_type find(offset_type logical, size_type* bytes = NULL);
+
+        //! map the block of bytes at logical to physical
+        void insert(offset_type logical, size_type bytes, offset_type physical);
+
+        //! remove the mapping of logical, returns the previous physical
+        //! offset (or unmapped) and its size.
+        offset_type erase(offset_type logical, size_type* bytes);
+    };
+
+    //! block written into a segment
+    struct segment_block
+    {
+        offset_type logical;
+        offset_type physical;
+        size_type bytes;
+
+        segment_block(offset_type l, offset_type p, size_type b)
+            : logical(l), physical(p), bytes(b)
+        { }
+    };
+
+    //! a region of write_block_size bytes of the backend file
+    struct segment
+    {
+        //! bytes of blocks still mapped into this segment
+        size_type live;
+        //! the segment is held by a write buffer
+        bool buffered;
+        //! incremented when the segment is reused, to detect reads which
+        //! raced with overwriting it
+        unsigned generation;
+        //! the blocks written into the segment since it was last reused
+        std::vector<segment_block> blocks;
+
+        segment()
+            : live(0), buffered(false), generation(0)
+        { }
+    };
+
+    //! a write buffer and the backend segment it fills
+    struct write_buffer
+    {
+        char* data;
+        //! physical offset of the segment or unmapped
+        offset_type address;
+        //! asynchronous write of the buffer to its segment
+        request_ptr flush;
+    };
 
     // the physical disk used as backend
     file* storage;
     offset_type sz;
     size_type write_block_size;
 
+    //! protects the address translation, the segments and the buffers'
+    //! addresses, taken after buffer_mutex
     mutex mapping_mutex;
-    // logical to physical address translation
-    sortseq address_mapping;
-    // physical to (logical address, size) translation
-    place_map reverse_mapping;
-    // list of free (physical) regions
-    sortseq free_space;
-    offset_type free_bytes;
-
-    // the write buffers:
-    // write_buffer[curbuf] is the current write buffer
-    // write_buffer[1-curbuf] is the previous write buffer
-    // buffer_address if the start offset on the backend file
-    // curpos is the next writing position in write_buffer[curbuf]
+    address_table address_mapping;
+    std::vector<segment> segments;
+
+    //! serializes writers and the cleaner, which append to the write buffers
     mutex buffer_mutex;
-    char* write_buffer[2];
-    offset_type buffer_address[2];
-    int curbuf;
+    std::vector<write_buffer> buffers;
+    //! buffers[curbuf] is the current write buffer
+    size_t curbuf;
+    //! the next writing position in buffers[curbuf]
     size_type curpos;
-    request_ptr backend_request;
 
-    struct FirstFit : public std::binary_function<place, offset_type, bool>
-    {
-        bool operator () (
-            const place& entry,
-            const offset_type size) const
-        {
-            return (entry.second >= size);
-        }
-    };
+    //! segment sized buffer to read the live blocks of a segment to clean
+    char* clean_buffer;
+
+    //! the cleaner thread, woken by cleaner_cond when free segments run low
+    thread_type cleaner_thread;
+    condition_variable cleaner_cond;
+    bool cleaner_stop;
 
 public:
     //! Constructs file object.
     //! param backend_file file object used as storage backend, will be deleted in ~wbtl_file()
+    //! param write_buffer_size size of the write buffers and backend segments
+    //! param write_buffers number of write buffers, all but one can be
+    //! flushed in parallel
     wbtl_file(
         file* backend_file,
         size_type write_buffer_size,
@@ -93,15 +193,36 @@ public:
     void discard(offset_type offset, offset_type size);
     const char * io_type() const;
 
+    //! Relocates the live blocks of one segment holding at most max_live
+    //! live bytes and returns false if there is no such segment.
+    bool clean_segment(size_type max_live);
+
+    //! Returns the number of free segments of the backend file.
+    size_t get_free_segments();
+
 private:
-    void _add_free_region(offset_type offset, offset_type size);
+    //! number of free segments reserved for relocating blocks
+    static const size_t cleaner_reserve = 1;
+
+    // mapping_lock has to be acquired by caller
+    size_t count_free_segments() const;
+    // mapping_lock has to be acquired by caller
+    void release_block(offset_type physical, size_type bytes);
+
+    // buffer_lock has to be acquired by caller
+    void append(const void* buffer, offset_type offset, size_type bytes,
+                offset_type relocate_from);
+    // buffer_lock has to be acquired by caller
+    void switch_buffer(bool relocating);
+    // buffer_lock has to be acquired by caller
+    bool clean_segment_locked(size_type max_live);
+
+    static void * cleaner(void* arg);
 
 protected:
     void sread(void* buffer, offset_type offset, size_type bytes);
     void swrite(void* buffer, offset_type offset, size_type bytes);
-    offset_type get_next_write_block();
-    void check_corruption(offset_type region_pos, offset_type region_size,
-                          sortseq::iterator pred, sortseq::iterator succ);
+    offset_type get_next_write_block(bool relocating);
 };
 
 //! \}
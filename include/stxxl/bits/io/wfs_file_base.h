@@ -50,6 +50,7 @@ public:
     offset_type size();
     void set_size(offset_type newsize);
     void lock();
+    void sync();
     const char * io_type() const;
     void close_remove();
 };
@@ -0,0 +1,105 @@
+/***************************************************************************
+ *  include/stxxl/bits/mng/allocation_tag.h
+ *
+ *  accounting and quotas of the disk space allocated per container
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_MNG_ALLOCATION_TAG_HEADER
+#define STXXL_MNG_ALLOCATION_TAG_HEADER
+
+#include <string>
+
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/noncopyable.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup mnglayer
+//! \{
+
+//! Names the disk space allocated by one or more containers.
+//!
+//! While a scoped_allocation_tag is alive, the block_manager accounts all
+//! blocks allocated by its thread to the tag, until they are deleted, and
+//! refuses allocations exceeding the tag's quota with bad_ext_alloc before
+//! touching the disks. The counters are kept by stats under the tag's name,
+//! tags with the same name share them, and they outlive the tag object.
+//!
+//! \code
+//! stxxl::allocation_tag tag("index", 1024 * 1024 * 1024);
+//! {
+//!     stxxl::scoped_allocation_tag scope(tag);
+//!     vector.push_back(x);   // blocks are accounted to "index"
+//! }
+//! std::cout << tag.get_stats().current << std::endl;
+//! \endcode
+class allocation_tag : private noncopyable
+{
+    //! id of the counters in stats
+    unsigned m_id;
+
+public:
+    //! Creates a tag, a non-zero quota replaces the one of other tags with
+    //! the same name.
+    //! \param name name of the counters in stats
+    //! \param quota limit of the allocated bytes, 0 for none
+    explicit allocation_tag(const std::string& name, int64 quota = 0);
+
+    //! Returns the id of the tag's counters, see
+    //! stats_data::get_allocation().
+    unsigned get_id() const
+    { return m_id; }
+
+    //! Sets the limit of the allocated bytes, 0 for none. Blocks already
+    //! allocated are not affected.
+    void set_quota(int64 quota);
+
+    //! Returns a copy of the tag's counters.
+    allocation_stats get_stats() const;
+
+    //! Accounts bytes about to be allocated, throws bad_ext_alloc if they
+    //! exceed the quota.
+    void reserve(int64 bytes);
+
+    //! Accounts bytes which are freed or whose allocation failed.
+    void release(int64 bytes);
+
+    //! Returns the tag of the innermost scoped_allocation_tag of the calling
+    //! thread, or NULL.
+    static allocation_tag * current();
+
+    //! Makes tag the current tag of the calling thread and returns the
+    //! previous one, see scoped_allocation_tag.
+    static allocation_tag * set_current(allocation_tag* tag);
+};
+
+//! Accounts the blocks allocated by the calling thread to a tag for the
+//! lifetime of this object. Scopes may be nested, the innermost one counts.
+class scoped_allocation_tag : private noncopyable
+{
+    allocation_tag* m_previous;
+
+public:
+    explicit scoped_allocation_tag(allocation_tag& tag)
+        : m_previous(allocation_tag::set_current(&tag))
+    { }
+
+    ~scoped_allocation_tag()
+    {
+        allocation_tag::set_current(m_previous);
+    }
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_MNG_ALLOCATION_TAG_HEADER
+// vim: et:ts=4:sw=4
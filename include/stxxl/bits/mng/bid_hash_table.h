@@ -0,0 +1,192 @@
+/***************************************************************************
+ *  include/stxxl/bits/mng/bid_hash_table.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_MNG_BID_HASH_TABLE_HEADER
+#define STXXL_MNG_BID_HASH_TABLE_HEADER
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/common/utils.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup mnglayer
+//! \{
+
+//! Open addressing hash table mapping valid BIDs to values.
+//!
+//! The slots are preallocated by reserve() for a given number of elements, so
+//! insert() and erase() do not allocate as long as the reserved number of
+//! elements is not exceeded. Collisions are resolved by linear probing, and
+//! erase() shifts the following elements back instead of leaving tombstones.
+//! Empty slots are marked by an invalid BID, hence only valid BIDs can be
+//! stored.
+template <typename BidType, typename ValueType>
+class bid_hash_table
+{
+public:
+    typedef BidType bid_type;
+    typedef ValueType value_type;
+
+    struct slot_type
+    {
+        bid_type bid;
+        value_type value;
+    };
+
+protected:
+    //! slots, the number is zero or a power of two
+    std::vector<slot_type> m_slots;
+    //! number of used slots
+    unsigned_type m_size;
+
+    unsigned_type mask() const
+    {
+        return m_slots.size() - 1;
+    }
+
+    unsigned_type home(const bid_type& bid) const
+    {
+        return longhash1(uint64(bid.offset) + reinterpret_cast<uint64>(bid.storage)) & mask();
+    }
+
+    //! returns the slot of bid or the empty slot where it would be inserted
+    unsigned_type probe(const bid_type& bid) const
+    {
+        unsigned_type i = home(bid);
+        while (m_slots[i].bid.valid() && !(m_slots[i].bid == bid))
+            i = (i + 1) & mask();
+        return i;
+    }
+
+    //! reinserts all elements into num_slots slots
+    void rehash(unsigned_type num_slots)
+    {
+        std::vector<slot_type> old_slots(num_slots);
+        std::swap(m_slots, old_slots);
+        for (unsigned_type i = 0; i < old_slots.size(); ++i)
+        {
+            if (old_slots[i].bid.valid())
+                m_slots[probe(old_slots[i].bid)] = old_slots[i];
+        }
+    }
+
+public:
+    bid_hash_table()
+        : m_size(0)
+    { }
+
+    //! Makes room for n elements without further allocation, keeping the
+    //! load factor at most 1/2.
+    void reserve(unsigned_type n)
+    {
+        unsigned_type num_slots = 8;
+        while (num_slots < 2 * n)
+            num_slots *= 2;
+        if (num_slots > m_slots.size())
+            rehash(num_slots);
+    }
+
+    //! Returns the number of elements.
+    unsigned_type size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    //! Returns a pointer to the value stored for bid, or NULL.
+    value_type * find(const bid_type& bid)
+    {
+        if (m_size == 0)
+            return NULL;
+        slot_type& s = m_slots[probe(bid)];
+        return s.bid.valid() ? &s.value : NULL;
+    }
+
+    //! Stores value for bid, replacing a previous value.
+    value_type & insert(const bid_type& bid, const value_type& value)
+    {
+        assert(bid.valid());
+        if (2 * (m_size + 1) > m_slots.size())
+            reserve(std::max<unsigned_type>(m_size + 1, m_slots.size()));
+
+        slot_type& s = m_slots[probe(bid)];
+        if (!s.bid.valid()) {
+            s.bid = bid;
+            ++m_size;
+        }
+        s.value = value;
+        return s.value;
+    }
+
+    //! Removes bid, returns false if it was not stored.
+    bool erase(const bid_type& bid)
+    {
+        if (m_size == 0)
+            return false;
+        unsigned_type i = probe(bid);
+        if (!m_slots[i].bid.valid())
+            return false;
+
+        // shift back following elements whose home slot is not between the
+        // hole and their current slot
+        for (unsigned_type j = (i + 1) & mask(); m_slots[j].bid.valid(); j = (j + 1) & mask())
+        {
+            unsigned_type h = home(m_slots[j].bid);
+            if (((j - h) & mask()) >= ((j - i) & mask())) {
+                m_slots[i] = m_slots[j];
+                i = j;
+            }
+        }
+        m_slots[i] = slot_type();
+        --m_size;
+        return true;
+    }
+
+    //! Removes all elements, keeps the slots.
+    void clear()
+    {
+        std::fill(m_slots.begin(), m_slots.end(), slot_type());
+        m_size = 0;
+    }
+
+    //! Returns the number of slots, for iterating with slot().
+    unsigned_type capacity() const
+    {
+        return m_slots.size();
+    }
+
+    //! Returns slot i, which is unused if its bid is invalid.
+    slot_type & slot(unsigned_type i)
+    {
+        return m_slots[i];
+    }
+
+    void swap(bid_hash_table& obj)
+    {
+        std::swap(m_slots, obj.m_slots);
+        std::swap(m_size, obj.m_size);
+    }
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_MNG_BID_HASH_TABLE_HEADER
+// vim: et:ts=4:sw=4
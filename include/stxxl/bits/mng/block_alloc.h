@@ -15,6 +15,7 @@
 #define STXXL_MNG_BLOCK_ALLOC_HEADER
 
 #include <algorithm>
+#include <vector>
 #include <stxxl/bits/parallel.h>
 #include <stxxl/bits/common/rand.h>
 #include <stxxl/bits/mng/config.h>
@@ -196,6 +197,35 @@ struct RC_flash : public RC
     }
 };
 
+//! Striping over the disks with fileio tiered, which keep new blocks on a
+//! fast device and move them to slower ones when they get cold, see
+//! tiered_file. Uses all disks if none is tiered.
+//! \remarks model of \b allocation_strategy concept
+struct tiered
+{
+    std::vector<unsigned_type> disks;
+
+    tiered()
+    {
+        std::vector<unsigned> t = config::get_instance()->tiered_disks();
+        disks.assign(t.begin(), t.end());
+        if (disks.empty()) {
+            for (unsigned_type i = 0; i < config::get_instance()->disks_number(); ++i)
+                disks.push_back(i);
+        }
+    }
+
+    unsigned_type operator () (unsigned_type i) const
+    {
+        return disks[i % disks.size()];
+    }
+
+    static const char * name()
+    {
+        return "striping on tiered disks";
+    }
+};
+
 //! 'Single disk' disk allocation scheme functor.
 //! \remarks model of \b allocation_strategy concept
 struct single_disk
@@ -119,6 +119,21 @@ struct first_disk_only : public interleaved_striping
     }
 };
 
+struct interleaved_tiered : public interleaved_striping
+{
+    std::vector<unsigned_type> disks;
+
+    interleaved_tiered(int_type _nruns, const tiered& strategy)
+        : interleaved_striping(_nruns, 0, strategy.disks.size()),
+          disks(strategy.disks)
+    { }
+
+    unsigned_type operator () (unsigned_type i) const
+    {
+        return disks[(i / nruns) % diff];
+    }
+};
+
 template <typename scheme>
 struct interleaved_alloc_traits
 { };
@@ -161,6 +176,12 @@ struct interleaved_alloc_traits<RC_flash>
     typedef interleaved_RC strategy;
 };
 
+template <>
+struct interleaved_alloc_traits<tiered>
+{
+    typedef interleaved_tiered strategy;
+};
+
 template <>
 struct interleaved_alloc_traits<single_disk>
 {
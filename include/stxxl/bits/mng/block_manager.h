@@ -38,8 +38,11 @@
 #include <stxxl/bits/io/create_file.h>
 #include <stxxl/bits/noncopyable.h>
 #include <stxxl/bits/singleton.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/mng/allocation_tag.h>
 #include <stxxl/bits/mng/bid.h>
 #include <stxxl/bits/mng/disk_allocator.h>
+#include <stxxl/bits/mng/extent_reservation.h>
 #include <stxxl/bits/mng/block_alloc.h>
 #include <stxxl/bits/mng/config.h>
 #include <stxxl/bits/common/utils.h>
@@ -47,6 +50,9 @@
 
 STXXL_BEGIN_NAMESPACE
 
+class stats_sampler;
+class discard_queue;
+
 #ifndef STXXL_MNG_COUNT_ALLOCATION
 #define STXXL_MNG_COUNT_ALLOCATION 1
 #endif // STXXL_MNG_COUNT_ALLOCATION
@@ -64,10 +70,39 @@ class block_manager : public singleton<block_manager>
 
     disk_allocator** disk_allocators;
     file** disk_files;
+    //! disks configured with the discard option, whose freed blocks are
+    //! discarded and returned to the allocator by m_discard_queue
+    bool* disk_discard;
 
     size_t ndisks;
+
+    //! statistics sampler requested by environment, see
+    //! stats_sampler::start_from_environment()
+    stats_sampler* m_stats_sampler;
+
+    //! background discarding of freed blocks, NULL if no disk has discard
+    discard_queue* m_discard_queue;
+
     block_manager();
 
+    //! Hands a batch of freed regions of disk to m_discard_queue.
+    void submit_discard(size_t disk, std::vector<disk_allocator::place>& regions);
+
+    //! (disk, offset) of a block allocated with an allocation_tag
+    typedef std::pair<size_t, int64> tagged_block;
+    typedef std::map<tagged_block, unsigned> tagged_map_type;
+
+    //! allocation tag ids of the blocks allocated with a tag
+    tagged_map_type m_tagged_blocks;
+    mutex m_tagged_mutex;
+    //! set by the first tagged allocation, until then deleting blocks does
+    //! not look them up
+    bool m_has_tagged_blocks;
+
+    //! Accounts the freed block at offset of disk to its allocation tag, if
+    //! it was allocated with one.
+    void untag_block(size_t disk, int64 offset, int64 bytes);
+
 #if STXXL_MNG_COUNT_ALLOCATION
     //! total requested allocation in bytes
     uint64 m_total_allocation;
@@ -85,7 +120,15 @@ protected:
         const unsigned_type nblocks,
         const DiskAssignFunctor& functor,
         unsigned_type offset,
-        BIDIteratorClass out);
+        BIDIteratorClass out,
+        extent_reservation* extents = NULL);
+
+    //! Discards a block and appends its region to the deallocation batch of
+    //! its disk, see delete_blocks().
+    template <unsigned BlockSize>
+    void collect_block(
+        const BID<BlockSize>& bid,
+        simple_vector<std::vector<disk_allocator::place> >& regions);
 
 public:
     //! return total number of bytes available in all disks
@@ -94,6 +137,29 @@ public:
     //! Return total number of free disk allocations
     uint64 get_free_bytes() const;
 
+    //! Waits until the blocks freed on disks with the discard option are
+    //! returned to their allocators.
+    //! \return true if there were pending discards
+    bool wait_discards();
+
+    //! return number of disks managed
+    size_t get_ndisks() const
+    { return ndisks; }
+
+    //! return the file of disk i, its device id identifies the disk's
+    //! counters in stats_data::get_disk()
+    file * get_disk_file(size_t i) const
+    { return disk_files[i]; }
+
+    //! return number of bytes available in disk i
+    uint64 get_disk_total_bytes(size_t i) const;
+
+    //! return number of free bytes in disk i
+    uint64 get_disk_free_bytes(size_t i) const;
+
+    //! return number of bytes allocated in disk i
+    uint64 get_disk_allocated_bytes(size_t i) const;
+
     //! Allocates new blocks.
     //!
     //! Allocates new blocks according to the strategy
@@ -116,6 +182,27 @@ public:
         new_blocks_int<bid_type>(std::distance(bidbegin, bidend), functor, offset, bidbegin);
     }
 
+    //! Allocates new blocks like new_blocks() above, but takes them from
+    //! contiguous per-disk extents held by \b extents, which are reserved and
+    //! grown as needed. A container that repeatedly allocates a few blocks
+    //! thus gets sequential offsets on each disk.
+    //! \param functor object of model of \b allocation_strategy concept
+    //! \param bidbegin bidirectional BID iterator object
+    //! \param bidend bidirectional BID iterator object
+    //! \param offset advance for \b functor to line up partial allocations
+    //! \param extents the container's reservation of extents
+    template <class DiskAssignFunctor, class BIDIteratorClass>
+    void new_blocks(
+        const DiskAssignFunctor& functor,
+        BIDIteratorClass bidbegin,
+        BIDIteratorClass bidend,
+        unsigned_type offset,
+        extent_reservation& extents)
+    {
+        typedef typename std::iterator_traits<BIDIteratorClass>::value_type bid_type;
+        new_blocks_int<bid_type>(std::distance(bidbegin, bidend), functor, offset, bidbegin, &extents);
+    }
+
     //! Allocates new blocks according to the strategy
     //! given by \b functor and stores block identifiers
     //! to the output iterator \b out
@@ -154,7 +241,10 @@ public:
 
     //! Deallocates blocks.
     //!
-    //! Deallocates blocks in the range [ \b bidbegin, \b bidend)
+    //! Deallocates blocks in the range [ \b bidbegin, \b bidend). The blocks
+    //! are returned to each disk's allocator in one sorted batch. On disks
+    //! with the discard option, the batch is discarded on the device by a
+    //! background thread first and counts as free only afterwards.
     //! \param bidbegin iterator object of \b bid_iterator concept
     //! \param bidend iterator object of \b bid_iterator concept
     template <class BIDIteratorClass>
@@ -187,7 +277,8 @@ void block_manager::new_blocks_int(
     const unsigned_type nblocks,
     const DiskAssignFunctor& functor,
     unsigned_type offset,
-    OutputIterator out)
+    OutputIterator out,
+    extent_reservation* extents)
 {
     typedef BIDType bid_type;
     typedef BIDArray<bid_type::t_size> bid_array_type;
@@ -206,6 +297,11 @@ void block_manager::new_blocks_int(
         bl[disk]++;
     }
 
+    // check the quota of the current tag before touching the disks
+    allocation_tag* tag = allocation_tag::current();
+    if (tag)
+        tag->reserve(nblocks * BIDType::size);
+
     // allocate blocks on disks
 
     for (unsigned_type i = 0; i < ndisks; ++i)
@@ -213,7 +309,44 @@ void block_manager::new_blocks_int(
         if (bl[i])
         {
             disk_bids[i].resize(bl[i]);
-            disk_allocators[i]->new_blocks(disk_bids[i]);
+            try
+            {
+                if (extents)
+                    extents->new_blocks(i, disk_allocators[i], disk_bids[i]);
+                else
+                    disk_allocators[i]->new_blocks(disk_bids[i]);
+            }
+            catch (bad_ext_alloc&)
+            {
+                // freed blocks may still be held by pending discards
+                if (!wait_discards()) {
+                    if (tag) tag->release(nblocks * BIDType::size);
+                    throw;
+                }
+                try
+                {
+                    if (extents)
+                        extents->new_blocks(i, disk_allocators[i], disk_bids[i]);
+                    else
+                        disk_allocators[i]->new_blocks(disk_bids[i]);
+                }
+                catch (bad_ext_alloc&)
+                {
+                    if (tag) tag->release(nblocks * BIDType::size);
+                    throw;
+                }
+            }
+        }
+    }
+
+    if (tag)
+    {
+        scoped_mutex_lock lock(m_tagged_mutex);
+        m_has_tagged_blocks = true;
+        for (unsigned_type i = 0; i < ndisks; ++i)
+        {
+            for (unsigned_type j = 0; j < disk_bids[i].size(); ++j)
+                m_tagged_blocks[tagged_block(i, disk_bids[i][j].offset)] = tag->get_id();
         }
     }
 
@@ -246,8 +379,20 @@ void block_manager::delete_block(const BID<BlockSize>& bid)
         return;  // self managed disk
     STXXL_VERBOSE_BLOCK_LIFE_CYCLE("BLC:delete " << FMT_BID(bid));
     assert(bid.storage->get_allocator_id() >= 0);
-    disk_allocators[bid.storage->get_allocator_id()]->delete_block(bid);
-    disk_files[bid.storage->get_allocator_id()]->discard(bid.offset, bid.size);
+    const int disk = bid.storage->get_allocator_id();
+    if (disk_discard[disk]) {
+        std::vector<disk_allocator::place> regions(
+            1, disk_allocator::place(bid.offset, bid.size));
+        submit_discard(disk, regions);
+    }
+    else {
+        disk_allocators[disk]->delete_block(bid);
+        disk_files[disk]->discard(bid.offset, bid.size);
+    }
+    if (m_has_tagged_blocks)
+        untag_block(disk, bid.offset, bid.size);
+    if (block_checksums* checksums = disk_files[disk]->get_checksums())
+        checksums->forget(bid.offset, bid.size);
 
 #if STXXL_MNG_COUNT_ALLOCATION
     m_current_allocation -= BlockSize;
@@ -259,10 +404,48 @@ void block_manager::delete_blocks(
     const BIDIteratorClass& bidbegin,
     const BIDIteratorClass& bidend)
 {
+    // collect the regions per disk to free each batch with a single lock
+    simple_vector<std::vector<disk_allocator::place> > regions(ndisks);
+
     for (BIDIteratorClass it = bidbegin; it != bidend; it++)
     {
-        delete_block(*it);
+        collect_block(*it, regions);
     }
+
+    for (unsigned_type i = 0; i < ndisks; ++i)
+    {
+        if (regions[i].empty())
+            continue;
+        if (disk_discard[i])
+            submit_discard(i, regions[i]);
+        else
+            disk_allocators[i]->delete_regions(regions[i]);
+    }
+}
+
+template <unsigned BlockSize>
+void block_manager::collect_block(
+    const BID<BlockSize>& bid,
+    simple_vector<std::vector<disk_allocator::place> >& regions)
+{
+    if (!bid.valid() || !bid.is_managed())
+        return;
+    STXXL_VERBOSE_BLOCK_LIFE_CYCLE("BLC:delete " << FMT_BID(bid));
+    assert(bid.storage->get_allocator_id() >= 0);
+    const int disk = bid.storage->get_allocator_id();
+    // discard before the region can be handed out again, which the discard
+    // queue does in the background if enabled
+    if (!disk_discard[disk])
+        disk_files[disk]->discard(bid.offset, bid.size);
+    regions[disk].push_back(disk_allocator::place(bid.offset, bid.size));
+    if (m_has_tagged_blocks)
+        untag_block(disk, bid.offset, bid.size);
+    if (block_checksums* checksums = disk_files[disk]->get_checksums())
+        checksums->forget(bid.offset, bid.size);
+
+#if STXXL_MNG_COUNT_ALLOCATION
+    m_current_allocation -= BlockSize;
+#endif // STXXL_MNG_COUNT_ALLOCATION
 }
 
 // in bytes
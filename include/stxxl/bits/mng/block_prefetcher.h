@@ -15,12 +15,15 @@
 #ifndef STXXL_MNG_BLOCK_PREFETCHER_HEADER
 #define STXXL_MNG_BLOCK_PREFETCHER_HEADER
 
+#include <algorithm>
 #include <vector>
 #include <queue>
 
 #include <stxxl/bits/common/onoff_switch.h>
+#include <stxxl/bits/common/timer.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/io/iouring_queue.h>
 #include <stxxl/bits/noncopyable.h>
 
 STXXL_BEGIN_NAMESPACE
@@ -51,6 +54,12 @@ public:
 //!
 //! \c block_prefetcher overlaps I/Os with consumption of read data.
 //! Utilizes optimal asynchronous prefetch scheduling (by Peter Sanders et.al.)
+//!
+//! In adaptive mode, see set_adaptive(), the number of buffers with reads in
+//! flight follows the time the consumer waits for blocks: it grows up to a
+//! maximum while waiting takes a noticeable share of the time, and shrinks
+//! back to the number the prefetch sequence was computed for when it does
+//! not.
 template <typename BlockType, typename BidIteratorType>
 class block_prefetcher : private noncopyable
 {
@@ -60,6 +69,11 @@ public:
 
     typedef typename block_type::bid_type bid_type;
 
+    //! adaptive mode: grow if the consumer waited this fraction of the time
+    static const double grow_wait_fraction;
+    //! adaptive mode: shrink if the consumer waited less than this fraction
+    static const double shrink_wait_fraction;
+
 protected:
     bid_iterator_type consume_seq_begin;
     bid_iterator_type consume_seq_end;
@@ -70,20 +84,45 @@ protected:
     unsigned_type nextread;
     unsigned_type nextconsume;
 
-    const int_type nreadblocks;
-
-    block_type* read_buffers;
-    request_ptr* read_reqs;
-    bid_type* read_bids;
+    //! number of buffers the prefetch sequence was computed for, never
+    //! fewer buffers are used
+    const int_type min_readblocks;
+    //! adaptive mode: most buffers to use, equal to min_readblocks otherwise
+    int_type max_readblocks;
+    //! number of buffers to use, adapted between min and max
+    int_type target_readblocks;
+    //! number of allocated buffers
+    int_type nreadblocks;
+
+    //! buffer slots, NULL if the buffer was released after shrinking
+    std::vector<block_type*> read_buffers;
+    std::vector<request_ptr> read_reqs;
+    std::vector<bid_type> read_bids;
 
     onoff_switch* completed;
     int_type* pref_buffer;
 
     completion_handler do_after_fetch;
 
+    //! adaptive mode: pulls, wait time and start of the current window
+    int_type window_pulls;
+    double window_wait;
+    double window_start;
+
     block_type * wait(int_type iblock)
     {
         STXXL_VERBOSE1("block_prefetcher: waiting block " << iblock);
+        if (max_readblocks > min_readblocks)
+        {
+            double start = timestamp();
+            {
+                stats::scoped_wait_timer wait_timer(stats::WAIT_OP_READ);
+
+                completed[iblock].wait_for_on();
+            }
+            adapt(timestamp() - start);
+        }
+        else
         {
             stats::scoped_wait_timer wait_timer(stats::WAIT_OP_READ);
 
@@ -92,8 +131,73 @@ protected:
         STXXL_VERBOSE1("block_prefetcher: finished waiting block " << iblock);
         int_type ibuffer = pref_buffer[iblock];
         STXXL_VERBOSE1("block_prefetcher: returning buffer " << ibuffer);
-        assert(ibuffer >= 0 && ibuffer < nreadblocks);
-        return (read_buffers + ibuffer);
+        assert(ibuffer >= 0 && ibuffer < int_type(read_buffers.size()));
+        return read_buffers[ibuffer];
+    }
+
+    //! Adjusts target_readblocks once per window of target_readblocks pulls
+    //! by the fraction of the window spent waiting.
+    void adapt(double waited)
+    {
+        window_wait += waited;
+        if (++window_pulls < target_readblocks)
+            return;
+
+        double now = timestamp();
+        double elapsed = now - window_start;
+        if (window_wait > grow_wait_fraction * elapsed)
+            target_readblocks = STXXL_MIN(max_readblocks,
+                                          target_readblocks + STXXL_MAX(int_type(1), target_readblocks / 2));
+        else if (window_wait < shrink_wait_fraction * elapsed)
+            target_readblocks = STXXL_MAX(min_readblocks, target_readblocks - 1);
+        STXXL_VERBOSE1("block_prefetcher: waited " << window_wait << " of " << elapsed <<
+                       " s, now using " << target_readblocks << " buffers");
+
+        window_pulls = 0;
+        window_wait = 0.0;
+        window_start = now;
+    }
+
+    //! Issues the read of the next block of the prefetch sequence into
+    //! buffer ibuffer.
+    void issue_read(int_type ibuffer)
+    {
+        int_type next_2_prefetch = prefetch_seq[nextread++];
+        STXXL_VERBOSE1("block_prefetcher: prefetching block " << next_2_prefetch <<
+                       " into buffer " << ibuffer);
+
+        assert((next_2_prefetch < int_type(seq_length)) && (next_2_prefetch >= 0));
+        assert(!completed[next_2_prefetch].is_on());
+
+        pref_buffer[next_2_prefetch] = ibuffer;
+        read_bids[ibuffer] = *(consume_seq_begin + next_2_prefetch);
+        read_reqs[ibuffer] = read_buffers[ibuffer]->read(
+            read_bids[ibuffer],
+            set_switch_handler(*(completed + next_2_prefetch), do_after_fetch));
+    }
+
+    //! Allocates a buffer in a free slot and returns its index.
+    int_type allocate_buffer()
+    {
+        int_type ibuffer = 0;
+        while (read_buffers[ibuffer] != NULL)
+            ++ibuffer;
+        read_buffers[ibuffer] = new block_type;
+#if STXXL_HAVE_IOURING_FILE
+        iouring_queue::register_buffer(read_buffers[ibuffer], sizeof(block_type));
+#endif
+        ++nreadblocks;
+        return ibuffer;
+    }
+
+    //! Frees the buffer in slot ibuffer, its read must have completed.
+    void free_buffer(int_type ibuffer)
+    {
+#if STXXL_HAVE_IOURING_FILE
+        iouring_queue::unregister_buffer(read_buffers[ibuffer]);
+#endif
+        delete read_buffers[ibuffer];
+        read_buffers[ibuffer] = NULL;
     }
 
 public:
@@ -114,40 +218,55 @@ public:
           consume_seq_end(_cons_end),
           seq_length(_cons_end - _cons_begin),
           prefetch_seq(_pref_seq),
-          nextread(STXXL_MIN(unsigned_type(_prefetch_buf_size), seq_length)),
+          nextread(0),
           nextconsume(0),
-          nreadblocks(nextread),
-          do_after_fetch(do_after_fetch)
+          min_readblocks(STXXL_MIN(unsigned_type(_prefetch_buf_size), seq_length)),
+          max_readblocks(min_readblocks),
+          target_readblocks(min_readblocks),
+          nreadblocks(0),
+          read_buffers(min_readblocks, (block_type*)NULL),
+          read_reqs(min_readblocks),
+          read_bids(min_readblocks),
+          do_after_fetch(do_after_fetch),
+          window_pulls(0),
+          window_wait(0.0),
+          window_start(0.0)
     {
         STXXL_VERBOSE1("block_prefetcher: seq_length=" << seq_length);
         STXXL_VERBOSE1("block_prefetcher: _prefetch_buf_size=" << _prefetch_buf_size);
         assert(seq_length > 0);
         assert(_prefetch_buf_size > 0);
-        int_type i;
-        read_buffers = new block_type[nreadblocks];
-        read_reqs = new request_ptr[nreadblocks];
-        read_bids = new bid_type[nreadblocks];
         pref_buffer = new int_type[seq_length];
 
         std::fill(pref_buffer, pref_buffer + seq_length, -1);
 
         completed = new onoff_switch[seq_length];
 
-        for (i = 0; i < nreadblocks; ++i)
-        {
-            assert(prefetch_seq[i] < int_type(seq_length));
-            assert(prefetch_seq[i] >= 0);
-            read_bids[i] = *(consume_seq_begin + prefetch_seq[i]);
-            STXXL_VERBOSE1("block_prefetcher: reading block " << i <<
-                           " prefetch_seq[" << i << "]=" << prefetch_seq[i] <<
-                           " @ " << &read_buffers[i] <<
-                           " @ " << read_bids[i]);
-            read_reqs[i] = read_buffers[i].read(
-                read_bids[i],
-                set_switch_handler(*(completed + prefetch_seq[i]), do_after_fetch));
-            pref_buffer[prefetch_seq[i]] = i;
-        }
+        for (int_type i = 0; i < min_readblocks; ++i)
+            issue_read(allocate_buffer());
+    }
+
+    //! Enables the adaptive mode, which uses up to max_buffers buffers, but
+    //! no fewer than given to the constructor.
+    void set_adaptive(int_type max_buffers)
+    {
+        max_readblocks = STXXL_MAX(min_readblocks,
+                                   STXXL_MIN(max_buffers, int_type(seq_length)));
+        target_readblocks = STXXL_MIN(target_readblocks, max_readblocks);
+        read_buffers.resize(max_readblocks, NULL);
+        read_reqs.resize(max_readblocks);
+        read_bids.resize(max_readblocks);
+        window_pulls = 0;
+        window_wait = 0.0;
+        window_start = timestamp();
     }
+
+    //! Number of buffers currently allocated.
+    int_type num_buffers() const
+    {
+        return nreadblocks;
+    }
+
     //! Pulls next unconsumed block from the consumption sequence.
     //! \return Pointer to the already prefetched block from the internal buffer pool
     block_type * pull_block()
@@ -162,7 +281,9 @@ public:
     //! \return \c false if there are no blocks to prefetch left, \c true if consumption sequence is not emptied
     bool block_consumed(block_type*& buffer)
     {
-        int_type ibuffer = buffer - read_buffers;
+        int_type ibuffer = std::find(read_buffers.begin(), read_buffers.end(), buffer)
+                           - read_buffers.begin();
+        assert(ibuffer >= 0 && ibuffer < int_type(read_buffers.size()));
         STXXL_VERBOSE1("block_prefetcher: buffer " << ibuffer << " consumed");
         if (read_reqs[ibuffer].valid())
             read_reqs[ibuffer]->wait();
@@ -171,19 +292,19 @@ public:
 
         if (nextread < seq_length)
         {
-            assert(ibuffer >= 0 && ibuffer < nreadblocks);
-            int_type next_2_prefetch = prefetch_seq[nextread++];
-            STXXL_VERBOSE1("block_prefetcher: prefetching block " << next_2_prefetch);
-
-            assert((next_2_prefetch < int_type(seq_length)) && (next_2_prefetch >= 0));
-            assert(!completed[next_2_prefetch].is_on());
-
-            pref_buffer[next_2_prefetch] = ibuffer;
-            read_bids[ibuffer] = *(consume_seq_begin + next_2_prefetch);
-            read_reqs[ibuffer] = read_buffers[ibuffer].read(
-                read_bids[ibuffer],
-                set_switch_handler(*(completed + next_2_prefetch), do_after_fetch)
-                );
+            if (nreadblocks > target_readblocks)
+            {
+                // shrinking: release the buffer instead of reusing it
+                free_buffer(ibuffer);
+                --nreadblocks;
+            }
+            else
+            {
+                issue_read(ibuffer);
+            }
+
+            while (nreadblocks < target_readblocks && nextread < seq_length)
+                issue_read(allocate_buffer());
         }
 
         if (nextconsume >= seq_length)
@@ -210,18 +331,24 @@ public:
     //! Frees used memory.
     ~block_prefetcher()
     {
-        for (int_type i = 0; i < nreadblocks; ++i)
+        for (size_t i = 0; i < read_buffers.size(); ++i)
             if (read_reqs[i].valid())
                 read_reqs[i]->wait();
 
-        delete[] read_reqs;
-        delete[] read_bids;
         delete[] completed;
         delete[] pref_buffer;
-        delete[] read_buffers;
+        for (size_t i = 0; i < read_buffers.size(); ++i)
+            if (read_buffers[i])
+                free_buffer(i);
     }
 };
 
+template <typename BlockType, typename BidIteratorType>
+const double block_prefetcher<BlockType, BidIteratorType>::grow_wait_fraction = 0.05;
+
+template <typename BlockType, typename BidIteratorType>
+const double block_prefetcher<BlockType, BidIteratorType>::shrink_wait_fraction = 0.005;
+
 //! \}
 
 STXXL_END_NAMESPACE
@@ -58,7 +58,11 @@ public:
     //! \param begin \c bid_iterator pointing to the first block of the stream
     //! \param end \c bid_iterator pointing to the ( \b last + 1 ) block of the stream
     //! \param nbuffers number of buffers for internal use
-    buf_istream(bid_iterator_type begin, bid_iterator_type end, unsigned_type nbuffers)
+    //! \param max_nbuffers if larger than nbuffers, the number of buffers
+    //!        adapts to the time spent waiting for reads and grows up to this
+    //!        value, see block_prefetcher::set_adaptive()
+    buf_istream(bid_iterator_type begin, bid_iterator_type end, unsigned_type nbuffers,
+                unsigned_type max_nbuffers = 0)
         : current_elem(0)
 #ifdef BUF_ISTREAM_CHECK_END
           , not_finished(true)
@@ -79,6 +83,8 @@ public:
                                   nbuffers, mdevid);
 
         prefetcher = new prefetcher_type(begin, end, prefetch_seq, nbuffers);
+        if (max_nbuffers > nbuffers)
+            prefetcher->set_adaptive(max_nbuffers);
 
         current_blk = prefetcher->pull_block();
     }
@@ -134,6 +140,12 @@ public:
         return *current_blk;
     }
 
+    //! Returns the number of buffers currently used for reading ahead
+    int_type num_buffers() const
+    {
+        return prefetcher->num_buffers();
+    }
+
     //! Reads the next block (do not intermix with operator++ !)
     void next_block()
     {
@@ -65,7 +65,11 @@ public:
     //! \param begin \c bid_iterator pointing to the first block of the stream
     //! \param end \c bid_iterator pointing to the ( \b last + 1 ) block of the stream
     //! \param nbuffers number of buffers for internal use
-    buf_istream_reverse(bid_iterator_type begin, bid_iterator_type end, int_type nbuffers)
+    //! \param max_nbuffers if larger than nbuffers, the number of buffers
+    //!        adapts to the time spent waiting for reads and grows up to this
+    //!        value, see block_prefetcher::set_adaptive()
+    buf_istream_reverse(bid_iterator_type begin, bid_iterator_type end, int_type nbuffers,
+                        int_type max_nbuffers = 0)
         : current_elem(0),
 #ifdef BUF_ISTREAM_CHECK_END
           not_finished(true),
@@ -88,6 +92,8 @@ public:
 
         // create stream prefetcher
         prefetcher = new prefetcher_type(bids_.begin(), bids_.end(), prefetch_seq, nbuffers);
+        if (max_nbuffers > nbuffers)
+            prefetcher->set_adaptive(max_nbuffers);
 
         // fetch block: last in sequence
         current_blk = prefetcher->pull_block();
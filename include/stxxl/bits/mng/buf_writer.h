@@ -17,6 +17,7 @@
 #include <queue>
 
 #include <stxxl/bits/io/request_operations.h>
+#include <stxxl/bits/io/request_batch.h>
 #include <stxxl/bits/io/disk_queues.h>
 #include <stxxl/bits/noncopyable.h>
 
@@ -76,6 +77,10 @@ public:
           writebatchsize(write_batch_size ? write_batch_size : 1)
     {
         write_buffers = new block_type[nwriteblocks];
+#if STXXL_HAVE_IOURING_FILE
+        // the buffers are written repeatedly, let io_uring pin them once
+        iouring_queue::register_buffer(write_buffers, nwriteblocks * sizeof(block_type));
+#endif
         write_reqs = new request_ptr[nwriteblocks];
 
         write_bids = new bid_type[nwriteblocks];
@@ -131,7 +136,8 @@ public:
     {
         if (batch_write_blocks.size() >= writebatchsize)
         {
-            // flush batch
+            // flush batch, submitting all requests at once
+            request_batch batch;
             while (!batch_write_blocks.empty())
             {
                 int_type ibuffer = batch_write_blocks.top().ibuffer;
@@ -140,10 +146,11 @@ public:
                 if (write_reqs[ibuffer].valid())
                     write_reqs[ibuffer]->wait();
 
-                write_reqs[ibuffer] = write_buffers[ibuffer].write(write_bids[ibuffer]);
+                write_buffers[ibuffer].write(write_bids[ibuffer], batch, write_reqs[ibuffer]);
 
                 busy_write_blocks.push_back(ibuffer);
             }
+            batch.submit();
         }
         //    STXXL_MSG("Adding write request to batch");
 
@@ -157,6 +164,7 @@ public:
     void flush()
     {
         int_type ibuffer;
+        request_batch batch;
         while (!batch_write_blocks.empty())
         {
             ibuffer = batch_write_blocks.top().ibuffer;
@@ -165,10 +173,11 @@ public:
             if (write_reqs[ibuffer].valid())
                 write_reqs[ibuffer]->wait();
 
-            write_reqs[ibuffer] = write_buffers[ibuffer].write(write_bids[ibuffer]);
+            write_buffers[ibuffer].write(write_bids[ibuffer], batch, write_reqs[ibuffer]);
 
             busy_write_blocks.push_back(ibuffer);
         }
+        batch.submit();
         for (std::vector<int_type>::const_iterator it =
                  busy_write_blocks.begin();
              it != busy_write_blocks.end(); it++)
@@ -189,6 +198,7 @@ public:
     ~buffered_writer()
     {
         int_type ibuffer;
+        request_batch batch;
         while (!batch_write_blocks.empty())
         {
             ibuffer = batch_write_blocks.top().ibuffer;
@@ -197,10 +207,11 @@ public:
             if (write_reqs[ibuffer].valid())
                 write_reqs[ibuffer]->wait();
 
-            write_reqs[ibuffer] = write_buffers[ibuffer].write(write_bids[ibuffer]);
+            write_buffers[ibuffer].write(write_bids[ibuffer], batch, write_reqs[ibuffer]);
 
             busy_write_blocks.push_back(ibuffer);
         }
+        batch.submit();
         for (std::vector<int_type>::const_iterator it =
                  busy_write_blocks.begin();
              it != busy_write_blocks.end(); it++)
@@ -210,6 +221,9 @@ public:
         }
 
         delete[] write_reqs;
+#if STXXL_HAVE_IOURING_FILE
+        iouring_queue::unregister_buffer(write_buffers);
+#endif
         delete[] write_buffers;
         delete[] write_bids;
     }
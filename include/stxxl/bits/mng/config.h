@@ -83,6 +83,15 @@ public:
     //! direct ON, fail if unavailable.
     enum direct_type { DIRECT_OFF = 0, DIRECT_TRY = 1, DIRECT_ON = 2 } direct;
 
+    //! tell the device about freed blocks: punch holes into files and issue
+    //! BLKDISCARD (TRIM) on raw devices. Done asynchronously in batches by
+    //! block_manager.
+    bool discard;
+
+    //! record a CRC-32C checksum of each block written and verify it on
+    //! reading, see file::enable_checksums().
+    bool checksum;
+
     //! marks flash drives (configuration entries with flash= instead of disk=)
     bool flash;
 
@@ -90,19 +99,38 @@ public:
     //! different disks. queue=-1 -> default queue (one for each disk).
     int queue;
 
+    //! select request queue implementation for the disk's queue, see
+    //! disk_queues::set_queue_impl(). Empty -> default queue (qwqr).
+    std::string queue_impl;
+
     //! the selected physical device id (e.g. for calculating prefetching
     //! sequences). If -1 then the device id is chosen automatically.
     unsigned int device_id;
 
+    //! NUMA node the disk is attached to. The disk's request queue threads are
+    //! pinned to the node's CPUs. If -1 then no NUMA placement is done.
+    int numa_node;
+
     //! turned on by syscall fileio when the path points to a raw block device
     bool raw_device;
 
     //! unlink file immediately after opening (available on most Unix)
     bool unlink_on_open;
 
-    //! desired queue length for linuxaio_file and linuxaio_queue
+    //! desired queue length for linuxaio_file/linuxaio_queue and
+    //! iouring_file/iouring_queue
     int queue_length;
 
+    //! number of write buffers of wbtl_file, 0 -> default (2)
+    int write_buffers;
+
+    //! path of the fast backend of tiered_file, which keeps its cold blocks
+    //! in path
+    std::string fast_path;
+
+    //! number of bytes to use in fast_path, 0 -> a tenth of size
+    uint64 fast_size;
+
     //! \}
 };
 
@@ -182,6 +210,9 @@ protected:
     //! static counter for automatic physical device enumeration
     unsigned int m_max_device_id;
 
+    //! counter of the queue ids handed out by get_next_queue_id()
+    int m_max_queue_id;
+
 public:
     //! Returns automatic physical device id counter
     unsigned int get_max_device_id();
@@ -192,6 +223,10 @@ public:
     //! Update the automatic physical device id counter
     void update_max_device_id(unsigned int devid);
 
+    //! Returns a request queue id used by no disk, for the backends of a
+    //! disk's file which are served by their own queue
+    int get_next_queue_id();
+
     //! \}
 
 public:
@@ -222,6 +257,10 @@ public:
         return std::pair<unsigned, unsigned>(first_flash, (unsigned)disks_list.size());
     }
 
+    //! Returns the indices of the disks with fileio tiered in the array of
+    //! all disks.
+    std::vector<unsigned> tiered_disks();
+
     //! Returns mutable disk_config structure for additional disk parameters
     inline disk_config & disk(size_t disk)
     {
@@ -0,0 +1,114 @@
+/***************************************************************************
+ *  include/stxxl/bits/mng/discard_queue.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_MNG_DISCARD_QUEUE_HEADER
+#define STXXL_MNG_DISCARD_QUEUE_HEADER
+
+#include <stxxl/bits/config.h>
+
+#if STXXL_STD_THREADS
+ #include <thread>
+#elif STXXL_BOOST_THREADS
+ #include <boost/thread/thread.hpp>
+#elif STXXL_POSIX_THREADS
+ #include <pthread.h>
+#else
+ #error "Thread implementation not detected."
+#endif
+
+#include <deque>
+#include <vector>
+
+#include <stxxl/bits/common/condition_variable.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/mng/disk_allocator.h>
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/noncopyable.h>
+
+STXXL_BEGIN_NAMESPACE
+
+class file;
+
+//! \addtogroup mnglayer
+//! \{
+
+//! Background thread which discards freed regions of disks configured with
+//! the discard option and only then returns them to their disk_allocator,
+//! such that a region is never handed out again while its discard is still
+//! pending. Adjacent regions of a batch are merged into one discard call.
+class discard_queue : private noncopyable
+{
+    typedef disk_allocator::place place;
+
+#if STXXL_STD_THREADS
+    typedef std::thread* thread_type;
+#elif STXXL_BOOST_THREADS
+    typedef boost::thread* thread_type;
+#else
+    typedef pthread_t thread_type;
+#endif
+
+    //! a batch of regions freed on one disk
+    struct batch
+    {
+        file* storage;
+        disk_allocator* alloc;
+        std::vector<place> regions;
+    };
+
+    mutex m_mutex;
+    //! signals new batches and termination to the thread
+    condition_variable m_work_cond;
+    //! signals that all batches were processed
+    condition_variable m_idle_cond;
+
+    std::deque<batch> m_batches;
+    //! number of bytes in submitted but not yet returned regions
+    stxxl::int64 m_pending_bytes;
+    //! the thread is processing a batch taken from m_batches
+    bool m_busy;
+    bool m_stop;
+
+    thread_type m_thread;
+
+    //! discard the regions of a batch and free them
+    static void process(batch& b);
+
+    static void * worker(void* arg);
+
+public:
+    //! Starts the thread.
+    discard_queue();
+
+    //! Processes the remaining batches and stops the thread.
+    ~discard_queue();
+
+    //! Hands the regions freed on a disk to the thread, which discards them
+    //! in storage and then deletes them from alloc. The contents of regions
+    //! are taken over.
+    void submit(file* storage, disk_allocator* alloc,
+                std::vector<place>& regions);
+
+    //! Waits until all submitted regions are returned to their allocators.
+    //! \return true if there were pending regions
+    bool wait();
+
+    //! Returns the number of bytes freed but not yet returned to the
+    //! allocators.
+    stxxl::int64 get_pending_bytes();
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_MNG_DISCARD_QUEUE_HEADER
+// vim: et:ts=4:sw=4
@@ -30,10 +30,11 @@
 
 #include <algorithm>
 #include <cassert>
-#include <functional>
 #include <map>
 #include <ostream>
+#include <set>
 #include <utility>
+#include <vector>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -42,22 +43,19 @@ STXXL_BEGIN_NAMESPACE
 
 class disk_allocator : private noncopyable
 {
+public:
+    //! a region of the disk: (position, size)
     typedef std::pair<stxxl::int64, stxxl::int64> place;
 
-    struct first_fit : public std::binary_function<place, stxxl::int64, bool>
-    {
-        bool operator () (
-            const place& entry,
-            const stxxl::int64 size) const
-        {
-            return (entry.second >= size);
-        }
-    };
-
+private:
+    //! free regions: position -> size, used to coalesce neighbours
     typedef std::map<stxxl::int64, stxxl::int64> sortseq;
+    //! free regions ordered by (size, position) for best fit allocation
+    typedef std::set<place> size_index;
 
     stxxl::mutex mutex;
     sortseq free_space;
+    size_index free_sizes;
     stxxl::int64 free_bytes;
     stxxl::int64 disk_bytes;
     stxxl::int64 cfg_bytes;
@@ -66,9 +64,30 @@ class disk_allocator : private noncopyable
 
     void dump() const;
 
-    void deallocation_error(
-        stxxl::int64 block_pos, stxxl::int64 block_size,
-        const sortseq::iterator& pred, const sortseq::iterator& succ) const;
+    // expects the mutex to be locked to prevent concurrent access
+    void insert_free(stxxl::int64 pos, stxxl::int64 size)
+    {
+        free_space[pos] = size;
+        free_sizes.insert(place(size, pos));
+    }
+
+    // expects the mutex to be locked to prevent concurrent access
+    void erase_free(sortseq::iterator region)
+    {
+        free_sizes.erase(place(region->second, region->first));
+        free_space.erase(region);
+    }
+
+    //! Returns the smallest free region with at least size bytes, and the
+    //! lowest one among equally sized regions, in O(log n).
+    // expects the mutex to be locked to prevent concurrent access
+    sortseq::iterator best_fit(stxxl::int64 size)
+    {
+        size_index::const_iterator it = free_sizes.lower_bound(place(size, 0));
+        if (it == free_sizes.end())
+            return free_space.end();
+        return free_space.find(it->second);
+    }
 
     // expects the mutex to be locked to prevent concurrent access
     void add_free_region(stxxl::int64 block_pos, stxxl::int64 block_size);
@@ -127,14 +146,25 @@ public:
     template <unsigned BlockSize>
     void new_blocks(BID<BlockSize>* begin, BID<BlockSize>* end);
 
-#if 0
-    template <unsigned BlockSize>
-    void delete_blocks(const BIDArray<BlockSize>& bids)
+    //! Allocates a contiguous region of bytes, growing the file if autogrow
+    //! is enabled. Returns the region's position, or -1 if there is none.
+    stxxl::int64 new_region(stxxl::int64 bytes);
+
+    //! Allocates the bytes directly behind pos if they are free, which
+    //! extends a region ending at pos in place. Returns false otherwise.
+    bool extend_region(stxxl::int64 pos, stxxl::int64 bytes);
+
+    //! Frees a region allocated by new_region() or extend_region().
+    void delete_region(stxxl::int64 pos, stxxl::int64 bytes)
     {
-        for (unsigned i = 0; i < bids.size(); ++i)
-            delete_block(bids[i]);
+        scoped_mutex_lock lock(mutex);
+        add_free_region(pos, bytes);
     }
-#endif
+
+    //! Frees a batch of regions under a single lock. The regions are sorted
+    //! and runs of adjacent ones are merged before they are returned to the
+    //! free space, thus \c regions is reordered.
+    void delete_regions(std::vector<place>& regions);
 
     template <unsigned BlockSize>
     void delete_block(const BID<BlockSize>& bid)
@@ -187,10 +217,7 @@ void disk_allocator::new_blocks(BID<BlockSize>* begin, BID<BlockSize>* end)
 
     // dump();
 
-    sortseq::iterator space;
-    space = std::find_if(free_space.begin(), free_space.end(),
-                         std::bind(first_fit(), std::placeholders::_1, requested_size) _STXXL_FORCE_SEQUENTIAL);
-
+    sortseq::iterator space = best_fit(requested_size);
 
     if (space == free_space.end() && requested_size == BlockSize)
     {
@@ -207,17 +234,16 @@ void disk_allocator::new_blocks(BID<BlockSize>* begin, BID<BlockSize>* end)
 
         grow_file(BlockSize);
 
-        space = std::find_if(free_space.begin(), free_space.end(),
-                             std::bind(first_fit(), std::placeholders::_1, requested_size) _STXXL_FORCE_SEQUENTIAL);
+        space = best_fit(requested_size);
     }
 
     if (space != free_space.end())
     {
         stxxl::int64 region_pos = (*space).first;
         stxxl::int64 region_size = (*space).second;
-        free_space.erase(space);
+        erase_free(space);
         if (region_size > requested_size)
-            free_space[region_pos + requested_size] = region_size - requested_size;
+            insert_free(region_pos + requested_size, region_size - requested_size);
 
         for (stxxl::int64 pos = region_pos; begin != end; ++begin)
         {
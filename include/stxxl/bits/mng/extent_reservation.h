@@ -0,0 +1,117 @@
+/***************************************************************************
+ *  include/stxxl/bits/mng/extent_reservation.h
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_MNG_EXTENT_RESERVATION_HEADER
+#define STXXL_MNG_EXTENT_RESERVATION_HEADER
+
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/mng/bid.h>
+#include <stxxl/bits/mng/disk_allocator.h>
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/noncopyable.h>
+
+#include <vector>
+
+#ifndef STXXL_EXTENT_MAX_SIZE
+//! maximum number of bytes an extent_reservation reserves on a disk at once
+#define STXXL_EXTENT_MAX_SIZE (64 * 1024 * 1024)
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup mnglayer
+//! \{
+
+//! Contiguous extents reserved on each disk for the future blocks of one
+//! container.
+//!
+//! Blocks allocated through block_manager::new_blocks() with a reservation
+//! are taken in order from the disk's current extent, such that a container
+//! which grows block by block still gets ascending, adjacent offsets on each
+//! disk. When an extent is used up, the reservation first tries to extend it
+//! in place and otherwise reserves a new one. Extents grow geometrically up
+//! to STXXL_EXTENT_MAX_SIZE bytes. The unused rest is returned to the disk
+//! allocators by release() and the destructor.
+class extent_reservation : private noncopyable
+{
+    struct extent
+    {
+        //! allocator of the disk, NULL if nothing was reserved yet
+        disk_allocator* alloc;
+        //! next free position in and end of the reserved region
+        stxxl::int64 pos, end;
+        //! number of bytes to reserve next time
+        stxxl::int64 next;
+
+        extent()
+            : alloc(NULL), pos(0), end(0), next(0)
+        { }
+    };
+
+    //! the extent of each disk, indexed by allocator id
+    std::vector<extent> m_extents;
+
+    //! Returns the position of bytes contiguous bytes taken from the extent
+    //! of disk, or -1 if no extent can be reserved.
+    stxxl::int64 take(size_t disk, disk_allocator* alloc, stxxl::int64 bytes);
+
+public:
+    extent_reservation()
+    { }
+
+    ~extent_reservation()
+    {
+        release();
+    }
+
+    //! Allocates the blocks of bids on disk from the reserved extent, or
+    //! directly from the disk allocator if no extent can be reserved.
+    template <unsigned BlockSize>
+    void new_blocks(size_t disk, disk_allocator* alloc,
+                    BIDArray<BlockSize>& bids)
+    {
+        stxxl::int64 bytes = 0;
+        for (typename BIDArray<BlockSize>::iterator it = bids.begin();
+             it != bids.end(); ++it)
+            bytes += it->size;
+
+        stxxl::int64 pos = take(disk, alloc, bytes);
+        if (pos < 0) {
+            alloc->new_blocks(bids);
+            return;
+        }
+
+        for (typename BIDArray<BlockSize>::iterator it = bids.begin();
+             it != bids.end(); ++it)
+        {
+            it->offset = pos;
+            pos += it->size;
+        }
+    }
+
+    //! Returns the number of reserved but unused bytes on all disks.
+    stxxl::int64 get_reserved_bytes() const;
+
+    //! Returns the unused rest of all extents to the disk allocators.
+    void release();
+
+    //! swap reservations with another one
+    void swap(extent_reservation& obj)
+    {
+        std::swap(m_extents, obj.m_extents);
+    }
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_MNG_EXTENT_RESERVATION_HEADER
+// vim: et:ts=4:sw=4
@@ -0,0 +1,242 @@
+/***************************************************************************
+ *  include/stxxl/bits/mng/memory_manager.h
+ *
+ *  process-wide budget of the internal memory used by containers and sorters
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_MNG_MEMORY_MANAGER_HEADER
+#define STXXL_MNG_MEMORY_MANAGER_HEADER
+
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/noncopyable.h>
+#include <stxxl/bits/singleton.h>
+#include <stxxl/bits/unused.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup mnglayer
+//! \{
+
+//! Counters of the internal memory of one kind of consumers, see
+//! memory_manager::get_usage().
+struct memory_usage
+{
+    //! name of the consumers
+    std::string name;
+    //! number of bytes currently held
+    uint64 current;
+    //! largest number of bytes held at the same time
+    uint64 maximum;
+    //! number of bytes ever acquired
+    uint64 total;
+    //! number of bytes released because the manager asked for them
+    uint64 shrunk;
+    //! number of acquisitions granted beyond the limit
+    unsigned overcommitted;
+
+    memory_usage()
+        : current(0), maximum(0), total(0), shrunk(0), overcommitted(0)
+    { }
+};
+
+class memory_manager;
+
+//! A component holding internal memory accounted by the memory_manager.
+//!
+//! Components keep a memory_consumer and take their block buffers from it
+//! with new_block() or allocate(), which account the bytes, and return them
+//! with delete_block() or deallocate(). Memory allocated otherwise is
+//! accounted with acquire() and release(). Components which can continue
+//! with less memory, like the page cache of a vector, override shrink() and
+//! are asked to give memory back when another component would exceed the
+//! limit; they unregister() at the start of their destructor.
+class memory_consumer : private noncopyable
+{
+    friend class memory_manager;
+
+    //! name of the counters in the memory_manager
+    std::string m_name;
+    //! bytes currently held
+    uint64 m_bytes;
+    //! still known to the memory_manager, see unregister()
+    bool m_registered;
+
+public:
+    //! Registers a consumer accounted under name.
+    explicit memory_consumer(const std::string& name);
+
+    //! Releases the memory still held and unregisters the consumer.
+    virtual ~memory_consumer() noexcept(false);
+
+    //! Stops the manager from calling shrink(), waiting for a call in
+    //! progress. Consumers overriding shrink() call this first in their
+    //! destructor, as the manager could otherwise call it on a partly
+    //! destroyed object. Memory held remains accounted.
+    void unregister();
+
+    //! Accounts the memory of buffers to be allocated. If the limit is
+    //! exceeded, other consumers are asked to shrink, and then less than
+    //! bytes but at least min_bytes may be granted. min_bytes are granted
+    //! in any case.
+    //! \return number of bytes granted
+    uint64 acquire(uint64 bytes, uint64 min_bytes);
+
+    //! Accounts the memory of buffers to be allocated, see acquire().
+    uint64 acquire(uint64 bytes)
+    {
+        return acquire(bytes, bytes);
+    }
+
+    //! Accounts memory that was freed.
+    void release(uint64 bytes);
+
+    //! Accounts all memory as freed.
+    void release_all()
+    {
+        release(m_bytes);
+    }
+
+    //! Allocates a buffer of bytes aligned for I/O, which are accounted like
+    //! by acquire(bytes).
+    void * allocate(size_t bytes);
+
+    //! Frees a buffer of allocate() and releases its bytes.
+    void deallocate(void* ptr, size_t bytes);
+
+    //! Allocates a block, whose bytes are accounted like by acquire().
+    template <typename BlockType>
+    BlockType * new_block()
+    {
+        acquire(sizeof(BlockType));
+        try {
+            return new BlockType;
+        }
+        catch (...) {
+            release(sizeof(BlockType));
+            throw;
+        }
+    }
+
+    //! Frees a block of new_block() and releases its bytes.
+    template <typename BlockType>
+    void delete_block(BlockType* block)
+    {
+        delete block;
+        release(sizeof(BlockType));
+    }
+
+    //! Exchanges the accounted memory with another consumer, for
+    //! components which swap their buffers.
+    void swap_bytes(memory_consumer& other);
+
+    //! Returns the number of bytes held.
+    uint64 get_bytes() const
+    {
+        return m_bytes;
+    }
+
+    const std::string & get_name() const
+    {
+        return m_name;
+    }
+
+    //! Called by the memory_manager from a thread acquiring memory beyond
+    //! the limit: free and release() about bytes if possible. The default
+    //! does not free anything.
+    virtual void shrink(uint64 bytes)
+    {
+        STXXL_UNUSED(bytes);
+    }
+};
+
+//! Process-wide budget of the internal memory of containers and sorters.
+//!
+//! All memory_consumer objects are registered with the manager, which
+//! accounts their memory per name. If a limit is set and an acquisition
+//! would exceed it, the consumers holding most memory are asked to shrink()
+//! until the acquisition fits, e.g. a vector releases its page cache while
+//! a sorter forms runs. Without a limit, the default, memory is only
+//! accounted.
+//!
+//! shrink() is called from the thread acquiring memory, so components
+//! shared by several threads must synchronize it or not override it. It
+//! may run while the consumer's buffers are referenced, e.g. in a[i] = b[j]
+//! a page fault of a shrinks b, hence a vector only records the request
+//! and releases pages at its own next page fault. The manager then grants
+//! the acquisition beyond the limit.
+//!
+//! \remarks is a singleton, which is not destroyed on exit, as consumers
+//! of static objects unregister later
+class memory_manager : public singleton<memory_manager, false>
+{
+    friend class singleton<memory_manager, false>;
+    friend class memory_consumer;
+
+    typedef std::map<std::string, memory_usage> usage_map_type;
+
+    //! protects the counters and the set of consumers
+    mutex m_mutex;
+    //! serializes calls of shrink() with unregistering consumers, so a
+    //! consumer is not destroyed while it shrinks
+    mutex m_shrink_mutex;
+
+    //! limit of the bytes held, 0 for none
+    uint64 m_limit;
+    //! bytes held by all consumers
+    uint64 m_used;
+    //! largest number of bytes held at the same time
+    uint64 m_peak;
+
+    std::set<memory_consumer*> m_consumers;
+    usage_map_type m_usage;
+
+    memory_manager();
+
+    void add_consumer(memory_consumer* consumer);
+    void remove_consumer(memory_consumer* consumer);
+
+    uint64 acquire(memory_consumer* consumer, uint64 bytes, uint64 min_bytes);
+    void release(memory_consumer* consumer, uint64 bytes);
+
+    //! accounts bytes to consumer, with m_mutex held
+    void account(memory_consumer* consumer, uint64 bytes);
+
+public:
+    //! Sets the limit of the bytes held by all consumers, 0 for none.
+    //! Memory already held is not affected.
+    void set_limit(uint64 bytes);
+
+    uint64 get_limit();
+
+    //! Returns the number of bytes held by all consumers.
+    uint64 get_used();
+
+    //! Returns the largest number of bytes held at the same time.
+    uint64 get_peak();
+
+    //! Returns the counters of all kinds of consumers, ordered by name.
+    std::vector<memory_usage> get_usage();
+
+    //! Prints the counters of all kinds of consumers.
+    void print(std::ostream& o);
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_MNG_MEMORY_MANAGER_HEADER
+// vim: et:ts=4:sw=4
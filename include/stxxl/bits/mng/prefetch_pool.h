@@ -14,10 +14,13 @@
 #ifndef STXXL_MNG_PREFETCH_POOL_HEADER
 #define STXXL_MNG_PREFETCH_POOL_HEADER
 
-#include <list>
+#include <vector>
 #include <stxxl/bits/config.h>
+#include <stxxl/bits/common/huge_pages.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/numa.h>
 #include <stxxl/bits/mng/write_pool.h>
-#include <stxxl/bits/compat/hash_map.h>
+#include <stxxl/bits/mng/bid_hash_table.h>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -25,6 +28,11 @@ STXXL_BEGIN_NAMESPACE
 //! \{
 
 //! Implements dynamically resizable prefetching pool.
+//!
+//! The free blocks are kept in an array and the hinted blocks in an open
+//! addressing table, both preallocated for the largest number of blocks the
+//! pool owned so far, hence hinting and reading blocks does not allocate
+//! memory.
 template <class BlockType>
 class prefetch_pool : private noncopyable
 {
@@ -33,57 +41,133 @@ public:
     typedef typename block_type::bid_type bid_type;
 
 protected:
-    struct bid_hash
-    {
-        size_t operator () (const bid_type& bid) const
-        {
-            size_t result = size_t(bid.storage) +
-                            size_t(bid.offset & 0xffffffff) +
-                            size_t(bid.offset >> 32);
-            return result;
-        }
-#if STXXL_MSVC
-        bool operator () (const bid_type& a, const bid_type& b) const
-        {
-            return (a.storage < b.storage) || (a.storage == b.storage && a.offset < b.offset);
-        }
-        enum
-        {                               // parameters for hash table
-            bucket_size = 4,            // 0 < bucket_size
-            min_buckets = 8             // min_buckets = 2 ^^ N, 0 < N
-        };
-#endif
-    };
     typedef std::pair<block_type*, request_ptr> busy_entry;
-    typedef typename compat_hash_map<bid_type, busy_entry, bid_hash>::result hash_map_type;
-    typedef typename std::list<block_type*>::iterator free_blocks_iterator;
-    typedef typename hash_map_type::iterator busy_blocks_iterator;
+    typedef bid_hash_table<bid_type, busy_entry> hash_map_type;
+    typedef typename std::vector<block_type*>::iterator free_blocks_iterator;
 
     //! contains free prefetch blocks
-    std::list<block_type*> free_blocks;
+    std::vector<block_type*> free_blocks;
 
     //! blocks that are in reading or already read but not retrieved by user
     hash_map_type busy_blocks;
 
-    //! count number of free blocks, since traversing the std::list is slow.
-    unsigned_type free_blocks_size;
+    //! number of blocks free_blocks and busy_blocks have room for
+    unsigned_type capacity;
+
+    //! blocks taken out of busy_blocks by invalidate() which return to
+    //! free_blocks once their request finished
+    unsigned_type num_invalidating;
+
+    //! NUMA node to allocate new blocks on, -1 for none
+    int numa_node;
+
+    //! backing of new blocks
+    huge_pages_mode huge_pages;
+
+    //! whether the pool is shared between threads and locks m_mutex
+    bool thread_safe;
+
+    //! protects the pool if thread_safe
+    mutable mutex m_mutex;
+
+    //! Constructs pool, see concurrent_prefetch_pool.
+    prefetch_pool(unsigned_type init_size, int node, bool is_thread_safe)
+        : capacity(0), num_invalidating(0), numa_node(node), huge_pages(HUGE_PAGES_DEFAULT), thread_safe(is_thread_safe)
+    {
+        init(init_size);
+    }
+
+    void init(unsigned_type init_size)
+    {
+        reserve(init_size);
+        for (unsigned_type i = 0; i < init_size; ++i)
+            free_blocks.push_back(new_block());
+    }
+
+    //! allocates a new block, placed on the pool's NUMA node if set and backed
+    //! as selected by set_huge_pages()
+    block_type * new_block()
+    {
+        block_type* block = new (huge_pages) block_type;
+        if (numa_node >= 0)
+            numa_bind_memory(block, sizeof(block_type), numa_node);
+        return block;
+    }
+
+    //! number of owned blocks, the lock must be held
+    unsigned_type owned_size() const
+    {
+        return free_blocks.size() + busy_blocks.size() + num_invalidating;
+    }
+
+    //! makes room for n owned blocks, grows geometrically
+    void reserve(unsigned_type n)
+    {
+        if (n <= capacity)
+            return;
+        capacity = std::max(n, 2 * capacity);
+        free_blocks.reserve(capacity);
+        busy_blocks.reserve(capacity);
+    }
+
+    //! takes a free block, one must be available
+    block_type * pop_free()
+    {
+        block_type* block = free_blocks.back();
+        free_blocks.pop_back();
+        return block;
+    }
+
+    //! takes the hinted block of bid, exchanging it for block, and returns
+    //! its request, or an invalid request if bid was not hinted.
+    request_ptr take_hinted(block_type*& block, const bid_type& bid)
+    {
+        busy_entry* cache_el = busy_blocks.find(bid);
+        if (cache_el == NULL)
+            return request_ptr();
+
+        STXXL_VERBOSE1("prefetch_pool::read bid=" << bid << " => copy in cache exists");
+        free_blocks.push_back(block);
+        block = cache_el->first;
+        request_ptr result = cache_el->second;
+        busy_blocks.erase(bid);
+        return result;
+    }
 
 public:
     //! Constructs pool.
     //! \param init_size initial number of blocks in the pool
-    explicit prefetch_pool(unsigned_type init_size = 1)
-        : free_blocks_size(init_size)
+    //! \param node NUMA node to allocate the blocks on, -1 for none
+    explicit prefetch_pool(unsigned_type init_size = 1, int node = -1)
+        : capacity(0), num_invalidating(0), numa_node(node), huge_pages(HUGE_PAGES_DEFAULT), thread_safe(false)
     {
-        unsigned_type i = 0;
-        for ( ; i < init_size; ++i)
-            free_blocks.push_back(new block_type);
+        init(init_size);
     }
 
+    //! Swaps the contents of two pools, which must not be in use by other
+    //! threads.
     void swap(prefetch_pool& obj)
     {
         std::swap(free_blocks, obj.free_blocks);
-        std::swap(busy_blocks, obj.busy_blocks);
-        std::swap(free_blocks_size, obj.free_blocks_size);
+        busy_blocks.swap(obj.busy_blocks);
+        std::swap(capacity, obj.capacity);
+        std::swap(num_invalidating, obj.num_invalidating);
+        std::swap(numa_node, obj.numa_node);
+        std::swap(huge_pages, obj.huge_pages);
+    }
+
+    //! Sets the NUMA node on which blocks are allocated when the pool grows,
+    //! e.g. config::get_instance()->disk(i).numa_node. -1 for none.
+    void set_numa_node(int node)
+    {
+        numa_node = node;
+    }
+
+    //! Sets the backing of blocks allocated when the pool grows, by default
+    //! the process-wide one, see set_huge_pages(huge_pages_mode, size_t).
+    void set_huge_pages(huge_pages_mode mode)
+    {
+        huge_pages = mode;
     }
 
     //! Waits for completion of all ongoing read requests and frees memory.
@@ -97,11 +181,13 @@ public:
 
         try
         {
-            busy_blocks_iterator i2 = busy_blocks.begin();
-            for ( ; i2 != busy_blocks.end(); ++i2)
+            for (unsigned_type i = 0; i < busy_blocks.capacity(); ++i)
             {
-                i2->second.second->wait();
-                delete i2->second.first;
+                typename hash_map_type::slot_type& s = busy_blocks.slot(i);
+                if (!s.bid.valid())
+                    continue;
+                s.value.second->wait();
+                delete s.value.first;
             }
         }
         catch (...)
@@ -111,26 +197,30 @@ public:
     //! Returns number of owned blocks.
     unsigned_type size() const
     {
-        return free_blocks_size + busy_blocks.size();
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        return owned_size();
     }
 
     //! Returns the number of free prefetching blocks.
     unsigned_type free_size() const
     {
-        return free_blocks_size;
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        return free_blocks.size();
     }
 
     //! Returns the number of busy prefetching blocks.
     unsigned_type busy_size() const
     {
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
         return busy_blocks.size();
     }
 
     //! Add a new block to prefetch pool, enlarges size of pool.
     void add(block_type*& block)
     {
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        reserve(owned_size() + 1);
         free_blocks.push_back(block);
-        ++free_blocks_size;
         block = NULL; // prevent caller from using the block any further
     }
 
@@ -139,12 +229,9 @@ public:
     //! \return pointer to the block. Ownership of the block goes to the caller.
     block_type * steal()
     {
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
         STXXL_CHECK(!free_blocks.empty());
-
-        block_type* p = free_blocks.back();
-        free_blocks.pop_back();
-        --free_blocks_size;
-        return p;
+        return pop_free();
     }
 
     /*!
@@ -161,20 +248,19 @@ public:
      */
     bool hint(bid_type bid)
     {
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
         // if block is already hinted, no need to hint it again
-        if (in_prefetching(bid)) {
+        if (busy_blocks.find(bid)) {
             STXXL_VERBOSE2("prefetch_pool::hint2 bid=" << bid << " was already cached");
             return true;
         }
 
-        if (free_blocks_size) //  only if we have a free block
+        if (!free_blocks.empty()) //  only if we have a free block
         {
-            --free_blocks_size;
-            block_type* block = free_blocks.back();
-            free_blocks.pop_back();
+            block_type* block = pop_free();
             STXXL_VERBOSE2("prefetch_pool::hint bid=" << bid << " => prefetching");
             request_ptr req = block->read(bid);
-            busy_blocks[bid] = busy_entry(block, req);
+            busy_blocks.insert(bid, busy_entry(block, req));
             return true;
         }
         STXXL_VERBOSE2("prefetch_pool::hint bid=" << bid << " => no free blocks for prefetching");
@@ -196,29 +282,29 @@ public:
      */
     bool hint(bid_type bid, write_pool<block_type>& w_pool)
     {
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
         // if block is already hinted, no need to hint it again
-        if (in_prefetching(bid)) {
+        if (busy_blocks.find(bid)) {
             STXXL_VERBOSE2("prefetch_pool::hint2 bid=" << bid << " was already cached");
             return true;
         }
 
-        if (free_blocks_size) //  only if we have a free block
+        if (!free_blocks.empty()) //  only if we have a free block
         {
-            --free_blocks_size;
-            block_type* block = free_blocks.back();
-            free_blocks.pop_back();
+            block_type* block = pop_free();
+            busy_entry wp_request;
             if (w_pool.has_request(bid))
+                wp_request = w_pool.steal_request(bid);
+            if (wp_request.first)
             {
-                busy_entry wp_request = w_pool.steal_request(bid);
                 STXXL_VERBOSE1("prefetch_pool::hint2 bid=" << bid << " was in write cache at " << wp_request.first);
-                assert(wp_request.first != 0);
                 w_pool.add(block);  //in exchange
-                busy_blocks[bid] = wp_request;
+                busy_blocks.insert(bid, wp_request);
                 return true;
             }
             STXXL_VERBOSE2("prefetch_pool::hint2 bid=" << bid << " => prefetching");
             request_ptr req = block->read(bid);
-            busy_blocks[bid] = busy_entry(block, req);
+            busy_blocks.insert(bid, busy_entry(block, req));
             return true;
         }
         STXXL_VERBOSE2("prefetch_pool::hint2 bid=" << bid << " => no free blocks for prefetching");
@@ -228,38 +314,49 @@ public:
     //! Cancel a hint request in case the block is no longer desired.
     bool invalidate(bid_type bid)
     {
-        busy_blocks_iterator cache_el = busy_blocks.find(bid);
-        if (cache_el == busy_blocks.end())
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        busy_entry* cache_el = busy_blocks.find(bid);
+        if (cache_el == NULL)
             return false;
 
+        busy_entry entry = *cache_el;
+        busy_blocks.erase(bid);
+        // keep counting the block while unlocked, such that concurrent
+        // add() and resize() leave room for it in free_blocks
+        ++num_invalidating;
+        lock.unlock();
+
         // cancel request if it is a read request, there might be
         // write requests 'stolen' from a write_pool that may not be canceled
-        if (cache_el->second.second->get_type() == request::READ)
-            cache_el->second.second->cancel();
+        if (entry.second->get_type() == request::READ)
+            entry.second->cancel();
         // finish the request
-        cache_el->second.second->wait();
-        ++free_blocks_size;
-        free_blocks.push_back(cache_el->second.first);
-        busy_blocks.erase(cache_el);
+        entry.second->wait();
+
+        lock.lock();
+        --num_invalidating;
+        free_blocks.push_back(entry.first);
         return true;
     }
 
     //! Checks if a block is in the hinted block set.
     bool in_prefetching(bid_type bid)
     {
-        return (busy_blocks.find(bid) != busy_blocks.end());
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        return busy_blocks.find(bid) != NULL;
     }
 
     //! Returns the request pointer for a hinted block, or an invalid NULL
     //! request in case it was not requested due to lack of prefetch buffers.
     request_ptr find(bid_type bid)
     {
-        busy_blocks_iterator cache_el = busy_blocks.find(bid);
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        busy_entry* cache_el = busy_blocks.find(bid);
 
-        if (cache_el == busy_blocks.end())
+        if (cache_el == NULL)
             return request_ptr(); // invalid pointer
         else
-            return cache_el->second.second;
+            return cache_el->second;
     }
 
     //! Returns true if the blocks was hinted and the request is finished.
@@ -285,46 +382,33 @@ public:
      */
     request_ptr read(block_type*& block, bid_type bid)
     {
-        busy_blocks_iterator cache_el = busy_blocks.find(bid);
-        if (cache_el == busy_blocks.end())
-        {
-            // not cached
-            STXXL_VERBOSE1("prefetch_pool::read bid=" << bid << " => no copy in cache, retrieving to " << block);
-            return block->read(bid);
-        }
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        request_ptr result = take_hinted(block, bid);
+        if (result.valid())
+            return result;
 
-        // cached
-        STXXL_VERBOSE1("prefetch_pool::read bid=" << bid << " => copy in cache exists");
-        ++free_blocks_size;
-        free_blocks.push_back(block);
-        block = cache_el->second.first;
-        request_ptr result = cache_el->second.second;
-        busy_blocks.erase(cache_el);
-        return result;
+        // not cached
+        lock.unlock();
+        STXXL_VERBOSE1("prefetch_pool::read bid=" << bid << " => no copy in cache, retrieving to " << block);
+        return block->read(bid);
     }
 
     request_ptr read(block_type*& block, bid_type bid, write_pool<block_type>& w_pool)
     {
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
         // try cache
-        busy_blocks_iterator cache_el = busy_blocks.find(bid);
-        if (cache_el != busy_blocks.end())
-        {
-            // cached
-            STXXL_VERBOSE1("prefetch_pool::read bid=" << bid << " => copy in cache exists");
-            ++free_blocks_size;
-            free_blocks.push_back(block);
-            block = cache_el->second.first;
-            request_ptr result = cache_el->second.second;
-            busy_blocks.erase(cache_el);
+        request_ptr result = take_hinted(block, bid);
+        if (result.valid())
             return result;
-        }
+        lock.unlock();
 
         // try w_pool cache
+        busy_entry wp_request;
         if (w_pool.has_request(bid))
+            wp_request = w_pool.steal_request(bid);
+        if (wp_request.first)
         {
-            busy_entry wp_request = w_pool.steal_request(bid);
             STXXL_VERBOSE1("prefetch_pool::read bid=" << bid << " was in write cache at " << wp_request.first);
-            assert(wp_request.first != 0);
             w_pool.add(block);  //in exchange
             block = wp_request.first;
             return wp_request.second;
@@ -343,27 +427,40 @@ public:
     //! \return new size of the pool
     unsigned_type resize(unsigned_type new_size)
     {
-        int_type diff = int_type(new_size) - int_type(size());
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        int_type diff = int_type(new_size) - int_type(owned_size());
         if (diff > 0)
         {
-            free_blocks_size += diff;
+            reserve(new_size);
             while (--diff >= 0)
-                free_blocks.push_back(new block_type);
+                free_blocks.push_back(new_block());
 
-            return size();
+            return owned_size();
         }
 
-        while (diff < 0 && free_blocks_size > 0)
+        while (diff < 0 && !free_blocks.empty())
         {
             ++diff;
-            --free_blocks_size;
-            delete free_blocks.back();
-            free_blocks.pop_back();
+            delete pop_free();
         }
-        return size();
+        return owned_size();
     }
 };
 
+//! Thread-safe prefetch_pool, which can be shared between threads, e.g. the
+//! workers of a parallel merge. Combine it with a concurrent_write_pool.
+template <class BlockType>
+class concurrent_prefetch_pool : public prefetch_pool<BlockType>
+{
+public:
+    //! Constructs pool.
+    //! \param init_size initial number of blocks in the pool
+    //! \param node NUMA node to allocate the blocks on, -1 for none
+    explicit concurrent_prefetch_pool(unsigned_type init_size = 1, int node = -1)
+        : prefetch_pool<BlockType>(init_size, node, true)
+    { }
+};
+
 //! \}
 
 STXXL_END_NAMESPACE
@@ -42,11 +42,13 @@ public:
     //! Constructs pool.
     //! \param init_size_prefetch initial number of blocks in the prefetch pool
     //! \param init_size_write initial number of blocks in the write pool
-    explicit read_write_pool(size_type init_size_prefetch = 1, size_type init_size_write = 1)
+    //! \param node NUMA node to allocate the blocks on, -1 for none
+    explicit read_write_pool(size_type init_size_prefetch = 1, size_type init_size_write = 1,
+                             int node = -1)
         : delete_pools(true)
     {
-        w_pool = new write_pool_type(init_size_write);
-        p_pool = new prefetch_pool_type(init_size_prefetch);
+        w_pool = new write_pool_type(init_size_write, node);
+        p_pool = new prefetch_pool_type(init_size_prefetch, node);
     }
 
     STXXL_DEPRECATED(read_write_pool(prefetch_pool_type& p_pool, write_pool_type& w_pool))
@@ -89,6 +91,20 @@ public:
         p_pool->resize(new_size);
     }
 
+    //! Sets the NUMA node on which blocks are allocated when the pools grow.
+    void set_numa_node(int node)
+    {
+        w_pool->set_numa_node(node);
+        p_pool->set_numa_node(node);
+    }
+
+    //! Sets the backing of blocks allocated when the pools grow.
+    void set_huge_pages(huge_pages_mode mode)
+    {
+        w_pool->set_huge_pages(mode);
+        p_pool->set_huge_pages(mode);
+    }
+
     // WRITE POOL METHODS
 
     //! Passes a block to the pool for writing.
@@ -109,6 +125,19 @@ public:
         return result;
     }
 
+    //! Passes a range of blocks to the pool for writing, see
+    //! write_pool::write().
+    void write(block_type** blocks, const bid_type* bids, unsigned_type n)
+    {
+        w_pool->write(blocks, bids, n);
+
+        for (unsigned_type i = 0; i < n; ++i)
+        {
+            if (p_pool->invalidate(bids[i]))
+                p_pool->hint(bids[i], *w_pool);
+        }
+    }
+
     //! Take out a block from the pool.
     //! \return pointer to the block. Ownership of the block goes to the caller.
     block_type * steal()
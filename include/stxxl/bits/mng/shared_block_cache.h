@@ -0,0 +1,654 @@
+/***************************************************************************
+ *  include/stxxl/bits/mng/shared_block_cache.h
+ *
+ *  cache of blocks keyed by BID which is shared by several containers
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#ifndef STXXL_MNG_SHARED_BLOCK_CACHE_HEADER
+#define STXXL_MNG_SHARED_BLOCK_CACHE_HEADER
+
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include <stxxl/bits/common/condition_variable.h>
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/compat/hash_map.h>
+#include <stxxl/bits/io/request.h>
+#include <stxxl/bits/io/request_operations.h>
+#include <stxxl/bits/mng/bid.h>
+#include <stxxl/bits/mng/memory_manager.h>
+#include <stxxl/bits/noncopyable.h>
+#include <stxxl/bits/verbose.h>
+
+STXXL_BEGIN_NAMESPACE
+
+//! \addtogroup mnglayer
+//! \{
+
+//! A cache of blocks of RawSize bytes keyed by their BID, which several
+//! containers share instead of keeping caches of their own.
+//!
+//! Clients pin() a block to access it, which reads it if it is not cached,
+//! and unpin() it afterwards, possibly marking it dirty. Blocks which are
+//! not pinned are replaced using the CLOCK algorithm, dirty ones are written
+//! back before. All methods may be called from several threads; the
+//! buffers are interpreted as any block type of RawSize bytes.
+//!
+//! Each client obtains an owner id with new_owner() and passes it when
+//! loading blocks, so it can flush() and discard() its blocks, e.g. before
+//! they are deleted. Buffers are allocated on demand and accounted with the
+//! memory_manager as "shared_block_cache", which may ask the cache to drop
+//! clean blocks.
+//!
+//! vector, hash_map and unordered_map opt in with use_shared_cache(). The
+//! node cache of map/btree and prefetch_pool are not clients: btree nodes
+//! are objects owning their blocks, and a prefetch_pool hands blocks over to
+//! its callers, which neither fits blocks owned by the cache.
+template <unsigned RawSize>
+class shared_block_cache : private noncopyable
+{
+public:
+    enum { raw_size = RawSize };
+
+    typedef BID<raw_size> bid_type;
+    typedef unsigned_type owner_type;
+
+private:
+    struct bid_hash
+    {
+        size_t operator () (const bid_type& bid) const
+        {
+            return longhash1(bid.offset + reinterpret_cast<uint64>(bid.storage));
+        }
+#if STXXL_MSVC
+        bool operator () (const bid_type& a, const bid_type& b) const
+        {
+            return (a.storage < b.storage) ||
+                   (a.storage == b.storage && a.offset < b.offset);
+        }
+        enum
+        {                                  // parameters for hash table
+            bucket_size = 4,               // 0 < bucket_size
+            min_buckets = 8                // min_buckets = 2 ^^ N, 0 < N
+        };
+#endif
+    };
+
+    struct slot_type
+    {
+        //! buffer of raw_size bytes, NULL until needed
+        void* buffer;
+        bid_type bid;
+        owner_type owner;
+        unsigned_type pins;
+        //! slot holds a block
+        bool used;
+        //! CLOCK reference bit
+        bool referenced;
+        bool dirty;
+        //! I/O in progress, see req
+        bool busy;
+        //! read issued by prefetch(), completed by the next one waiting
+        request_ptr req;
+
+        slot_type()
+            : buffer(NULL), owner(0), pins(0),
+              used(false), referenced(false), dirty(false), busy(false)
+        { }
+    };
+
+    class cache_memory_consumer : public memory_consumer
+    {
+        shared_block_cache* m_cache;
+
+    public:
+        explicit cache_memory_consumer(shared_block_cache* cache)
+            : memory_consumer("shared_block_cache"), m_cache(cache)
+        { }
+
+        ~cache_memory_consumer()
+        {
+            unregister();
+        }
+
+        void shrink(uint64 bytes)
+        {
+            m_cache->drop_clean(div_ceil(bytes, (uint64)raw_size));
+        }
+    };
+
+    typedef typename compat_hash_map<bid_type, unsigned_type, bid_hash>::result bid_map_type;
+
+    mutex m_mutex;
+    //! signaled when a slot is no longer busy
+    condition_variable m_cond;
+
+    std::vector<slot_type> m_slots;
+    bid_map_type m_bid_map;
+    //! CLOCK hand
+    unsigned_type m_hand;
+    owner_type m_last_owner;
+
+    cache_memory_consumer m_memory;
+
+    int64 n_hits;
+    int64 n_misses;
+    int64 n_prefetched;
+    int64 n_written;
+    int64 n_evicted;
+    int64 n_dropped;
+
+public:
+    //! Creates a cache of at most cache_size bytes, no memory is allocated
+    //! until blocks are loaded.
+    explicit shared_block_cache(uint64 cache_size)
+        : m_slots(cache_size / raw_size),
+          m_hand(0),
+          m_last_owner(0),
+          m_memory(this),
+          n_hits(0), n_misses(0), n_prefetched(0),
+          n_written(0), n_evicted(0), n_dropped(0)
+    {
+        if (m_slots.empty())
+            STXXL_THROW2(std::runtime_error, "shared_block_cache::shared_block_cache",
+                         "Too few memory for a block cache (<1)");
+    }
+
+    //! Writes all dirty blocks and frees the buffers.
+    ~shared_block_cache()
+    {
+        // no drop_clean() from the memory_manager while the slots go away
+        m_memory.unregister();
+
+        try {
+            flush();
+        }
+        catch (io_error& e) {
+            STXXL_ERRMSG("shared_block_cache: writing dirty blocks failed: " << e.what());
+        }
+
+        scoped_mutex_lock lock(m_mutex);
+        for (unsigned_type i = 0; i < m_slots.size(); ++i)
+        {
+            slot_type& s = m_slots[i];
+            if (s.req.valid()) {
+                s.req->cancel();
+                try {
+                    s.req->wait(false);
+                }
+                catch (io_error&) { }
+            }
+            if (s.buffer) {
+                m_memory.deallocate(s.buffer, raw_size);
+                s.buffer = NULL;
+            }
+        }
+    }
+
+    //! Returns the number of blocks which can be cached.
+    unsigned_type size() const
+    {
+        return m_slots.size();
+    }
+
+    //! Returns a new owner id for a client.
+    owner_type new_owner()
+    {
+        scoped_mutex_lock lock(m_mutex);
+        return ++m_last_owner;
+    }
+
+    //! Pins the block bid and returns its buffer, which stays in the cache
+    //! until it is unpinned as often as pinned. If the block is not cached
+    //! it is read, unless read is false because the caller overwrites it.
+    //! Throws if all blocks are pinned.
+    template <typename BlockType>
+    BlockType * pin(const bid_type& bid, owner_type owner, bool read = true)
+    {
+        return reinterpret_cast<BlockType*>(pin_buffer(bid, owner, read));
+    }
+
+    //! Pins the block bid if it is cached.
+    //! \return its buffer, or NULL if the block is not cached
+    template <typename BlockType>
+    BlockType * pin_cached(const bid_type& bid)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        slot_type* s = find_settled(bid, lock);
+        if (!s)
+            return NULL;
+        ++s->pins;
+        s->referenced = true;
+        return reinterpret_cast<BlockType*>(s->buffer);
+    }
+
+    //! Unpins a block, which is marked dirty if it was modified.
+    //! \return false if the block was not pinned
+    bool unpin(const bid_type& bid, bool dirty = false)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        typename bid_map_type::iterator it = m_bid_map.find(bid);
+        if (it == m_bid_map.end())
+            return false;
+        slot_type& s = m_slots[it->second];
+        if (s.pins == 0)
+            return false;
+        --s.pins;
+        s.dirty = s.dirty || dirty;
+        return true;
+    }
+
+    //! Marks a cached block dirty.
+    //! \return false if the block is not cached
+    bool make_dirty(const bid_type& bid)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        slot_type* s = find_settled(bid, lock);
+        if (!s)
+            return false;
+        s->dirty = true;
+        return true;
+    }
+
+    //! Returns whether a block is cached, or being read.
+    bool is_cached(const bid_type& bid)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        return m_bid_map.find(bid) != m_bid_map.end();
+    }
+
+    //! Starts reading a block which is not cached, without pinning it.
+    //! Nothing is done if no block can be replaced.
+    void prefetch(const bid_type& bid, owner_type owner)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        if (m_bid_map.find(bid) != m_bid_map.end())
+            return;
+
+        unsigned_type i;
+        victim_result r;
+        while ((r = find_victim(lock, i)) == victim_retry)
+        {
+            if (m_bid_map.find(bid) != m_bid_map.end())
+                return;
+        }
+        if (r == victim_none)
+            return;
+
+        slot_type& s = occupy(i, bid, owner, 0);
+        ++n_prefetched;
+        lock.unlock();
+
+        request_ptr req;
+        try {
+            allocate(s);
+            req = bid.storage->aread(s.buffer, bid.offset, raw_size);
+        }
+        catch (...) {
+            lock.lock();
+            vacate(i);
+            throw;
+        }
+
+        lock.lock();
+        s.req = req;
+        m_cond.notify_all();
+    }
+
+    //! Writes the dirty blocks of owner, or of all owners if owner is 0.
+    void flush(owner_type owner = 0)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        std::vector<unsigned_type> slots;
+        for (unsigned_type i = 0; i < m_slots.size(); ++i)
+        {
+            slot_type& s = m_slots[i];
+            if (s.used && s.dirty && !s.busy && (owner == 0 || s.owner == owner))
+            {
+                s.busy = true;
+                slots.push_back(i);
+            }
+        }
+        lock.unlock();
+
+        std::vector<request_ptr> reqs(slots.size());
+        try {
+            for (unsigned_type j = 0; j < slots.size(); ++j)
+            {
+                slot_type& s = m_slots[slots[j]];
+                reqs[j] = s.bid.storage->awrite(s.buffer, s.bid.offset, raw_size);
+            }
+            wait_all(reqs.begin(), reqs.end());
+        }
+        catch (...) {
+            for (unsigned_type j = 0; j < reqs.size(); ++j)
+                if (reqs[j].valid()) reqs[j]->wait(false);
+            lock.lock();
+            for (unsigned_type j = 0; j < slots.size(); ++j)
+                m_slots[slots[j]].busy = false;
+            m_cond.notify_all();
+            throw;
+        }
+
+        lock.lock();
+        for (unsigned_type j = 0; j < slots.size(); ++j)
+        {
+            m_slots[slots[j]].dirty = false;
+            m_slots[slots[j]].busy = false;
+        }
+        n_written += slots.size();
+        m_cond.notify_all();
+    }
+
+    //! Drops a block without writing it, e.g. before it is deleted.
+    void discard(const bid_type& bid)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        typename bid_map_type::iterator it;
+        while ((it = m_bid_map.find(bid)) != m_bid_map.end() &&
+               !settle(it->second, lock, false)) ;
+        if (it != m_bid_map.end())
+            vacate(it->second);
+    }
+
+    //! Drops all blocks of owner without writing them, also pinned ones.
+    void discard_owner(owner_type owner)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        for (unsigned_type i = 0; i < m_slots.size(); ++i)
+        {
+            slot_type& s = m_slots[i];
+            while (s.used && s.owner == owner && !settle(i, lock, false)) ;
+            if (s.used && s.owner == owner)
+                vacate(i);
+        }
+    }
+
+    //! Print statistics: number of hits/misses, blocks written back and
+    //! replaced.
+    void print_statistics(std::ostream& o) const
+    {
+        const int64 n_total = n_hits + n_misses;
+        o << "Shared block cache of " << m_slots.size() << " blocks" << std::endl;
+        o << "  Blocks found                    : " << n_hits << " ("
+          << (n_total ? 100. * double(n_hits) / double(n_total) : 0.) << "%)" << std::endl;
+        o << "  Blocks not found                : " << n_misses << std::endl;
+        o << "  Blocks prefetched               : " << n_prefetched << std::endl;
+        o << "  Blocks written                  : " << n_written << std::endl;
+        o << "  Blocks replaced                 : " << n_evicted << std::endl;
+        o << "  Blocks dropped for memory       : " << n_dropped << std::endl;
+    }
+
+    //! Reset all counters to zero.
+    void reset_statistics()
+    {
+        scoped_mutex_lock lock(m_mutex);
+        n_hits = n_misses = n_prefetched = 0;
+        n_written = n_evicted = n_dropped = 0;
+    }
+
+private:
+    void * pin_buffer(const bid_type& bid, owner_type owner, bool read)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        for ( ; ; )
+        {
+            typename bid_map_type::iterator it = m_bid_map.find(bid);
+            if (it != m_bid_map.end())
+            {
+                if (!settle(it->second, lock, true))
+                    continue;
+                slot_type& s = m_slots[it->second];
+                ++s.pins;
+                s.referenced = true;
+                ++n_hits;
+                return s.buffer;
+            }
+
+            unsigned_type i;
+            victim_result r = find_victim(lock, i);
+            if (r == victim_retry)
+                continue;
+            if (r == victim_none)
+                STXXL_THROW2(std::runtime_error, "shared_block_cache::pin",
+                             "The block cache is too small, all blocks are pinned");
+
+            slot_type& s = occupy(i, bid, owner, 1);
+            ++n_misses;
+            lock.unlock();
+
+            try {
+                allocate(s);
+                if (read)
+                    bid.storage->aread(s.buffer, bid.offset, raw_size)->wait();
+            }
+            catch (...) {
+                lock.lock();
+                vacate(i);
+                throw;
+            }
+
+            lock.lock();
+            s.busy = false;
+            m_cond.notify_all();
+            return s.buffer;
+        }
+    }
+
+    //! Waits until a slot is not busy, completing a prefetch. Returns false
+    //! if the lock was released meanwhile, and the slot must be looked up
+    //! again. Errors of prefetches are raised if throw_errors is set.
+    bool settle(unsigned_type i, scoped_mutex_lock& lock, bool throw_errors)
+    {
+        slot_type& s = m_slots[i];
+        if (!s.busy)
+            return true;
+
+        if (!s.req.valid()) {
+            m_cond.wait(lock);
+            return false;
+        }
+
+        request_ptr req = s.req;
+        lock.unlock();
+        bool failed = false;
+        try {
+            req->wait();
+        }
+        catch (io_error&) {
+            failed = true;
+            if (throw_errors) {
+                lock.lock();
+                if (s.req == req)
+                    vacate(i);
+                throw;
+            }
+        }
+        lock.lock();
+        if (s.req == req)
+        {
+            if (failed)
+                vacate(i);
+            else {
+                s.req = request_ptr();
+                s.busy = false;
+                m_cond.notify_all();
+            }
+        }
+        return false;
+    }
+
+    //! looks up a block and waits for pending I/O
+    slot_type * find_settled(const bid_type& bid, scoped_mutex_lock& lock)
+    {
+        typename bid_map_type::iterator it;
+        while ((it = m_bid_map.find(bid)) != m_bid_map.end() &&
+               !settle(it->second, lock, true)) ;
+        return (it == m_bid_map.end()) ? NULL : &m_slots[it->second];
+    }
+
+    enum victim_result { victim_found, victim_retry, victim_none };
+
+    //! Finds a free slot or one to be replaced using CLOCK, which is written
+    //! first if it is dirty. Returns victim_retry if the lock was released
+    //! meanwhile, and the caller must look up the block again, and
+    //! victim_none if all slots are pinned.
+    victim_result find_victim(scoped_mutex_lock& lock, unsigned_type& victim)
+    {
+        const unsigned_type n = m_slots.size();
+        unsigned_type busy = 0, prefetching = n;
+        for (unsigned_type step = 0; step < 2 * n; ++step)
+        {
+            unsigned_type i = m_hand;
+            m_hand = (m_hand + 1) % n;
+            slot_type& s = m_slots[i];
+
+            if (!s.used) {
+                victim = i;
+                return victim_found;
+            }
+            if (s.busy) {
+                if (s.req.valid() && prefetch_done(s.req)) {
+                    // settle() drops failed prefetches
+                    settle(i, lock, false);
+                    return victim_retry;
+                }
+                if (s.req.valid())
+                    prefetching = i;
+                ++busy;
+                continue;
+            }
+            if (s.pins > 0)
+                continue;
+            if (s.referenced) {
+                s.referenced = false;
+                continue;
+            }
+
+            if (s.dirty)
+            {
+                s.busy = true;
+                lock.unlock();
+                request_ptr req = s.bid.storage->awrite(s.buffer, s.bid.offset, raw_size);
+                try {
+                    req->wait();
+                }
+                catch (...) {
+                    lock.lock();
+                    s.busy = false;
+                    m_cond.notify_all();
+                    throw;
+                }
+                lock.lock();
+                s.dirty = false;
+                s.busy = false;
+                ++n_written;
+                m_cond.notify_all();
+                return victim_retry;
+            }
+
+            m_bid_map.erase(s.bid);
+            s.used = false;
+            ++n_evicted;
+            victim = i;
+            return victim_found;
+        }
+
+        if (prefetching < n) {
+            settle(prefetching, lock, false);
+            return victim_retry;
+        }
+        if (busy > 0) {
+            // wait for I/O of other threads, which may free slots
+            m_cond.wait(lock);
+            return victim_retry;
+        }
+        return victim_none;
+    }
+
+    static bool prefetch_done(const request_ptr& req)
+    {
+        try {
+            return req->poll();
+        }
+        catch (io_error&) {
+            return true;
+        }
+    }
+
+    //! assigns a free slot to bid, busy until its buffer is read
+    slot_type & occupy(unsigned_type i, const bid_type& bid, owner_type owner, unsigned_type pins)
+    {
+        slot_type& s = m_slots[i];
+        assert(!s.used);
+        s.bid = bid;
+        s.owner = owner;
+        s.pins = pins;
+        s.used = true;
+        s.referenced = true;
+        s.dirty = false;
+        s.busy = true;
+        s.req = request_ptr();
+        m_bid_map[bid] = i;
+        return s;
+    }
+
+    //! frees a slot, the buffer is kept
+    void vacate(unsigned_type i)
+    {
+        slot_type& s = m_slots[i];
+        m_bid_map.erase(s.bid);
+        s.used = false;
+        s.pins = 0;
+        s.dirty = false;
+        s.busy = false;
+        s.req = request_ptr();
+        m_cond.notify_all();
+    }
+
+    //! allocates the buffer of an occupied slot, without holding the lock
+    void allocate(slot_type& s)
+    {
+        if (s.buffer)
+            return;
+        // may exceed the limit, the cache does not grow beyond its size
+        s.buffer = m_memory.allocate(raw_size);
+    }
+
+    //! frees the buffers of up to nblocks free or clean unpinned slots, for
+    //! the memory_manager
+    void drop_clean(uint64 nblocks)
+    {
+        scoped_mutex_lock lock(m_mutex);
+        uint64 dropped = 0;
+        for (unsigned_type i = 0; i < m_slots.size() && dropped < nblocks; ++i)
+        {
+            slot_type& s = m_slots[i];
+            if (!s.buffer || (s.used && (s.busy || s.pins > 0 || s.dirty)))
+                continue;
+            if (s.used) {
+                vacate(i);
+                ++n_dropped;
+            }
+            m_memory.deallocate(s.buffer, raw_size);
+            s.buffer = NULL;
+            ++dropped;
+        }
+    }
+};
+
+//! \}
+
+STXXL_END_NAMESPACE
+
+#endif // !STXXL_MNG_SHARED_BLOCK_CACHE_HEADER
+// vim: et:ts=4:sw=4
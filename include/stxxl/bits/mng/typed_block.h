@@ -20,7 +20,9 @@
 
 #include <stxxl/bits/config.h>
 #include <stxxl/bits/io/request.h>
+#include <stxxl/bits/io/request_batch.h>
 #include <stxxl/bits/common/aligned_alloc.h>
+#include <stxxl/bits/common/huge_pages.h>
 #include <stxxl/bits/mng/bid.h>
 
 #ifndef STXXL_VERBOSE_TYPED_BLOCK
@@ -304,6 +306,28 @@ public:
         return bid.storage->aread(this, bid.offset, raw_size, on_cmpl);
     }
 
+    /*! Schedules writing the block to the disk(s) as part of a batch.
+     *! \param bid block identifier, points the file(disk) and position
+     *! \param batch collects the request until submitted
+     *! \param req receives the request object when the batch is submitted
+     */
+    void write(const bid_type& bid, request_batch& batch, request_ptr& req)
+    {
+        STXXL_VERBOSE_BLOCK_LIFE_CYCLE("BLC:write  " << FMT_BID(bid));
+        batch.awrite(bid.storage, this, bid.offset, raw_size, req);
+    }
+
+    /*! Schedules reading the block from the disk(s) as part of a batch.
+     *! \param bid block identifier, points the file(disk) and position
+     *! \param batch collects the request until submitted
+     *! \param req receives the request object when the batch is submitted
+     */
+    void read(const bid_type& bid, request_batch& batch, request_ptr& req)
+    {
+        STXXL_VERBOSE_BLOCK_LIFE_CYCLE("BLC:read   " << FMT_BID(bid));
+        batch.aread(bid.storage, this, bid.offset, raw_size, req);
+    }
+
     static void* operator new (size_t bytes)
     {
         unsigned_type meta_info_size = bytes % raw_size;
@@ -326,6 +350,22 @@ public:
         void* result = aligned_alloc<STXXL_BLOCK_ALIGN>(
             bytes - meta_info_size, meta_info_size);
 
+#if STXXL_WITH_VALGRIND || STXXL_TYPED_BLOCK_INITIALIZE_ZERO
+        memset(result, 0, bytes);
+#endif
+        return result;
+    }
+
+    //! Allocates a block backed by huge pages as selected by huge_pages,
+    //! e.g. new (HUGE_PAGES_TRANSPARENT) block_type.
+    static void* operator new (size_t bytes, huge_pages_mode huge_pages)
+    {
+        unsigned_type meta_info_size = bytes % raw_size;
+        STXXL_VERBOSE_TYPED_BLOCK("typed::block operator new: bytes=" << bytes << ", meta_info_size=" << meta_info_size << ", huge_pages=" << get_huge_pages_name(huge_pages));
+
+        void* result = aligned_alloc<STXXL_BLOCK_ALIGN>(
+            bytes - meta_info_size, meta_info_size, huge_pages);
+
 #if STXXL_WITH_VALGRIND || STXXL_TYPED_BLOCK_INITIALIZE_ZERO
         memset(result, 0, bytes);
 #endif
@@ -347,6 +387,11 @@ public:
         aligned_dealloc<STXXL_BLOCK_ALIGN>(ptr);
     }
 
+    static void operator delete (void* ptr, huge_pages_mode)
+    {
+        aligned_dealloc<STXXL_BLOCK_ALIGN>(ptr);
+    }
+
     static void operator delete (void*, void*)
     { }
 
@@ -14,11 +14,16 @@
 #ifndef STXXL_MNG_WRITE_POOL_HEADER
 #define STXXL_MNG_WRITE_POOL_HEADER
 
-#include <list>
+#include <vector>
 #include <stxxl/bits/config.h>
 #include <stxxl/bits/noncopyable.h>
 #include <stxxl/bits/deprecated.h>
+#include <stxxl/bits/common/huge_pages.h>
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/numa.h>
 #include <stxxl/bits/io/request_operations.h>
+#include <stxxl/bits/io/request_batch.h>
+#include <stxxl/bits/mng/bid_hash_table.h>
 
 #define STXXL_VERBOSE_WPOOL(msg) STXXL_VERBOSE1("write_pool[" << static_cast<void*>(this) << "]" << msg)
 
@@ -28,6 +33,11 @@ STXXL_BEGIN_NAMESPACE
 //! \{
 
 //! Implements dynamically resizable buffered writing pool.
+//!
+//! The free blocks and the blocks in writing are kept in arrays, and the
+//! blocks in writing are indexed by BID in an open addressing table. All are
+//! preallocated for the largest number of blocks the pool owned so far, hence
+//! stealing and writing blocks does not allocate memory.
 template <class BlockType>
 class write_pool : private noncopyable
 {
@@ -49,31 +59,204 @@ public:
 
         operator request_ptr () { return req; }
     };
-    typedef typename std::list<block_type*>::iterator free_blocks_iterator;
-    typedef typename std::list<busy_entry>::iterator busy_blocks_iterator;
+    typedef typename std::vector<block_type*>::iterator free_blocks_iterator;
+    typedef typename std::vector<busy_entry>::iterator busy_blocks_iterator;
 
 protected:
+    typedef bid_hash_table<bid_type, unsigned_type> busy_index_type;
+
     // contains free write blocks
-    std::list<block_type*> free_blocks;
-    // blocks that are in writing
-    std::list<busy_entry> busy_blocks;
+    std::vector<block_type*> free_blocks;
+    // blocks that are in writing, in no particular order
+    std::vector<busy_entry> busy_blocks;
+    // position in busy_blocks of the pending write to a bid, stale writes
+    // superseded by a newer one are not indexed
+    busy_index_type busy_index;
+    // number of blocks the arrays and the index have room for
+    unsigned_type capacity;
+    // NUMA node to allocate new blocks on, -1 for none
+    int numa_node;
+    // backing of new blocks
+    huge_pages_mode huge_pages;
+    // whether the pool is shared between threads and locks m_mutex
+    bool thread_safe;
+    // protects the pool if thread_safe
+    mutable mutex m_mutex;
+
+    //! Constructs pool, see concurrent_write_pool.
+    write_pool(unsigned_type init_size, int node, bool is_thread_safe)
+        : capacity(0), numa_node(node), huge_pages(HUGE_PAGES_DEFAULT), thread_safe(is_thread_safe)
+    {
+        init(init_size);
+    }
 
-public:
-    //! Constructs pool.
-    //! \param init_size initial number of blocks in the pool
-    explicit write_pool(unsigned_type init_size = 1)
+    void init(unsigned_type init_size)
     {
+        reserve(init_size);
         for (unsigned_type i = 0; i < init_size; ++i)
+            free_blocks.push_back(new_block());
+    }
+
+    //! allocates a new block, placed on the pool's NUMA node if set and backed
+    //! as selected by set_huge_pages()
+    block_type * new_block()
+    {
+        block_type* block = new (huge_pages) block_type;
+        if (numa_node >= 0)
+            numa_bind_memory(block, sizeof(block_type), numa_node);
+        STXXL_VERBOSE_WPOOL("  create block=" << block);
+        return block;
+    }
+
+    //! number of owned blocks, the lock must be held
+    unsigned_type owned_size() const
+    {
+        return free_blocks.size() + busy_blocks.size();
+    }
+
+    //! makes room for n owned blocks, grows geometrically
+    void reserve(unsigned_type n)
+    {
+        if (n <= capacity)
+            return;
+        capacity = std::max(n, 2 * capacity);
+        free_blocks.reserve(capacity);
+        busy_blocks.reserve(capacity);
+        busy_index.reserve(capacity);
+    }
+
+    //! returns the position of the pending write request to bid, or -1
+    int_type find_busy(const bid_type& bid)
+    {
+        unsigned_type* pos = busy_index.find(bid);
+        return pos ? int_type(*pos) : -1;
+    }
+
+    //! appends a write request to the busy blocks, capacity must be reserved
+    void push_busy(block_type* block, const request_ptr& req, const bid_type& bid)
+    {
+        assert(busy_blocks.size() < capacity);
+        int_type pos = find_busy(bid);
+        if (pos >= 0) {
+            // written twice in one batch, the first write becomes stale
+            busy_blocks[pos].bid.storage = 0;
+            busy_index.erase(bid);
+        }
+        busy_blocks.push_back(busy_entry());
+        busy_blocks.back().block = block;
+        busy_blocks.back().req = req;
+        busy_blocks.back().bid = bid;
+        if (bid.valid())
+            busy_index.insert(bid, busy_blocks.size() - 1);
+    }
+
+    //! removes the busy block at pos by moving the last one into its place
+    void erase_busy(unsigned_type pos)
+    {
+        if (busy_blocks[pos].bid.valid())
+            busy_index.erase(busy_blocks[pos].bid);
+        if (pos + 1 != busy_blocks.size()) {
+            busy_blocks[pos].block = busy_blocks.back().block;
+            busy_blocks[pos].req = busy_blocks.back().req;
+            busy_blocks[pos].bid = busy_blocks.back().bid;
+            if (busy_blocks[pos].bid.valid())
+                busy_index.insert(busy_blocks[pos].bid, pos);
+        }
+        busy_blocks.pop_back();
+    }
+
+    //! cancel a pending write request to bid, it is superseded by block
+    void cancel_pending_write(block_type* block, const bid_type& bid)
+    {
+        int_type pos = find_busy(bid);
+        if (pos < 0)
+            return;
+
+        assert(busy_blocks[pos].block != block);
+        STXXL_UNUSED(block);
+        STXXL_VERBOSE_WPOOL("WAW dependency");
+        // try to cancel the obsolete request
+        busy_blocks[pos].req->cancel();
+        // invalidate the bid of the stale write request,
+        // prevents prefetch_pool from stealing a stale block
+        busy_blocks[pos].bid.storage = 0;
+        busy_index.erase(bid);
+    }
+
+    //! takes out a block, waits for a write request if none is free
+    block_type * steal(scoped_optional_mutex_lock& lock)
+    {
+        STXXL_ASSERT(owned_size() > 0);
+        if (!free_blocks.empty())
         {
-            free_blocks.push_back(new block_type);
-            STXXL_VERBOSE_WPOOL("  create block=" << free_blocks.back());
+            block_type* p = free_blocks.back();
+            STXXL_VERBOSE_WPOOL("::steal : " << free_blocks.size() << " free blocks available, serve block=" << p);
+            free_blocks.pop_back();
+            return p;
+        }
+        STXXL_VERBOSE_WPOOL("::steal : all " << busy_blocks.size() << " are busy");
+        if (thread_safe)
+        {
+            // wait without holding the lock, another thread may be faster
+            // to take the block
+            while (free_blocks.empty())
+            {
+                STXXL_ASSERT(!busy_blocks.empty());
+                request_ptr req = busy_blocks.front().req;
+                lock.unlock();
+                req->wait();
+                lock.lock();
+                check_all_busy();
+            }
+            block_type* p = free_blocks.back();
+            free_blocks.pop_back();
+            STXXL_VERBOSE_WPOOL("  serve block=" << p);
+            return p;
         }
+        busy_blocks_iterator completed = wait_any(busy_blocks.begin(), busy_blocks.end());
+        assert(completed != busy_blocks.end()); // we got something reasonable from wait_any
+        assert(completed->req->poll());         // and it is *really* completed
+        block_type* p = completed->block;
+        erase_busy(completed - busy_blocks.begin());
+        check_all_busy();                       // for debug
+        STXXL_VERBOSE_WPOOL("  serve block=" << p);
+        return p;
+    }
+
+public:
+    //! Constructs pool.
+    //! \param init_size initial number of blocks in the pool
+    //! \param node NUMA node to allocate the blocks on, -1 for none
+    explicit write_pool(unsigned_type init_size = 1, int node = -1)
+        : capacity(0), numa_node(node), huge_pages(HUGE_PAGES_DEFAULT), thread_safe(false)
+    {
+        init(init_size);
     }
 
+    //! Swaps the contents of two pools, which must not be in use by other
+    //! threads.
     void swap(write_pool& obj)
     {
         std::swap(free_blocks, obj.free_blocks);
         std::swap(busy_blocks, obj.busy_blocks);
+        busy_index.swap(obj.busy_index);
+        std::swap(capacity, obj.capacity);
+        std::swap(numa_node, obj.numa_node);
+        std::swap(huge_pages, obj.huge_pages);
+    }
+
+    //! Sets the NUMA node on which blocks are allocated when the pool grows,
+    //! e.g. config::get_instance()->disk(i).numa_node. -1 for none.
+    void set_numa_node(int node)
+    {
+        numa_node = node;
+    }
+
+    //! Sets the backing of blocks allocated when the pool grows, by default
+    //! the process-wide one, see set_huge_pages(huge_pages_mode, size_t).
+    void set_huge_pages(huge_pages_mode mode)
+    {
+        huge_pages = mode;
     }
 
     //! Waits for completion of all ongoing write requests and frees memory.
@@ -93,10 +276,7 @@ public:
             for (busy_blocks_iterator i2 = busy_blocks.begin(); i2 != busy_blocks.end(); ++i2)
             {
                 i2->req->wait();
-                if (free_blocks.empty())
-                    STXXL_VERBOSE_WPOOL("  delete busy block=(empty)");
-                else
-                    STXXL_VERBOSE_WPOOL("  delete busy block=" << free_blocks.back());
+                STXXL_VERBOSE_WPOOL("  delete busy block=" << i2->block);
                 delete i2->block;
             }
         }
@@ -105,7 +285,11 @@ public:
     }
 
     //! Returns number of owned blocks.
-    unsigned_type size() const { return free_blocks.size() + busy_blocks.size(); }
+    unsigned_type size() const
+    {
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        return owned_size();
+    }
 
     //! Passes a block to the pool for writing.
     //! \param block block to write. Ownership of the block goes to the pool.
@@ -115,46 +299,71 @@ public:
     //! \return request object of the write operation
     request_ptr write(block_type*& block, bid_type bid)
     {
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
         STXXL_VERBOSE_WPOOL("::write: " << block << " @ " << bid);
-        for (busy_blocks_iterator i2 = busy_blocks.begin(); i2 != busy_blocks.end(); ++i2)
-        {
-            if (i2->bid == bid) {
-                assert(i2->block != block);
-                STXXL_VERBOSE_WPOOL("WAW dependency");
-                // try to cancel the obsolete request
-                i2->req->cancel();
-                // invalidate the bid of the stale write request,
-                // prevents prefetch_pool from stealing a stale block
-                i2->bid.storage = 0;
-            }
-        }
+        reserve(owned_size() + 1);
+        cancel_pending_write(block, bid);
         request_ptr result = block->write(bid);
-        busy_blocks.push_back(busy_entry(block, result, bid));
+        push_busy(block, result, bid);
         block = NULL; // prevent caller from using the block any further
         return result;
     }
 
+    //! Passes a range of blocks to the pool for writing. The write requests
+    //! are submitted to the disk queues at once, see \c request_batch.
+    //! \param blocks array of n blocks to write. Ownership of the blocks goes
+    //! to the pool, the pointers are set to NULL.
+    //! \param bids array of n locations, where to write. Of a bid given
+    //! several times only the last block is written, the others are returned
+    //! to the pool.
+    //! \param n number of blocks
+    void write(block_type** blocks, const bid_type* bids, unsigned_type n)
+    {
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        reserve(owned_size() + n);
+        for (unsigned_type i = 0; i < n; ++i)
+        {
+            STXXL_VERBOSE_WPOOL("::write: " << blocks[i] << " @ " << bids[i]);
+            cancel_pending_write(blocks[i], bids[i]);
+        }
+
+        const unsigned_type first = busy_blocks.size();
+        unsigned_type superseded = 0;
+        for (unsigned_type i = 0; i < n; ++i)
+        {
+            int_type pos = find_busy(bids[i]);
+            if (pos >= 0) {
+                // written twice in this batch, the first block is not written
+                assert(unsigned_type(pos) >= first);
+                STXXL_VERBOSE_WPOOL("WAW dependency in batch");
+                free_blocks.push_back(busy_blocks[pos].block);
+                busy_blocks[pos].block = NULL;
+                ++superseded;
+            }
+            push_busy(blocks[i], request_ptr(), bids[i]);
+            blocks[i] = NULL; // prevent caller from using the block any further
+        }
+        for (unsigned_type pos = busy_blocks.size(); superseded > 0 && pos > first; )
+        {
+            if (busy_blocks[--pos].block == NULL) {
+                erase_busy(pos);
+                --superseded;
+            }
+        }
+
+        // the batch keeps references to the busy entries' requests
+        request_batch batch;
+        for (unsigned_type pos = first; pos < busy_blocks.size(); ++pos)
+            busy_blocks[pos].block->write(busy_blocks[pos].bid, batch, busy_blocks[pos].req);
+        batch.submit();
+    }
+
     //! Take out a block from the pool.
     //! \return pointer to the block. Ownership of the block goes to the caller.
     block_type * steal()
     {
-        STXXL_ASSERT(size() > 0);
-        if (!free_blocks.empty())
-        {
-            block_type* p = free_blocks.back();
-            STXXL_VERBOSE_WPOOL("::steal : " << free_blocks.size() << " free blocks available, serve block=" << p);
-            free_blocks.pop_back();
-            return p;
-        }
-        STXXL_VERBOSE_WPOOL("::steal : all " << busy_blocks.size() << " are busy");
-        busy_blocks_iterator completed = wait_any(busy_blocks.begin(), busy_blocks.end());
-        assert(completed != busy_blocks.end()); // we got something reasonable from wait_any
-        assert(completed->req->poll());         // and it is *really* completed
-        block_type* p = completed->block;
-        busy_blocks.erase(completed);
-        check_all_busy();                       // for debug
-        STXXL_VERBOSE_WPOOL("  serve block=" << p);
-        return p;
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        return steal(lock);
     }
 
     // deprecated name for the steal()
@@ -167,75 +376,62 @@ public:
     //! \param new_size new size of the pool after the call
     void resize(unsigned_type new_size)
     {
-        int_type diff = int_type(new_size) - int_type(size());
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        int_type diff = int_type(new_size) - int_type(owned_size());
         if (diff > 0)
         {
+            reserve(new_size);
             while (--diff >= 0)
-            {
-                free_blocks.push_back(new block_type);
-                STXXL_VERBOSE_WPOOL("  create block=" << free_blocks.back());
-            }
+                free_blocks.push_back(new_block());
 
             return;
         }
 
         while (++diff <= 0)
-            delete steal();
+            delete steal(lock);
     }
 
     STXXL_DEPRECATED(request_ptr get_request(bid_type bid))
     {
-        busy_blocks_iterator i2 = busy_blocks.begin();
-        for ( ; i2 != busy_blocks.end(); ++i2)
-        {
-            if (i2->bid == bid)
-                return i2->req;
-        }
-        return request_ptr();
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        int_type pos = find_busy(bid);
+        return (pos >= 0) ? busy_blocks[pos].req : request_ptr();
     }
 
     bool has_request(bid_type bid)
     {
-        for (busy_blocks_iterator i2 = busy_blocks.begin(); i2 != busy_blocks.end(); ++i2)
-        {
-            if (i2->bid == bid)
-                return true;
-        }
-        return false;
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        return find_busy(bid) >= 0;
     }
 
     STXXL_DEPRECATED(block_type * steal(bid_type bid))
     {
-        busy_blocks_iterator i2 = busy_blocks.begin();
-        for ( ; i2 != busy_blocks.end(); ++i2)
-        {
-            if (i2->bid == bid)
-            {
-                block_type* p = i2->block;
-                i2->req->wait();
-                busy_blocks.erase(i2);
-                return p;
-            }
-        }
-        return NULL;
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        int_type pos = find_busy(bid);
+        if (pos < 0)
+            return NULL;
+
+        block_type* p = busy_blocks[pos].block;
+        busy_blocks[pos].req->wait();
+        erase_busy(pos);
+        return p;
     }
 
     // returns a block and a (potentially unfinished) I/O request associated with it
     std::pair<block_type*, request_ptr> steal_request(bid_type bid)
     {
-        for (busy_blocks_iterator i2 = busy_blocks.begin(); i2 != busy_blocks.end(); ++i2)
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
+        int_type pos = find_busy(bid);
+        if (pos >= 0)
         {
-            if (i2->bid == bid)
-            {
-                // remove busy block from list, request has not yet been waited for!
-                block_type* blk = i2->block;
-                request_ptr req = i2->req;
-                busy_blocks.erase(i2);
-
-                STXXL_VERBOSE_WPOOL("::steal_request block=" << blk);
-                // hand over block and (unfinished) request to caller
-                return std::pair<block_type*, request_ptr>(blk, req);
-            }
+            // remove busy block from list, request has not yet been waited for!
+            block_type* blk = busy_blocks[pos].block;
+            request_ptr req = busy_blocks[pos].req;
+            erase_busy(pos);
+
+            STXXL_VERBOSE_WPOOL("::steal_request block=" << blk);
+            // hand over block and (unfinished) request to caller
+            return std::pair<block_type*, request_ptr>(blk, req);
         }
         STXXL_VERBOSE_WPOOL("::steal_request NOT FOUND");
         // not matching request found, return a dummy
@@ -244,7 +440,9 @@ public:
 
     void add(block_type*& block)
     {
+        scoped_optional_mutex_lock lock(m_mutex, thread_safe);
         STXXL_VERBOSE_WPOOL("::add " << block);
+        reserve(owned_size() + 1);
         free_blocks.push_back(block);
         block = NULL; // prevent caller from using the block any further
     }
@@ -252,14 +450,14 @@ public:
 protected:
     void check_all_busy()
     {
-        busy_blocks_iterator cur = busy_blocks.begin();
+        unsigned_type cur = 0;
         int_type cnt = 0;
-        while (cur != busy_blocks.end())
+        while (cur < busy_blocks.size())
         {
-            if (cur->req->poll())
+            if (busy_blocks[cur].req->poll())
             {
-                free_blocks.push_back(cur->block);
-                cur = busy_blocks.erase(cur);
+                free_blocks.push_back(busy_blocks[cur].block);
+                erase_busy(cur);
                 ++cnt;
                 continue;
             }
@@ -270,6 +468,21 @@ protected:
     }
 };
 
+//! Thread-safe write_pool, which can be shared between threads, e.g. the
+//! workers of a parallel merge. steal() waits for write requests without
+//! holding the lock.
+template <class BlockType>
+class concurrent_write_pool : public write_pool<BlockType>
+{
+public:
+    //! Constructs pool.
+    //! \param init_size initial number of blocks in the pool
+    //! \param node NUMA node to allocate the blocks on, -1 for none
+    explicit concurrent_write_pool(unsigned_type init_size = 1, int node = -1)
+        : write_pool<BlockType>(init_size, node, true)
+    { }
+};
+
 //! \}
 
 STXXL_END_NAMESPACE
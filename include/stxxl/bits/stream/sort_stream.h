@@ -19,6 +19,7 @@
 #include <stxxl/bits/config.h>
 #include <stxxl/bits/stream/stream.h>
 #include <stxxl/bits/mng/block_manager.h>
+#include <stxxl/bits/mng/memory_manager.h>
 #include <stxxl/bits/algo/sort_base.h>
 #include <stxxl/bits/algo/sort_helper.h>
 #include <stxxl/bits/algo/adaptor.h>
@@ -233,11 +234,15 @@ void basic_runs_creator<Input, CompareType, BlockSize, AllocStr>::compute_result
     // fill the rest of the last block with max values
     fill_with_max_value(Blocks1, cur_run_size, blocks1_length);
 
+    // each run is handed to the disk queues in one batch
+    request_batch batch;
+
     for (i = 0; i < cur_run_size; ++i)
     {
         run[i].value = Blocks1[i][0];
-        write_reqs[i] = Blocks1[i].write(run[i].bid);
+        Blocks1[i].write(run[i].bid, batch, write_reqs[i]);
     }
+    batch.submit();
     m_result->runs.push_back(run);
     m_result->runs_sizes.push_back(blocks1_length);
     m_result->elements += blocks1_length;
@@ -276,7 +281,7 @@ void basic_runs_creator<Input, CompareType, BlockSize, AllocStr>::compute_result
         {
             run[i].value = Blocks1[i][0];
             write_reqs[i]->wait();
-            write_reqs[i] = Blocks1[i].write(run[i].bid);
+            Blocks1[i].write(run[i].bid, batch, write_reqs[i]);
         }
 
         request_ptr* write_reqs1 = new request_ptr[cur_run_size - m2];
@@ -284,8 +289,9 @@ void basic_runs_creator<Input, CompareType, BlockSize, AllocStr>::compute_result
         for ( ; i < cur_run_size; ++i)
         {
             run[i].value = Blocks1[i][0];
-            write_reqs1[i - m2] = Blocks1[i].write(run[i].bid);
+            Blocks1[i].write(run[i].bid, batch, write_reqs1[i - m2]);
         }
+        batch.submit();
 
         m_result->runs[0] = run;
         m_result->runs_sizes[0] = blocks2_length;
@@ -313,8 +319,9 @@ void basic_runs_creator<Input, CompareType, BlockSize, AllocStr>::compute_result
     {
         run[i].value = Blocks2[i][0];
         write_reqs[i]->wait();
-        write_reqs[i] = Blocks2[i].write(run[i].bid);
+        Blocks2[i].write(run[i].bid, batch, write_reqs[i]);
     }
+    batch.submit();
     assert((blocks2_length % el_in_run) == 0);
 
     m_result->add_run(run, blocks2_length);
@@ -334,8 +341,9 @@ void basic_runs_creator<Input, CompareType, BlockSize, AllocStr>::compute_result
         {
             run[i].value = Blocks1[i][0];
             write_reqs[i]->wait();
-            write_reqs[i] = Blocks1[i].write(run[i].bid);
+            Blocks1[i].write(run[i].bid, batch, write_reqs[i]);
         }
+        batch.submit();
         m_result->add_run(run, blocks1_length);
 
         std::swap(Blocks1, Blocks2);
@@ -469,6 +477,9 @@ private:
     //! run object containing block ids of the run being written to disk
     run_type run;
 
+    //! accounts the accumulation buffers with the memory_manager
+    memory_consumer m_memory;
+
 protected:
     //!  fill the rest of the block with max values
     void fill_with_max_value(block_type* blocks, unsigned_type num_blocks,
@@ -520,6 +531,7 @@ protected:
         // fill the rest of the last block with max values
         fill_with_max_value(m_blocks1, cur_run_size, m_cur_el);
 
+        request_batch batch;
         unsigned_type i = 0;
         for ( ; i < cur_run_size; ++i)
         {
@@ -527,8 +539,9 @@ protected:
             if (m_write_reqs[i].get())
                 m_write_reqs[i]->wait();
 
-            m_write_reqs[i] = m_blocks1[i].write(run[i].bid);
+            m_blocks1[i].write(run[i].bid, batch, m_write_reqs[i]);
         }
+        batch.submit();
         m_result->add_run(run, m_cur_el);
 
         for (i = 0; i < m_m2; ++i)
@@ -549,7 +562,8 @@ public:
           m_m2(m_memsize / 2),
           m_el_in_run(m_m2 * block_type::size),
           m_blocks1(NULL), m_blocks2(NULL),
-          m_write_reqs(NULL)
+          m_write_reqs(NULL),
+          m_memory("runs_creator")
     {
         sort_helper::verify_sentinel_strict_weak_ordering(m_cmp);
         if (!(2 * BlockSize * sort_memory_usage_factor() <= m_memory_to_use)) {
@@ -591,6 +605,7 @@ public:
     {
         if (!m_blocks1)
         {
+            m_memory.acquire(m_m2 * 2 * block_type::raw_size);
             m_blocks1 = new block_type[m_m2 * 2];
             m_blocks2 = m_blocks1 + m_m2;
 
@@ -612,6 +627,7 @@ public:
 
             delete[] m_write_reqs;
             m_write_reqs = NULL;
+            m_memory.release_all();
         }
     }
 
@@ -640,14 +656,16 @@ public:
 
         disk_queues::get_instance()->set_priority_op(request_queue::WRITE);
 
+        request_batch batch;
         for (unsigned_type i = 0; i < cur_run_blocks; ++i)
         {
             run[i].value = m_blocks1[i][0];
             if (m_write_reqs[i].get())
                 m_write_reqs[i]->wait();
 
-            m_write_reqs[i] = m_blocks1[i].write(run[i].bid);
+            m_blocks1[i].write(run[i].bid, batch, m_write_reqs[i]);
         }
+        batch.submit();
 
         m_result->add_run(run, m_el_in_run);
 
@@ -987,6 +1005,9 @@ private:
     //! prefetcher object
     prefetcher_type* m_prefetcher;
 
+    //! accounts the prefetch buffers with the memory_manager
+    memory_consumer m_memory;
+
     //! loser tree used for native merging
     loser_tree_type* m_losers;
 
@@ -1017,6 +1038,7 @@ private:
             delete m_prefetcher;
             delete[] m_prefetch_seq;
             m_prefetcher = NULL;
+            m_memory.release_all();
         }
     }
 
@@ -1104,6 +1126,7 @@ public:
           m_buffer_block(new out_block_type),
           m_prefetch_seq(NULL),
           m_prefetcher(NULL),
+          m_memory("runs_merger"),
           m_losers(NULL)
 #if STXXL_PARALLEL_MULTIWAY_MERGE
           , seqs(NULL),
@@ -1227,11 +1250,13 @@ public:
             m_prefetch_seq[i] = i;
 #endif      //STXXL_SORT_OPTIMAL_PREFETCHING
 
+        const unsigned_type n_buffers = STXXL_MIN(nruns + n_prefetch_buffers, prefetch_seq_size);
+        m_memory.acquire(n_buffers * block_type::raw_size);
         m_prefetcher = new prefetcher_type(
             m_consume_seq.begin(),
             m_consume_seq.end(),
             m_prefetch_seq,
-            STXXL_MIN(nruns + n_prefetch_buffers, prefetch_seq_size));
+            n_buffers);
 
         if (do_parallel_merge())
         {
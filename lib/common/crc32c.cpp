@@ -0,0 +1,226 @@
+/***************************************************************************
+ *  lib/common/crc32c.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <cstring>
+
+#include <stxxl/bits/common/crc32c.h>
+#include <stxxl/bits/config.h>
+
+#if STXXL_HAVE_SSE42_CRC32C
+ #include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+ #include <arm_acle.h>
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! reflected polynomial of CRC-32C
+static const uint32 crc32c_poly = 0x82F63B78;
+
+//! table of the byte-wise computation
+struct crc32c_table_type
+{
+    uint32 entry[256];
+
+    crc32c_table_type()
+    {
+        for (uint32 i = 0; i < 256; ++i)
+        {
+            uint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? (c >> 1) ^ crc32c_poly : (c >> 1);
+            entry[i] = c;
+        }
+    }
+};
+
+static const crc32c_table_type crc32c_table;
+
+//! computes the CRC of inverted crc, byte by byte
+static uint32 crc32c_table_bytes(const unsigned char* p, size_t size, uint32 crc)
+{
+    for (size_t i = 0; i < size; ++i)
+        crc = crc32c_table.entry[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if STXXL_HAVE_SSE42_CRC32C || defined(__ARM_FEATURE_CRC32)
+
+//! Multiplies the 32x32 GF(2) matrix mat, given by its columns, with vec.
+static uint32 gf2_matrix_times(const uint32* mat, uint32 vec)
+{
+    uint32 sum = 0;
+    for ( ; vec; vec >>= 1, ++mat)
+    {
+        if (vec & 1)
+            sum ^= *mat;
+    }
+    return sum;
+}
+
+//! Tables of the linear map which appends n zero bytes to the data of an
+//! (inverted) CRC, it combines the CRCs of consecutive pieces: the CRC of
+//! A + B is shift(crc(A)) ^ crc(B) with n = |B| and crc(B) started at zero.
+struct crc32c_shift_type
+{
+    uint32 entry[4][256];
+
+    explicit crc32c_shift_type(size_t n)
+    {
+        // columns of the map appending one zero byte, which is squared to
+        // get the map for n bytes
+        uint32 mat[32], tmp[32], result[32];
+        for (int i = 0; i < 32; ++i)
+        {
+            uint32 c = (uint32)1 << i;
+            mat[i] = crc32c_table.entry[c & 0xFF] ^ (c >> 8);
+            result[i] = (uint32)1 << i;
+        }
+        for ( ; n; n >>= 1)
+        {
+            if (n & 1)
+            {
+                for (int i = 0; i < 32; ++i)
+                    tmp[i] = gf2_matrix_times(mat, result[i]);
+                for (int i = 0; i < 32; ++i)
+                    result[i] = tmp[i];
+            }
+            for (int i = 0; i < 32; ++i)
+                tmp[i] = gf2_matrix_times(mat, mat[i]);
+            for (int i = 0; i < 32; ++i)
+                mat[i] = tmp[i];
+        }
+
+        for (int k = 0; k < 4; ++k)
+        {
+            for (uint32 b = 0; b < 256; ++b)
+                entry[k][b] = gf2_matrix_times(result, b << (8 * k));
+        }
+    }
+
+    uint32 operator () (uint32 crc) const
+    {
+        return entry[0][crc & 0xFF] ^ entry[1][(crc >> 8) & 0xFF] ^
+               entry[2][(crc >> 16) & 0xFF] ^ entry[3][crc >> 24];
+    }
+};
+
+//! The crc32 instruction has a latency of three cycles but a throughput of
+//! one per cycle, thus three interleaved pieces of this length are
+//! processed at a time and their CRCs combined.
+static const size_t crc32c_stream_bytes = 4096;
+
+static const crc32c_shift_type crc32c_shift_1(crc32c_stream_bytes);
+static const crc32c_shift_type crc32c_shift_2(2 * crc32c_stream_bytes);
+
+#endif
+
+#if STXXL_HAVE_SSE42_CRC32C
+
+static const bool crc32c_have_hardware =
+    (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2") != 0);
+
+//! computes the CRC of inverted crc with the crc32 instruction, eight bytes
+//! at a time in three streams
+__attribute__ ((target("sse4.2")))
+static uint32 crc32c_hardware(const unsigned char* p, size_t size, uint32 crc)
+{
+    for ( ; size && ((size_t)p & 7); --size)
+        crc = _mm_crc32_u8(crc, *p++);
+
+    for ( ; size >= 3 * crc32c_stream_bytes;
+          size -= 3 * crc32c_stream_bytes, p += 3 * crc32c_stream_bytes)
+    {
+        const unsigned char* p1 = p + crc32c_stream_bytes;
+        const unsigned char* p2 = p + 2 * crc32c_stream_bytes;
+        uint64 c0 = crc, c1 = 0, c2 = 0;
+        for (size_t i = 0; i < crc32c_stream_bytes; i += 8)
+        {
+            uint64 v0, v1, v2;
+            std::memcpy(&v0, p + i, sizeof(v0));
+            std::memcpy(&v1, p1 + i, sizeof(v1));
+            std::memcpy(&v2, p2 + i, sizeof(v2));
+            c0 = _mm_crc32_u64(c0, v0);
+            c1 = _mm_crc32_u64(c1, v1);
+            c2 = _mm_crc32_u64(c2, v2);
+        }
+        crc = crc32c_shift_2((uint32)c0) ^ crc32c_shift_1((uint32)c1) ^ (uint32)c2;
+    }
+
+    uint64 c = crc;
+    for ( ; size >= 8; size -= 8, p += 8)
+    {
+        uint64 v;
+        std::memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32)c;
+
+    for ( ; size; --size)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+#elif defined(__ARM_FEATURE_CRC32)
+
+static const bool crc32c_have_hardware = true;
+
+//! computes the CRC of inverted crc with the ARMv8 crc32c instructions,
+//! eight bytes at a time in three streams
+static uint32 crc32c_hardware(const unsigned char* p, size_t size, uint32 crc)
+{
+    for ( ; size && ((size_t)p & 7); --size)
+        crc = __crc32cb(crc, *p++);
+
+    for ( ; size >= 3 * crc32c_stream_bytes;
+          size -= 3 * crc32c_stream_bytes, p += 3 * crc32c_stream_bytes)
+    {
+        const unsigned char* p1 = p + crc32c_stream_bytes;
+        const unsigned char* p2 = p + 2 * crc32c_stream_bytes;
+        uint32 c0 = crc, c1 = 0, c2 = 0;
+        for (size_t i = 0; i < crc32c_stream_bytes; i += 8)
+        {
+            uint64 v0, v1, v2;
+            std::memcpy(&v0, p + i, sizeof(v0));
+            std::memcpy(&v1, p1 + i, sizeof(v1));
+            std::memcpy(&v2, p2 + i, sizeof(v2));
+            c0 = __crc32cd(c0, v0);
+            c1 = __crc32cd(c1, v1);
+            c2 = __crc32cd(c2, v2);
+        }
+        crc = crc32c_shift_2(c0) ^ crc32c_shift_1(c1) ^ c2;
+    }
+
+    for ( ; size >= 8; size -= 8, p += 8)
+    {
+        uint64 v;
+        std::memcpy(&v, p, sizeof(v));
+        crc = __crc32cd(crc, v);
+    }
+
+    for ( ; size; --size)
+        crc = __crc32cb(crc, *p++);
+    return crc;
+}
+
+#endif
+
+uint32 crc32c(const void* data, size_t size, uint32 crc)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+#if STXXL_HAVE_SSE42_CRC32C || defined(__ARM_FEATURE_CRC32)
+    if (crc32c_have_hardware)
+        return ~crc32c_hardware(p, size, ~crc);
+#endif
+    return ~crc32c_table_bytes(p, size, ~crc);
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
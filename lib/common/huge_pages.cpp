@@ -0,0 +1,269 @@
+/***************************************************************************
+ *  lib/common/huge_pages.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/common/huge_pages.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <stxxl/bits/common/mutex.h>
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/unused.h>
+#include <stxxl/bits/verbose.h>
+
+#if STXXL_HAVE_HUGE_PAGES
+ #include <unistd.h>
+ #include <sys/mman.h>
+
+ #ifndef MAP_HUGE_SHIFT
+  #define MAP_HUGE_SHIFT 26
+ #endif
+ #ifndef MAP_HUGE_2MB
+  #define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+ #endif
+ #ifndef MAP_HUGE_1GB
+  #define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+ #endif
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! process-wide huge page settings and statistics
+struct huge_pages_settings
+{
+    mutex mtx;
+    huge_pages_mode mode;
+    size_t min_size;
+    //! bytes currently mapped per mode
+    size_t mapped[HUGE_PAGES_1GIB + 1];
+    //! whether a failure of the mode was already reported
+    bool failed[HUGE_PAGES_1GIB + 1];
+
+    huge_pages_settings()
+        : mode(HUGE_PAGES_NONE), min_size(2 * 1024 * 1024)
+    {
+        std::fill(mapped, mapped + HUGE_PAGES_1GIB + 1, 0);
+        std::fill(failed, failed + HUGE_PAGES_1GIB + 1, false);
+
+        const char* env = getenv("STXXLHUGEPAGES");
+        if (!env) return;
+
+        std::string str = env;
+        if (str == "thp" || str == "transparent")
+            mode = HUGE_PAGES_TRANSPARENT;
+        else if (str == "2m" || str == "2M")
+            mode = HUGE_PAGES_2MIB;
+        else if (str == "1g" || str == "1G")
+            mode = HUGE_PAGES_1GIB;
+        else if (str != "none" && str != "")
+            STXXL_ERRMSG("Unknown STXXLHUGEPAGES=" << str << ", expected none, thp, 2m or 1g.");
+    }
+
+    static huge_pages_settings & get()
+    {
+        static huge_pages_settings settings;
+        return settings;
+    }
+};
+
+void set_huge_pages(huge_pages_mode mode, size_t min_size)
+{
+    huge_pages_settings& s = huge_pages_settings::get();
+    scoped_mutex_lock lock(s.mtx);
+    s.mode = (mode == HUGE_PAGES_DEFAULT) ? HUGE_PAGES_NONE : mode;
+    s.min_size = min_size;
+}
+
+huge_pages_mode get_huge_pages()
+{
+    huge_pages_settings& s = huge_pages_settings::get();
+    scoped_mutex_lock lock(s.mtx);
+    return s.mode;
+}
+
+const char * get_huge_pages_name(huge_pages_mode mode)
+{
+    switch (mode)
+    {
+    case HUGE_PAGES_DEFAULT:
+        return "default";
+    case HUGE_PAGES_NONE:
+        return "none";
+    case HUGE_PAGES_TRANSPARENT:
+        return "transparent";
+    case HUGE_PAGES_2MIB:
+        return "2 MiB";
+    case HUGE_PAGES_1GIB:
+        return "1 GiB";
+    }
+    return "unknown";
+}
+
+size_t get_huge_pages_mapped(huge_pages_mode mode)
+{
+    huge_pages_settings& s = huge_pages_settings::get();
+    scoped_mutex_lock lock(s.mtx);
+    return (mode > HUGE_PAGES_DEFAULT && mode <= HUGE_PAGES_1GIB) ? s.mapped[mode] : 0;
+}
+
+#if STXXL_HAVE_HUGE_PAGES
+
+//! stored at the beginning of the normal page in front of the data area
+struct huge_pages_header
+{
+    size_t prefix_size;
+    size_t length;
+    huge_pages_mode mode;
+};
+
+static size_t huge_page_size(huge_pages_mode mode)
+{
+    return (mode == HUGE_PAGES_1GIB) ? 1024 * 1024 * 1024 : 2 * 1024 * 1024;
+}
+
+//! maps a data area of length bytes at a huge page boundary, preceded by one
+//! normal page, returns the beginning of the normal page or NULL.
+static char * huge_pages_map(size_t length, huge_pages_mode mode)
+{
+    const size_t prefix_size = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t huge_size = huge_page_size(mode);
+
+    // reserve address space for aligning the data area to a huge page
+    size_t reserve_size = prefix_size + length + huge_size;
+    char* area = (char*)mmap(NULL, reserve_size, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED)
+        return NULL;
+
+    char* data = area + prefix_size;
+    data += (huge_size - (size_t)data % huge_size) % huge_size;
+    char* base = data - prefix_size;
+
+    // give back the unused address space in front and behind
+    if (base != area)
+        munmap(area, base - area);
+    if (data + length != area + reserve_size)
+        munmap(data + length, area + reserve_size - (data + length));
+
+    bool ok = (mprotect(base, prefix_size, PROT_READ | PROT_WRITE) == 0);
+    if (ok && mode == HUGE_PAGES_TRANSPARENT)
+    {
+        ok = (mprotect(data, length, PROT_READ | PROT_WRITE) == 0);
+        // without transparent huge pages in the kernel the area is still
+        // usable with normal pages
+        if (ok && madvise(data, length, MADV_HUGEPAGE) != 0)
+            STXXL_VERBOSE1("huge_pages_alloc(): madvise(MADV_HUGEPAGE) failed: " << strerror(errno));
+    }
+    else if (ok)
+    {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB |
+                    ((mode == HUGE_PAGES_1GIB) ? MAP_HUGE_1GB : MAP_HUGE_2MB);
+        ok = (mmap(data, length, PROT_READ | PROT_WRITE, flags, -1, 0) != MAP_FAILED);
+    }
+
+    if (!ok) {
+        STXXL_VERBOSE1("huge_pages_alloc(): mapping " << length << " bytes with " <<
+                       get_huge_pages_name(mode) << " pages failed: " << strerror(errno));
+        munmap(base, prefix_size + length);
+        return NULL;
+    }
+
+    huge_pages_header* header = (huge_pages_header*)base;
+    header->prefix_size = prefix_size;
+    header->length = length;
+    header->mode = mode;
+    return base;
+}
+
+void * huge_pages_alloc(size_t size, size_t meta_info_size, huge_pages_mode mode)
+{
+    huge_pages_settings& s = huge_pages_settings::get();
+    {
+        scoped_mutex_lock lock(s.mtx);
+        if (mode == HUGE_PAGES_DEFAULT)
+            mode = s.mode;
+        if (mode == HUGE_PAGES_NONE || size < s.min_size)
+            return NULL;
+    }
+
+    // the header, the pointer to it, and the meta info must fit in front
+    const size_t prefix_size = (size_t)sysconf(_SC_PAGESIZE);
+    if (sizeof(huge_pages_header) + sizeof(char*) + meta_info_size > prefix_size)
+        return NULL;
+
+    // never use pages larger than the allocation, a 2 MiB block must not
+    // occupy a whole 1 GiB page
+    while (mode > HUGE_PAGES_TRANSPARENT && huge_page_size(mode) > size)
+        mode = huge_pages_mode(mode - 1);
+    if (huge_page_size(mode) > size)
+        return NULL;
+
+    // fall back to smaller, then to transparent huge pages
+    for ( ; mode >= HUGE_PAGES_TRANSPARENT; mode = huge_pages_mode(mode - 1))
+    {
+        size_t length = huge_page_size(mode) * ((size + huge_page_size(mode) - 1) / huge_page_size(mode));
+        char* base = huge_pages_map(length, mode);
+
+        scoped_mutex_lock lock(s.mtx);
+        if (base)
+        {
+            s.mapped[mode] += length;
+
+            char* result = base + prefix_size - meta_info_size;
+            *(((char**)result) - 1) = base + 1; // tagged, see aligned_dealloc()
+            return result;
+        }
+        if (!s.failed[mode]) {
+            s.failed[mode] = true;
+            STXXL_ERRMSG("Mapping block buffers with " << get_huge_pages_name(mode) <<
+                         " huge pages failed, falling back to " <<
+                         (mode == HUGE_PAGES_TRANSPARENT ? "normal" : get_huge_pages_name(huge_pages_mode(mode - 1))) <<
+                         " pages.");
+        }
+    }
+    return NULL;
+}
+
+void huge_pages_free(void* ptr)
+{
+    char* base = (char*)ptr;
+    huge_pages_header header = *(huge_pages_header*)base;
+
+    munmap(base + header.prefix_size, header.length);
+    munmap(base, header.prefix_size);
+
+    huge_pages_settings& s = huge_pages_settings::get();
+    scoped_mutex_lock lock(s.mtx);
+    s.mapped[header.mode] -= header.length;
+}
+
+#else // !STXXL_HAVE_HUGE_PAGES
+
+void * huge_pages_alloc(size_t size, size_t meta_info_size, huge_pages_mode mode)
+{
+    STXXL_UNUSED(size);
+    STXXL_UNUSED(meta_info_size);
+    STXXL_UNUSED(mode);
+    return NULL;
+}
+
+void huge_pages_free(void* ptr)
+{
+    STXXL_UNUSED(ptr);
+    abort();
+}
+
+#endif // STXXL_HAVE_HUGE_PAGES
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
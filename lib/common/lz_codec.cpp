@@ -0,0 +1,195 @@
+/***************************************************************************
+ *  lib/common/lz_codec.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <cstring>
+
+#include <stxxl/bits/common/lz_codec.h>
+#include <stxxl/bits/common/types.h>
+
+STXXL_BEGIN_NAMESPACE
+
+// The compressed stream is a sequence of
+//   token | literal length ext | literals | offset (2 bytes LE) | match length ext
+// where the token holds the literal length in its upper and the match length
+// minus min_match in its lower nibble. A nibble of 15 is followed by length
+// bytes which are added up until one is less than 255. The last sequence
+// consists of literals only and ends the stream.
+
+static const size_t min_match = 4;
+static const size_t max_offset = 65535;
+static const unsigned hash_bits = 12;
+
+static inline uint32 read32(const uint8* p)
+{
+    uint32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline unsigned hash4(uint32 v)
+{
+    return (v * 2654435761U) >> (32 - hash_bits);
+}
+
+//! write extended length bytes for a length nibble of 15
+static inline uint8* write_length(uint8* op, size_t len)
+{
+    for ( ; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (uint8)len;
+    return op;
+}
+
+//! emit literals [anchor, anchor + lit) and, if mlen != 0, a match
+static inline bool emit_sequence(uint8*& op, uint8* oend,
+                                 const uint8* anchor, size_t lit,
+                                 size_t offset, size_t mlen)
+{
+    // token, literals and offset plus worst case length bytes
+    if ((size_t)(oend - op) < 1 + lit + lit / 255 + 1 + 2 + mlen / 255 + 1)
+        return false;
+
+    uint8* token = op++;
+    *token = (uint8)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15)
+        op = write_length(op, lit - 15);
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    if (mlen == 0)
+        return true;
+
+    *op++ = (uint8)(offset & 0xFF);
+    *op++ = (uint8)(offset >> 8);
+
+    mlen -= min_match;
+    *token |= (uint8)(mlen < 15 ? mlen : 15);
+    if (mlen >= 15)
+        op = write_length(op, mlen - 15);
+    return true;
+}
+
+size_t lz_compress(const void* src, size_t size, void* dst, size_t capacity)
+{
+    const uint8* in = static_cast<const uint8*>(src);
+    const uint8* end = in + size;
+    const uint8* ip = in;
+    const uint8* anchor = in;
+    uint8* op = static_cast<uint8*>(dst);
+    uint8* oend = op + capacity;
+
+    uint32 table[1 << hash_bits];
+    memset(table, 0, sizeof(table));
+
+    // skip ahead faster in incompressible data
+    size_t misses = 0;
+
+    while (ip + min_match <= end)
+    {
+        uint32 seq = read32(ip);
+        unsigned h = hash4(seq);
+        const uint8* ref = in + table[h];
+        table[h] = (uint32)(ip - in);
+
+        if (ref < ip && (size_t)(ip - ref) <= max_offset && read32(ref) == seq)
+        {
+            const uint8* mp = ip + min_match;
+            const uint8* rp = ref + min_match;
+            while (mp < end && *mp == *rp)
+                ++mp, ++rp;
+
+            if (!emit_sequence(op, oend, anchor, (size_t)(ip - anchor),
+                               (size_t)(ip - ref), (size_t)(mp - ip)))
+                return 0;
+
+            ip = anchor = mp;
+            misses = 0;
+        }
+        else
+        {
+            ip += 1 + (misses++ >> 5);
+        }
+    }
+
+    if (!emit_sequence(op, oend, anchor, (size_t)(end - anchor), 0, 0))
+        return 0;
+
+    return (size_t)(op - static_cast<uint8*>(dst));
+}
+
+//! read extended length bytes following a length nibble of 15
+static inline bool read_length(const uint8*& ip, const uint8* iend, size_t& len)
+{
+    uint8 b;
+    do {
+        if (ip == iend)
+            return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool lz_decompress(const void* src, size_t src_size, void* dst, size_t size)
+{
+    const uint8* ip = static_cast<const uint8*>(src);
+    const uint8* iend = ip + src_size;
+    uint8* out = static_cast<uint8*>(dst);
+    uint8* op = out;
+    uint8* oend = out + size;
+
+    while (ip < iend)
+    {
+        uint8 token = *ip++;
+
+        size_t lit = token >> 4;
+        if (lit == 15 && !read_length(ip, iend, lit))
+            return false;
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit)
+            return false;
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+
+        // the last sequence has no match
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+
+        size_t mlen = token & 15;
+        if (mlen == 15 && !read_length(ip, iend, mlen))
+            return false;
+        mlen += min_match;
+
+        if (offset == 0 || offset > (size_t)(op - out) ||
+            (size_t)(oend - op) < mlen)
+            return false;
+
+        const uint8* ref = op - offset;
+        if (offset >= mlen) {
+            memcpy(op, ref, mlen);
+            op += mlen;
+        }
+        else {
+            // overlapping match repeats the last offset bytes
+            for (size_t i = 0; i < mlen; ++i)
+                *op++ = *ref++;
+        }
+    }
+
+    return op == oend;
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
@@ -0,0 +1,144 @@
+/***************************************************************************
+ *  lib/common/numa.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/common/numa.h>
+
+#if STXXL_HAVE_NUMA
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include <stxxl/bits/verbose.h>
+
+#else
+
+#include <stxxl/bits/unused.h>
+
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+#if STXXL_HAVE_NUMA
+
+//! maximum node number supported by numa_bind_memory()
+static const int max_numa_node = 1024;
+
+//! parse a sysfs list like "0-3,8-11" into the numbers contained
+static bool read_sysfs_list(const std::string& path, std::vector<int>& list)
+{
+    std::ifstream in(path.c_str());
+    std::string line;
+    if (!in.good() || !std::getline(in, line))
+        return false;
+
+    std::istringstream ss(line);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        if (range.empty()) continue;
+
+        int first = atoi(range.c_str()), last = first;
+        std::string::size_type dash = range.find('-');
+        if (dash != std::string::npos)
+            last = atoi(range.c_str() + dash + 1);
+
+        for (int i = first; i <= last; ++i)
+            list.push_back(i);
+    }
+    return true;
+}
+
+int numa_num_nodes()
+{
+    std::vector<int> nodes;
+    if (!read_sysfs_list("/sys/devices/system/node/online", nodes) ||
+        nodes.empty())
+        return 1;
+    return nodes.back() + 1;
+}
+
+bool numa_bind_memory(void* ptr, size_t size, int node)
+{
+    if (node < 0 || node >= max_numa_node)
+        return false;
+
+    // mbind() works on whole pages
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t begin = ((size_t)ptr + page_size - 1) & ~(page_size - 1);
+    size_t end = ((size_t)ptr + size) & ~(page_size - 1);
+    if (begin >= end)
+        return true;
+
+    unsigned long nodemask[max_numa_node / (8 * sizeof(unsigned long))] = { 0 };
+    nodemask[node / (8 * sizeof(unsigned long))] =
+        1UL << (node % (8 * sizeof(unsigned long)));
+
+    long rc = syscall(SYS_mbind, begin, end - begin, MPOL_PREFERRED,
+                      nodemask, (unsigned long)max_numa_node + 1, MPOL_MF_MOVE);
+    if (rc != 0) {
+        STXXL_VERBOSE1("numa_bind_memory(): mbind() to node " << node <<
+                       " failed: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool numa_pin_thread(pthread_t thread, int node)
+{
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+
+    std::vector<int> cpus;
+    if (node < 0 || !read_sysfs_list(path.str(), cpus) || cpus.empty())
+        return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i)
+        CPU_SET(cpus[i], &set);
+
+    int rc = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (rc != 0) {
+        STXXL_VERBOSE1("numa_pin_thread(): pthread_setaffinity_np() to node " <<
+                       node << " failed: " << strerror(rc));
+        return false;
+    }
+    return true;
+}
+
+#else // !STXXL_HAVE_NUMA
+
+int numa_num_nodes()
+{
+    return 1;
+}
+
+bool numa_bind_memory(void* ptr, size_t size, int node)
+{
+    STXXL_UNUSED(ptr);
+    STXXL_UNUSED(size);
+    STXXL_UNUSED(node);
+    return false;
+}
+
+#endif // STXXL_HAVE_NUMA
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
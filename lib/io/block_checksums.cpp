@@ -0,0 +1,90 @@
+/***************************************************************************
+ *  lib/io/block_checksums.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/common/crc32c.h>
+#include <stxxl/bits/io/block_checksums.h>
+
+STXXL_BEGIN_NAMESPACE
+
+block_checksums::block_checksums()
+    : m_verified(0), m_mismatches(0)
+{ }
+
+void block_checksums::erase_overlapping(offset_type offset, size_type bytes)
+{
+    map_type::iterator it = m_map.lower_bound(offset);
+    // the preceding range may reach into the region
+    if (it != m_map.begin())
+    {
+        map_type::iterator prev = it;
+        --prev;
+        if (prev->first + prev->second.bytes > offset)
+            it = prev;
+    }
+    while (it != m_map.end() && it->first < offset + bytes)
+        m_map.erase(it++);
+}
+
+void block_checksums::record(offset_type offset, size_type bytes, const void* data)
+{
+    // compute without holding the lock
+    entry e = { bytes, crc32c(data, bytes) };
+
+    scoped_mutex_lock lock(m_mutex);
+    map_type::iterator it = m_map.find(offset);
+    if (it != m_map.end() && it->second.bytes == bytes) {
+        // fast path: a block is rewritten
+        it->second = e;
+        return;
+    }
+    erase_overlapping(offset, bytes);
+    m_map.insert(std::make_pair(offset, e));
+}
+
+bool block_checksums::verify(offset_type offset, size_type bytes, const void* data)
+{
+    uint32 crc;
+    {
+        scoped_mutex_lock lock(m_mutex);
+        map_type::const_iterator it = m_map.find(offset);
+        if (it == m_map.end() || it->second.bytes != bytes)
+            return true;
+        crc = it->second.crc;
+    }
+
+    bool ok = (crc32c(data, bytes) == crc);
+
+    scoped_mutex_lock lock(m_mutex);
+    ++m_verified;
+    if (!ok)
+        ++m_mismatches;
+    return ok;
+}
+
+void block_checksums::forget(offset_type offset, size_type bytes)
+{
+    scoped_mutex_lock lock(m_mutex);
+    erase_overlapping(offset, bytes);
+}
+
+uint64 block_checksums::get_verified()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_verified;
+}
+
+uint64 block_checksums::get_mismatches()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_mismatches;
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
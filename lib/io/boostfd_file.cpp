@@ -48,7 +48,7 @@ void boostfd_file::serve(void* buffer, offset_type offset, size_type bytes,
             " : " << ex.what());
     }
 
-    stats::scoped_read_write_timer read_write_timer(bytes, type == request::WRITE);
+    stats::scoped_read_write_timer read_write_timer(bytes, type == request::WRITE, get_device_id());
 
     if (type == request::READ)
     {
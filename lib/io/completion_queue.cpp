@@ -0,0 +1,179 @@
+/***************************************************************************
+ *  lib/io/completion_queue.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <vector>
+
+#include <stxxl/bits/config.h>
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/io/completion_queue.h>
+#include <stxxl/bits/unused.h>
+
+#if STXXL_HAVE_EVENTFD
+ #include <cerrno>
+ #include <sys/eventfd.h>
+ #include <unistd.h>
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+completion_queue::completion_queue()
+    : m_eventfd(-1)
+{ }
+
+completion_queue::~completion_queue()
+{
+    std::vector<request_ptr> pending;
+    {
+        scoped_mutex_lock lock(m_mutex);
+        for (watched_type::iterator it = m_watched.begin();
+             it != m_watched.end(); ++it)
+            pending.push_back(it->second);
+        m_watched.clear();
+    }
+    // after delete_waiter() returns a request no longer calls notify()
+    for (size_t i = 0; i < pending.size(); ++i)
+        pending[i]->delete_waiter(this);
+
+#if STXXL_HAVE_EVENTFD
+    if (m_eventfd >= 0)
+        ::close(m_eventfd);
+#endif
+}
+
+void completion_queue::watch(const request_ptr& req)
+{
+    {
+        scoped_mutex_lock lock(m_mutex);
+        if (!m_watched.insert(std::make_pair(req.get(), req)).second)
+            return;
+    }
+
+    bool done;
+    try {
+        done = req->add_waiter(this);
+    }
+    catch (io_error&) {
+        // the error is raised again when the request is waited for
+        done = true;
+    }
+    if (done)
+        notify(req.get());
+}
+
+bool completion_queue::unwatch(const request_ptr& req)
+{
+    {
+        scoped_mutex_lock lock(m_mutex);
+        if (m_watched.erase(req.get()) == 0)
+            return false;
+    }
+    req->delete_waiter(this);
+    return true;
+}
+
+void completion_queue::notify(request* req)
+{
+    scoped_mutex_lock lock(m_mutex);
+    watched_type::iterator it = m_watched.find(req);
+    if (it == m_watched.end())
+        return;
+
+    m_completed.push_back(it->second);
+    m_watched.erase(it);
+    if (m_completed.size() == 1)
+        signal_fd(true);
+
+    // notify while holding the lock: once it is released, a waiter may
+    // return and destroy the queue, e.g. the one of wait_all() or wait_any()
+    m_cond.notify_one();
+}
+
+void completion_queue::signal_fd(bool readable)
+{
+#if STXXL_HAVE_EVENTFD
+    if (m_eventfd < 0)
+        return;
+
+    uint64 value = 1;
+    if (readable) {
+        if (::write(m_eventfd, &value, sizeof(value)) != sizeof(value))
+            STXXL_ERRMSG("completion_queue: writing to eventfd failed");
+    }
+    else {
+        // reset the counter, the descriptor is not readable afterwards
+        if (::read(m_eventfd, &value, sizeof(value)) != sizeof(value) &&
+            errno != EAGAIN)
+            STXXL_ERRMSG("completion_queue: reading from eventfd failed");
+    }
+#else
+    STXXL_UNUSED(readable);
+#endif
+}
+
+request_ptr completion_queue::poll()
+{
+    scoped_mutex_lock lock(m_mutex);
+    if (m_completed.empty())
+        return request_ptr();
+
+    request_ptr req = m_completed.front();
+    m_completed.pop_front();
+    if (m_completed.empty())
+        signal_fd(false);
+    return req;
+}
+
+request_ptr completion_queue::wait()
+{
+    scoped_mutex_lock lock(m_mutex);
+    while (m_completed.empty())
+    {
+        if (m_watched.empty())
+            return request_ptr();
+        m_cond.wait(lock);
+    }
+
+    request_ptr req = m_completed.front();
+    m_completed.pop_front();
+    if (m_completed.empty())
+        signal_fd(false);
+    return req;
+}
+
+int completion_queue::get_fd()
+{
+#if STXXL_HAVE_EVENTFD
+    scoped_mutex_lock lock(m_mutex);
+    if (m_eventfd < 0)
+    {
+        m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventfd < 0)
+            STXXL_THROW_ERRNO(io_error, "eventfd() failed");
+        if (!m_completed.empty())
+            signal_fd(true);
+    }
+#endif
+    return m_eventfd;
+}
+
+size_t completion_queue::num_pending()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_watched.size();
+}
+
+size_t completion_queue::num_completed()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_completed.size();
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
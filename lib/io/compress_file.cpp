@@ -0,0 +1,326 @@
+/***************************************************************************
+ *  lib/io/compress_file.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <cassert>
+#include <cstring>
+#include <iomanip>
+
+#include <stxxl/bits/common/aligned_alloc.h>
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/exceptions.h>
+#include <stxxl/bits/common/lz_codec.h>
+#include <stxxl/bits/config.h>
+#include <stxxl/bits/io/boostfd_file.h>
+#include <stxxl/bits/io/compress_file.h>
+#include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/io/mmap_file.h>
+#include <stxxl/bits/io/syscall_file.h>
+#include <stxxl/bits/io/wincall_file.h>
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/verbose.h>
+
+STXXL_BEGIN_NAMESPACE
+
+template <class base_file_type>
+compress_file<base_file_type>::compress_file(
+    const std::string& filename,
+    int mode,
+    int queue_id,
+    int allocator_id,
+    unsigned int device_id)
+    : file(device_id),
+      disk_queued_file(queue_id, allocator_id),
+      storage(filename, mode, queue_id, NO_ALLOCATOR, device_id),
+      current_size(0),
+      storage_end(0),
+      buffer(NULL),
+      buffer_size(0)
+{
+    // previous contents are unreachable without the offset map and are
+    // overwritten from the start
+    storage_size = storage.size();
+}
+
+template <class base_file_type>
+compress_file<base_file_type>::~compress_file()
+{
+    if (buffer)
+        aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+}
+
+template <class base_file_type>
+char* compress_file<base_file_type>::get_buffer(size_type size)
+{
+    if (size > buffer_size)
+    {
+        if (buffer)
+            aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+        buffer = static_cast<char*>(aligned_alloc<STXXL_BLOCK_ALIGN>(size));
+        buffer_size = size;
+    }
+    return buffer;
+}
+
+template <class base_file_type>
+typename compress_file<base_file_type>::offset_type
+compress_file<base_file_type>::allocate(offset_type size)
+{
+    // first fit in the free regions, otherwise append
+    for (free_map::iterator it = free_space.begin(); it != free_space.end(); ++it)
+    {
+        if (it->second < size)
+            continue;
+
+        offset_type region = it->first;
+        if (it->second > size)
+            free_space[region + size] = it->second - size;
+        free_space.erase(it);
+        return region;
+    }
+
+    offset_type region = storage_end;
+    storage_end += size;
+    if (storage_end > storage_size)
+    {
+        storage.set_size(storage_end);
+        storage_size = storage_end;
+    }
+    return region;
+}
+
+template <class base_file_type>
+void compress_file<base_file_type>::add_free_region(offset_type offset, offset_type size)
+{
+    free_map::iterator succ = free_space.lower_bound(offset);
+    assert(succ == free_space.end() || offset + size <= succ->first);
+
+    // coalesce with successor
+    if (succ != free_space.end() && offset + size == succ->first)
+    {
+        size += succ->second;
+        free_space.erase(succ++);
+    }
+
+    // coalesce with predecessor
+    if (succ != free_space.begin())
+    {
+        free_map::iterator pred = succ;
+        --pred;
+        assert(pred->first + pred->second <= offset);
+        if (pred->first + pred->second == offset)
+        {
+            offset = pred->first;
+            size += pred->second;
+            free_space.erase(pred);
+        }
+    }
+
+    if (offset + size == storage_end)
+        storage_end = offset;       // shrink the log
+    else
+        free_space[offset] = size;
+}
+
+template <class base_file_type>
+void compress_file<base_file_type>::sread(void* buffer, offset_type offset, size_type bytes)
+{
+    extent ext;
+    offset_type ext_offset;
+    {
+        scoped_mutex_lock mapping_lock(mapping_mutex);
+        // find the first block ending after offset
+        typename extent_map::const_iterator it = address_mapping.upper_bound(offset);
+        if (it != address_mapping.begin())
+        {
+            --it;
+            if (it->first + it->second.bytes <= offset)
+                ++it;
+        }
+
+        if (it == address_mapping.end() || it->first >= offset + bytes)
+        {
+            // never written
+            memset(buffer, 0, bytes);
+            return;
+        }
+        if (it->first > offset || it->first + it->second.bytes < offset + bytes)
+            STXXL_THROW(io_error, "compress_file: read of " << bytes <<
+                        " bytes at " << offset << " spans several blocks");
+
+        ext_offset = it->first;
+        ext = it->second;
+    }
+
+    STXXL_VERBOSE2("compress_file: read " << bytes << " @ 0x" << std::hex <<
+                   offset << " from 0x" << ext.physical << std::dec <<
+                   " (" << ext.stored << " stored)");
+
+    if (!ext.compressed && ext_offset == offset && bytes == ext.bytes &&
+        bytes == padded(bytes))
+    {
+        storage.serve(buffer, ext.physical, bytes, request::READ);
+        return;
+    }
+
+    scoped_mutex_lock buffer_lock(buffer_mutex);
+    size_type stored = (size_type)padded(ext.stored);
+    bool whole = (ext_offset == offset && bytes == ext.bytes);
+    char* buf = get_buffer(whole ? stored : stored + (size_type)padded(ext.bytes));
+    storage.serve(buf, ext.physical, stored, request::READ);
+
+    if (!ext.compressed) {
+        memcpy(buffer, buf + (offset - ext_offset), bytes);
+    }
+    else if (whole) {
+        if (!lz_decompress(buf, ext.stored, buffer, bytes))
+            STXXL_THROW(io_error, "compress_file: corrupt block at " << offset);
+    }
+    else {
+        char* block = buf + stored;
+        if (!lz_decompress(buf, ext.stored, block, ext.bytes))
+            STXXL_THROW(io_error, "compress_file: corrupt block at " << ext_offset);
+        memcpy(buffer, block + (offset - ext_offset), bytes);
+    }
+}
+
+template <class base_file_type>
+void compress_file<base_file_type>::swrite(void* buffer, offset_type offset, size_type bytes)
+{
+    scoped_mutex_lock buffer_lock(buffer_mutex);
+
+    // only keep the compressed block if it saves at least one aligned unit
+    size_type raw = (size_type)padded(bytes);
+    size_type capacity = raw - STXXL_BLOCK_ALIGN;
+    char* buf = get_buffer(raw);
+    size_type stored = capacity ? (size_type)lz_compress(buffer, bytes, buf, capacity) : 0;
+    bool compressed = (stored != 0);
+
+    if (!compressed) {
+        stored = bytes;
+        if (bytes != raw) {
+            memcpy(buf, buffer, bytes);
+            memset(buf + bytes, 0, raw - bytes);
+        }
+        else {
+            buf = static_cast<char*>(buffer);
+        }
+    }
+    else {
+        memset(buf + stored, 0, (size_t)(padded(stored) - stored));
+    }
+
+    offset_type physical;
+    {
+        scoped_mutex_lock mapping_lock(mapping_mutex);
+
+        // overwriting must replace whole blocks
+        typename extent_map::iterator succ = address_mapping.lower_bound(offset);
+        bool same = (succ != address_mapping.end() && succ->first == offset &&
+                     succ->second.bytes == bytes);
+        bool overlaps = (!same && succ != address_mapping.end() &&
+                         succ->first < offset + bytes);
+        if (succ != address_mapping.begin())
+        {
+            typename extent_map::iterator pred = succ;
+            --pred;
+            overlaps = overlaps || (pred->first + pred->second.bytes > offset);
+        }
+        if (overlaps)
+            STXXL_THROW(io_error, "compress_file: write of " << bytes <<
+                        " bytes at " << offset << " overlaps a different block");
+
+        physical = allocate(padded(stored));
+    }
+
+    STXXL_VERBOSE2("compress_file: write " << bytes << " @ 0x" << std::hex <<
+                   offset << " to 0x" << physical << std::dec <<
+                   " (" << stored << " stored)");
+
+    storage.serve(buf, physical, (size_type)padded(stored), request::WRITE);
+    stats::get_instance()->write_compressed(bytes, (unsigned_type)padded(stored));
+
+    // switch the mapping only after the new copy is written
+    scoped_mutex_lock mapping_lock(mapping_mutex);
+    extent& ext = address_mapping[offset];
+    if (ext.bytes != 0)
+        add_free_region(ext.physical, padded(ext.stored));
+    ext.physical = physical;
+    ext.bytes = bytes;
+    ext.stored = stored;
+    ext.compressed = compressed;
+}
+
+template <class base_file_type>
+void compress_file<base_file_type>::serve(void* buffer, offset_type offset,
+                                          size_type bytes, request::request_type type)
+{
+    if (bytes == 0)
+        return;
+
+    if (type == request::READ)
+        sread(buffer, offset, bytes);
+    else
+        swrite(buffer, offset, bytes);
+}
+
+template <class base_file_type>
+void compress_file<base_file_type>::lock()
+{
+    storage.lock();
+}
+
+template <class base_file_type>
+void compress_file<base_file_type>::discard(offset_type offset, offset_type length)
+{
+    STXXL_UNUSED(length);
+
+    scoped_mutex_lock mapping_lock(mapping_mutex);
+    typename extent_map::iterator it = address_mapping.find(offset);
+    // could be OK if the block was never written
+    if (it == address_mapping.end())
+        return;
+
+    add_free_region(it->second.physical, padded(it->second.stored));
+    storage.discard(it->second.physical, padded(it->second.stored));
+    address_mapping.erase(it);
+
+    STXXL_VERBOSE2("compress_file: discard " << offset << " + " << length);
+}
+
+template <class base_file_type>
+void compress_file<base_file_type>::close_remove()
+{
+    storage.close_remove();
+}
+
+template <class base_file_type>
+const char* compress_file<base_file_type>::io_type() const
+{
+    return "compress";
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+template class compress_file<syscall_file>;
+
+#if STXXL_HAVE_MMAP_FILE
+template class compress_file<mmap_file>;
+#endif
+
+#if STXXL_HAVE_WINCALL_FILE
+template class compress_file<wincall_file>;
+#endif
+
+#if STXXL_HAVE_BOOSTFD_FILE
+template class compress_file<boostfd_file>;
+#endif
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
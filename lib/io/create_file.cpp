@@ -67,6 +67,10 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
         config::get_instance()->update_max_device_id(cfg.device_id);
     }
 
+    // select request queue implementation before the first request
+    if (!cfg.queue_impl.empty())
+        disk_queues::get_instance()->set_queue_impl(cfg.queue, cfg.queue_impl);
+
     // *** Select fileio Implementation
 
     if (cfg.io_impl == "syscall")
@@ -75,6 +79,7 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
             new syscall_file(cfg.path, mode, cfg.queue, disk_allocator_id,
                              cfg.device_id);
         result->lock();
+        result->set_discard(cfg.discard);
 
         // if marked as device but file is not -> throw!
         if (cfg.raw_device && !result->is_device())
@@ -105,6 +110,14 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
         result->lock();
         return result;
     }
+    else if (cfg.io_impl == "compress_syscall")
+    {
+        compress_file<syscall_file>* result =
+            new compress_file<syscall_file>(cfg.path, mode, cfg.queue,
+                                            disk_allocator_id, cfg.device_id);
+        result->lock();
+        return result;
+    }
     else if (cfg.io_impl == "memory")
     {
         mem_file* result = new mem_file(cfg.queue, disk_allocator_id, cfg.device_id);
@@ -123,6 +136,43 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
                               cfg.device_id, cfg.queue_length);
 
         result->lock();
+        result->set_discard(cfg.discard);
+
+        // if marked as device but file is not -> throw!
+        if (cfg.raw_device && !result->is_device())
+        {
+            delete result;
+            STXXL_THROW(io_error, "Disk " << cfg.path << " was expected to be "
+                        "a raw block device, but it is a normal file!");
+        }
+
+        // if is raw_device -> get size and remove some flags.
+        if (result->is_device())
+        {
+            cfg.raw_device = true;
+            cfg.size = result->size();
+            cfg.autogrow = cfg.delete_on_exit = cfg.unlink_on_open = false;
+        }
+
+        if (cfg.unlink_on_open)
+            result->unlink();
+
+        return result;
+    }
+#endif
+#if STXXL_HAVE_IOURING_FILE
+    // io_uring can have the desired queue length, specified as queue_length=?
+    else if (cfg.io_impl == "io_uring")
+    {
+        // iouring_queue is a singleton.
+        cfg.queue = file::DEFAULT_IOURING_QUEUE;
+
+        ufs_file_base* result =
+            new iouring_file(cfg.path, mode, cfg.queue, disk_allocator_id,
+                             cfg.device_id, cfg.queue_length);
+
+        result->lock();
+        result->set_discard(cfg.discard);
 
         // if marked as device but file is not -> throw!
         if (cfg.raw_device && !result->is_device())
@@ -153,6 +203,7 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
             new mmap_file(cfg.path, mode, cfg.queue, disk_allocator_id,
                           cfg.device_id);
         result->lock();
+        result->set_discard(cfg.discard);
 
         if (cfg.unlink_on_open)
             result->unlink();
@@ -167,6 +218,14 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
         result->lock();
         return result;
     }
+    else if (cfg.io_impl == "compress_mmap")
+    {
+        compress_file<mmap_file>* result =
+            new compress_file<mmap_file>(cfg.path, mode, cfg.queue,
+                                         disk_allocator_id, cfg.device_id);
+        result->lock();
+        return result;
+    }
 #endif
 #if STXXL_HAVE_SIMDISK_FILE
     else if (cfg.io_impl == "simdisk")
@@ -196,6 +255,14 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
         result->lock();
         return result;
     }
+    else if (cfg.io_impl == "compress_wincall")
+    {
+        compress_file<wincall_file>* result =
+            new compress_file<wincall_file>(cfg.path, mode, cfg.queue,
+                                            disk_allocator_id, cfg.device_id);
+        result->lock();
+        return result;
+    }
 #endif
 #if STXXL_HAVE_BOOSTFD_FILE
     else if (cfg.io_impl == "boostfd")
@@ -214,6 +281,14 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
         result->lock();
         return result;
     }
+    else if (cfg.io_impl == "compress_boostfd")
+    {
+        compress_file<boostfd_file>* result =
+            new compress_file<boostfd_file>(cfg.path, mode, cfg.queue,
+                                            disk_allocator_id, cfg.device_id);
+        result->lock();
+        return result;
+    }
 #endif
 #if STXXL_HAVE_WBTL_FILE
     else if (cfg.io_impl == "wbtl")
@@ -221,7 +296,9 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
         ufs_file_base* backend =
             new syscall_file(cfg.path, mode, -1, -1); // FIXME: ID
         wbtl_file* result =
-            new stxxl::wbtl_file(backend, 16 * 1024 * 1024, 2, cfg.queue,
+            new stxxl::wbtl_file(backend, 16 * 1024 * 1024,
+                                 cfg.write_buffers ? cfg.write_buffers : 2,
+                                 cfg.queue,
                                  disk_allocator_id);
         result->lock();
 
@@ -231,6 +308,38 @@ file * create_file(disk_config& cfg, int mode, int disk_allocator_id)
         return result;
     }
 #endif
+    else if (cfg.io_impl == "tiered")
+    {
+        file::offset_type fast_size = cfg.fast_size ? cfg.fast_size : cfg.size / 10;
+        if (cfg.fast_path.empty() || fast_size == 0)
+            STXXL_THROW(std::runtime_error, "Disk " << cfg.path << " with "
+                        "fileio tiered needs the options fast=<path> and "
+                        "fast_size=<size>.");
+
+        // the tiered_file forwards its requests to the backends, so the slow
+        // one is served by the disk's queue and the fast one by a queue of
+        // its own, such that both tiers work in parallel. Each tier is
+        // accounted as a device in the stats.
+        ufs_file_base* fast =
+            new syscall_file(cfg.fast_path, mode,
+                             config::get_instance()->get_next_queue_id(),
+                             file::NO_ALLOCATOR,
+                             config::get_instance()->get_next_device_id());
+        ufs_file_base* slow =
+            new syscall_file(cfg.path, mode, cfg.queue, file::NO_ALLOCATOR,
+                             cfg.device_id);
+        tiered_file* result =
+            new stxxl::tiered_file(fast, slow, fast_size, cfg.queue,
+                                   disk_allocator_id);
+        result->lock();
+
+        if (cfg.unlink_on_open) {
+            fast->unlink();
+            slow->unlink();
+        }
+
+        return result;
+    }
 
     STXXL_THROW(std::runtime_error,
                 "Unsupported disk I/O implementation '" << cfg.io_impl << "'.");
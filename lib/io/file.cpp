@@ -15,6 +15,12 @@
 
 STXXL_BEGIN_NAMESPACE
 
+void file::enable_checksums()
+{
+    if (!m_checksums)
+        m_checksums = new block_checksums();
+}
+
 int file::unlink(const char* path)
 {
     return ::unlink(path);
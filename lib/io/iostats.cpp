@@ -20,6 +20,7 @@
 #include <stxxl/bits/common/types.h>
 #include <stxxl/bits/namespace.h>
 
+#include <cassert>
 #include <string>
 #include <sstream>
 #include <iomanip>
@@ -35,6 +36,8 @@ stats::stats()
       c_writes(0),
       c_volume_read(0),
       c_volume_written(0),
+      z_volume_in(0),
+      z_volume_out(0),
       t_reads(0.0),
       t_writes(0.0),
       p_reads(0.0),
@@ -57,7 +60,106 @@ stats::stats()
       acc_waits(0),
       acc_wait_read(0), acc_wait_write(0),
       last_reset(timestamp())
-{ }
+{
+    for (unsigned d = 0; d < STXXL_IO_STATS_MAX_DISKS; ++d)
+        m_disks[d] = NULL;
+}
+
+stats::~stats()
+{
+    for (unsigned d = 0; d < STXXL_IO_STATS_MAX_DISKS; ++d)
+        delete m_disks[d];
+}
+
+void stats::disk_state::update(double now)
+{
+    double diff = now - p_begin;
+    counters.t_reads += double(acc_reads) * diff;
+    counters.t_writes += double(acc_writes) * diff;
+    counters.p_ios += (acc_reads + acc_writes) ? diff : 0.0;
+    counters.t_queue += double(counters.queue_depth) * diff;
+    p_begin = now;
+}
+
+stats::disk_state* stats::get_disk_state(unsigned disk)
+{
+    if (disk >= STXXL_IO_STATS_MAX_DISKS)
+        return NULL;
+
+    disk_state* d = m_disks[disk];
+    if (!d)
+    {
+        scoped_mutex_lock DisksLock(disks_mutex);
+        if (!m_disks[disk])
+            m_disks[disk] = new disk_state(timestamp());
+        d = m_disks[disk];
+    }
+    return d;
+}
+
+bool stats::get_disk_stats(unsigned disk, disk_stats& out) const
+{
+    if (disk >= STXXL_IO_STATS_MAX_DISKS || !m_disks[disk])
+        return false;
+
+    disk_state* d = m_disks[disk];
+    scoped_mutex_lock DiskLock(d->mtx);
+    d->update(timestamp());
+    out = d->counters;
+    return true;
+}
+
+unsigned stats::register_allocation_tag(const std::string& name)
+{
+    scoped_mutex_lock AllocationsLock(allocations_mutex);
+    for (unsigned t = 0; t < m_allocations.size(); ++t)
+    {
+        if (m_allocations[t].name == name)
+            return t;
+    }
+    m_allocations.push_back(allocation_stats());
+    m_allocations.back().name = name;
+    return (unsigned)(m_allocations.size() - 1);
+}
+
+void stats::set_allocation_quota(unsigned tag, int64 quota)
+{
+    scoped_mutex_lock AllocationsLock(allocations_mutex);
+    m_allocations[tag].quota = quota;
+}
+
+bool stats::allocation_added(unsigned tag, int64 bytes)
+{
+    scoped_mutex_lock AllocationsLock(allocations_mutex);
+    allocation_stats& a = m_allocations[tag];
+    if (a.quota && a.current + bytes > a.quota) {
+        ++a.refused;
+        return false;
+    }
+    a.current += bytes;
+    a.total += bytes;
+    a.maximum = STXXL_MAX(a.maximum, a.current);
+    return true;
+}
+
+void stats::allocation_removed(unsigned tag, int64 bytes)
+{
+    scoped_mutex_lock AllocationsLock(allocations_mutex);
+    assert(m_allocations[tag].current >= bytes);
+    m_allocations[tag].current -= bytes;
+}
+
+unsigned stats::get_allocation_tags() const
+{
+    scoped_mutex_lock AllocationsLock(allocations_mutex);
+    return (unsigned)m_allocations.size();
+}
+
+allocation_stats stats::get_allocation_stats(unsigned tag) const
+{
+    scoped_mutex_lock AllocationsLock(allocations_mutex);
+    return m_allocations[tag];
+}
 
 #ifndef STXXL_IO_STATS_RESET_FORBIDDEN
 void stats::reset()
@@ -89,6 +191,8 @@ void stats::reset()
         volume_written = 0;
         c_writes = 0;
         c_volume_written = 0;
+        z_volume_in = 0;
+        z_volume_out = 0;
         t_writes = 0.0;
         p_writes = 0.0;
     }
@@ -117,13 +221,35 @@ void stats::reset()
         t_wait_write = 0.0;
         p_wait_write = 0.0;
     }
+    m_latency = disk_latency();
 
     last_reset = timestamp();
+    for (unsigned d = 0; d < STXXL_IO_STATS_MAX_DISKS; ++d)
+    {
+        if (!m_disks[d]) continue;
+
+        scoped_mutex_lock DiskLock(m_disks[d]->mtx);
+        // keep the requests still in flight
+        disk_stats counters;
+        counters.queue_depth = m_disks[d]->counters.queue_depth;
+        m_disks[d]->counters = counters;
+        m_disks[d]->p_begin = last_reset;
+    }
+    {
+        scoped_mutex_lock AllocationsLock(allocations_mutex);
+        // keep the blocks still allocated
+        for (unsigned t = 0; t < m_allocations.size(); ++t)
+        {
+            m_allocations[t].maximum = m_allocations[t].current;
+            m_allocations[t].total = 0;
+            m_allocations[t].refused = 0;
+        }
+    }
 }
 #endif
 
 #if STXXL_IO_STATS
-void stats::write_started(unsigned_type size_, double now)
+void stats::write_started(unsigned_type size_, double now, unsigned disk)
 {
     if (now == 0.0)
         now = timestamp();
@@ -144,9 +270,18 @@ void stats::write_started(unsigned_type size_, double now)
         p_ios += (acc_ios++) ? diff : 0.0;
         p_begin_io = now;
     }
+    if (disk_state* d = get_disk_state(disk))
+    {
+        scoped_mutex_lock DiskLock(d->mtx);
+
+        d->update(now);
+        ++d->counters.writes;
+        d->counters.volume_written += size_;
+        ++d->acc_writes;
+    }
 }
 
-void stats::write_canceled(unsigned_type size_)
+void stats::write_canceled(unsigned_type size_, unsigned disk)
 {
     {
         scoped_mutex_lock WriteLock(write_mutex);
@@ -154,10 +289,17 @@ void stats::write_canceled(unsigned_type size_)
         --writes;
         volume_written -= size_;
     }
-    write_finished();
+    if (disk_state* d = get_disk_state(disk))
+    {
+        scoped_mutex_lock DiskLock(d->mtx);
+
+        --d->counters.writes;
+        d->counters.volume_written -= size_;
+    }
+    write_finished(disk);
 }
 
-void stats::write_finished()
+void stats::write_finished(unsigned disk)
 {
     double now = timestamp();
     {
@@ -175,6 +317,13 @@ void stats::write_finished()
         p_ios += (acc_ios--) ? diff : 0.0;
         p_begin_io = now;
     }
+    if (disk_state* d = get_disk_state(disk))
+    {
+        scoped_mutex_lock DiskLock(d->mtx);
+
+        d->update(now);
+        --d->acc_writes;
+    }
 }
 
 void stats::write_cached(unsigned_type size_)
@@ -185,7 +334,15 @@ void stats::write_cached(unsigned_type size_)
     c_volume_written += size_;
 }
 
-void stats::read_started(unsigned_type size_, double now)
+void stats::write_compressed(unsigned_type size_in, unsigned_type size_out)
+{
+    scoped_mutex_lock WriteLock(write_mutex);
+
+    z_volume_in += size_in;
+    z_volume_out += size_out;
+}
+
+void stats::read_started(unsigned_type size_, double now, unsigned disk)
 {
     if (now == 0.0)
         now = timestamp();
@@ -206,9 +363,18 @@ void stats::read_started(unsigned_type size_, double now)
         p_ios += (acc_ios++) ? diff : 0.0;
         p_begin_io = now;
     }
+    if (disk_state* d = get_disk_state(disk))
+    {
+        scoped_mutex_lock DiskLock(d->mtx);
+
+        d->update(now);
+        ++d->counters.reads;
+        d->counters.volume_read += size_;
+        ++d->acc_reads;
+    }
 }
 
-void stats::read_canceled(unsigned_type size_)
+void stats::read_canceled(unsigned_type size_, unsigned disk)
 {
     {
         scoped_mutex_lock ReadLock(read_mutex);
@@ -216,10 +382,17 @@ void stats::read_canceled(unsigned_type size_)
         --reads;
         volume_read -= size_;
     }
-    read_finished();
+    if (disk_state* d = get_disk_state(disk))
+    {
+        scoped_mutex_lock DiskLock(d->mtx);
+
+        --d->counters.reads;
+        d->counters.volume_read -= size_;
+    }
+    read_finished(disk);
 }
 
-void stats::read_finished()
+void stats::read_finished(unsigned disk)
 {
     double now = timestamp();
     {
@@ -237,6 +410,13 @@ void stats::read_finished()
         p_ios += (acc_ios--) ? diff : 0.0;
         p_begin_io = now;
     }
+    if (disk_state* d = get_disk_state(disk))
+    {
+        scoped_mutex_lock DiskLock(d->mtx);
+
+        d->update(now);
+        --d->acc_reads;
+    }
 }
 
 void stats::read_cached(unsigned_type size_)
@@ -246,6 +426,53 @@ void stats::read_cached(unsigned_type size_)
     ++c_reads;
     c_volume_read += size_;
 }
+
+void stats::request_submitted(unsigned disk)
+{
+    if (disk_state* d = get_disk_state(disk))
+    {
+        scoped_mutex_lock DiskLock(d->mtx);
+
+        d->update(timestamp());
+        ++d->counters.queue_depth;
+    }
+}
+
+void stats::request_completed(unsigned disk)
+{
+    if (disk_state* d = get_disk_state(disk))
+    {
+        scoped_mutex_lock DiskLock(d->mtx);
+
+        d->update(timestamp());
+        --d->counters.queue_depth;
+    }
+}
+
+void stats::request_served(unsigned disk, bool is_write,
+                           double queue_time, double service_time)
+{
+    // the histograms count atomically and need no lock
+    disk_state* ds = get_disk_state(disk);
+    disk_latency* d = ds ? &ds->counters.latency : NULL;
+
+    if (is_write) {
+        m_latency.write_queue.add(queue_time);
+        m_latency.write_service.add(service_time);
+        if (d) {
+            d->write_queue.add(queue_time);
+            d->write_service.add(service_time);
+        }
+    }
+    else {
+        m_latency.read_queue.add(queue_time);
+        m_latency.read_service.add(service_time);
+        if (d) {
+            d->read_queue.add(queue_time);
+            d->read_service.add(service_time);
+        }
+    }
+}
 #endif
 
 #ifndef STXXL_DO_NOT_COUNT_WAIT_TIME
@@ -352,6 +579,284 @@ std::string format_with_SI_IEC_unit_multiplier(uint64 number, const char* unit,
     return out.str();
 }
 
+//! print p50/p99/p99.9 of a latency histogram in milliseconds
+static void print_percentiles(std::ostream& o, const latency_histogram& h)
+{
+    std::ios_base::fmtflags flags = o.flags();
+    std::streamsize precision = o.precision();
+    o << std::fixed << std::setprecision(3)
+      << h.percentile(0.5) * 1e3 << " / "
+      << h.percentile(0.99) * 1e3 << " / "
+      << h.percentile(0.999) * 1e3 << " ms ("
+      << h.count() << " requests)" << std::endl;
+    o.flags(flags);
+    o.precision(precision);
+}
+
+void stats_data::print_disks(std::ostream& o) const
+{
+#define hr add_IEC_binary_multiplier
+    for (unsigned d = 0; d < get_disks(); ++d)
+    {
+        const disk_stats& ds = get_disk(d);
+        if (ds.reads + ds.writes == 0)
+            continue;
+
+        o << " disk " << std::setw(3) << d
+          << " number of bytes read / written    : "
+          << hr(ds.volume_read, "B") << "/ " << hr(ds.volume_written, "B")
+          << std::endl;
+        o << " disk " << std::setw(3) << d
+          << " busy time (utilization)           : " << ds.p_ios << " s ("
+          << (get_elapsed_time() > 0.0 ? 100.0 * ds.p_ios / get_elapsed_time() : 0.0)
+          << " %)" << std::endl;
+        o << " disk " << std::setw(3) << d
+          << " average / current queue depth     : "
+          << get_disk_average_queue_depth(d) << " / " << ds.queue_depth
+          << std::endl;
+
+        const disk_latency& l = ds.latency;
+        if (l.read_service.count() + l.write_service.count() == 0)
+            continue;
+
+        o << " disk " << std::setw(3) << d
+          << " read queue time p50/p99/p99.9     : ";
+        print_percentiles(o, l.read_queue);
+        o << " disk " << std::setw(3) << d
+          << " read service time p50/p99/p99.9   : ";
+        print_percentiles(o, l.read_service);
+        o << " disk " << std::setw(3) << d
+          << " write queue time p50/p99/p99.9    : ";
+        print_percentiles(o, l.write_queue);
+        o << " disk " << std::setw(3) << d
+          << " write service time p50/p99/p99.9  : ";
+        print_percentiles(o, l.write_service);
+    }
+#undef hr
+}
+
+void stats_data::print_allocations(std::ostream& o) const
+{
+#define hr add_IEC_binary_multiplier
+    for (unsigned t = 0; t < get_allocation_tags(); ++t)
+    {
+        const allocation_stats& a = get_allocation(t);
+        if (a.total == 0 && a.current == 0 && a.refused == 0)
+            continue;
+
+        o << " allocation tag " << a.name << std::endl;
+        o << "  current / maximum / total allocation      : "
+          << hr(a.current, "B") << "/ " << hr(a.maximum, "B") << "/ "
+          << hr(a.total, "B") << std::endl;
+        if (a.quota)
+            o << "  quota (refused allocations)               : "
+              << hr(a.quota, "B") << "(" << a.refused << ")" << std::endl;
+    }
+#undef hr
+}
+
+//! write a string value, escaping quotes and backslashes
+static void json_string(std::ostream& o, const std::string& str)
+{
+    o << '"';
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        if (str[i] == '"' || str[i] == '\\')
+            o << '\\';
+        o << str[i];
+    }
+    o << '"';
+}
+
+//! write "name":{"count":#,"p50":#,"p99":#,"p999":#}
+static void json_percentiles(std::ostream& o, const char* name,
+                             const latency_histogram& h)
+{
+    o << '"' << name << "\":{\"count\":" << h.count()
+      << ",\"p50\":" << h.percentile(0.5)
+      << ",\"p99\":" << h.percentile(0.99)
+      << ",\"p999\":" << h.percentile(0.999) << '}';
+}
+
+static void json_latency(std::ostream& o, const disk_latency& l)
+{
+    o << "\"latency\":{";
+    json_percentiles(o, "read_queue", l.read_queue);
+    o << ',';
+    json_percentiles(o, "read_service", l.read_service);
+    o << ',';
+    json_percentiles(o, "write_queue", l.write_queue);
+    o << ',';
+    json_percentiles(o, "write_service", l.write_service);
+    o << '}';
+}
+
+void stats_data::to_json(std::ostream& o) const
+{
+    std::ios_base::fmtflags flags = o.flags();
+    std::streamsize precision = o.precision();
+    o.unsetf(std::ios_base::floatfield);
+    o.precision(9);
+
+    o << "{\"reads\":" << get_reads()
+      << ",\"writes\":" << get_writes()
+      << ",\"read_volume\":" << get_read_volume()
+      << ",\"written_volume\":" << get_written_volume()
+      << ",\"cached_reads\":" << get_cached_reads()
+      << ",\"cached_writes\":" << get_cached_writes()
+      << ",\"cached_read_volume\":" << get_cached_read_volume()
+      << ",\"cached_written_volume\":" << get_cached_written_volume()
+      << ",\"compressed_input_volume\":" << get_compressed_input_volume()
+      << ",\"compressed_output_volume\":" << get_compressed_output_volume()
+      << ",\"read_time\":" << get_read_time()
+      << ",\"write_time\":" << get_write_time()
+      << ",\"pread_time\":" << get_pread_time()
+      << ",\"pwrite_time\":" << get_pwrite_time()
+      << ",\"pio_time\":" << get_pio_time()
+      << ",\"io_wait_time\":" << get_io_wait_time()
+      << ",\"wait_read_time\":" << get_wait_read_time()
+      << ",\"wait_write_time\":" << get_wait_write_time()
+      << ",\"elapsed\":" << get_elapsed_time()
+      << ',';
+    json_latency(o, get_latency());
+
+    o << ",\"disks\":[";
+    bool first = true;
+    for (unsigned d = 0; d < get_disks(); ++d)
+    {
+        const disk_stats& ds = get_disk(d);
+        if (ds.reads + ds.writes == 0)
+            continue;
+
+        if (!first) o << ',';
+        first = false;
+        o << "{\"disk\":" << d
+          << ",\"reads\":" << ds.reads
+          << ",\"writes\":" << ds.writes
+          << ",\"read_volume\":" << ds.volume_read
+          << ",\"written_volume\":" << ds.volume_written
+          << ",\"read_time\":" << ds.t_reads
+          << ",\"write_time\":" << ds.t_writes
+          << ",\"busy_time\":" << ds.p_ios
+          << ",\"average_queue_depth\":" << get_disk_average_queue_depth(d)
+          << ",\"queue_depth\":" << ds.queue_depth
+          << ',';
+        json_latency(o, ds.latency);
+        o << '}';
+    }
+    o << "],\"allocations\":[";
+    for (unsigned t = 0; t < get_allocation_tags(); ++t)
+    {
+        const allocation_stats& a = get_allocation(t);
+        if (t) o << ',';
+        o << "{\"tag\":";
+        json_string(o, a.name);
+        o << ",\"quota\":" << a.quota
+          << ",\"current\":" << a.current
+          << ",\"maximum\":" << a.maximum
+          << ",\"total\":" << a.total
+          << ",\"refused\":" << a.refused << '}';
+    }
+    o << "]}";
+
+    o.flags(flags);
+    o.precision(precision);
+}
+
+//! columns of a disk_latency in CSV rows
+static const char* csv_latency_columns[] = {
+    "read_queue", "read_service", "write_queue", "write_service"
+};
+
+static void csv_latency(std::ostream& o, const disk_latency& l)
+{
+    const latency_histogram* h[4] = {
+        &l.read_queue, &l.read_service, &l.write_queue, &l.write_service
+    };
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        o << ',' << h[i]->count()
+          << ',' << h[i]->percentile(0.5)
+          << ',' << h[i]->percentile(0.99)
+          << ',' << h[i]->percentile(0.999);
+    }
+}
+
+void stats_data::csv_header(std::ostream& o)
+{
+    o << "time,disk,reads,writes,read_volume,written_volume,"
+      << "cached_reads,cached_writes,cached_read_volume,cached_written_volume,"
+      << "compressed_input_volume,compressed_output_volume,"
+      << "read_time,write_time,pread_time,pwrite_time,pio_time,"
+      << "io_wait_time,wait_read_time,wait_write_time,elapsed,"
+      << "average_queue_depth,queue_depth";
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        const char* c = csv_latency_columns[i];
+        o << ',' << c << "_count," << c << "_p50,"
+          << c << "_p99," << c << "_p999";
+    }
+    o << std::endl;
+}
+
+void stats_data::to_csv(std::ostream& o, double time) const
+{
+    std::ios_base::fmtflags flags = o.flags();
+    std::streamsize precision = o.precision();
+    o.unsetf(std::ios_base::floatfield);
+    o.precision(9);
+
+    double avg_queue_depth = 0.0;
+    int queue_depth = 0;
+    for (unsigned d = 0; d < get_disks(); ++d)
+    {
+        avg_queue_depth += get_disk_average_queue_depth(d);
+        queue_depth += get_disk(d).queue_depth;
+    }
+
+    o << time << ",all"
+      << ',' << get_reads() << ',' << get_writes()
+      << ',' << get_read_volume() << ',' << get_written_volume()
+      << ',' << get_cached_reads() << ',' << get_cached_writes()
+      << ',' << get_cached_read_volume() << ',' << get_cached_written_volume()
+      << ',' << get_compressed_input_volume()
+      << ',' << get_compressed_output_volume()
+      << ',' << get_read_time() << ',' << get_write_time()
+      << ',' << get_pread_time() << ',' << get_pwrite_time()
+      << ',' << get_pio_time()
+      << ',' << get_io_wait_time()
+      << ',' << get_wait_read_time() << ',' << get_wait_write_time()
+      << ',' << get_elapsed_time()
+      << ',' << avg_queue_depth << ',' << queue_depth;
+    csv_latency(o, get_latency());
+    o << std::endl;
+
+    // cache, compression, parallel read/write and wait times are only known
+    // for all disks together
+    for (unsigned d = 0; d < get_disks(); ++d)
+    {
+        const disk_stats& ds = get_disk(d);
+        if (ds.reads + ds.writes == 0)
+            continue;
+
+        o << time << ',' << d
+          << ',' << ds.reads << ',' << ds.writes
+          << ',' << ds.volume_read << ',' << ds.volume_written
+          << ",,,,,,"
+          << ',' << ds.t_reads << ',' << ds.t_writes
+          << ",,"
+          << ',' << ds.p_ios
+          << ",,,"
+          << ',' << get_elapsed_time()
+          << ',' << get_disk_average_queue_depth(d) << ',' << ds.queue_depth;
+        csv_latency(o, ds.latency);
+        o << std::endl;
+    }
+
+    o.flags(flags);
+    o.precision(precision);
+}
+
 std::ostream& operator << (std::ostream& o, const stats_data& s)
 {
 #define hr add_IEC_binary_multiplier
@@ -377,6 +882,11 @@ std::ostream& operator << (std::ostream& o, const stats_data& s)
         o << " average block size (cached write)          : " << hr(s.get_cached_written_volume() / s.get_cached_writes(), "B") << std::endl;
         o << " number of bytes written to cache           : " << hr(s.get_cached_written_volume(), "B") << std::endl;
     }
+    if (s.get_compressed_input_volume()) {
+        o << " number of bytes passed to compression      : " << hr(s.get_compressed_input_volume(), "B") << std::endl;
+        o << " number of bytes stored compressed          : " << hr(s.get_compressed_output_volume(), "B") << std::endl;
+        o << " compression ratio                          : " << s.get_compression_ratio() << std::endl;
+    }
     o << " total number of writes                     : " << hr(s.get_writes()) << std::endl;
     o << " average block size (write)                 : "
       << hr(s.get_writes() ? s.get_written_volume() / s.get_writes() : 0, "B") << std::endl;
@@ -390,9 +900,27 @@ std::ostream& operator << (std::ostream& o, const stats_data& s)
     o << " time spent in I/O (parallel I/O time)      : " << s.get_pio_time() << " s"
       << " @ " << ((double)(s.get_read_volume() + s.get_written_volume()) / 1048576.0 / s.get_pio_time()) << " MiB/s"
       << std::endl;
+    if (s.get_latency().read_service.count()) {
+        o << " read queue time p50/p99/p99.9              : ";
+        print_percentiles(o, s.get_latency().read_queue);
+        o << " read service time p50/p99/p99.9            : ";
+        print_percentiles(o, s.get_latency().read_service);
+    }
+    if (s.get_latency().write_service.count()) {
+        o << " write queue time p50/p99/p99.9             : ";
+        print_percentiles(o, s.get_latency().write_queue);
+        o << " write service time p50/p99/p99.9           : ";
+        print_percentiles(o, s.get_latency().write_service);
+    }
+    unsigned used_disks = 0;
+    for (unsigned d = 0; d < s.get_disks(); ++d)
+        used_disks += (s.get_disk(d).reads + s.get_disk(d).writes != 0);
+    if (used_disks > 1)
+        s.print_disks(o);
 #else
     o << " n/a" << std::endl;
 #endif
+    s.print_allocations(o);
 #ifndef STXXL_DO_NOT_COUNT_WAIT_TIME
     o << " I/O wait time                              : " << s.get_io_wait_time() << " s" << std::endl;
     if (s.get_wait_read_time() != 0.0)
@@ -0,0 +1,585 @@
+/***************************************************************************
+ *  lib/io/iouring_queue.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/io/iouring_queue.h>
+
+#if STXXL_HAVE_IOURING_FILE
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <stxxl/bits/verbose.h>
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/io/iouring_request.h>
+#include <stxxl/bits/parallel.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+STXXL_BEGIN_NAMESPACE
+
+mutex iouring_queue::s_buffers_mtx;
+std::vector<iovec> iouring_queue::s_buffers;
+unsigned iouring_queue::s_buffers_generation = 0;
+
+//! maximum number of registered buffers accepted by the kernel
+static const size_t iouring_max_registered_buffers = 1024;
+
+static inline bool iovec_base_less(const iovec& a, const iovec& b)
+{
+    return a.iov_base < b.iov_base;
+}
+
+iouring_queue::iouring_queue(int desired_queue_length)
+    : ring_fd(-1), wakeup_fd(-1),
+      sq_ring_ptr(NULL), cq_ring_ptr(NULL), sqes(NULL),
+      sq_local_tail(0),
+      wakeup_pending(false),
+      num_posted(0), num_posted_fixed(0), num_in_kernel(0),
+      register_failed(false),
+      worker_thread_state(NOT_RUNNING),
+      registered_generation(0)
+{
+    if (desired_queue_length == 0) {
+        // default value, 64 entries per queue (i.e. usually per disk) should
+        // be enough
+        max_events = 64;
+    }
+    else
+        max_events = desired_queue_length;
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    // one additional entry for the wakeup poll
+    ring_fd = (int)syscall(SYS_io_uring_setup, max_events + 1, &params);
+    if (ring_fd < 0) {
+        STXXL_THROW_ERRNO(io_error, "iouring_queue::iouring_queue"
+                          " io_uring_setup() entries=" << max_events + 1);
+    }
+
+    // the ring is released again if a later step fails
+    try
+    {
+        if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+            STXXL_THROW(io_error, "iouring_queue::iouring_queue"
+                        " the running kernel's io_uring is too old (need >= 5.6)");
+        }
+
+        // never have more requests in flight than there are completion entries
+        sq_entries = params.sq_entries;
+        max_events = std::min<int>(
+            max_events, (int)std::min(params.sq_entries, params.cq_entries) - 1);
+
+        // map submission and completion rings into our address space
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+        sq_ring_ptr = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ring_ptr == MAP_FAILED)
+            STXXL_THROW_ERRNO(io_error, "iouring_queue::iouring_queue mmap() of submission ring");
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ring_ptr = sq_ring_ptr;
+        }
+        else {
+            cq_ring_ptr = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+            if (cq_ring_ptr == MAP_FAILED)
+                STXXL_THROW_ERRNO(io_error, "iouring_queue::iouring_queue mmap() of completion ring");
+        }
+
+        sqes = static_cast<io_uring_sqe*>(
+            mmap(NULL, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED)
+            STXXL_THROW_ERRNO(io_error, "iouring_queue::iouring_queue mmap() of submission entries");
+
+        char* sq = static_cast<char*>(sq_ring_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_ring_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(cq_ring_ptr);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_ring_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // use an identity mapping from submission ring slots to entries
+        for (unsigned i = 0; i < sq_entries; ++i)
+            sq_array[i] = i;
+
+        sq_local_tail = *sq_tail;
+
+        wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeup_fd < 0)
+            STXXL_THROW_ERRNO(io_error, "iouring_queue::iouring_queue eventfd()");
+
+        STXXL_MSG("Set up an io_uring queue with " << max_events << " entries.");
+
+        start_thread(worker, static_cast<void*>(this), worker_thread, worker_thread_state);
+    }
+    catch (...)
+    {
+        release_ring();
+        throw;
+    }
+}
+
+iouring_queue::~iouring_queue()
+{
+    assert(worker_thread_state() == RUNNING);
+    worker_thread_state.set_to(TERMINATING);
+    wakeup();
+    join_thread(worker_thread, worker_thread_state);
+
+    release_ring();
+}
+
+void iouring_queue::release_ring()
+{
+    if (sqes != NULL && sqes != MAP_FAILED)
+        munmap(sqes, sq_entries * sizeof(io_uring_sqe));
+    if (cq_ring_ptr != NULL && cq_ring_ptr != MAP_FAILED && cq_ring_ptr != sq_ring_ptr)
+        munmap(cq_ring_ptr, cq_ring_size);
+    if (sq_ring_ptr != NULL && sq_ring_ptr != MAP_FAILED)
+        munmap(sq_ring_ptr, sq_ring_size);
+
+    if (wakeup_fd >= 0)
+        close(wakeup_fd);
+    close(ring_fd);
+}
+
+void iouring_queue::add_request(request_ptr& req)
+{
+    if (req.empty())
+        STXXL_THROW_INVALID_ARGUMENT("Empty request submitted to disk_queue.");
+    if (worker_thread_state() != RUNNING)
+        STXXL_ERRMSG("Request submitted to stopped queue.");
+    if (!dynamic_cast<iouring_request*>(req.get()))
+        STXXL_ERRMSG("Non-io_uring request submitted to io_uring queue.");
+
+    scoped_mutex_lock lock(waiting_mtx);
+
+    waiting_requests.push_back(req);
+
+    // only signal the worker once per batch of waiting requests
+    if (wakeup_pending) return;
+    wakeup_pending = true;
+
+    lock.unlock();
+    wakeup();
+}
+
+void iouring_queue::add_requests(request_ptr* begin, request_ptr* end)
+{
+    if (worker_thread_state() != RUNNING)
+        STXXL_ERRMSG("Request submitted to stopped queue.");
+
+    for (request_ptr* r = begin; r != end; ++r)
+    {
+        if (r->empty())
+            STXXL_THROW_INVALID_ARGUMENT("Empty request submitted to disk_queue.");
+        if (!dynamic_cast<iouring_request*>(r->get()))
+            STXXL_ERRMSG("Non-io_uring request submitted to io_uring queue.");
+    }
+
+    if (begin == end) return;
+
+    scoped_mutex_lock lock(waiting_mtx);
+
+    waiting_requests.insert(waiting_requests.end(), begin, end);
+
+    if (wakeup_pending) return;
+    wakeup_pending = true;
+
+    lock.unlock();
+    wakeup();
+}
+
+bool iouring_queue::cancel_request(request_ptr& req)
+{
+    if (req.empty())
+        STXXL_THROW_INVALID_ARGUMENT("Empty request canceled disk_queue.");
+    if (worker_thread_state() != RUNNING)
+        STXXL_ERRMSG("Request canceled in stopped queue.");
+    if (!dynamic_cast<iouring_request*>(req.get()))
+        STXXL_ERRMSG("Non-io_uring request submitted to io_uring queue.");
+
+    scoped_mutex_lock lock(waiting_mtx);
+
+    queue_type::iterator pos =
+        std::find(waiting_requests.begin(), waiting_requests.end(),
+                  req _STXXL_FORCE_SEQUENTIAL);
+    if (pos == waiting_requests.end())
+        return false;
+
+    waiting_requests.erase(pos);
+    lock.unlock();
+
+    // request is canceled, but was not yet posted.
+    dynamic_cast<iouring_request*>(req.get())->completed(false, true);
+
+    return true;
+}
+
+void iouring_queue::register_buffer(void* buffer, size_t size)
+{
+    scoped_mutex_lock lock(s_buffers_mtx);
+
+    iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+    s_buffers.push_back(iov);
+
+    __atomic_add_fetch(&s_buffers_generation, 1, __ATOMIC_RELEASE);
+}
+
+void iouring_queue::unregister_buffer(void* buffer)
+{
+    scoped_mutex_lock lock(s_buffers_mtx);
+
+    for (std::vector<iovec>::iterator it = s_buffers.begin();
+         it != s_buffers.end(); ++it)
+    {
+        if (it->iov_base != buffer) continue;
+
+        s_buffers.erase(it);
+        __atomic_add_fetch(&s_buffers_generation, 1, __ATOMIC_RELEASE);
+        return;
+    }
+}
+
+void iouring_queue::update_registered_buffers()
+{
+    unsigned generation = __atomic_load_n(&s_buffers_generation, __ATOMIC_ACQUIRE);
+
+    // wait until no request uses the old registration anymore
+    if (generation == registered_generation || num_posted_fixed != 0)
+        return;
+
+    std::vector<iovec> buffers;
+    {
+        scoped_mutex_lock lock(s_buffers_mtx);
+        buffers = s_buffers;
+        generation = s_buffers_generation;
+    }
+
+    if (!registered.empty()) {
+        syscall(SYS_io_uring_register, ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        registered.clear();
+    }
+
+    if (buffers.size() > iouring_max_registered_buffers) {
+        STXXL_ERRMSG("iouring_queue: only the first " <<
+                     iouring_max_registered_buffers << " of " <<
+                     buffers.size() << " buffers are registered.");
+        buffers.resize(iouring_max_registered_buffers);
+    }
+
+    if (!buffers.empty())
+    {
+        std::sort(buffers.begin(), buffers.end(), iovec_base_less);
+
+        long r = syscall(SYS_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS,
+                         &buffers[0], (unsigned)buffers.size());
+        if (r < 0) {
+            // usually RLIMIT_MEMLOCK, report only once as the buffer list
+            // changes whenever buffers are allocated or freed.
+            if (!register_failed) {
+                STXXL_ERRMSG("iouring_queue: registering " << buffers.size() <<
+                             " buffers failed: " << strerror(errno) <<
+                             ", continuing with unregistered buffers.");
+                register_failed = true;
+            }
+        }
+        else {
+            registered.swap(buffers);
+        }
+    }
+
+    registered_generation = generation;
+}
+
+int iouring_queue::find_registered_buffer(const void* buffer, size_t bytes) const
+{
+    if (registered.empty())
+        return -1;
+
+    // the registration is outdated: the buffer may have been freed already.
+    if (__atomic_load_n(&s_buffers_generation, __ATOMIC_ACQUIRE) != registered_generation)
+        return -1;
+
+    iovec key;
+    key.iov_base = const_cast<void*>(buffer);
+    key.iov_len = 0;
+
+    std::vector<iovec>::const_iterator it =
+        std::upper_bound(registered.begin(), registered.end(), key, iovec_base_less);
+    if (it == registered.begin())
+        return -1;
+    --it;
+
+    const char* begin = static_cast<const char*>(it->iov_base);
+    const char* cbuffer = static_cast<const char*>(buffer);
+    if (cbuffer + bytes > begin + it->iov_len)
+        return -1;
+
+    return (int)(it - registered.begin());
+}
+
+void iouring_queue::wakeup()
+{
+    uint64_t one = 1;
+    // EAGAIN means the counter is saturated, which wakes the worker anyway.
+    if (write(wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        STXXL_THROW_ERRNO(io_error, "iouring_queue::wakeup write(eventfd)");
+}
+
+io_uring_sqe* iouring_queue::get_sqe()
+{
+    io_uring_sqe* sqe = &sqes[sq_local_tail & *sq_ring_mask];
+    ++sq_local_tail;
+    return sqe;
+}
+
+void iouring_queue::post(iouring_request* req, void* user_data, bool first_post)
+{
+    if (first_post)
+    {
+        req->m_buf_index = find_registered_buffer(req->get_buffer(), req->get_size());
+        if (req->m_buf_index >= 0)
+            ++num_posted_fixed;
+        ++num_posted;
+#if STXXL_IO_STATS
+        req->m_post_time = timestamp();
+#endif
+
+        if (req->get_type() == request::READ)
+            stats::get_instance()->read_started(req->get_size(), 0.0, req->get_file()->get_device_id());
+        else
+            stats::get_instance()->write_started(req->get_size(), 0.0, req->get_file()->get_device_id());
+    }
+    else if (req->m_buf_index >= 0)
+        ++num_posted_fixed;
+
+    req->fill_sqe(get_sqe(), user_data);
+}
+
+int iouring_queue::enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    for ( ; ; )
+    {
+        long r = syscall(SYS_io_uring_enter, ring_fd, to_submit, min_complete,
+                         flags, NULL, 0);
+        if (r >= 0)
+            return (int)r;
+
+        // io_uring_enter may return prematurely in case a signal is received
+        if (errno == EINTR)
+            continue;
+        // out of kernel resources or completion queue full, see backoff()
+        if (errno == EAGAIN || errno == EBUSY)
+            return -1;
+
+        STXXL_THROW_ERRNO(io_error, "iouring_queue::enter"
+                          " io_uring_enter() to_submit=" << to_submit);
+    }
+}
+
+void iouring_queue::backoff()
+{
+    // the kernel rejected the submission for lack of resources, which are
+    // only freed by completing entries: wait for one instead of retrying
+    // right away.
+    if (num_in_kernel != 0 &&
+        enter(0, 1, IORING_ENTER_GETEVENTS) >= 0)
+        return;
+
+    // nothing in flight to wait for
+    usleep(1000);
+}
+
+void iouring_queue::handle_completion(const io_uring_cqe* cqe)
+{
+    // unsigned_type is as long as a pointer, and like this, we avoid an icpc warning
+    request_ptr* r = reinterpret_cast<request_ptr*>(static_cast<unsigned_type>(cqe->user_data));
+    iouring_request* req = static_cast<iouring_request*>(r->get());
+
+    if (req->m_buf_index >= 0)
+        --num_posted_fixed;
+
+    if (cqe->res == -EAGAIN || cqe->res == -EINTR)
+    {
+        // transient failure, submit again.
+        post(req, r, false);
+        return;
+    }
+    else if (cqe->res < 0)
+    {
+        std::ostringstream msg;
+        msg << "Error in iouring_request" <<
+            " path=" << dynamic_cast<iouring_file*>(req->get_file())->filename <<
+            " offset=" << req->get_offset() + req->m_done <<
+            " bytes=" << req->get_size() - req->m_done <<
+            " type=" << ((req->get_type() == request::READ) ? "READ" : "WRITE") <<
+            " : " << strerror(-cqe->res);
+        req->error_occured(msg.str());
+    }
+    else
+    {
+        req->m_done += cqe->res;
+
+        if (req->m_done < req->get_size())
+        {
+            if (cqe->res > 0) {
+                // short transfer, submit the remainder.
+                post(req, r, false);
+                return;
+            }
+            else if (req->get_type() == request::READ) {
+                // read request extends past end-of-file
+                // fill reminder with zeroes
+                memset(static_cast<char*>(req->get_buffer()) + req->m_done, 0,
+                       req->get_size() - req->m_done);
+            }
+            else {
+                req->error_occured("Error in iouring_request: zero bytes written");
+            }
+        }
+    }
+
+    --num_posted;
+#if STXXL_IO_STATS
+    stats::get_instance()->request_served(
+        req->get_file()->get_device_id(), req->get_type() == request::WRITE,
+        req->m_post_time - req->m_submit_time, timestamp() - req->m_post_time);
+#endif
+    req->completed(false);
+    delete r;              // release auto_ptr reference
+}
+
+unsigned iouring_queue::reap_completions()
+{
+    unsigned head = *cq_head, wakeups = 0;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+    for ( ; head != tail; ++head)
+    {
+        const io_uring_cqe* cqe = &cqes[head & *cq_ring_mask];
+
+        if (cqe->user_data == 0) {
+            // eventfd poll fired: reset counter, the poll is re-armed later.
+            uint64_t value;
+            if (read(wakeup_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                STXXL_THROW_ERRNO(io_error, "iouring_queue::reap_completions read(eventfd)");
+            ++wakeups;
+        }
+        else {
+            handle_completion(cqe);
+        }
+        --num_in_kernel;
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    return wakeups;
+}
+
+// internal routine, run by the worker thread
+void iouring_queue::work()
+{
+    bool arm_wakeup = true;
+
+    for ( ; ; ) // as long as thread is running
+    {
+        update_registered_buffers();
+
+        if (arm_wakeup)
+        {
+            // (one-shot) poll on the eventfd, completes when add_request() or
+            // the destructor signal the worker.
+            io_uring_sqe* sqe = get_sqe();
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = wakeup_fd;
+            sqe->poll_events = POLLIN;
+            sqe->user_data = 0;
+            arm_wakeup = false;
+        }
+
+        {
+            // collect all requests which arrived in the meantime
+            scoped_mutex_lock lock(waiting_mtx);
+            wakeup_pending = false;
+
+            while (!waiting_requests.empty() && num_posted < max_events)
+            {
+                request_ptr* r = new request_ptr(waiting_requests.front());
+                waiting_requests.pop_front();
+
+                post(static_cast<iouring_request*>(r->get()), r, true);
+            }
+
+            // terminate if termination has been requested
+            if (worker_thread_state() == TERMINATING &&
+                waiting_requests.empty() && num_posted == 0)
+                break;
+        }
+
+        // publish all new submission entries
+        __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+        unsigned to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+        // poll the completion ring first, only sleep if it is empty
+        bool have_completions =
+            (*cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE));
+
+        if (to_submit != 0 || !have_completions)
+        {
+            int submitted = enter(to_submit, have_completions ? 0 : 1,
+                                  have_completions ? 0 : IORING_ENTER_GETEVENTS);
+            if (submitted >= 0)
+                num_in_kernel += submitted;
+            else if (!have_completions)
+                backoff();
+        }
+
+        if (reap_completions() != 0)
+            arm_wakeup = true;
+    }
+}
+
+void* iouring_queue::worker(void* arg)
+{
+    self_type* pthis = static_cast<self_type*>(arg);
+
+    pthis->work();
+
+    pthis->worker_thread_state.set_to(TERMINATED);
+
+    return NULL;
+}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_IOURING_FILE
+// vim: et:ts=4:sw=4
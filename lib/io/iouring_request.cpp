@@ -0,0 +1,86 @@
+/***************************************************************************
+ *  lib/io/iouring_request.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/io/iouring_request.h>
+
+#if STXXL_HAVE_IOURING_FILE
+
+#include <stxxl/bits/io/disk_queues.h>
+#include <stxxl/bits/verbose.h>
+
+#include <cstring>
+
+STXXL_BEGIN_NAMESPACE
+
+void iouring_request::completed(bool posted, bool canceled)
+{
+    STXXL_VERBOSE_IOURING("iouring_request[" << this << "] completed(" <<
+                          posted << "," << canceled << ")");
+
+    if (!canceled)
+    {
+        if (m_type == READ)
+            stats::get_instance()->read_finished(m_file->get_device_id());
+        else
+            stats::get_instance()->write_finished(m_file->get_device_id());
+    }
+    else if (posted)
+    {
+        if (m_type == READ)
+            stats::get_instance()->read_canceled(m_bytes, m_file->get_device_id());
+        else
+            stats::get_instance()->write_canceled(m_bytes, m_file->get_device_id());
+    }
+    request_with_state::completed(canceled);
+}
+
+void iouring_request::fill_sqe(io_uring_sqe* sqe, void* user_data)
+{
+    iouring_file* af = dynamic_cast<iouring_file*>(m_file);
+
+    assert(m_bytes - m_done <= 0xFFFFFFFFu);
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (m_buf_index >= 0) {
+        sqe->opcode = (m_type == READ) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = (__u16)m_buf_index;
+    }
+    else {
+        sqe->opcode = (m_type == READ) ? IORING_OP_READ : IORING_OP_WRITE;
+    }
+    sqe->fd = af->file_des;
+    sqe->off = m_offset + m_done;
+    sqe->addr = static_cast<__u64>((unsigned long)(static_cast<char*>(m_buffer) + m_done));
+    sqe->len = (__u32)(m_bytes - m_done);
+    // indirection, so the ring retains a counting_ptr reference
+    sqe->user_data = reinterpret_cast<__u64>(user_data);
+}
+
+//! Cancel the request
+//!
+//! Routine is called by user, as part of the request interface. Only requests
+//! not yet submitted to the kernel can be canceled.
+bool iouring_request::cancel()
+{
+    STXXL_VERBOSE_IOURING("iouring_request[" << this << "] cancel()");
+
+    if (!m_file) return false;
+
+    request_ptr req(this);
+    iouring_queue* queue = dynamic_cast<iouring_queue*>(
+        disk_queues::get_instance()->get_queue(m_file->get_queue_id())
+        );
+    return queue->cancel_request(req);
+}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_IOURING_FILE
+// vim: et:ts=4:sw=4
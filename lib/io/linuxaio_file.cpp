@@ -45,6 +45,30 @@ request_ptr linuxaio_file::awrite(
     return req;
 }
 
+void linuxaio_file::aread_batch(
+    request_ptr* reqs, void* const* buffers,
+    const offset_type* pos, const size_type* bytes, size_t n,
+    const completion_handler& on_cmpl)
+{
+    for (size_t i = 0; i < n; ++i)
+        reqs[i] = new linuxaio_request(on_cmpl, this, buffers[i], pos[i], bytes[i],
+                                       request::READ);
+
+    disk_queues::get_instance()->add_requests(reqs, reqs + n, get_queue_id());
+}
+
+void linuxaio_file::awrite_batch(
+    request_ptr* reqs, void* const* buffers,
+    const offset_type* pos, const size_type* bytes, size_t n,
+    const completion_handler& on_cmpl)
+{
+    for (size_t i = 0; i < n; ++i)
+        reqs[i] = new linuxaio_request(on_cmpl, this, buffers[i], pos[i], bytes[i],
+                                       request::WRITE);
+
+    disk_queues::get_instance()->add_requests(reqs, reqs + n, get_queue_id());
+}
+
 void linuxaio_file::serve(void* buffer, offset_type offset, size_type bytes,
                           request::request_type type)
 {
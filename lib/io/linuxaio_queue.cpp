@@ -21,10 +21,12 @@
 #include <stxxl/bits/verbose.h>
 #include <stxxl/bits/mng/block_manager.h>
 #include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/io/iostats.h>
 #include <stxxl/bits/io/linuxaio_request.h>
 #include <stxxl/bits/io/linuxaio_queue.h>
 
 #include <algorithm>
+#include <vector>
 
 #ifndef STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
 #define STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION 1
@@ -88,6 +90,27 @@ void linuxaio_queue::add_request(request_ptr& req)
     num_waiting_requests++;
 }
 
+void linuxaio_queue::add_requests(request_ptr* begin, request_ptr* end)
+{
+    if (post_thread_state() != RUNNING)
+        STXXL_ERRMSG("Request submitted to stopped queue.");
+
+    for (request_ptr* r = begin; r != end; ++r)
+    {
+        if (r->empty())
+            STXXL_THROW_INVALID_ARGUMENT("Empty request submitted to disk_queue.");
+        if (!dynamic_cast<linuxaio_request*>(r->get()))
+            STXXL_ERRMSG("Non-LinuxAIO request submitted to LinuxAIO queue.");
+    }
+
+    if (begin == end) return;
+
+    scoped_mutex_lock lock(waiting_mtx);
+
+    waiting_requests.insert(waiting_requests.end(), begin, end);
+    num_waiting_requests.increment(int(end - begin));
+}
+
 bool linuxaio_queue::cancel_request(request_ptr& req)
 {
     if (req.empty())
@@ -124,8 +147,14 @@ bool linuxaio_queue::cancel_request(request_ptr& req)
 // internal routines, run by the posting thread
 void linuxaio_queue::post_requests()
 {
-    request_ptr req;
     io_event* events = new io_event[max_events];
+    // requests taken from the waiting list, submitted with one io_submit()
+    std::vector<request_ptr> batch;
+    std::vector<iocb*> cbs(max_events);
+    // device ids of the batch, the requests may complete and be released
+    // before io_submit() returns
+    std::vector<unsigned> devices(max_events);
+    batch.reserve(max_events);
 
     for ( ; ; ) // as long as thread is running
     {
@@ -139,30 +168,96 @@ void linuxaio_queue::post_requests()
         scoped_mutex_lock lock(waiting_mtx);
         if (!waiting_requests.empty())
         {
-            req = waiting_requests.front();
+            // take the request accounted for above plus all others which are
+            // waiting, up to the number of kernel events.
+            batch.push_back(waiting_requests.front());
             waiting_requests.pop_front();
+
+            while (!waiting_requests.empty() &&
+                   (int)batch.size() < max_events)
+            {
+                batch.push_back(waiting_requests.front());
+                waiting_requests.pop_front();
+                num_waiting_requests.decrement(); // will never block
+            }
             lock.unlock();
 
-            num_free_events--; // might block because too many requests are posted
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                num_free_events--; // might block because too many requests are posted
+
+                // polymorphic_downcast
+                linuxaio_request* req = dynamic_cast<linuxaio_request*>(batch[i].get());
+                req->fill_control_block();
+                cbs[i] = &req->cb;
+                devices[i] = req->get_file()->get_device_id();
+            }
 
-            // polymorphic_downcast
-            while (!dynamic_cast<linuxaio_request*>(req.get())->post())
+            size_t num_posted = 0;
+            while (num_posted < batch.size())
             {
-                // post failed, so first handle events to make queues (more)
-                // empty, then try again.
+                // account the requests before submitting them, since the
+                // wait thread may finish them before io_submit() returns.
+                double now = timestamp();
+                for (size_t i = num_posted; i < batch.size(); ++i)
+                {
+                    linuxaio_request* req = static_cast<linuxaio_request*>(batch[i].get());
+                    req->m_post_time = now;
+                    if (req->get_type() == request::READ)
+                        stats::get_instance()->read_started(req->get_size(), now, devices[i]);
+                    else
+                        stats::get_instance()->write_started(req->get_size(), now, devices[i]);
+                }
 
-                // wait for at least one event to complete, no time limit
-                long num_events = syscall(SYS_io_getevents, context, 1, max_events, events, NULL);
-                if (num_events < 0) {
-                    STXXL_THROW_ERRNO(io_error, "linuxaio_queue::post_requests"
-                                      " io_getevents() nr_events=" << num_events);
+                long success = syscall(SYS_io_submit, context,
+                                       batch.size() - num_posted,
+                                       &cbs[num_posted]);
+                int saved_errno = errno;
+
+                // the requests are finally posted
+                if (success > 0) {
+                    num_posted_requests.increment(int(success));
+                    num_posted += success;
+                }
+
+                // undo the accounting of those not accepted by the kernel,
+                // they are accounted again when resubmitted.
+                for (size_t i = num_posted; i < batch.size(); ++i)
+                {
+                    request* req = batch[i].get();
+                    if (req->get_type() == request::READ)
+                        stats::get_instance()->read_canceled(req->get_size(), devices[i]);
+                    else
+                        stats::get_instance()->write_canceled(req->get_size(), devices[i]);
                 }
 
-                handle_events(events, num_events, false);
+                if (success > 0)
+                {
+                    continue;
+                }
+                else if (success == -1 && saved_errno != EAGAIN)
+                {
+                    errno = saved_errno;
+                    STXXL_THROW_ERRNO(io_error, "linuxaio_queue::post_requests"
+                                      " io_submit()");
+                }
+                else
+                {
+                    // post failed, so first handle events to make queues
+                    // (more) empty, then try again.
+
+                    // wait for at least one event to complete, no time limit
+                    long num_events = syscall(SYS_io_getevents, context, 1, max_events, events, NULL);
+                    if (num_events < 0) {
+                        STXXL_THROW_ERRNO(io_error, "linuxaio_queue::post_requests"
+                                          " io_getevents() nr_events=" << num_events);
+                    }
+
+                    handle_events(events, num_events, false);
+                }
             }
 
-            // request is finally posted
-            num_posted_requests++;
+            batch.clear();
         }
         else
         {
@@ -182,7 +277,15 @@ void linuxaio_queue::handle_events(io_event* events, long num_events, bool cance
     {
         // unsigned_type is as long as a pointer, and like this, we avoid an icpc warning
         request_ptr* r = reinterpret_cast<request_ptr*>(static_cast<unsigned_type>(events[e].data));
-        r->get()->completed(canceled);
+        linuxaio_request* req = static_cast<linuxaio_request*>(r->get());
+#if STXXL_IO_STATS
+        if (!canceled) {
+            stats::get_instance()->request_served(
+                req->get_file()->get_device_id(), req->get_type() == request::WRITE,
+                req->m_post_time - req->m_submit_time, timestamp() - req->m_post_time);
+        }
+#endif
+        req->completed(canceled);
         delete r;              // release auto_ptr reference
         num_free_events++;
         num_posted_requests--; // will never block
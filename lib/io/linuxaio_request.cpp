@@ -32,16 +32,16 @@ void linuxaio_request::completed(bool posted, bool canceled)
     if (!canceled)
     {
         if (m_type == READ)
-            stats::get_instance()->read_finished();
+            stats::get_instance()->read_finished(m_file->get_device_id());
         else
-            stats::get_instance()->write_finished();
+            stats::get_instance()->write_finished(m_file->get_device_id());
     }
     else if (posted)
     {
         if (m_type == READ)
-            stats::get_instance()->read_canceled(m_bytes);
+            stats::get_instance()->read_canceled(m_bytes, m_file->get_device_id());
         else
-            stats::get_instance()->write_canceled(m_bytes);
+            stats::get_instance()->write_canceled(m_bytes, m_file->get_device_id());
     }
     request_with_state::completed(canceled);
 }
@@ -61,35 +61,6 @@ void linuxaio_request::fill_control_block()
     cb.aio_offset = m_offset;
 }
 
-//! Submits an I/O request to the OS
-//! \returns false if submission fails
-bool linuxaio_request::post()
-{
-    STXXL_VERBOSE_LINUXAIO("linuxaio_request[" << this << "] post()");
-
-    fill_control_block();
-    iocb* cb_pointer = &cb;
-    // io_submit might considerable time, so we have to remember the current
-    // time before the call.
-    double now = timestamp();
-    linuxaio_queue* queue = dynamic_cast<linuxaio_queue*>(
-        disk_queues::get_instance()->get_queue(m_file->get_queue_id())
-        );
-    long success = syscall(SYS_io_submit, queue->get_io_context(), 1, &cb_pointer);
-    if (success == 1)
-    {
-        if (m_type == READ)
-            stats::get_instance()->read_started(m_bytes, now);
-        else
-            stats::get_instance()->write_started(m_bytes, now);
-    }
-    else if (success == -1 && errno != EAGAIN)
-        STXXL_THROW_ERRNO(io_error, "linuxaio_request::post"
-                          " io_submit()");
-
-    return success == 1;
-}
-
 //! Cancel the request
 //!
 //! Routine is called by user, as part of the request interface.
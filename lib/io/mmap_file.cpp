@@ -20,47 +20,260 @@
 #include "ufs_platform.h"
 #include <sys/mman.h>
 
+#include <algorithm>
+#include <cstring>
+
 STXXL_BEGIN_NAMESPACE
 
-void mmap_file::serve(void* buffer, offset_type offset, size_type bytes,
-                      request::request_type type)
+//! sequential accesses ask the kernel to read ahead this many times their size
+static const unsigned mmap_readahead_factor = 8;
+
+mmap_file::~mmap_file()
 {
     scoped_mutex_lock fd_lock(fd_mutex);
 
-    //assert(offset + bytes <= _size());
+    unmap_windows(0);
+
+    // windows still borrowed by map_read() stay mapped
+    for (size_t i = 0; i < m_windows.size(); ++i)
+        delete m_windows[i];
+}
+
+void mmap_file::unmap_window(window* w)
+{
+    if (munmap(w->base, w->length) != 0)
+        STXXL_ERRMSG("munmap() failed: " << strerror(errno));
+    delete w;
+}
+
+void mmap_file::unmap_windows(offset_type size)
+{
+    for (size_t i = 0; i < m_windows.size(); )
+    {
+        window* w = m_windows[i];
+        if (w->offset + (offset_type)w->length <= size) {
+            ++i;
+            continue;
+        }
+        if (w->pins) {
+            STXXL_ERRMSG("mmap_file: mapping at offset " << w->offset <<
+                         " of " << filename << " is still in use");
+            ++i;
+            continue;
+        }
+        unmap_window(w);
+        m_windows[i] = m_windows.back();
+        m_windows.pop_back();
+    }
+}
+
+mmap_file::window* mmap_file::get_window(offset_type offset, size_type bytes,
+                                         bool is_write)
+{
+    const offset_type window_offset = offset - offset % STXXL_MMAP_WINDOW_SIZE;
+    const offset_type end = offset + bytes;
+    ++m_use_counter;
+
+    for (size_t i = 0; i < m_windows.size(); ++i)
+    {
+        window* w = m_windows[i];
+        if (w->offset == window_offset && end <= w->offset + (offset_type)w->length) {
+            w->last_use = m_use_counter;
+            return w;
+        }
+    }
+
+    // the file may have grown since the last check
+    if (end > m_size)
+        m_size = _size();
+    if (end > m_size)
+    {
+        if (!is_write)
+            STXXL_THROW(io_error, "mmap_file: read beyond the end of the file" <<
+                        " path=" << filename << " offset=" << offset <<
+                        " bytes=" << bytes << " size=" << m_size);
+        _set_size(end);
+        m_size = end;
+    }
 
-    stats::scoped_read_write_timer read_write_timer(bytes, type == request::WRITE);
+    // replace a shorter mapping of the window, or the least recently used
+    // window if there are too many
+    window* victim = NULL;
+    for (size_t i = 0; i < m_windows.size(); ++i)
+    {
+        window* w = m_windows[i];
+        if (w->pins) continue;
+        if (w->offset == window_offset) {
+            victim = w;
+            break;
+        }
+        if (m_windows.size() >= STXXL_MMAP_MAX_WINDOWS &&
+            (!victim || w->last_use < victim->last_use))
+            victim = w;
+    }
+    if (victim) {
+        m_windows.erase(std::find(m_windows.begin(), m_windows.end(), victim));
+        unmap_window(victim);
+    }
 
-    int prot = (type == request::READ) ? PROT_READ : PROT_WRITE;
-    void* mem = mmap(NULL, bytes, prot, MAP_SHARED, file_des, offset);
-    // void *mem = mmap (buffer, bytes, prot , MAP_SHARED|MAP_FIXED , file_des, offset);
-    // STXXL_MSG("Mmaped to "<<mem<<" , buffer suggested at "<<buffer);
+    size_type length = (size_type)std::min<offset_type>(
+        STXXL_MMAP_WINDOW_SIZE, m_size - window_offset);
+    int prot = PROT_READ | ((m_mode & RDONLY) ? 0 : PROT_WRITE);
+    void* mem = mmap(NULL, length, prot, MAP_SHARED, file_des, window_offset);
     if (mem == MAP_FAILED)
     {
         STXXL_THROW_ERRNO(io_error,
                           " mmap() failed." <<
                           " path=" << filename <<
-                          " bytes=" << bytes <<
-                          " Page size: " << sysconf(_SC_PAGESIZE) <<
-                          " offset modulo page size " << (offset % sysconf(_SC_PAGESIZE)));
+                          " bytes=" << length <<
+                          " offset=" << window_offset);
+    }
+
+    window* w = new window;
+    w->base = static_cast<char*>(mem);
+    w->offset = window_offset;
+    w->length = length;
+    w->pins = 0;
+    w->advice = POSIX_MADV_NORMAL;
+    w->last_use = m_use_counter;
+    m_windows.push_back(w);
+    return w;
+}
+
+void mmap_file::advise(window* w, offset_type offset, size_type bytes)
+{
+    const bool sequential = (offset == m_last_end);
+    m_last_end = offset + bytes;
+
+    // the advice is only a hint, errors are ignored
+    int advice = sequential ? POSIX_MADV_SEQUENTIAL : POSIX_MADV_RANDOM;
+    if (w->advice != advice) {
+        posix_madvise(w->base, w->length, advice);
+        w->advice = advice;
     }
-    else if (mem == 0)
+
+    if (sequential)
     {
-        STXXL_THROW_ERRNO(io_error, "mmap() returned NULL");
+        static const size_type page_size = (size_type)sysconf(_SC_PAGESIZE);
+
+        // read ahead the following bytes within the window
+        size_type begin = (size_type)(offset + bytes - w->offset);
+        begin -= begin % page_size;
+        size_type ahead = std::min<size_type>(
+            mmap_readahead_factor * bytes, w->length - begin);
+        if (ahead > 0)
+            posix_madvise(w->base + begin, ahead, POSIX_MADV_WILLNEED);
     }
-    else
+}
+
+void mmap_file::serve(void* buffer, offset_type offset, size_type bytes,
+                      request::request_type type)
+{
+    stats::scoped_read_write_timer read_write_timer(bytes, type == request::WRITE, get_device_id());
+
+    char* cbuffer = static_cast<char*>(buffer);
+    while (bytes > 0)
     {
-        if (type == request::READ)
+        // split the transfer at window boundaries
+        size_type chunk = (size_type)std::min<offset_type>(
+            bytes, STXXL_MMAP_WINDOW_SIZE - offset % STXXL_MMAP_WINDOW_SIZE);
+
+        window* w;
         {
-            memcpy(buffer, mem, bytes);
+            scoped_mutex_lock fd_lock(fd_mutex);
+            w = get_window(offset, chunk, type == request::WRITE);
+            advise(w, offset, chunk);
+            ++w->pins;
         }
+
+        // copy without holding the lock, the pin keeps the window mapped
+        char* mem = w->base + (offset - w->offset);
+        if (type == request::READ)
+            memcpy(cbuffer, mem, chunk);
         else
+            memcpy(mem, cbuffer, chunk);
+
         {
-            memcpy(mem, buffer, bytes);
+            scoped_mutex_lock fd_lock(fd_mutex);
+            --w->pins;
+        }
+
+        cbuffer += chunk;
+        offset += chunk;
+        bytes -= chunk;
+    }
+}
+
+const void* mmap_file::map_read(offset_type offset, size_type bytes)
+{
+    if (offset % STXXL_MMAP_WINDOW_SIZE + bytes > STXXL_MMAP_WINDOW_SIZE)
+        return NULL;
+
+    scoped_mutex_lock fd_lock(fd_mutex);
+
+    if (offset + bytes > m_size && offset + bytes > (m_size = _size()))
+        return NULL;
+
+    window* w = get_window(offset, bytes, false);
+    advise(w, offset, bytes);
+    ++w->pins;
+    const char* ptr = w->base + (offset - w->offset);
+    fd_lock.unlock();
+
+    // verify the checksum like a read request would
+    block_checksums* checksums = get_checksums();
+    if (checksums && !checksums->verify(offset, bytes, ptr)) {
+        unmap_read(ptr, offset, bytes);
+        STXXL_THROW(io_error, "checksum mismatch reading " << bytes <<
+                    " bytes at offset " << offset << " of " << io_type() << " file");
+    }
+
+    // the pages are read when the caller touches them, count a read anyway
+    stats::get_instance()->read_started(bytes, 0.0, get_device_id());
+    stats::get_instance()->read_finished(get_device_id());
+
+    return ptr;
+}
+
+void mmap_file::unmap_read(const void* ptr, offset_type offset, size_type bytes)
+{
+    STXXL_UNUSED(offset);
+    STXXL_UNUSED(bytes);
+
+    scoped_mutex_lock fd_lock(fd_mutex);
+
+    const char* cptr = static_cast<const char*>(ptr);
+    for (size_t i = 0; i < m_windows.size(); ++i)
+    {
+        window* w = m_windows[i];
+        if (w->base <= cptr && cptr < w->base + w->length) {
+            assert(w->pins > 0);
+            --w->pins;
+            return;
         }
-        STXXL_THROW_ERRNO_NE_0(munmap(mem, bytes), io_error,
-                               "munmap() failed");
     }
+
+    STXXL_THROW_INVALID_ARGUMENT("mmap_file::unmap_read(): pointer " << ptr <<
+                                 " was not returned by map_read()");
+}
+
+void mmap_file::set_size(offset_type newsize)
+{
+    scoped_mutex_lock fd_lock(fd_mutex);
+
+    // accessing mapped pages beyond the end of the file fails
+    unmap_windows(newsize);
+    _set_size(newsize);
+    m_size = _size();
+}
+
+void mmap_file::close_remove()
+{
+    {
+        scoped_mutex_lock fd_lock(fd_mutex);
+        unmap_windows(0);
+    }
+    ufs_file_base::close_remove();
 }
 
 const char* mmap_file::io_type() const
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *  lib/io/request_batch.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <algorithm>
+#include <functional>
+
+#include <stxxl/bits/io/request_batch.h>
+#include <stxxl/bits/io/file.h>
+
+STXXL_BEGIN_NAMESPACE
+
+struct request_batch::entry_file_less
+{
+    bool operator () (const entry& a, const entry& b) const
+    {
+        return std::less<file*>()(a.m_file, b.m_file);
+    }
+};
+
+void request_batch::add(file* f, request::request_type type, void* buffer,
+                        offset_type pos, size_type bytes, request_ptr& req)
+{
+    entry e;
+    e.m_file = f;
+    e.m_type = type;
+    e.m_buffer = buffer;
+    e.m_offset = pos;
+    e.m_bytes = bytes;
+    e.m_req = &req;
+    m_entries.push_back(e);
+}
+
+void request_batch::submit()
+{
+    if (m_entries.empty())
+        return;
+
+    // group by file, retaining the order of requests to the same file
+    std::stable_sort(m_entries.begin(), m_entries.end(), entry_file_less());
+
+    entry_vector_type::const_iterator begin = m_entries.begin();
+    while (begin != m_entries.end())
+    {
+        entry_vector_type::const_iterator end = begin + 1;
+        while (end != m_entries.end() &&
+               end->m_file == begin->m_file && end->m_type == begin->m_type)
+            ++end;
+
+        size_t n = end - begin;
+        m_reqs.resize(n);
+        m_buffers.resize(n);
+        m_offsets.resize(n);
+        m_bytes.resize(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            m_buffers[i] = begin[i].m_buffer;
+            m_offsets[i] = begin[i].m_offset;
+            m_bytes[i] = begin[i].m_bytes;
+        }
+
+        if (begin->m_type == request::READ)
+            begin->m_file->aread_batch(&m_reqs[0], &m_buffers[0],
+                                       &m_offsets[0], &m_bytes[0], n);
+        else
+            begin->m_file->awrite_batch(&m_reqs[0], &m_buffers[0],
+                                        &m_offsets[0], &m_bytes[0], n);
+
+        for (size_t i = 0; i < n; ++i)
+            *begin[i].m_req = m_reqs[i];
+
+        // drop the references held by the scratch array
+        m_reqs.clear();
+
+        begin = end;
+    }
+
+    m_entries.clear();
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
@@ -76,6 +76,39 @@ void request_queue_impl_1q::add_request(request_ptr& req)
     m_sem++;
 }
 
+void request_queue_impl_1q::add_requests(request_ptr* begin, request_ptr* end)
+{
+    if (m_thread_state() != RUNNING)
+        STXXL_THROW_INVALID_ARGUMENT("Request submitted to not running queue.");
+
+    for (request_ptr* r = begin; r != end; ++r)
+    {
+        if (r->empty())
+            STXXL_THROW_INVALID_ARGUMENT("Empty request submitted to disk_queue.");
+        if (!dynamic_cast<serving_request*>(r->get()))
+            STXXL_ERRMSG("Incompatible request submitted to running queue.");
+    }
+
+    if (begin == end) return;
+
+    scoped_mutex_lock Lock(m_queue_mutex);
+#if STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+    for (request_ptr* r = begin; r != end; ++r)
+    {
+        if (std::find_if(m_queue.begin(), m_queue.end(),
+                         bind2nd(file_offset_match(), *r) _STXXL_FORCE_SEQUENTIAL)
+            != m_queue.end())
+        {
+            STXXL_ERRMSG("request submitted for a BID with a pending request");
+        }
+    }
+#endif
+    m_queue.insert(m_queue.end(), begin, end);
+    Lock.unlock();
+
+    m_sem.increment(int(end - begin));
+}
+
 bool request_queue_impl_1q::cancel_request(request_ptr& req)
 {
     if (req.empty())
@@ -120,13 +153,17 @@ void* request_queue_impl_1q::worker(void* arg)
             scoped_mutex_lock Lock(pthis->m_queue_mutex);
             if (!pthis->m_queue.empty())
             {
-                request_ptr req = pthis->m_queue.front();
-                pthis->m_queue.pop_front();
+                request_ptr reqs[STXXL_MAX_COALESCED_REQUESTS];
+                size_t n = pop_adjacent(pthis->m_queue, reqs);
 
                 Lock.unlock();
 
+                // the semaphore was incremented once per request
+                for (size_t i = 1; i < n; ++i)
+                    pthis->m_sem.decrement();
+
                 //assert(req->nref() > 1);
-                dynamic_cast<serving_request*>(req.get())->serve();
+                serving_request::serve_coalesced(reqs, n);
             }
             else
             {
@@ -0,0 +1,232 @@
+/***************************************************************************
+ *  lib/io/request_queue_impl_elevator.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/config.h>
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/timer.h>
+#include <stxxl/bits/io/request_queue_impl_elevator.h>
+#include <stxxl/bits/io/serving_request.h>
+
+#if STXXL_STD_THREADS && STXXL_MSVC >= 1700
+ #include <windows.h>
+#endif
+
+#ifndef STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+#define STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION 1
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+request_queue_impl_elevator::request_queue_impl_elevator(int n, double max_delay)
+    : m_seq(0), m_max_delay(max_delay),
+      m_thread_state(NOT_RUNNING), m_sem(0)
+{
+    STXXL_UNUSED(n);
+    m_head.f = NULL;
+    m_head.offset = 0;
+    m_head.seq = 0;
+    start_thread(worker, static_cast<void*>(this), m_thread, m_thread_state);
+}
+
+void request_queue_impl_elevator::insert(request_ptr& req, double now)
+{
+    key_type key;
+    key.f = req->get_file();
+    key.offset = req->get_offset();
+    key.seq = m_seq++;
+
+#if STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+    {
+        key_type first = key;
+        first.seq = 0;
+        queue_type::const_iterator it = m_queue.lower_bound(first);
+        if (it != m_queue.end() && it->first.f == key.f &&
+            it->first.offset == key.offset)
+        {
+            STXXL_ERRMSG("request submitted for a BID with a pending request");
+        }
+    }
+#endif
+
+    entry_type& entry = m_queue[key];
+    entry.req = req;
+    entry.deadline = now + m_max_delay;
+    m_arrival.push_back(key);
+}
+
+size_t request_queue_impl_elevator::next_requests(request_ptr* reqs)
+{
+    // forget keys of requests already served by the sweep or canceled
+    while (!m_arrival.empty() &&
+           m_queue.find(m_arrival.front()) == m_queue.end())
+        m_arrival.pop_front();
+
+    queue_type::iterator it;
+    if (!m_arrival.empty() &&
+        (it = m_queue.find(m_arrival.front()))->second.deadline <= timestamp())
+    {
+        // the oldest request waited too long, continue the sweep from there
+        m_arrival.pop_front();
+    }
+    else
+    {
+        it = m_queue.upper_bound(m_head);
+        if (it == m_queue.end())
+            it = m_queue.begin();
+    }
+
+    // take adjacent requests following in sweep order along
+    size_t n = 0;
+    do {
+        m_head = it->first;
+        reqs[n++] = it->second.req;
+        m_queue.erase(it++);
+    } while (n < STXXL_MAX_COALESCED_REQUESTS && it != m_queue.end() &&
+             is_adjacent(reqs[n - 1], it->second.req));
+
+    return n;
+}
+
+void request_queue_impl_elevator::add_request(request_ptr& req)
+{
+    if (req.empty())
+        STXXL_THROW_INVALID_ARGUMENT("Empty request submitted to disk_queue.");
+    if (m_thread_state() != RUNNING)
+        STXXL_THROW_INVALID_ARGUMENT("Request submitted to not running queue.");
+    if (!dynamic_cast<serving_request*>(req.get()))
+        STXXL_ERRMSG("Incompatible request submitted to running queue.");
+
+    double now = timestamp();
+    {
+        scoped_mutex_lock Lock(m_queue_mutex);
+        insert(req, now);
+    }
+
+    m_sem++;
+}
+
+void request_queue_impl_elevator::add_requests(request_ptr* begin, request_ptr* end)
+{
+    if (m_thread_state() != RUNNING)
+        STXXL_THROW_INVALID_ARGUMENT("Request submitted to not running queue.");
+
+    for (request_ptr* r = begin; r != end; ++r)
+    {
+        if (r->empty())
+            STXXL_THROW_INVALID_ARGUMENT("Empty request submitted to disk_queue.");
+        if (!dynamic_cast<serving_request*>(r->get()))
+            STXXL_ERRMSG("Incompatible request submitted to running queue.");
+    }
+
+    if (begin == end) return;
+
+    double now = timestamp();
+    {
+        scoped_mutex_lock Lock(m_queue_mutex);
+        for (request_ptr* r = begin; r != end; ++r)
+            insert(*r, now);
+    }
+
+    m_sem.increment(int(end - begin));
+}
+
+bool request_queue_impl_elevator::cancel_request(request_ptr& req)
+{
+    if (req.empty())
+        STXXL_THROW_INVALID_ARGUMENT("Empty request canceled disk_queue.");
+    if (m_thread_state() != RUNNING)
+        STXXL_THROW_INVALID_ARGUMENT("Request canceled to not running queue.");
+    if (!dynamic_cast<serving_request*>(req.get()))
+        STXXL_ERRMSG("Incompatible request submitted to running queue.");
+
+    key_type first;
+    first.f = req->get_file();
+    first.offset = req->get_offset();
+    first.seq = 0;
+
+    bool was_still_in_queue = false;
+    {
+        scoped_mutex_lock Lock(m_queue_mutex);
+        for (queue_type::iterator it = m_queue.lower_bound(first);
+             it != m_queue.end() && it->first.f == first.f &&
+             it->first.offset == first.offset; ++it)
+        {
+            if (it->second.req == req)
+            {
+                // the key stays in m_arrival and is skipped by next_requests()
+                m_queue.erase(it);
+                was_still_in_queue = true;
+                m_sem--;
+                break;
+            }
+        }
+    }
+
+    return was_still_in_queue;
+}
+
+request_queue_impl_elevator::~request_queue_impl_elevator()
+{
+    stop_thread(m_thread, m_thread_state, m_sem);
+}
+
+void* request_queue_impl_elevator::worker(void* arg)
+{
+    self* pthis = static_cast<self*>(arg);
+
+    for ( ; ; )
+    {
+        pthis->m_sem--;
+
+        {
+            scoped_mutex_lock Lock(pthis->m_queue_mutex);
+            if (!pthis->m_queue.empty())
+            {
+                request_ptr reqs[STXXL_MAX_COALESCED_REQUESTS];
+                size_t n = pthis->next_requests(reqs);
+
+                Lock.unlock();
+
+                // the semaphore was incremented once per request
+                for (size_t i = 1; i < n; ++i)
+                    pthis->m_sem.decrement();
+
+                serving_request::serve_coalesced(reqs, n);
+            }
+            else
+            {
+                Lock.unlock();
+
+                pthis->m_sem++;
+            }
+        }
+
+        // terminate if it has been requested and queues are empty
+        if (pthis->m_thread_state() == TERMINATING) {
+            if ((pthis->m_sem--) == 0)
+                break;
+            else
+                pthis->m_sem++;
+        }
+    }
+
+    pthis->m_thread_state.set_to(TERMINATED);
+
+#if STXXL_STD_THREADS && STXXL_MSVC >= 1700
+    // Workaround for deadlock bug in Visual C++ Runtime 2012 and 2013, see
+    // request_queue_impl_worker.cpp. -tb
+    ExitThread(NULL);
+#else
+    return NULL;
+#endif
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
@@ -0,0 +1,240 @@
+/***************************************************************************
+ *  lib/io/request_queue_impl_mpsc.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/io/request_queue_impl_mpsc.h>
+
+#if STXXL_HAVE_FUTEX
+
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/io/request.h>
+#include <stxxl/bits/io/serving_request.h>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+STXXL_BEGIN_NAMESPACE
+
+request_queue_impl_mpsc::request_queue_impl_mpsc(int n)
+    : m_write_stack(NULL), m_read_stack(NULL),
+      m_parked(0), m_terminate(0),
+      m_thread_state(NOT_RUNNING)
+{
+    STXXL_UNUSED(n);
+    start_thread(worker, static_cast<void*>(this), m_thread, m_thread_state);
+}
+
+void request_queue_impl_mpsc::add_request(request_ptr& req)
+{
+    add_requests(&req, &req + 1);
+}
+
+void request_queue_impl_mpsc::add_requests(request_ptr* begin, request_ptr* end)
+{
+    if (__atomic_load_n(&m_terminate, __ATOMIC_RELAXED))
+        STXXL_THROW_INVALID_ARGUMENT("Request submitted to not running queue.");
+
+    for (request_ptr* r = begin; r != end; ++r)
+    {
+        if (r->empty())
+            STXXL_THROW_INVALID_ARGUMENT("Empty request submitted to disk_queue.");
+        if (!dynamic_cast<serving_request*>(r->get()))
+            STXXL_ERRMSG("Incompatible request submitted to running queue.");
+    }
+
+    // build one chain per stack, newest first, and push each at once
+    node* write_first = NULL, * write_last = NULL;
+    node* read_first = NULL, * read_last = NULL;
+
+    for (request_ptr* r = begin; r != end; ++r)
+    {
+        node* n = new node;
+        n->req = *r;
+
+        node*& first = (r->get()->get_type() == request::READ)
+                       ? read_first : write_first;
+        node*& last = (r->get()->get_type() == request::READ)
+                      ? read_last : write_last;
+
+        n->next = first;
+        first = n;
+        if (!last) last = n;
+    }
+
+    if (write_first)
+        push(m_write_stack, write_first, write_last);
+    if (read_first)
+        push(m_read_stack, read_first, read_last);
+
+    wakeup();
+}
+
+bool request_queue_impl_mpsc::cancel_request(request_ptr& req)
+{
+    if (req.empty())
+        STXXL_THROW_INVALID_ARGUMENT("Empty request canceled disk_queue.");
+
+    serving_request* sreq = dynamic_cast<serving_request*>(req.get());
+    if (!sreq) {
+        STXXL_ERRMSG("Incompatible request submitted to running queue.");
+        return false;
+    }
+
+    // the request stays in the queue, but the worker will skip it.
+    return mark_dequeued(req);
+}
+
+bool request_queue_impl_mpsc::mark_dequeued(const request_ptr& req)
+{
+    serving_request* sreq = dynamic_cast<serving_request*>(req.get());
+    return __sync_bool_compare_and_swap(&sreq->m_dequeued, 0, 1);
+}
+
+request_queue_impl_mpsc::~request_queue_impl_mpsc()
+{
+    m_thread_state.set_to(TERMINATING);
+    __atomic_store_n(&m_terminate, 1, __ATOMIC_SEQ_CST);
+    wakeup();
+    join_thread(m_thread, m_thread_state);
+}
+
+void request_queue_impl_mpsc::push(node*& stack, node* first, node* last)
+{
+    node* head = __atomic_load_n(&stack, __ATOMIC_RELAXED);
+    do {
+        last->next = head;
+    } while (!__atomic_compare_exchange_n(&stack, &head, first, true,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+}
+
+void request_queue_impl_mpsc::drain(node*& stack, queue_type& queue)
+{
+    node* n = __atomic_exchange_n(&stack, (node*)NULL, __ATOMIC_ACQUIRE);
+
+    // stack is newest first, reverse it to retain submission order
+    node* fifo = NULL;
+    while (n) {
+        node* next = n->next;
+        n->next = fifo;
+        fifo = n;
+        n = next;
+    }
+
+    while (fifo) {
+        queue.push_back(fifo->req);
+        node* next = fifo->next;
+        delete fifo;
+        fifo = next;
+    }
+}
+
+void request_queue_impl_mpsc::wakeup()
+{
+    // the futex syscall is only needed if the worker announced to sleep
+    if (__atomic_load_n(&m_parked, __ATOMIC_SEQ_CST) == 1 &&
+        __atomic_exchange_n(&m_parked, 0, __ATOMIC_SEQ_CST) == 1)
+    {
+        syscall(SYS_futex, &m_parked, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+void request_queue_impl_mpsc::park()
+{
+    // announce sleeping, then check for work which was pushed before the
+    // submitter could see the announcement.
+    __atomic_store_n(&m_parked, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&m_write_stack, __ATOMIC_SEQ_CST) ||
+        __atomic_load_n(&m_read_stack, __ATOMIC_SEQ_CST) ||
+        __atomic_load_n(&m_terminate, __ATOMIC_SEQ_CST))
+    {
+        __atomic_store_n(&m_parked, 0, __ATOMIC_SEQ_CST);
+        return;
+    }
+
+    // returns immediately if wakeup() already reset the word, and may return
+    // spuriously (EINTR), hence loop.
+    while (__atomic_load_n(&m_parked, __ATOMIC_SEQ_CST) == 1)
+        syscall(SYS_futex, &m_parked, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+}
+
+void request_queue_impl_mpsc::work()
+{
+    for ( ; ; )
+    {
+        if (__atomic_load_n(&m_write_stack, __ATOMIC_RELAXED))
+            drain(m_write_stack, m_write_queue);
+        if (__atomic_load_n(&m_read_stack, __ATOMIC_RELAXED))
+            drain(m_read_stack, m_read_queue);
+
+        request_ptr req;
+
+        // write requests have priority, as in request_queue_impl_qwqr
+        if (!m_write_queue.empty())
+        {
+            req = m_write_queue.front();
+            m_write_queue.pop_front();
+        }
+        else if (!m_read_queue.empty())
+        {
+            req = m_read_queue.front();
+            m_read_queue.pop_front();
+        }
+        else
+        {
+            // terminate if it has been requested and queues are empty
+            if (__atomic_load_n(&m_terminate, __ATOMIC_SEQ_CST) &&
+                !__atomic_load_n(&m_write_stack, __ATOMIC_SEQ_CST) &&
+                !__atomic_load_n(&m_read_stack, __ATOMIC_SEQ_CST))
+                break;
+
+            park();
+            continue;
+        }
+
+        // skip requests which were canceled meanwhile
+        if (!mark_dequeued(req))
+            continue;
+
+        // take adjacent requests following in the same queue along
+        queue_type& queue = (req->get_type() == request::READ)
+                            ? m_read_queue : m_write_queue;
+
+        request_ptr reqs[STXXL_MAX_COALESCED_REQUESTS];
+        size_t n = 0;
+        reqs[n++] = req;
+
+        while (n < STXXL_MAX_COALESCED_REQUESTS && !queue.empty() &&
+               is_adjacent(reqs[n - 1], queue.front()) &&
+               mark_dequeued(queue.front()))
+        {
+            reqs[n++] = queue.front();
+            queue.pop_front();
+        }
+
+        serving_request::serve_coalesced(reqs, n);
+    }
+}
+
+void* request_queue_impl_mpsc::worker(void* arg)
+{
+    self* pthis = static_cast<self*>(arg);
+
+    pthis->work();
+
+    pthis->m_thread_state.set_to(TERMINATED);
+
+    return NULL;
+}
+
+STXXL_END_NAMESPACE
+
+#endif // #if STXXL_HAVE_FUTEX
+// vim: et:ts=4:sw=4
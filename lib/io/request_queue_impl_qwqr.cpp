@@ -94,6 +94,80 @@ void request_queue_impl_qwqr::add_request(request_ptr& req)
     m_sem++;
 }
 
+void request_queue_impl_qwqr::add_requests(request_ptr* begin, request_ptr* end)
+{
+    if (m_thread_state() != RUNNING)
+        STXXL_THROW_INVALID_ARGUMENT("Request submitted to not running queue.");
+
+    int num_reads = 0, num_writes = 0;
+    for (request_ptr* r = begin; r != end; ++r)
+    {
+        if (r->empty())
+            STXXL_THROW_INVALID_ARGUMENT("Empty request submitted to disk_queue.");
+        if (!dynamic_cast<serving_request*>(r->get()))
+            STXXL_ERRMSG("Incompatible request submitted to running queue.");
+
+        if (r->get()->get_type() == request::READ)
+            ++num_reads;
+        else
+            ++num_writes;
+    }
+
+#if STXXL_CHECK_FOR_PENDING_REQUESTS_ON_SUBMISSION
+    if (num_reads)
+    {
+        scoped_mutex_lock Lock(m_write_mutex);
+        for (request_ptr* r = begin; r != end; ++r)
+        {
+            if (r->get()->get_type() == request::READ &&
+                std::find_if(m_write_queue.begin(), m_write_queue.end(),
+                             bind2nd(file_offset_match(), *r) _STXXL_FORCE_SEQUENTIAL)
+                != m_write_queue.end())
+            {
+                STXXL_ERRMSG("READ request submitted for a BID with a pending WRITE request");
+            }
+        }
+    }
+    if (num_writes)
+    {
+        scoped_mutex_lock Lock(m_read_mutex);
+        for (request_ptr* r = begin; r != end; ++r)
+        {
+            if (r->get()->get_type() != request::READ &&
+                std::find_if(m_read_queue.begin(), m_read_queue.end(),
+                             bind2nd(file_offset_match(), *r) _STXXL_FORCE_SEQUENTIAL)
+                != m_read_queue.end())
+            {
+                STXXL_ERRMSG("WRITE request submitted for a BID with a pending READ request");
+            }
+        }
+    }
+#endif
+
+    // take each lock once for the whole batch
+    if (num_reads)
+    {
+        scoped_mutex_lock Lock(m_read_mutex);
+        for (request_ptr* r = begin; r != end; ++r)
+        {
+            if (r->get()->get_type() == request::READ)
+                m_read_queue.push_back(*r);
+        }
+    }
+    if (num_writes)
+    {
+        scoped_mutex_lock Lock(m_write_mutex);
+        for (request_ptr* r = begin; r != end; ++r)
+        {
+            if (r->get()->get_type() != request::READ)
+                m_write_queue.push_back(*r);
+        }
+    }
+
+    if (num_reads + num_writes)
+        m_sem.increment(num_reads + num_writes);
+}
+
 bool request_queue_impl_qwqr::cancel_request(request_ptr& req)
 {
     if (req.empty())
@@ -153,13 +227,17 @@ void* request_queue_impl_qwqr::worker(void* arg)
             scoped_mutex_lock WriteLock(pthis->m_write_mutex);
             if (!pthis->m_write_queue.empty())
             {
-                request_ptr req = pthis->m_write_queue.front();
-                pthis->m_write_queue.pop_front();
+                request_ptr reqs[STXXL_MAX_COALESCED_REQUESTS];
+                size_t n = pop_adjacent(pthis->m_write_queue, reqs);
 
                 WriteLock.unlock();
 
+                // the semaphore was incremented once per request
+                for (size_t i = 1; i < n; ++i)
+                    pthis->m_sem.decrement();
+
                 //assert(req->get_reference_count()) > 1);
-                dynamic_cast<serving_request*>(req.get())->serve();
+                serving_request::serve_coalesced(reqs, n);
             }
             else
             {
@@ -180,15 +258,19 @@ void* request_queue_impl_qwqr::worker(void* arg)
 
             if (!pthis->m_read_queue.empty())
             {
-                request_ptr req = pthis->m_read_queue.front();
-                pthis->m_read_queue.pop_front();
+                request_ptr reqs[STXXL_MAX_COALESCED_REQUESTS];
+                size_t n = pop_adjacent(pthis->m_read_queue, reqs);
 
                 ReadLock.unlock();
 
-                STXXL_VERBOSE2("queue: before serve request has " << req->get_reference_count() << " references ");
+                // the semaphore was incremented once per request
+                for (size_t i = 1; i < n; ++i)
+                    pthis->m_sem.decrement();
+
+                STXXL_VERBOSE2("queue: before serve request has " << reqs[0]->get_reference_count() << " references ");
                 //assert(req->get_reference_count() > 1);
-                dynamic_cast<serving_request*>(req.get())->serve();
-                STXXL_VERBOSE2("queue: after serve request has " << req->get_reference_count() << " references ");
+                serving_request::serve_coalesced(reqs, n);
+                STXXL_VERBOSE2("queue: after serve request has " << reqs[0]->get_reference_count() << " references ");
             }
             else
             {
@@ -14,12 +14,14 @@
  **************************************************************************/
 
 #include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/numa.h>
 #include <stxxl/bits/common/semaphore.h>
 #include <stxxl/bits/common/state.h>
 #include <stxxl/bits/config.h>
 #include <stxxl/bits/io/request_queue_impl_worker.h>
 #include <stxxl/bits/namespace.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 
@@ -42,6 +44,7 @@ void request_queue_impl_worker::start_thread(void* (*worker)(void*), void* arg,
 #else
     STXXL_CHECK_PTHREAD_CALL(pthread_create(&t, NULL, worker, arg));
 #endif
+    m_threads.push_back(&t);
     s.set_to(RUNNING);
 }
 
@@ -50,6 +53,11 @@ void request_queue_impl_worker::stop_thread(thread_type& t, state<thread_state>&
     assert(s() == RUNNING);
     s.set_to(TERMINATING);
     sem++;
+    join_thread(t, s);
+}
+
+void request_queue_impl_worker::join_thread(thread_type& t, state<thread_state>& s)
+{
 #if STXXL_STD_THREADS
 #if STXXL_MSVC >= 1700
     // In the Visual C++ Runtime 2012 and 2013, there is a deadlock bug, which
@@ -78,6 +86,28 @@ void request_queue_impl_worker::stop_thread(thread_type& t, state<thread_state>&
 #endif
     assert(s() == TERMINATED);
     s.set_to(NOT_RUNNING);
+
+    m_threads.erase(std::remove(m_threads.begin(), m_threads.end(), &t),
+                    m_threads.end());
+}
+
+void request_queue_impl_worker::set_numa_node(int node)
+{
+#if STXXL_HAVE_NUMA
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        thread_type& t = *m_threads[i];
+#if STXXL_STD_THREADS || STXXL_BOOST_THREADS
+        bool ok = numa_pin_thread(t->native_handle(), node);
+#else
+        bool ok = numa_pin_thread(t, node);
+#endif
+        if (!ok)
+            STXXL_ERRMSG("Could not pin request queue thread to NUMA node " << node << ".");
+    }
+#else
+    STXXL_ERRMSG("NUMA node " << node << " ignored, NUMA is not supported in this build.");
+#endif
 }
 
 STXXL_END_NAMESPACE
@@ -18,6 +18,7 @@
 #include <stxxl/bits/io/iostats.h>
 #include <stxxl/bits/io/request.h>
 #include <stxxl/bits/io/request_with_state.h>
+#include <stxxl/bits/common/utils.h>
 #include <stxxl/bits/singleton.h>
 #include <stxxl/bits/verbose.h>
 
@@ -58,6 +59,7 @@ bool request_with_state::cancel()
         request_ptr rp(this);
         if (disk_queues::get_instance()->cancel_request(rp, m_file->get_queue_id()))
         {
+            stats::get_instance()->request_completed(m_file->get_device_id());
             m_state.set_to(DONE);
             notify_waiters();
             m_file->delete_request_ref();
@@ -81,6 +83,18 @@ bool request_with_state::poll()
 void request_with_state::completed(bool canceled)
 {
     STXXL_VERBOSE3_THIS("request_with_state::completed()");
+    block_checksums* checksums = m_file->get_checksums();
+    if (checksums && !canceled && !m_error.get())
+    {
+        // before anyone waiting for the request sees the data
+        if (m_type == WRITE)
+            checksums->record(m_offset, m_bytes, m_buffer);
+        else if (!checksums->verify(m_offset, m_bytes, m_buffer))
+            error_occured("checksum mismatch reading " + to_str(m_bytes) +
+                          " bytes at offset " + to_str(m_offset) + " of " +
+                          m_file->io_type() + " file");
+    }
+    stats::get_instance()->request_completed(m_file->get_device_id());
     m_state.set_to(DONE);
     if (!canceled)
         m_on_complete(this);
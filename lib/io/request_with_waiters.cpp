@@ -12,20 +12,16 @@
  **************************************************************************/
 
 #include <stxxl/bits/common/mutex.h>
-#include <stxxl/bits/common/onoff_switch.h>
+#include <stxxl/bits/io/completion_queue.h>
 #include <stxxl/bits/io/request_with_waiters.h>
-#include <stxxl/bits/parallel.h>
-
-#include <algorithm>
-#include <functional>
 
 STXXL_BEGIN_NAMESPACE
 
-bool request_with_waiters::add_waiter(onoff_switch* sw)
+bool request_with_waiters::add_waiter(completion_queue* queue)
 {
     // this lock needs to be obtained before poll(), otherwise a race
     // condition might occur: the state might change and notify_waiters()
-    // could be called between poll() and insert() resulting in waiter sw
+    // could be called between poll() and insert() resulting in waiter queue
     // never being notified
     scoped_mutex_lock lock(m_waiters_mutex);
 
@@ -34,24 +30,25 @@ bool request_with_waiters::add_waiter(onoff_switch* sw)
         return true;
     }
 
-    m_waiters.insert(sw);
+    m_waiters.insert(queue);
 
     return false;
 }
 
-void request_with_waiters::delete_waiter(onoff_switch* sw)
+void request_with_waiters::delete_waiter(completion_queue* queue)
 {
     scoped_mutex_lock lock(m_waiters_mutex);
-    m_waiters.erase(sw);
+    m_waiters.erase(queue);
 }
 
 void request_with_waiters::notify_waiters()
 {
     scoped_mutex_lock lock(m_waiters_mutex);
-    std::for_each(m_waiters.begin(),
-                  m_waiters.end(),
-                  std::mem_fun(&onoff_switch::on)
-                  _STXXL_FORCE_SEQUENTIAL);
+    for (std::set<completion_queue*>::iterator it = m_waiters.begin();
+         it != m_waiters.end(); ++it)
+        (*it)->notify(this);
+    // a request completes only once
+    m_waiters.clear();
 }
 
 size_t request_with_waiters::num_waiters()
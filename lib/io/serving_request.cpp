@@ -13,13 +13,16 @@
 
 #include <stxxl/bits/common/exceptions.h>
 #include <stxxl/bits/common/state.h>
+#include <stxxl/bits/common/timer.h>
 #include <stxxl/bits/io/file.h>
+#include <stxxl/bits/io/iostats.h>
 #include <stxxl/bits/io/request_interface.h>
 #include <stxxl/bits/io/request_with_state.h>
 #include <stxxl/bits/io/serving_request.h>
 #include <stxxl/bits/namespace.h>
 #include <stxxl/bits/verbose.h>
 
+#include <cassert>
 #include <iomanip>
 
 STXXL_BEGIN_NAMESPACE
@@ -31,7 +34,13 @@ serving_request::serving_request(
     offset_type off,
     size_type b,
     request_type t)
-    : request_with_state(on_cmpl, f, buf, off, b, t)
+    : request_with_state(on_cmpl, f, buf, off, b, t),
+      m_dequeued(0),
+#if STXXL_IO_STATS
+      m_submit_time(timestamp())
+#else
+      m_submit_time(0.0)
+#endif
 {
 #ifdef STXXL_CHECK_BLOCK_ALIGNING
     // Direct I/O requires file system block size alignment for file offsets,
@@ -52,6 +61,10 @@ void serving_request::serve()
         m_offset << "/0x" << m_bytes <<
         ((m_type == request::READ) ? " READ" : " WRITE"));
 
+#if STXXL_IO_STATS
+    double start = timestamp();
+#endif
+
     try
     {
         m_file->serve(m_buffer, m_offset, m_bytes, m_type);
@@ -61,11 +74,78 @@ void serving_request::serve()
         error_occured(ex.what());
     }
 
+#if STXXL_IO_STATS
+    stats::get_instance()->request_served(
+        m_file->get_device_id(), m_type == request::WRITE,
+        start - m_submit_time, timestamp() - start);
+#endif
+
     check_nref(true);
 
     completed(false);
 }
 
+void serving_request::serve_coalesced(const request_ptr* reqs, size_t n)
+{
+    if (n == 1) {
+        dynamic_cast<serving_request*>(reqs[0].get())->serve();
+        return;
+    }
+
+    assert(n <= STXXL_MAX_COALESCED_REQUESTS);
+
+    serving_request* sreqs[STXXL_MAX_COALESCED_REQUESTS];
+    void* buffers[STXXL_MAX_COALESCED_REQUESTS];
+    size_type bytes[STXXL_MAX_COALESCED_REQUESTS];
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        sreqs[i] = dynamic_cast<serving_request*>(reqs[i].get());
+        sreqs[i]->check_nref();
+        buffers[i] = sreqs[i]->m_buffer;
+        bytes[i] = sreqs[i]->m_bytes;
+    }
+
+    serving_request* first = sreqs[0];
+    STXXL_VERBOSE2(
+        "[" << static_cast<void*>(first) << "] " <<
+        "serving_request::serve_coalesced(): " << n << " requests @ [" <<
+        first->m_file << "|" << first->m_file->get_allocator_id() << "]0x" <<
+        std::hex << std::setfill('0') << std::setw(8) <<
+        first->m_offset <<
+        ((first->m_type == request::READ) ? " READ" : " WRITE"));
+
+#if STXXL_IO_STATS
+    double start = timestamp();
+#endif
+
+    try
+    {
+        first->m_file->serve_vector(buffers, bytes, n,
+                                    first->m_offset, first->m_type);
+    }
+    catch (const io_error& ex)
+    {
+        for (size_t i = 0; i < n; ++i)
+            sreqs[i]->error_occured(ex.what());
+    }
+
+#if STXXL_IO_STATS
+    // each request took as long to serve as the whole operation
+    double stop = timestamp();
+    for (size_t i = 0; i < n; ++i)
+        stats::get_instance()->request_served(
+            first->m_file->get_device_id(), first->m_type == request::WRITE,
+            start - sreqs[i]->m_submit_time, stop - start);
+#endif
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        sreqs[i]->check_nref(true);
+        sreqs[i]->completed(false);
+    }
+}
+
 const char* serving_request::io_type() const
 {
     return m_file->io_type();
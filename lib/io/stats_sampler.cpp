@@ -0,0 +1,164 @@
+/***************************************************************************
+ *  lib/io/stats_sampler.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/exceptions.h>
+#include <stxxl/bits/common/timer.h>
+#include <stxxl/bits/io/stats_sampler.h>
+#include <stxxl/bits/verbose.h>
+
+#if STXXL_BOOST_THREADS
+ #include <boost/bind.hpp>
+#endif
+
+#if STXXL_WINDOWS
+ #include <windows.h>
+#else
+ #include <unistd.h>
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! longest sleep of the sampler thread before checking for termination
+static const double max_sleep = 0.1;
+
+static void sleep_seconds(double seconds)
+{
+#if STXXL_WINDOWS
+    Sleep((DWORD)(seconds * 1000.0));
+#else
+    usleep((useconds_t)(seconds * 1000000.0));
+#endif
+}
+
+stats_sampler::stats_sampler(const std::string& path, double interval,
+                             format_type format)
+    : m_out(path.c_str(), std::ios::out | std::ios::trunc),
+      m_interval(interval),
+      m_format(format),
+      m_start(timestamp()),
+      m_last(*stats::get_instance()),
+      m_stop(false)
+{
+    if (!m_out.good())
+        STXXL_THROW_ERRNO(io_error, "Cannot open statistics file " << path);
+    if (interval <= 0.0)
+        STXXL_THROW_INVALID_ARGUMENT("stats_sampler interval must be positive");
+
+    if (m_format == CSV)
+        stats_data::csv_header(m_out);
+
+#if STXXL_STD_THREADS
+    m_thread = new std::thread(worker, static_cast<void*>(this));
+#elif STXXL_BOOST_THREADS
+    m_thread = new boost::thread(boost::bind(worker, static_cast<void*>(this)));
+#else
+    STXXL_CHECK_PTHREAD_CALL(pthread_create(&m_thread, NULL, worker, static_cast<void*>(this)));
+#endif
+}
+
+stats_sampler::~stats_sampler()
+{
+    {
+        scoped_mutex_lock lock(m_mutex);
+        m_stop = true;
+    }
+
+#if STXXL_STD_THREADS
+    m_thread->join();
+    delete m_thread;
+#elif STXXL_BOOST_THREADS
+    m_thread->join();
+    delete m_thread;
+#else
+    STXXL_CHECK_PTHREAD_CALL(pthread_join(m_thread, NULL));
+#endif
+
+    sample();
+}
+
+void stats_sampler::sample()
+{
+    stats_data now(*stats::get_instance());
+    stats_data delta = now - m_last;
+    m_last = now;
+
+    double time = timestamp() - m_start;
+    if (m_format == CSV) {
+        delta.to_csv(m_out, time);
+    }
+    else {
+        m_out << "{\"time\":" << time << ",\"stats\":";
+        delta.to_json(m_out);
+        m_out << '}' << std::endl;
+    }
+}
+
+void* stats_sampler::worker(void* arg)
+{
+    stats_sampler* pthis = static_cast<stats_sampler*>(arg);
+
+    double next = timestamp() + pthis->m_interval;
+    for ( ; ; )
+    {
+        {
+            scoped_mutex_lock lock(pthis->m_mutex);
+            if (pthis->m_stop)
+                break;
+        }
+
+        double now = timestamp();
+        if (now < next) {
+            sleep_seconds(std::min(next - now, max_sleep));
+            continue;
+        }
+
+        pthis->sample();
+        next += pthis->m_interval;
+        if (next < now)
+            next = now + pthis->m_interval;
+    }
+
+    return NULL;
+}
+
+stats_sampler* stats_sampler::start_from_environment()
+{
+    const char* path = getenv("STXXLSTATSFILE");
+    if (!path || !*path)
+        return NULL;
+
+    double interval = 1.0;
+    const char* interval_str = getenv("STXXLSTATSINTERVAL");
+    if (interval_str && *interval_str)
+    {
+        char* endp;
+        interval = strtod(interval_str, &endp);
+        if (*endp != 0 || interval <= 0.0) {
+            STXXL_ERRMSG("Invalid STXXLSTATSINTERVAL=" << interval_str <<
+                         ", using 1 second.");
+            interval = 1.0;
+        }
+    }
+
+    std::string filename = path;
+    format_type format =
+        (filename.size() >= 4 &&
+         filename.compare(filename.size() - 4, 4, ".csv") == 0) ? CSV : JSON;
+
+    STXXL_MSG("Writing I/O statistics every " << interval << " s to " << filename);
+    return new stats_sampler(filename, interval, format);
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
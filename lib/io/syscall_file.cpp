@@ -21,6 +21,15 @@
 #include <stxxl/bits/io/syscall_file.h>
 #include "ufs_platform.h"
 
+#if STXXL_HAVE_PREADV
+ #include <sys/uio.h>
+ #include <algorithm>
+ #include <cerrno>
+ #include <climits>
+ #include <cstring>
+ #include <vector>
+#endif
+
 STXXL_BEGIN_NAMESPACE
 
 void syscall_file::serve(void* buffer, offset_type offset, size_type bytes,
@@ -30,7 +39,7 @@ void syscall_file::serve(void* buffer, offset_type offset, size_type bytes,
 
     char* cbuffer = static_cast<char*>(buffer);
 
-    stats::scoped_read_write_timer read_write_timer(bytes, type == request::WRITE);
+    stats::scoped_read_write_timer read_write_timer(bytes, type == request::WRITE, get_device_id());
 
     while (bytes > 0)
     {
@@ -111,6 +120,77 @@ void syscall_file::serve(void* buffer, offset_type offset, size_type bytes,
     }
 }
 
+#if STXXL_HAVE_PREADV
+void syscall_file::serve_vector(void* const* buffers, const size_type* bytes,
+                                size_t n, offset_type offset,
+                                request::request_type type)
+{
+    scoped_mutex_lock fd_lock(fd_mutex);
+
+    std::vector<struct iovec> iov(n);
+    size_type total = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = bytes[i];
+        total += bytes[i];
+    }
+
+    stats::scoped_read_write_timer read_write_timer(total, type == request::WRITE, get_device_id());
+
+    size_t i = 0;
+    while (i < n)
+    {
+        int iovcnt = (int)std::min<size_t>(n - i, IOV_MAX);
+        ssize_t rc;
+
+        if (type == request::READ)
+            rc = ::preadv(file_des, &iov[i], iovcnt, offset);
+        else
+            rc = ::pwritev(file_des, &iov[i], iovcnt, offset);
+
+        if (rc < 0 && errno == EINTR)
+            continue;
+
+        if (rc <= 0)
+        {
+            STXXL_THROW_ERRNO
+                (io_error,
+                " this=" << this <<
+                " call=" << ((type == request::READ) ? "::preadv" : "::pwritev") <<
+                "(fd,iov,iovcnt,offset)" <<
+                " path=" << filename <<
+                " fd=" << file_des <<
+                " offset=" << offset <<
+                " iovcnt=" << iovcnt <<
+                " bytes=" << total <<
+                " type=" << ((type == request::READ) ? "READ" : "WRITE") <<
+                " rc=" << rc);
+        }
+
+        offset += rc;
+
+        // skip completed buffers and advance into a partially transferred one
+        size_type done = (size_type)rc;
+        while (done > 0 && done >= iov[i].iov_len)
+            done -= iov[i++].iov_len;
+        if (done > 0)
+        {
+            iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + done;
+            iov[i].iov_len -= done;
+        }
+
+        if (i < n && type == request::READ && offset == this->_size())
+        {
+            // read request extends past end-of-file
+            // fill reminder with zeroes
+            for ( ; i < n; ++i)
+                memset(iov[i].iov_base, 0, iov[i].iov_len);
+        }
+    }
+}
+#endif
+
 const char* syscall_file::io_type() const
 {
     return "syscall";
@@ -0,0 +1,484 @@
+/***************************************************************************
+ *  lib/io/tiered_file.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/io/request_with_state.h>
+#include <stxxl/bits/io/tiered_file.h>
+#include <stxxl/bits/verbose.h>
+#include <stxxl/aligned_alloc>
+
+#if STXXL_BOOST_THREADS
+ #include <boost/bind.hpp>
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+const tiered_file::offset_type tiered_file::unmapped;
+
+tiered_file::tiered_file(
+    file* fast_file,
+    file* slow_file,
+    offset_type fast_capacity,
+    int queue_id, int allocator_id)
+    : disk_queued_file(queue_id, allocator_id),
+      m_fast(fast_file), m_slow(slow_file), m_size(0),
+      m_fast_capacity(fast_capacity), m_fast_used(0), m_fast_end(0),
+      m_write_seq(0), m_moving(unmapped), m_mover_stop(false),
+      // the mover starts when the fast tier is 90% full and frees a quarter
+      m_high_water(fast_capacity / 10 * 9),
+      m_low_water(fast_capacity / 4 * 3)
+{
+    m_fast->set_size(m_fast_capacity);
+
+#if STXXL_STD_THREADS
+    m_mover_thread = new std::thread(mover, static_cast<void*>(this));
+#elif STXXL_BOOST_THREADS
+    m_mover_thread = new boost::thread(boost::bind(mover, static_cast<void*>(this)));
+#else
+    STXXL_CHECK_PTHREAD_CALL(pthread_create(&m_mover_thread, NULL, mover, static_cast<void*>(this)));
+#endif
+}
+
+tiered_file::~tiered_file()
+{
+    {
+        scoped_mutex_lock lock(m_mutex);
+        m_mover_stop = true;
+        m_mover_cond.notify_one();
+    }
+
+#if STXXL_STD_THREADS
+    m_mover_thread->join();
+    delete m_mover_thread;
+#elif STXXL_BOOST_THREADS
+    m_mover_thread->join();
+    delete m_mover_thread;
+#else
+    STXXL_CHECK_PTHREAD_CALL(pthread_join(m_mover_thread, NULL));
+#endif
+
+    delete m_fast;
+    delete m_slow;
+}
+
+tiered_file::offset_type tiered_file::allocate_fast(size_type bytes)
+{
+    // m_mutex has to be acquired by caller
+    offset_type physical;
+
+    std::map<size_type, std::vector<offset_type> >::iterator it =
+        m_fast_free.find(bytes);
+    if (it != m_fast_free.end() && !it->second.empty()) {
+        physical = it->second.back();
+        it->second.pop_back();
+    }
+    else if (m_fast_end + bytes <= m_fast_capacity) {
+        physical = m_fast_end;
+        m_fast_end += bytes;
+    }
+    else {
+        return unmapped;
+    }
+
+    m_fast_used += bytes;
+    return physical;
+}
+
+void tiered_file::free_fast(offset_type physical, size_type bytes)
+{
+    // m_mutex has to be acquired by caller
+    m_fast_free[bytes].push_back(physical);
+    m_fast_used -= bytes;
+}
+
+//! Request for a tiered_file, forwarded to one of the backends.
+class tiered_file::tiered_request : public request_with_state
+{
+public:
+    tiered_request(const completion_handler& on_cmpl, file* f, void* buffer,
+                   offset_type offset, size_type bytes, request_type type)
+        : request_with_state(on_cmpl, f, buffer, offset, bytes, type)
+    { }
+
+    //! The request is on a backend's queue and cannot be canceled.
+    bool cancel()
+    {
+        return false;
+    }
+
+    //! Completes the request after the backend's request.
+    void forward_completed()
+    {
+        completed(false);
+    }
+};
+
+//! Completion handler of the backend request, completes the tiered_request.
+struct tiered_file::forward_handler
+{
+    //! keeps the tiered_request alive until the backend finished
+    request_ptr req;
+    tiered_file* file;
+    offset_type offset;
+    //! region on the fast tier, or unmapped for the slow tier
+    offset_type physical;
+
+    forward_handler(const request_ptr& req, tiered_file* file,
+                    offset_type offset, offset_type physical)
+        : req(req), file(file), offset(offset), physical(physical)
+    { }
+
+    void operator () (request* backend)
+    {
+        try {
+            backend->check_errors();
+        }
+        catch (const io_error& ex) {
+            req->error_occured(ex.what());
+        }
+
+        if (physical != unmapped)
+            file->unpin(offset, physical);
+
+        static_cast<tiered_request*>(req.get())->forward_completed();
+    }
+};
+
+request_ptr tiered_file::submit(void* buffer, offset_type offset, size_type bytes,
+                                request::request_type type,
+                                const completion_handler& on_cmpl)
+{
+    request_ptr req(new tiered_request(on_cmpl, this, buffer, offset, bytes, type));
+
+    file* target = m_slow;
+    offset_type physical = offset;
+    {
+        scoped_mutex_lock lock(m_mutex);
+
+        fast_map_type::iterator it = m_fast_blocks.find(offset);
+
+        if (type == request::WRITE)
+        {
+            // a block of another size needs another region, the old one can
+            // only be freed once no request uses it anymore.
+            while (it != m_fast_blocks.end() && it->second.bytes != bytes &&
+                   it->second.pins != 0)
+            {
+                m_unpinned_cond.wait(lock);
+                it = m_fast_blocks.find(offset);
+            }
+
+            if (it != m_fast_blocks.end() && it->second.bytes != bytes)
+            {
+                // the region is reused for a block of another size
+                free_fast(it->second.physical, it->second.bytes);
+                m_fast_blocks.erase(it);
+                it = m_fast_blocks.end();
+            }
+
+            if (it == m_fast_blocks.end())
+            {
+                offset_type fast = allocate_fast(bytes);
+                if (fast != unmapped) {
+                    fast_block b = { fast, bytes, 0, 0, 0 };
+                    it = m_fast_blocks.insert(std::make_pair(offset, b)).first;
+                }
+                if (m_fast_used >= m_high_water || fast == unmapped)
+                    m_mover_cond.notify_one();
+            }
+
+            if (it != m_fast_blocks.end())
+                it->second.version = ++m_write_seq;
+        }
+
+        if (it != m_fast_blocks.end())
+        {
+            assert(bytes <= it->second.bytes);
+            ++it->second.pins;
+            if (it->second.accesses < (unsigned)(-1))
+                ++it->second.accesses;
+            target = m_fast;
+            physical = it->second.physical;
+        }
+        else if (type == request::WRITE)
+        {
+            // do not overwrite the block with the copy of an older version
+            while (m_moving == offset)
+                m_moved_cond.wait(lock);
+        }
+    }
+
+    STXXL_VERBOSE2("tiered_file: " << (type == request::READ ? "read" : "write") <<
+                   " " << offset << " + " << bytes << " on " <<
+                   (target == m_fast ? "fast" : "slow") << " tier at " << physical);
+
+    stats::get_instance()->request_submitted(get_device_id());
+
+    forward_handler handler(req, this, offset,
+                            target == m_fast ? physical : unmapped);
+    try
+    {
+        if (type == request::READ)
+            target->aread(buffer, physical, bytes, handler);
+        else
+            target->awrite(buffer, physical, bytes, handler);
+    }
+    catch (const io_error& ex)
+    {
+        req->error_occured(ex.what());
+        handler(req.get());
+    }
+
+    return req;
+}
+
+void tiered_file::unpin(offset_type offset, offset_type physical)
+{
+    scoped_mutex_lock lock(m_mutex);
+    fast_map_type::iterator it = m_fast_blocks.find(offset);
+    if (it != m_fast_blocks.end() && it->second.physical == physical &&
+        --it->second.pins == 0)
+        m_unpinned_cond.notify_all();
+}
+
+request_ptr tiered_file::aread(void* buffer, offset_type pos, size_type bytes,
+                               const completion_handler& on_cmpl)
+{
+    return submit(buffer, pos, bytes, request::READ, on_cmpl);
+}
+
+request_ptr tiered_file::awrite(void* buffer, offset_type pos, size_type bytes,
+                                const completion_handler& on_cmpl)
+{
+    return submit(buffer, pos, bytes, request::WRITE, on_cmpl);
+}
+
+void tiered_file::aread_batch(request_ptr* reqs, void* const* buffers,
+                              const offset_type* pos, const size_type* bytes,
+                              size_t n, const completion_handler& on_cmpl)
+{
+    for (size_t i = 0; i < n; ++i)
+        reqs[i] = submit(buffers[i], pos[i], bytes[i], request::READ, on_cmpl);
+}
+
+void tiered_file::awrite_batch(request_ptr* reqs, void* const* buffers,
+                               const offset_type* pos, const size_type* bytes,
+                               size_t n, const completion_handler& on_cmpl)
+{
+    for (size_t i = 0; i < n; ++i)
+        reqs[i] = submit(buffers[i], pos[i], bytes[i], request::WRITE, on_cmpl);
+}
+
+void tiered_file::serve(void* buffer, offset_type offset, size_type bytes,
+                        request::request_type type)
+{
+    submit(buffer, offset, bytes, type, completion_handler())->wait(false);
+}
+
+tiered_file::size_type tiered_file::migrate(offset_type logical)
+{
+    fast_block b;
+    {
+        scoped_mutex_lock lock(m_mutex);
+        // one block is moved at a time, see serve()
+        while (m_moving != unmapped)
+            m_moved_cond.wait(lock);
+
+        fast_map_type::iterator it = m_fast_blocks.find(logical);
+        if (it == m_fast_blocks.end() || it->second.pins != 0)
+            return 0;
+        b = it->second;
+        m_moving = logical;
+    }
+
+    char* buffer = static_cast<char*>(stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(b.bytes));
+    try
+    {
+        m_fast->aread(buffer, b.physical, b.bytes)->wait(false);
+        m_slow->awrite(buffer, logical, b.bytes)->wait(false);
+    }
+    catch (...)
+    {
+        stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+        scoped_mutex_lock lock(m_mutex);
+        m_moving = unmapped;
+        m_moved_cond.notify_all();
+        throw;
+    }
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+
+    scoped_mutex_lock lock(m_mutex);
+    m_moving = unmapped;
+    m_moved_cond.notify_all();
+
+    // a block which was written during the copy stays on the fast tier, a
+    // reader of the old region may still be running.
+    fast_map_type::iterator it = m_fast_blocks.find(logical);
+    if (it == m_fast_blocks.end() || it->second.version != b.version ||
+        it->second.physical != b.physical || it->second.pins != 0)
+        return 0;
+
+    free_fast(b.physical, b.bytes);
+    m_fast_blocks.erase(it);
+    m_fast->discard(b.physical, b.bytes);
+
+    STXXL_VERBOSE2("tiered_file: moved " << logical << " + " << b.bytes <<
+                   " to slow tier, accesses " << b.accesses);
+    return b.bytes;
+}
+
+tiered_file::offset_type tiered_file::demote(offset_type max_fast_bytes)
+{
+    // (access count, logical offset) of the blocks on the fast tier
+    std::vector<std::pair<unsigned, offset_type> > candidates;
+    {
+        scoped_mutex_lock lock(m_mutex);
+        if (m_fast_used > max_fast_bytes)
+        {
+            candidates.reserve(m_fast_blocks.size());
+            for (fast_map_type::const_iterator it = m_fast_blocks.begin();
+                 it != m_fast_blocks.end(); ++it)
+                candidates.push_back(std::make_pair(it->second.accesses, it->first));
+        }
+
+        // age the access counts, such that old accesses count less
+        for (fast_map_type::iterator it = m_fast_blocks.begin();
+             it != m_fast_blocks.end(); ++it)
+            it->second.accesses /= 2;
+    }
+
+    // coldest first, equally cold ones in ascending order of their offsets
+    std::sort(candidates.begin(), candidates.end());
+
+    offset_type moved = 0;
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        {
+            scoped_mutex_lock lock(m_mutex);
+            if (m_fast_used <= max_fast_bytes)
+                break;
+        }
+        moved += migrate(candidates[i].second);
+    }
+    return moved;
+}
+
+void* tiered_file::mover(void* arg)
+{
+    tiered_file* self = static_cast<tiered_file*>(arg);
+
+    bool idle = false;
+    for ( ; ; )
+    {
+        {
+            scoped_mutex_lock lock(self->m_mutex);
+            // if nothing could be moved, wait for the next write to retry
+            while (!self->m_mover_stop &&
+                   (idle || self->m_fast_used < self->m_high_water))
+            {
+                self->m_mover_cond.wait(lock);
+                idle = false;
+            }
+            if (self->m_mover_stop)
+                break;
+        }
+
+        try
+        {
+            idle = (self->demote(self->m_low_water) == 0);
+        }
+        catch (const io_error& ex)
+        {
+            STXXL_ERRMSG("tiered_file: moving blocks failed: " << ex.what());
+            idle = true;
+        }
+    }
+
+    return NULL;
+}
+
+void tiered_file::discard(offset_type offset, offset_type size)
+{
+    {
+        scoped_mutex_lock lock(m_mutex);
+        fast_map_type::iterator it;
+        // the region can only be freed once no request and not the mover
+        // uses it anymore, like in submit()
+        for ( ; ; )
+        {
+            it = m_fast_blocks.find(offset);
+            if (it != m_fast_blocks.end() && it->second.pins != 0)
+                m_unpinned_cond.wait(lock);
+            else if (m_moving == offset)
+                m_moved_cond.wait(lock);
+            else
+                break;
+        }
+        if (it != m_fast_blocks.end())
+        {
+            offset_type physical = it->second.physical;
+            size_type bytes = it->second.bytes;
+            free_fast(physical, bytes);
+            m_fast_blocks.erase(it);
+            m_fast->discard(physical, bytes);
+        }
+    }
+    m_slow->discard(offset, size);
+}
+
+tiered_file::offset_type tiered_file::get_fast_bytes()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_fast_used;
+}
+
+bool tiered_file::is_fast(offset_type offset)
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_fast_blocks.find(offset) != m_fast_blocks.end();
+}
+
+void tiered_file::sync()
+{
+    m_fast->sync();
+    m_slow->sync();
+}
+
+void tiered_file::lock()
+{
+    m_fast->lock();
+    m_slow->lock();
+}
+
+tiered_file::offset_type tiered_file::size()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_size;
+}
+
+void tiered_file::set_size(offset_type newsize)
+{
+    scoped_mutex_lock lock(m_mutex);
+    m_slow->set_size(newsize);
+    m_size = newsize;
+}
+
+const char* tiered_file::io_type() const
+{
+    return "tiered";
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
@@ -22,6 +22,11 @@
 #include <stxxl/bits/verbose.h>
 #include "ufs_platform.h"
 
+#if STXXL_HAVE_BLKDISCARD
+ #include <sys/ioctl.h>
+ #include <linux/fs.h>
+#endif
+
 STXXL_BEGIN_NAMESPACE
 
 const char* ufs_file_base::io_type() const
@@ -32,7 +37,7 @@ const char* ufs_file_base::io_type() const
 ufs_file_base::ufs_file_base(
     const std::string& filename,
     int mode)
-    : file_des(-1), m_mode(mode), filename(filename)
+    : file_des(-1), m_mode(mode), filename(filename), m_discard(false)
 {
     int flags = 0;
 
@@ -193,6 +198,18 @@ void ufs_file_base::lock()
 #endif
 }
 
+void ufs_file_base::sync()
+{
+    scoped_mutex_lock fd_lock(fd_mutex);
+#if STXXL_WINDOWS || defined(__MINGW32__)
+    STXXL_THROW_ERRNO_NE_0(::_commit(file_des), io_error,
+                           "_commit() path=" << filename << " fd=" << file_des);
+#else
+    STXXL_THROW_ERRNO_NE_0(::fsync(file_des), io_error,
+                           "fsync() path=" << filename << " fd=" << file_des);
+#endif
+}
+
 file::offset_type ufs_file_base::_size()
 {
     // We use lseek SEEK_END to find the file size. This works for raw devices
@@ -284,5 +301,46 @@ bool ufs_file_base::is_device() const
     return m_is_device;
 }
 
+void ufs_file_base::set_discard(bool enable)
+{
+#if !STXXL_HAVE_FALLOC_PUNCH_HOLE && !STXXL_HAVE_BLKDISCARD
+    if (enable)
+        STXXL_MSG("Warning: discarding freed blocks of " << filename <<
+                  " is not supported on this platform.");
+    enable = false;
+#endif
+    m_discard = enable;
+}
+
+void ufs_file_base::discard(offset_type offset, offset_type size)
+{
+    if (!m_discard)
+        return;
+
+    int rc = -1;
+    errno = EOPNOTSUPP;
+
+    if (m_is_device) {
+#if STXXL_HAVE_BLKDISCARD
+        uint64 range[2] = { (uint64)offset, (uint64)size };
+        rc = ::ioctl(file_des, BLKDISCARD, &range);
+#endif
+    }
+    else {
+#if STXXL_HAVE_FALLOC_PUNCH_HOLE
+        rc = ::fallocate(file_des, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                         offset, size);
+#endif
+    }
+
+    if (rc != 0) {
+        // discarding is only a hint, turn it off instead of failing
+        STXXL_ERRMSG("discard() path=" << filename << " fd=" << file_des <<
+                     " offset=" << offset << " size=" << size << " failed: " <<
+                     strerror(errno) << ", disabling discard.");
+        m_discard = false;
+    }
+}
+
 STXXL_END_NAMESPACE
 // vim: et:ts=4:sw=4
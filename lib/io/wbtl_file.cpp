@@ -19,17 +19,110 @@
 #if STXXL_HAVE_WBTL_FILE
 
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iomanip>
+#include <stxxl/bits/common/utils.h>
 #include <stxxl/bits/io/io.h>
-#include <stxxl/bits/parallel.h>
 #include <stxxl/aligned_alloc>
 
+#if STXXL_BOOST_THREADS
+ #include <boost/bind.hpp>
+#endif
+
 #ifndef STXXL_VERBOSE_WBTL
 #define STXXL_VERBOSE_WBTL STXXL_VERBOSE2
 #endif
 
 STXXL_BEGIN_NAMESPACE
 
+const wbtl_file::offset_type wbtl_file::unmapped;
+const size_t wbtl_file::cleaner_reserve;
+
+#define FMT_A_S(_addr_, _size_) "0x" << std::hex << std::setfill('0') << std::setw(8) << (_addr_) << "/0x" << std::setw(8) << (_size_)
+        #define FMT_A_C(_addr_, _size_) "0x" << std::setw(8) << (_addr_) << "(" << std::dec << (_size_) << ")"
+        #define FMT_A(_addr_) "0x" << std::setw(8) << (_addr_)
+
+wbtl_file::address_table::~address_table()
+{
+    for (size_t i = 0; i < m_leaves.size(); ++i)
+        delete[] m_leaves[i];
+}
+
+wbtl_file::offset_type* wbtl_file::address_table::entry(offset_type logical, bool create)
+{
+    if (m_block_size == 0 || logical % m_block_size != 0)
+        return NULL;
+
+    const offset_type index = logical / m_block_size;
+    const size_t leaf = (size_t)(index >> leaf_bits);
+    const size_t leaf_size = (size_t)1 << leaf_bits;
+
+    if (leaf >= m_leaves.size()) {
+        if (!create) return NULL;
+        m_leaves.resize(leaf + 1, NULL);
+    }
+    if (m_leaves[leaf] == NULL) {
+        if (!create) return NULL;
+        m_leaves[leaf] = new offset_type[leaf_size];
+        std::fill(m_leaves[leaf], m_leaves[leaf] + leaf_size, unmapped);
+    }
+    return m_leaves[leaf] + (size_t)(index & (leaf_size - 1));
+}
+
+wbtl_file::offset_type wbtl_file::address_table::find(offset_type logical, size_type* bytes)
+{
+    offset_type* e = entry(logical, false);
+    if (e != NULL && *e != unmapped) {
+        if (bytes) *bytes = m_block_size;
+        return *e;
+    }
+
+    std::map<offset_type, std::pair<offset_type, size_type> >::const_iterator it =
+        m_others.find(logical);
+    if (it == m_others.end())
+        return unmapped;
+
+    if (bytes) *bytes = it->second.second;
+    return it->second.first;
+}
+
+void wbtl_file::address_table::insert(offset_type logical, size_type bytes, offset_type physical)
+{
+    if (m_block_size == 0)
+        m_block_size = bytes;
+
+    if (bytes == m_block_size) {
+        offset_type* e = entry(logical, true);
+        if (e != NULL) {
+            *e = physical;
+            return;
+        }
+    }
+    m_others[logical] = std::make_pair(physical, bytes);
+}
+
+wbtl_file::offset_type wbtl_file::address_table::erase(offset_type logical, size_type* bytes)
+{
+    offset_type* e = entry(logical, false);
+    if (e != NULL && *e != unmapped) {
+        offset_type physical = *e;
+        *e = unmapped;
+        *bytes = m_block_size;
+        return physical;
+    }
+
+    std::map<offset_type, std::pair<offset_type, size_type> >::iterator it =
+        m_others.find(logical);
+    if (it == m_others.end())
+        return unmapped;
+
+    offset_type physical = it->second.first;
+    *bytes = it->second.second;
+    m_others.erase(it);
+    return physical;
+}
+
 wbtl_file::wbtl_file(
     file* backend_file,
     size_type write_buffer_size,
@@ -37,20 +130,53 @@ wbtl_file::wbtl_file(
     int queue_id, int allocator_id)
     : disk_queued_file(queue_id, allocator_id), storage(backend_file),
       sz(0), write_block_size(write_buffer_size),
-      free_bytes(0), curbuf(1), curpos(write_block_size)
+      curbuf(0), curpos(write_block_size), cleaner_stop(false)
 {
-    STXXL_UNUSED(write_buffers);
-    assert(write_buffers == 2); // currently hardcoded
-    write_buffer[0] = static_cast<char*>(stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(write_block_size));
-    write_buffer[1] = static_cast<char*>(stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(write_block_size));
-    buffer_address[0] = offset_type(-1);
-    buffer_address[1] = offset_type(-1);
+    if (write_buffers < 1)
+        STXXL_THROW_INVALID_ARGUMENT("wbtl_file needs at least one write buffer");
+
+    buffers.resize(write_buffers);
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+        buffers[i].data = static_cast<char*>(stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(write_block_size));
+        buffers[i].address = unmapped;
+    }
+    clean_buffer = static_cast<char*>(stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(write_block_size));
+
+#if STXXL_STD_THREADS
+    cleaner_thread = new std::thread(cleaner, static_cast<void*>(this));
+#elif STXXL_BOOST_THREADS
+    cleaner_thread = new boost::thread(boost::bind(cleaner, static_cast<void*>(this)));
+#else
+    STXXL_CHECK_PTHREAD_CALL(pthread_create(&cleaner_thread, NULL, cleaner, static_cast<void*>(this)));
+#endif
 }
 
 wbtl_file::~wbtl_file()
 {
-    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(write_buffer[1]);
-    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(write_buffer[0]);
+    {
+        scoped_mutex_lock mapping_lock(mapping_mutex);
+        cleaner_stop = true;
+        cleaner_cond.notify_one();
+    }
+
+#if STXXL_STD_THREADS
+    cleaner_thread->join();
+    delete cleaner_thread;
+#elif STXXL_BOOST_THREADS
+    cleaner_thread->join();
+    delete cleaner_thread;
+#else
+    STXXL_CHECK_PTHREAD_CALL(pthread_join(cleaner_thread, NULL));
+#endif
+
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+        if (buffers[i].flush.get())
+            buffers[i].flush->wait(false);
+        stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffers[i].data);
+    }
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(clean_buffer);
     delete storage;
     storage = 0;
 }
@@ -85,263 +211,343 @@ void wbtl_file::set_size(offset_type newsize)
     scoped_mutex_lock mapping_lock(mapping_mutex);
     assert(sz <= newsize); // may not shrink
     if (sz < newsize) {
-        _add_free_region(sz, newsize - sz);
-        storage->set_size(newsize);
+        // besides the logical size, the backend holds a segment for each
+        // write buffer and the cleaner's reserve plus one, such that some
+        // segments must contain dead blocks when all free ones are taken.
+        size_t nsegments = (size_t)div_ceil(newsize, write_block_size) +
+                           buffers.size() + cleaner_reserve + 1;
+        if (segments.size() < nsegments) {
+            segments.resize(nsegments);
+            storage->set_size((offset_type)nsegments * write_block_size);
+        }
         sz = newsize;
-        assert(sz == storage->size());
     }
 }
 
-#define FMT_A_S(_addr_, _size_) "0x" << std::hex << std::setfill('0') << std::setw(8) << (_addr_) << "/0x" << std::setw(8) << (_size_)
-        #define FMT_A_C(_addr_, _size_) "0x" << std::setw(8) << (_addr_) << "(" << std::dec << (_size_) << ")"
-        #define FMT_A(_addr_) "0x" << std::setw(8) << (_addr_)
-
 // logical address
 void wbtl_file::discard(offset_type offset, offset_type size)
 {
     scoped_mutex_lock mapping_lock(mapping_mutex);
-    sortseq::iterator physical = address_mapping.find(offset);
-    STXXL_VERBOSE_WBTL("wbtl:discard l" << FMT_A_S(offset, size) << " @    p" << FMT_A(physical != address_mapping.end() ? physical->second : 0xffffffff));
-    if (physical == address_mapping.end()) {
+    size_type bytes = 0;
+    offset_type physical = address_mapping.erase(offset, &bytes);
+    STXXL_VERBOSE_WBTL("wbtl:discard l" << FMT_A_S(offset, size) << " @    p" << FMT_A(physical));
+    STXXL_UNUSED(size);
+    if (physical == unmapped) {
         // could be OK if the block was never written ...
-        //STXXL_ERRMSG("discard: mapping not found: " << FMT_A_S(offset, size) << " ==> " << "???");
-    }
-    else {
-        offset_type physical_offset = physical->second;
-        address_mapping.erase(physical);
-        _add_free_region(physical_offset, size);
-        place_map::iterator reverse = reverse_mapping.find(physical_offset);
-        if (reverse == reverse_mapping.end()) {
-            STXXL_ERRMSG("discard: reverse mapping not found: " << FMT_A_S(offset, size) << " ==> " << "???");
-        }
-        else {
-            assert(offset == (reverse->second).first);
-            reverse_mapping.erase(reverse);
-        }
-        storage->discard(physical_offset, size);
+        return;
     }
+    release_block(physical, bytes);
+    storage->discard(physical, bytes);
 }
 
 // physical address
-void wbtl_file::_add_free_region(offset_type offset, offset_type size)
+void wbtl_file::release_block(offset_type physical, size_type bytes)
+{
+    // mapping_lock has to be aquired by caller
+    segment& seg = segments[(size_t)(physical / write_block_size)];
+    assert(seg.live >= bytes);
+    seg.live -= bytes;
+    if (seg.live == 0 && !seg.buffered)
+        seg.blocks.clear();
+}
+
+size_t wbtl_file::count_free_segments() const
 {
     // mapping_lock has to be aquired by caller
-    STXXL_VERBOSE_WBTL("wbtl:addfre  p" << FMT_A_S(offset, size) << " F <= f" << FMT_A_C(free_bytes, free_space.size()));
-    offset_type region_pos = offset;
-    offset_type region_size = size;
-    if (!free_space.empty())
+    size_t free = 0;
+    for (size_t i = 0; i < segments.size(); ++i)
     {
-        sortseq::iterator succ = free_space.upper_bound(region_pos);
-        sortseq::iterator pred = succ;
-        pred--;
-        check_corruption(region_pos, region_size, pred, succ);
-        if (succ == free_space.end())
-        {
-            if (pred == free_space.end())
-            {
-                //dump();
-                assert(pred != free_space.end());
-            }
-            if ((*pred).first + (*pred).second == region_pos)
-            {
-                // coalesce with predecessor
-                region_size += (*pred).second;
-                region_pos = (*pred).first;
-                free_space.erase(pred);
-            }
-        }
-        else
+        if (!segments[i].buffered && segments[i].live == 0)
+            ++free;
+    }
+    return free;
+}
+
+size_t wbtl_file::get_free_segments()
+{
+    scoped_mutex_lock mapping_lock(mapping_mutex);
+    return count_free_segments();
+}
+
+void wbtl_file::sread(void* buffer, offset_type offset, size_type bytes)
+{
+    for ( ; ; )
+    {
+        offset_type physical_offset;
+        unsigned generation;
+        // map logical to physical address
         {
-            if (free_space.size() > 1)
-            {
-                bool succ_is_not_the_first = (succ != free_space.begin());
-                if ((*succ).first == region_pos + region_size)
-                {
-                    // coalesce with successor
-                    region_size += (*succ).second;
-                    free_space.erase(succ);
-                }
-                if (succ_is_not_the_first)
-                {
-                    if (pred == free_space.end())
-                    {
-                        //dump();
-                        assert(pred != free_space.end());
-                    }
-                    if ((*pred).first + (*pred).second == region_pos)
-                    {
-                        // coalesce with predecessor
-                        region_size += (*pred).second;
-                        region_pos = (*pred).first;
-                        free_space.erase(pred);
-                    }
-                }
+            scoped_mutex_lock mapping_lock(mapping_mutex);
+            physical_offset = address_mapping.find(offset);
+            if (physical_offset == unmapped) {
+                STXXL_ERRMSG("wbtl_read: mapping not found: " << FMT_A_S(offset, bytes) << " ==> " << "???");
+                // block was deleted or never written before
+                char* uninitialized = (char*)malloc(sizeof(char));
+                memset(buffer, *uninitialized, bytes);
+                free(uninitialized);
+                return;
             }
-            else
+
+            for (size_t i = 0; i < buffers.size(); ++i)
             {
-                if ((*succ).first == region_pos + region_size)
+                const write_buffer& wb = buffers[i];
+                if (wb.address != unmapped && wb.address <= physical_offset &&
+                    physical_offset < wb.address + write_block_size)
                 {
-                    // coalesce with successor
-                    region_size += (*succ).second;
-                    free_space.erase(succ);
+                    // block is in a write buffer
+                    assert(physical_offset + bytes <= wb.address + write_block_size);
+                    memcpy(buffer, wb.data + (physical_offset - wb.address), bytes);
+                    stats::get_instance()->read_cached(bytes);
+                    STXXL_VERBOSE_WBTL("wbtl:sread   l" << FMT_A_S(offset, bytes) << " @    p" << FMT_A(physical_offset) << " " << std::dec << i);
+                    return;
                 }
             }
+
+            generation = segments[(size_t)(physical_offset / write_block_size)].generation;
         }
-    }
 
-    free_space[region_pos] = region_size;
-    free_bytes += size;
-    STXXL_VERBOSE_WBTL("wbtl:free    p" << FMT_A_S(region_pos, region_size) << " F => f" << FMT_A_C(free_bytes, free_space.size()));
-}
+        // block is not cached, read it without holding a lock
+        request_ptr req = storage->aread(buffer, physical_offset, bytes);
+        req->wait(false);
 
-void wbtl_file::sread(void* buffer, offset_type offset, size_type bytes)
-{
-    scoped_mutex_lock buffer_lock(buffer_mutex);
-    int cached = -1;
-    offset_type physical_offset;
-    // map logical to physical address
-    {
         scoped_mutex_lock mapping_lock(mapping_mutex);
-        sortseq::iterator physical = address_mapping.find(offset);
-        if (physical == address_mapping.end()) {
-            STXXL_ERRMSG("wbtl_read: mapping not found: " << FMT_A_S(offset, bytes) << " ==> " << "???");
-            //STXXL_THROW_ERRNO(io_error, "wbtl_read of unmapped memory");
-            physical_offset = 0xffffffff;
-        }
-        else {
-            physical_offset = physical->second;
+        if (address_mapping.find(offset) == physical_offset &&
+            segments[(size_t)(physical_offset / write_block_size)].generation == generation)
+        {
+            STXXL_VERBOSE_WBTL("wbtl:sread   l" << FMT_A_S(offset, bytes) << " @    p" << FMT_A(physical_offset) << " -1");
+            return;
         }
+        // the block was relocated and its segment reused meanwhile, retry
     }
+}
 
-    if (buffer_address[curbuf] <= physical_offset &&
-        physical_offset < buffer_address[curbuf] + write_block_size)
-    {
-        // block is in current write buffer
-        assert(physical_offset + bytes <= buffer_address[curbuf] + write_block_size);
-        memcpy(buffer, write_buffer[curbuf] + (physical_offset - buffer_address[curbuf]), bytes);
-        stats::get_instance()->read_cached(bytes);
-        cached = curbuf;
-    }
-    else if (buffer_address[1 - curbuf] <= physical_offset &&
-             physical_offset < buffer_address[1 - curbuf] + write_block_size)
+void wbtl_file::swrite(void* buffer, offset_type offset, size_type bytes)
+{
+    scoped_mutex_lock buffer_lock(buffer_mutex);
+    append(buffer, offset, bytes, unmapped);
+}
+
+void wbtl_file::append(const void* buffer, offset_type offset, size_type bytes,
+                       offset_type relocate_from)
+{
+    // buffer_lock has to be aquired by caller
+    if (bytes > write_block_size)
+        STXXL_THROW_INVALID_ARGUMENT("wbtl_file: block of " << bytes <<
+                                     " bytes exceeds the write buffer size");
+
+    while (bytes > write_block_size - curpos)
+        switch_buffer(relocate_from != unmapped);
+
+    write_buffer& wb = buffers[curbuf];
+    offset_type physical = wb.address + curpos;
+
+    // write block into buffer
+    memcpy(wb.data + curpos, buffer, bytes);
+    curpos += bytes;
+
+    scoped_mutex_lock mapping_lock(mapping_mutex);
+    if (relocate_from != unmapped)
     {
-        // block is in previous write buffer
-        assert(physical_offset + bytes <= buffer_address[1 - curbuf] + write_block_size);
-        memcpy(buffer, write_buffer[1 - curbuf] + (physical_offset - buffer_address[1 - curbuf]), bytes);
-        stats::get_instance()->read_cached(bytes);
-        cached = curbuf;
-    }
-    else if (physical_offset == 0xffffffff) {
-        // block was deleted or never written before
-        char* uninitialized = (char*)malloc(sizeof(char));
-        memset(buffer, *uninitialized, bytes);
-        free(uninitialized);
+        // the block may have been discarded or overwritten while the
+        // cleaner was reading it, then the copy is dead already.
+        if (address_mapping.find(offset) != relocate_from)
+            return;
+        release_block(relocate_from, bytes);
     }
     else
     {
-        // block is not cached
-        request_ptr req = storage->aread(buffer, physical_offset, bytes);
-        req->wait(false);
+        size_type old_bytes = 0;
+        offset_type old = address_mapping.erase(offset, &old_bytes);
+        // the old copy is not discarded from the backend: that would be a
+        // syscall under mapping_mutex for every overwrite, and its segment
+        // is rewritten as a whole once the cleaner has freed it.
+        if (old != unmapped)
+            release_block(old, old_bytes);
+        stats::get_instance()->write_cached(bytes);
     }
-    STXXL_VERBOSE_WBTL("wbtl:sread   l" << FMT_A_S(offset, bytes) << " @    p" << FMT_A(physical_offset) << " " << std::dec << cached);
-    STXXL_UNUSED(cached);
+
+    address_mapping.insert(offset, bytes, physical);
+    segment& seg = segments[(size_t)(physical / write_block_size)];
+    seg.live += bytes;
+    seg.blocks.push_back(segment_block(offset, physical, bytes));
+    STXXL_VERBOSE_WBTL("wbtl:swrite  l" << FMT_A_S(offset, bytes) << " @ => p" << FMT_A(physical));
 }
 
-void wbtl_file::swrite(void* buffer, offset_type offset, size_type bytes)
+void wbtl_file::switch_buffer(bool relocating)
 {
-    scoped_mutex_lock buffer_lock(buffer_mutex);
-    // is the block already mapped?
+    // buffer_lock has to be aquired by caller
+    offset_type next_address = get_next_write_block(relocating);
+
+    if (next_address == unmapped)
     {
-        scoped_mutex_lock mapping_lock(mapping_mutex);
-        sortseq::iterator physical = address_mapping.find(offset);
-        STXXL_VERBOSE_WBTL("wbtl:swrite  l" << FMT_A_S(offset, bytes) << " @ <= p" <<
-                           FMT_A_C(physical != address_mapping.end() ? physical->second : 0xffffffff, address_mapping.size()));
-        if (physical != address_mapping.end()) {
-            mapping_lock.unlock();
-            // FIXME: special case if we can replace it in the current writing block
-            discard(offset, bytes);
-        }
+        if (relocating)
+            STXXL_THROW(io_error, "wbtl_file: no free segment to relocate blocks to");
+
+        // relocate the live blocks of the segment with the most dead space
+        // in the foreground. This appends to the current write buffer, the
+        // caller checks for room again afterwards.
+        if (!clean_segment_locked(write_block_size - 1))
+            STXXL_THROW(io_error, "OutOfSpace, probably fragmented");
+        return;
     }
 
-    if (bytes > write_block_size - curpos)
-    {
-        // not enough space in the current write buffer
+    write_buffer& cur = buffers[curbuf];
+    if (cur.address != unmapped) {
+        STXXL_VERBOSE_WBTL("wbtl:w2disk  p" << FMT_A_S(cur.address, write_block_size));
+        // the unused rest of the segment is reclaimed by cleaning it
+        cur.flush = storage->awrite(cur.data, cur.address, write_block_size);
+    }
 
-        if (buffer_address[curbuf] != offset_type(-1)) {
-            STXXL_VERBOSE_WBTL("wbtl:w2disk  p" << FMT_A_S(buffer_address[curbuf], write_block_size));
+    // reuse the least recently flushed buffer, the others stay in flight
+    curbuf = (curbuf + 1) % buffers.size();
+    write_buffer& next = buffers[curbuf];
+    if (next.flush.get()) {
+        next.flush->wait(false);
+        next.flush = NULL;
+    }
 
-            // mark remaining part as free
-            if (curpos < write_block_size)
-                _add_free_region(buffer_address[curbuf] + curpos, write_block_size - curpos);
+    scoped_mutex_lock mapping_lock(mapping_mutex);
+    if (next.address != unmapped)
+    {
+        segment& seg = segments[(size_t)(next.address / write_block_size)];
+        seg.buffered = false;
+        if (seg.live == 0)
+            seg.blocks.clear();
+    }
+    next.address = next_address;
+    curpos = 0;
+}
 
-            if (backend_request.get()) {
-                backend_request->wait(false);
-            }
+wbtl_file::offset_type wbtl_file::get_next_write_block(bool relocating)
+{
+    // buffer_lock has to be aquired by caller
+    scoped_mutex_lock mapping_lock(mapping_mutex);
 
-            backend_request = storage->awrite(write_buffer[curbuf], buffer_address[curbuf], write_block_size);
+    size_t free = 0, first = segments.size();
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        if (!segments[i].buffered && segments[i].live == 0) {
+            if (first == segments.size()) first = i;
+            ++free;
         }
+    }
 
-        curbuf = 1 - curbuf;
+    // the last free segments are reserved for relocating blocks
+    if (first == segments.size() || (!relocating && free <= cleaner_reserve))
+        return unmapped;
 
-        buffer_address[curbuf] = get_next_write_block();
-        curpos = 0;
-    }
-    assert(bytes <= write_block_size - curpos);
+    segment& seg = segments[first];
+    seg.buffered = true;
+    ++seg.generation;
+    seg.blocks.clear();
 
-    // write block into buffer
-    memcpy(write_buffer[curbuf] + curpos, buffer, bytes);
-    stats::get_instance()->write_cached(bytes);
+    if (free - 1 < buffers.size() + cleaner_reserve + 1)
+        cleaner_cond.notify_one();
 
-    scoped_mutex_lock mapping_lock(mapping_mutex);
-    address_mapping[offset] = buffer_address[curbuf] + curpos;
-    reverse_mapping[buffer_address[curbuf] + curpos] = place(offset, bytes);
-    STXXL_VERBOSE_WBTL("wbtl:swrite  l" << FMT_A_S(offset, bytes) << " @ => p" << FMT_A_C(buffer_address[curbuf] + curpos, address_mapping.size()));
-    curpos += bytes;
+    offset_type address = (offset_type)first * write_block_size;
+    STXXL_VERBOSE_WBTL("wbtl:nextwb  p" << FMT_A_S(address, write_block_size) << " F    f" << FMT_A_C(free - 1, segments.size()));
+    return address;
 }
 
-wbtl_file::offset_type wbtl_file::get_next_write_block()
+bool wbtl_file::clean_segment(size_type max_live)
 {
-    // mapping_lock has to be aquired by caller
-    sortseq::iterator space =
-        std::find_if(free_space.begin(), free_space.end(),
-                     bind2nd(FirstFit(), write_block_size) _STXXL_FORCE_SEQUENTIAL);
+    scoped_mutex_lock buffer_lock(buffer_mutex);
+    return clean_segment_locked(max_live);
+}
 
-    if (space != free_space.end())
+bool wbtl_file::clean_segment_locked(size_type max_live)
+{
+    // buffer_lock has to be aquired by caller
+    std::vector<segment_block> live_blocks;
+    offset_type address;
     {
-        offset_type region_pos = (*space).first;
-        offset_type region_size = (*space).second;
-        free_space.erase(space);
-        if (region_size > write_block_size)
-            free_space[region_pos + write_block_size] = region_size - write_block_size;
+        scoped_mutex_lock mapping_lock(mapping_mutex);
 
-        free_bytes -= write_block_size;
+        // pick the segment with the least live bytes
+        size_t victim = segments.size();
+        for (size_t i = 0; i < segments.size(); ++i)
+        {
+            const segment& seg = segments[i];
+            if (seg.buffered || seg.live == 0 || seg.live > max_live)
+                continue;
+            if (victim == segments.size() || seg.live < segments[victim].live)
+                victim = i;
+        }
+        if (victim == segments.size())
+            return false;
 
-        STXXL_VERBOSE_WBTL("wbtl:nextwb  p" << FMT_A_S(region_pos, write_block_size) << " F    f" << FMT_A_C(free_bytes, free_space.size()));
-        return region_pos;
+        const segment& seg = segments[victim];
+        for (size_t i = 0; i < seg.blocks.size(); ++i)
+        {
+            if (address_mapping.find(seg.blocks[i].logical) == seg.blocks[i].physical)
+                live_blocks.push_back(seg.blocks[i]);
+        }
+
+        address = (offset_type)victim * write_block_size;
+        STXXL_VERBOSE_WBTL("wbtl:clean   p" << FMT_A_S(address, write_block_size) << " live " << std::dec << seg.live);
+    }
+
+    // the segment is not buffered, thus completely written to the backend
+    request_ptr req = storage->aread(clean_buffer, address, write_block_size);
+    req->wait(false);
+
+    // appending the blocks frees the segment with the last one
+    for (size_t i = 0; i < live_blocks.size(); ++i)
+    {
+        const segment_block& b = live_blocks[i];
+        append(clean_buffer + (b.physical - address), b.logical, b.bytes, b.physical);
     }
 
-    STXXL_THROW_ERRNO(io_error, "OutOfSpace, probably fragmented");
+    return true;
 }
 
-void wbtl_file::check_corruption(offset_type region_pos, offset_type region_size,
-                                 sortseq::iterator pred, sortseq::iterator succ)
+void* wbtl_file::cleaner(void* arg)
 {
-    if (pred != free_space.end())
+    wbtl_file* self = static_cast<wbtl_file*>(arg);
+
+    // keep enough free segments that writers rarely clean in the foreground,
+    // but relocate only mostly dead segments to save backend bandwidth
+    const size_t target = self->buffers.size() + cleaner_reserve + 1;
+    const size_type max_live = self->write_block_size / 2;
+
+    for ( ; ; )
     {
-        if (pred->first <= region_pos && pred->first + pred->second > region_pos)
         {
-            STXXL_THROW(bad_ext_alloc, "Error: double deallocation of external memory " <<
-                        "System info: P " << pred->first << " " << pred->second << " " << region_pos);
+            scoped_mutex_lock mapping_lock(self->mapping_mutex);
+            while (!self->cleaner_stop)
+            {
+                size_t free = self->count_free_segments();
+                if (free < target && free >= cleaner_reserve)
+                {
+                    bool victim = false;
+                    for (size_t i = 0; i < self->segments.size() && !victim; ++i)
+                    {
+                        const segment& seg = self->segments[i];
+                        victim = !seg.buffered && seg.live != 0 && seg.live <= max_live;
+                    }
+                    if (victim)
+                        break;
+                }
+                self->cleaner_cond.wait(mapping_lock);
+            }
+            if (self->cleaner_stop)
+                break;
+        }
+
+        try
+        {
+            self->clean_segment(max_live);
         }
-    }
-    if (succ != free_space.end())
-    {
-        if (region_pos <= succ->first && region_pos + region_size > succ->first)
+        catch (const io_error& ex)
         {
-            STXXL_THROW(bad_ext_alloc, "Error: double deallocation of external memory "
-                        << "System info: S " << region_pos << " " << region_size << " " << succ->first);
+            STXXL_ERRMSG("wbtl_file: cleaning failed: " << ex.what());
+            scoped_mutex_lock mapping_lock(self->mapping_mutex);
+            if (!self->cleaner_stop)
+                self->cleaner_cond.wait(mapping_lock);
         }
     }
+
+    return NULL;
 }
 
 const char* wbtl_file::io_type() const
@@ -173,6 +173,13 @@ void wfs_file_base::lock()
     locked = true;
 }
 
+void wfs_file_base::sync()
+{
+    scoped_mutex_lock fd_lock(fd_mutex);
+    if (!FlushFileBuffers(file_des))
+        STXXL_THROW_WIN_LASTERROR(io_error, "FlushFileBuffers() fd=" << file_des);
+}
+
 file::offset_type wfs_file_base::_size()
 {
     LARGE_INTEGER result;
@@ -49,7 +49,7 @@ void wincall_file::serve(void* buffer, offset_type offset, size_type bytes,
     }
     else
     {
-        stats::scoped_read_write_timer read_write_timer(bytes, type == request::WRITE);
+        stats::scoped_read_write_timer read_write_timer(bytes, type == request::WRITE, get_device_id());
 
         if (type == request::READ)
         {
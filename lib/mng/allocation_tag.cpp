@@ -0,0 +1,76 @@
+/***************************************************************************
+ *  lib/mng/allocation_tag.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/common/exceptions.h>
+#include <stxxl/bits/config.h>
+#include <stxxl/bits/mng/allocation_tag.h>
+
+#if STXXL_MSVC
+ #define STXXL_THREAD_LOCAL __declspec(thread)
+#elif __cplusplus >= 201103L
+ #define STXXL_THREAD_LOCAL thread_local
+#else
+ #define STXXL_THREAD_LOCAL __thread
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+//! tag of the innermost scoped_allocation_tag of each thread
+static STXXL_THREAD_LOCAL allocation_tag* s_current_tag = NULL;
+
+allocation_tag::allocation_tag(const std::string& name, int64 quota)
+    : m_id(stats::get_instance()->register_allocation_tag(name))
+{
+    if (quota)
+        set_quota(quota);
+}
+
+void allocation_tag::set_quota(int64 quota)
+{
+    stats::get_instance()->set_allocation_quota(m_id, quota);
+}
+
+allocation_stats allocation_tag::get_stats() const
+{
+    return stats::get_instance()->get_allocation_stats(m_id);
+}
+
+void allocation_tag::reserve(int64 bytes)
+{
+    if (!stats::get_instance()->allocation_added(m_id, bytes))
+    {
+        allocation_stats s = get_stats();
+        STXXL_THROW(bad_ext_alloc,
+                    "allocating " << bytes << " bytes with tag " << s.name <<
+                    " would exceed its quota of " << s.quota << " bytes, " <<
+                    s.current << " bytes are allocated");
+    }
+}
+
+void allocation_tag::release(int64 bytes)
+{
+    stats::get_instance()->allocation_removed(m_id, bytes);
+}
+
+allocation_tag* allocation_tag::current()
+{
+    return s_current_tag;
+}
+
+allocation_tag* allocation_tag::set_current(allocation_tag* tag)
+{
+    allocation_tag* previous = s_current_tag;
+    s_current_tag = tag;
+    return previous;
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
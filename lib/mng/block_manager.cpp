@@ -14,13 +14,17 @@
 
 #include <stxxl/bits/common/types.h>
 #include <stxxl/bits/io/create_file.h>
+#include <stxxl/bits/io/disk_queues.h>
 #include <stxxl/bits/io/file.h>
+#include <stxxl/bits/io/stats_sampler.h>
 #include <stxxl/bits/mng/block_manager.h>
 #include <stxxl/bits/mng/config.h>
+#include <stxxl/bits/mng/discard_queue.h>
 #include <stxxl/bits/mng/disk_allocator.h>
 #include <stxxl/bits/namespace.h>
 #include <stxxl/bits/verbose.h>
 
+#include <cassert>
 #include <cstddef>
 #include <fstream>
 #include <string>
@@ -40,6 +44,9 @@ block_manager::block_manager()
     ndisks = config->disks_number();
     disk_allocators = new disk_allocator*[ndisks];
     disk_files = new file*[ndisks];
+    disk_discard = new bool[ndisks];
+    m_discard_queue = NULL;
+    m_has_tagged_blocks = false;
 
     uint64 total_size = 0;
 
@@ -54,6 +61,12 @@ block_manager::block_manager()
         try
         {
             disk_files[i] = create_file(cfg, file::CREAT | file::RDWR, i);
+            if (cfg.checksum)
+                disk_files[i]->enable_checksums();
+
+            if (cfg.numa_node >= 0)
+                disk_queues::get_instance()->set_queue_numa_node(
+                    disk_files[i]->get_queue_id(), cfg.numa_node);
 
             STXXL_MSG("Disk '" << cfg.path << "' is allocated, space: " <<
                       (cfg.size) / (1024 * 1024) <<
@@ -70,6 +83,10 @@ block_manager::block_manager()
         total_size += cfg.size;
 
         disk_allocators[i] = new disk_allocator(disk_files[i], cfg);
+
+        disk_discard[i] = cfg.discard;
+        if (cfg.discard && !m_discard_queue)
+            m_discard_queue = new discard_queue();
     }
 
     if (ndisks > 1)
@@ -84,11 +101,16 @@ block_manager::block_manager()
     m_total_allocation = 0;
     m_maximum_allocation = 0;
 #endif // STXXL_MNG_COUNT_ALLOCATION
+
+    m_stats_sampler = stats_sampler::start_from_environment();
 }
 
 block_manager::~block_manager()
 {
     STXXL_VERBOSE1("Block manager destructor");
+    delete m_stats_sampler;
+    // return the blocks still being discarded
+    delete m_discard_queue;
     for (size_t i = ndisks; i > 0; )
     {
         --i;
@@ -97,6 +119,33 @@ block_manager::~block_manager()
     }
     delete[] disk_allocators;
     delete[] disk_files;
+    delete[] disk_discard;
+}
+
+void block_manager::submit_discard(
+    size_t disk, std::vector<disk_allocator::place>& regions)
+{
+    assert(m_discard_queue);
+    m_discard_queue->submit(disk_files[disk], disk_allocators[disk], regions);
+}
+
+void block_manager::untag_block(size_t disk, int64 offset, int64 bytes)
+{
+    unsigned tag;
+    {
+        scoped_mutex_lock lock(m_tagged_mutex);
+        tagged_map_type::iterator it = m_tagged_blocks.find(tagged_block(disk, offset));
+        if (it == m_tagged_blocks.end())
+            return;
+        tag = it->second;
+        m_tagged_blocks.erase(it);
+    }
+    stats::get_instance()->allocation_removed(tag, bytes);
+}
+
+bool block_manager::wait_discards()
+{
+    return m_discard_queue && m_discard_queue->wait();
 }
 
 uint64 block_manager::get_total_bytes() const
@@ -119,5 +168,23 @@ uint64 block_manager::get_free_bytes() const
     return total;
 }
 
+uint64 block_manager::get_disk_total_bytes(size_t i) const
+{
+    assert(i < ndisks);
+    return disk_allocators[i]->get_total_bytes();
+}
+
+uint64 block_manager::get_disk_free_bytes(size_t i) const
+{
+    assert(i < ndisks);
+    return disk_allocators[i]->get_free_bytes();
+}
+
+uint64 block_manager::get_disk_allocated_bytes(size_t i) const
+{
+    assert(i < ndisks);
+    return disk_allocators[i]->get_used_bytes();
+}
+
 STXXL_END_NAMESPACE
 // vim: et:ts=4:sw=4
@@ -13,10 +13,12 @@
  *  http://www.boost.org/LICENSE_1_0.txt)
  **************************************************************************/
 
+#include <algorithm>
 #include <fstream>
 #include <stxxl/bits/common/error_handling.h>
 #include <stxxl/bits/config.h>
 #include <stxxl/bits/io/file.h>
+#include <stxxl/bits/io/disk_queues.h>
 #include <stxxl/bits/mng/config.h>
 #include <stxxl/bits/common/utils.h>
 #include <stxxl/version.h>
@@ -48,10 +50,27 @@ config::~config()
         {
             STXXL_ERRMSG("Removing disk file: " << it->path);
             unlink(it->path.c_str());
+            if (!it->fast_path.empty()) {
+                STXXL_ERRMSG("Removing disk file: " << it->fast_path);
+                unlink(it->fast_path.c_str());
+            }
         }
     }
 }
 
+std::vector<unsigned> config::tiered_disks()
+{
+    check_initialized();
+
+    std::vector<unsigned> disks;
+    for (unsigned i = 0; i < disks_list.size(); ++i)
+    {
+        if (disks_list[i].io_impl == "tiered")
+            disks.push_back(i);
+    }
+    return disks;
+}
+
 void config::initialize()
 {
     // if disks_list is empty, then try to load disk configuration files
@@ -61,6 +80,7 @@ void config::initialize()
     }
 
     m_max_device_id = 0;
+    m_max_queue_id = 0;
 
     is_initialized = true;
 }
@@ -193,6 +213,19 @@ void config::update_max_device_id(unsigned int devid)
         m_max_device_id = devid + 1;
 }
 
+int config::get_next_queue_id()
+{
+    check_initialized();
+
+    // disks without an explicit queue get their index, see block_manager
+    for (size_t i = 0; i < disks_list.size(); ++i)
+    {
+        m_max_queue_id = std::max(m_max_queue_id, (int)i + 1);
+        m_max_queue_id = std::max(m_max_queue_id, disks_list[i].queue + 1);
+    }
+    return m_max_queue_id++;
+}
+
 uint64 config::total_size() const
 {
     assert(is_initialized);
@@ -215,12 +248,17 @@ disk_config::disk_config()
       autogrow(true),
       delete_on_exit(false),
       direct(DIRECT_TRY),
+      discard(false),
+      checksum(false),
       flash(false),
       queue(file::DEFAULT_QUEUE),
       device_id(file::DEFAULT_DEVICE_ID),
+      numa_node(-1),
       raw_device(false),
       unlink_on_open(false),
-      queue_length(0)
+      queue_length(0),
+      write_buffers(0),
+      fast_size(0)
 { }
 
 disk_config::disk_config(const std::string& _path, uint64 _size,
@@ -231,12 +269,17 @@ disk_config::disk_config(const std::string& _path, uint64 _size,
       autogrow(true),
       delete_on_exit(false),
       direct(DIRECT_TRY),
+      discard(false),
+      checksum(false),
       flash(false),
       queue(file::DEFAULT_QUEUE),
       device_id(file::DEFAULT_DEVICE_ID),
+      numa_node(-1),
       raw_device(false),
       unlink_on_open(false),
-      queue_length(0)
+      queue_length(0),
+      write_buffers(0),
+      fast_size(0)
 {
     parse_fileio();
 }
@@ -246,12 +289,17 @@ disk_config::disk_config(const std::string& line)
       autogrow(true),
       delete_on_exit(false),
       direct(DIRECT_TRY),
+      discard(false),
+      checksum(false),
       flash(false),
       queue(file::DEFAULT_QUEUE),
       device_id(file::DEFAULT_DEVICE_ID),
+      numa_node(-1),
       raw_device(false),
       unlink_on_open(false),
-      queue_length(0)
+      queue_length(0),
+      write_buffers(0),
+      fast_size(0)
 {
     parse_line(line);
 }
@@ -277,10 +325,16 @@ void disk_config::parse_line(const std::string& line)
     autogrow = true; // was default for a long time, have to keep it this way
     delete_on_exit = false;
     direct = DIRECT_TRY;
+    discard = false;
+    checksum = false;
     // flash is already set
     queue = file::DEFAULT_QUEUE;
+    queue_impl = "";
     device_id = file::DEFAULT_DEVICE_ID;
+    numa_node = -1;
     unlink_on_open = false;
+    fast_path = "";
+    fast_size = 0;
 
     // *** Save Basic Options ***
 
@@ -386,9 +440,67 @@ void disk_config::parse_fileio()
                             "Invalid parameter '" << *p << "' in disk configuration file.");
             }
         }
+        else if (*p == "discard" || *p == "nodiscard" || eq[0] == "discard")
+        {
+            if (io_impl != "syscall" && io_impl != "mmap" &&
+                io_impl != "linuxaio" && io_impl != "io_uring") {
+                STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
+            }
+
+            if (*p == "discard") discard = true;
+            else if (*p == "nodiscard") discard = false;
+            else if (eq[1] == "off") discard = false;
+            else if (eq[1] == "on") discard = true;
+            else if (eq[1] == "no") discard = false;
+            else if (eq[1] == "yes") discard = true;
+            else
+            {
+                STXXL_THROW(std::runtime_error,
+                            "Invalid parameter '" << *p << "' in disk configuration file.");
+            }
+        }
+        else if (*p == "checksum" || *p == "nochecksum" || eq[0] == "checksum")
+        {
+            if (*p == "checksum") checksum = true;
+            else if (*p == "nochecksum") checksum = false;
+            else if (eq[1] == "off") checksum = false;
+            else if (eq[1] == "on") checksum = true;
+            else if (eq[1] == "no") checksum = false;
+            else if (eq[1] == "yes") checksum = true;
+            else
+            {
+                STXXL_THROW(std::runtime_error,
+                            "Invalid parameter '" << *p << "' in disk configuration file.");
+            }
+        }
+        else if (eq[0] == "fast" || eq[0] == "fast_size")
+        {
+            if (io_impl != "tiered") {
+                STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' "
+                            "is only valid for fileio tiered "
+                            "in disk configuration file.");
+            }
+
+            if (eq[0] == "fast") {
+                fast_path = eq[1];
+            }
+            else if (!parse_SI_IEC_size(eq[1], fast_size, 'M') || fast_size == 0) {
+                STXXL_THROW(std::runtime_error,
+                            "Invalid parameter '" << *p << "' in disk configuration file.");
+            }
+        }
+        else if (eq[0] == "numa")
+        {
+            char* endp;
+            numa_node = (int)strtoul(eq[1].c_str(), &endp, 10);
+            if (eq[1].empty() || (endp && *endp != 0)) {
+                STXXL_THROW(std::runtime_error,
+                            "Invalid parameter '" << *p << "' in disk configuration file.");
+            }
+        }
         else if (eq[0] == "queue")
         {
-            if (io_impl == "linuxaio") {
+            if (io_impl == "linuxaio" || io_impl == "io_uring") {
                 STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
             }
 
@@ -399,11 +511,24 @@ void disk_config::parse_fileio()
                             "Invalid parameter '" << *p << "' in disk configuration file.");
             }
         }
+        else if (eq[0] == "queue_impl")
+        {
+            if (io_impl == "linuxaio" || io_impl == "io_uring") {
+                STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
+            }
+
+            if (!disk_queues::is_valid_queue_impl(eq[1])) {
+                STXXL_THROW(std::runtime_error,
+                            "Invalid parameter '" << *p << "' in disk configuration file.");
+            }
+
+            queue_impl = eq[1];
+        }
         else if (eq[0] == "queue_length")
         {
-            if (io_impl != "linuxaio") {
+            if (io_impl != "linuxaio" && io_impl != "io_uring") {
                 STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' "
-                            "is only valid for fileio linuxaio "
+                            "is only valid for fileio linuxaio and io_uring "
                             "in disk configuration file.");
             }
 
@@ -414,6 +539,21 @@ void disk_config::parse_fileio()
                             "Invalid parameter '" << *p << "' in disk configuration file.");
             }
         }
+        else if (eq[0] == "write_buffers")
+        {
+            if (io_impl != "wbtl") {
+                STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' "
+                            "is only valid for fileio wbtl "
+                            "in disk configuration file.");
+            }
+
+            char* endp;
+            write_buffers = (int)strtoul(eq[1].c_str(), &endp, 10);
+            if ((endp && *endp != 0) || write_buffers < 1) {
+                STXXL_THROW(std::runtime_error,
+                            "Invalid parameter '" << *p << "' in disk configuration file.");
+            }
+        }
         else if (eq[0] == "device_id" || eq[0] == "devid")
         {
             char* endp;
@@ -425,7 +565,7 @@ void disk_config::parse_fileio()
         }
         else if (*p == "raw_device")
         {
-            if (!(io_impl == "syscall")) {
+            if (!(io_impl == "syscall" || io_impl == "io_uring")) {
                 STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
             }
 
@@ -434,7 +574,8 @@ void disk_config::parse_fileio()
         else if (*p == "unlink" || *p == "unlink_on_open")
         {
             if (!(io_impl == "syscall" || io_impl == "linuxaio" ||
-                  io_impl == "mmap" || io_impl == "wbtl"))
+                  io_impl == "io_uring" || io_impl == "mmap" ||
+                  io_impl == "wbtl"))
             {
                 STXXL_THROW(std::runtime_error, "Parameter '" << *p << "' invalid for fileio '" << io_impl << "' in disk configuration file.");
             }
@@ -471,15 +612,28 @@ std::string disk_config::fileio_string() const
     else
         STXXL_THROW(std::runtime_error, "Invalid setting for 'direct' option.");
 
+    if (discard)
+        oss << " discard";
+
+    if (checksum)
+        oss << " checksum";
+
     if (flash)
         oss << " flash";
 
-    if (queue != file::DEFAULT_QUEUE && queue != file::DEFAULT_LINUXAIO_QUEUE)
+    if (queue != file::DEFAULT_QUEUE && queue != file::DEFAULT_LINUXAIO_QUEUE &&
+        queue != file::DEFAULT_IOURING_QUEUE)
         oss << " queue=" << queue;
 
+    if (!queue_impl.empty())
+        oss << " queue_impl=" << queue_impl;
+
     if (device_id != file::DEFAULT_DEVICE_ID)
         oss << " devid=" << device_id;
 
+    if (numa_node >= 0)
+        oss << " numa=" << numa_node;
+
     if (raw_device)
         oss << " raw_device";
 
@@ -489,6 +643,15 @@ std::string disk_config::fileio_string() const
     if (queue_length != 0)
         oss << " queue_length=" << queue_length;
 
+    if (write_buffers != 0)
+        oss << " write_buffers=" << write_buffers;
+
+    if (!fast_path.empty())
+        oss << " fast=" << fast_path;
+
+    if (fast_size != 0)
+        oss << " fast_size=" << fast_size << "B";
+
     return oss.str();
 }
 
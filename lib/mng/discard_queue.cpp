@@ -0,0 +1,166 @@
+/***************************************************************************
+ *  lib/mng/discard_queue.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <algorithm>
+#include <exception>
+
+#include <stxxl/bits/common/error_handling.h>
+#include <stxxl/bits/io/file.h>
+#include <stxxl/bits/mng/discard_queue.h>
+#include <stxxl/bits/verbose.h>
+
+#if STXXL_BOOST_THREADS
+ #include <boost/bind.hpp>
+#endif
+
+STXXL_BEGIN_NAMESPACE
+
+discard_queue::discard_queue()
+    : m_pending_bytes(0),
+      m_busy(false),
+      m_stop(false)
+{
+#if STXXL_STD_THREADS
+    m_thread = new std::thread(worker, static_cast<void*>(this));
+#elif STXXL_BOOST_THREADS
+    m_thread = new boost::thread(boost::bind(worker, static_cast<void*>(this)));
+#else
+    STXXL_CHECK_PTHREAD_CALL(pthread_create(&m_thread, NULL, worker, static_cast<void*>(this)));
+#endif
+}
+
+discard_queue::~discard_queue()
+{
+    {
+        scoped_mutex_lock lock(m_mutex);
+        m_stop = true;
+        m_work_cond.notify_one();
+    }
+
+#if STXXL_STD_THREADS
+    m_thread->join();
+    delete m_thread;
+#elif STXXL_BOOST_THREADS
+    m_thread->join();
+    delete m_thread;
+#else
+    STXXL_CHECK_PTHREAD_CALL(pthread_join(m_thread, NULL));
+#endif
+}
+
+void discard_queue::submit(file* storage, disk_allocator* alloc,
+                           std::vector<place>& regions)
+{
+    stxxl::int64 bytes = 0;
+    for (size_t i = 0; i < regions.size(); ++i)
+        bytes += regions[i].second;
+
+    scoped_mutex_lock lock(m_mutex);
+    m_batches.push_back(batch());
+    m_batches.back().storage = storage;
+    m_batches.back().alloc = alloc;
+    m_batches.back().regions.swap(regions);
+    m_pending_bytes += bytes;
+    m_work_cond.notify_one();
+}
+
+bool discard_queue::wait()
+{
+    scoped_mutex_lock lock(m_mutex);
+    if (m_batches.empty() && !m_busy)
+        return false;
+    while (!m_batches.empty() || m_busy)
+        m_idle_cond.wait(lock);
+    return true;
+}
+
+stxxl::int64 discard_queue::get_pending_bytes()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_pending_bytes;
+}
+
+void discard_queue::process(batch& b)
+{
+    // merge adjacent regions, such that runs of blocks freed together are
+    // discarded with one call
+    std::sort(b.regions.begin(), b.regions.end());
+
+    size_t out = 0;
+    for (size_t i = 1; i < b.regions.size(); ++i)
+    {
+        if (b.regions[out].first + b.regions[out].second == b.regions[i].first)
+            b.regions[out].second += b.regions[i].second;
+        else
+            b.regions[++out] = b.regions[i];
+    }
+    if (!b.regions.empty())
+        b.regions.resize(out + 1);
+
+    for (size_t i = 0; i < b.regions.size(); ++i)
+        b.storage->discard(b.regions[i].first, b.regions[i].second);
+
+    STXXL_VERBOSE2("discard_queue: discarded " << b.regions.size() <<
+                   " regions of " << b.storage->io_type() << " file");
+
+    b.alloc->delete_regions(b.regions);
+}
+
+void* discard_queue::worker(void* arg)
+{
+    discard_queue* self = static_cast<discard_queue*>(arg);
+
+    batch b;
+    stxxl::int64 bytes = 0;
+
+    for ( ; ; )
+    {
+        {
+            scoped_mutex_lock lock(self->m_mutex);
+
+            // account for the previous batch
+            self->m_pending_bytes -= bytes;
+            self->m_busy = false;
+            if (self->m_batches.empty())
+                self->m_idle_cond.notify_all();
+
+            // drain the queue before stopping, the regions must be returned
+            while (self->m_batches.empty() && !self->m_stop)
+                self->m_work_cond.wait(lock);
+
+            if (self->m_batches.empty())
+                break;
+
+            b.storage = self->m_batches.front().storage;
+            b.alloc = self->m_batches.front().alloc;
+            b.regions.clear();
+            b.regions.swap(self->m_batches.front().regions);
+            self->m_batches.pop_front();
+            self->m_busy = true;
+        }
+
+        bytes = 0;
+        for (size_t i = 0; i < b.regions.size(); ++i)
+            bytes += b.regions[i].second;
+
+        // process the batch without holding the lock
+        try {
+            process(b);
+        }
+        catch (const std::exception& ex) {
+            STXXL_ERRMSG("discard_queue: freeing regions failed: " << ex.what());
+        }
+    }
+
+    return NULL;
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
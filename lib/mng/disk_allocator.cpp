@@ -18,10 +18,12 @@
 #include <stxxl/bits/namespace.h>
 #include <stxxl/bits/verbose.h>
 
+#include <algorithm>
 #include <cassert>
 #include <map>
 #include <ostream>
 #include <utility>
+#include <vector>
 
 STXXL_BEGIN_NAMESPACE
 
@@ -38,31 +40,6 @@ void disk_allocator::dump() const
     STXXL_ERRMSG("Total bytes: " << total);
 }
 
-void disk_allocator::deallocation_error(
-    stxxl::int64 block_pos, stxxl::int64 block_size,
-    const sortseq::iterator& pred, const sortseq::iterator& succ) const
-{
-    STXXL_ERRMSG("Error deallocating block at " << block_pos << " size " << block_size);
-    STXXL_ERRMSG(((pred == succ) ? "pred==succ" : "pred!=succ"));
-    if (pred == free_space.end()) {
-        STXXL_ERRMSG("pred==free_space.end()");
-    }
-    else {
-        if (pred == free_space.begin())
-            STXXL_ERRMSG("pred==free_space.begin()");
-        STXXL_ERRMSG("pred: begin=" << pred->first << " size=" << pred->second);
-    }
-    if (succ == free_space.end()) {
-        STXXL_ERRMSG("succ==free_space.end()");
-    }
-    else {
-        if (succ == free_space.begin())
-            STXXL_ERRMSG("succ==free_space.begin()");
-        STXXL_ERRMSG("succ: begin=" << succ->first << " size=" << succ->second);
-    }
-    dump();
-}
-
 void disk_allocator::add_free_region(stxxl::int64 block_pos, stxxl::int64 block_size)
 {
     //assert(block_size);
@@ -70,94 +47,117 @@ void disk_allocator::add_free_region(stxxl::int64 block_pos, stxxl::int64 block_
     STXXL_VERBOSE2("Deallocating a block with size: " << block_size << " position: " << block_pos);
     stxxl::int64 region_pos = block_pos;
     stxxl::int64 region_size = block_size;
-    if (!free_space.empty())
+
+    sortseq::iterator succ = free_space.upper_bound(region_pos);
+    if (succ != free_space.begin())
     {
-        sortseq::iterator succ = free_space.upper_bound(region_pos);
         sortseq::iterator pred = succ;
-        if (pred != free_space.begin())
-            pred--;
-        if (pred != free_space.end())
+        --pred;
+        if (pred->first + pred->second > region_pos)
         {
-            if (pred->first <= region_pos && pred->first + pred->second > region_pos)
-            {
-                STXXL_THROW2(bad_ext_alloc, "disk_allocator::check_corruption", "Error: double deallocation of external memory, trying to deallocate region " << region_pos << " + " << region_size << "  in empty space [" << pred->first << " + " << pred->second << "]");
-            }
+            STXXL_THROW2(bad_ext_alloc, "disk_allocator::check_corruption", "Error: double deallocation of external memory, trying to deallocate region " << region_pos << " + " << region_size << "  in empty space [" << pred->first << " + " << pred->second << "]");
         }
-        if (succ != free_space.end())
+        if (pred->first + pred->second == region_pos)
         {
-            if (region_pos <= succ->first && region_pos + region_size > succ->first)
-            {
-                STXXL_THROW2(bad_ext_alloc, "disk_allocator::check_corruption", "Error: double deallocation of external memory, trying to deallocate region " << region_pos << " + " << region_size << "  which overlaps empty space [" << succ->first << " + " << succ->second << "]");
-            }
+            // coalesce with predecessor
+            region_pos = pred->first;
+            region_size += pred->second;
+            erase_free(pred);
         }
-        if (succ == free_space.end())
+    }
+    if (succ != free_space.end())
+    {
+        if (block_pos + block_size > succ->first)
         {
-            if (pred == free_space.end())
-            {
-                deallocation_error(block_pos, block_size, pred, succ);
-                assert(pred != free_space.end());
-            }
-            if ((*pred).first + (*pred).second == region_pos)
-            {
-                // coalesce with predecessor
-                region_size += (*pred).second;
-                region_pos = (*pred).first;
-                free_space.erase(pred);
-            }
+            STXXL_THROW2(bad_ext_alloc, "disk_allocator::check_corruption", "Error: double deallocation of external memory, trying to deallocate region " << block_pos << " + " << block_size << "  which overlaps empty space [" << succ->first << " + " << succ->second << "]");
         }
-        else
+        if (block_pos + block_size == succ->first)
         {
-            if (free_space.size() > 1)
-            {
-#if 0
-                if (pred == succ)
-                {
-                    deallocation_error(block_pos, block_size, pred, succ);
-                    assert(pred != succ);
-                }
-#endif
-                bool succ_is_not_the_first = (succ != free_space.begin());
-                if ((*succ).first == region_pos + region_size)
-                {
-                    // coalesce with successor
-                    region_size += (*succ).second;
-                    free_space.erase(succ);
-                    //-tb: set succ to pred afterwards due to iterator invalidation
-                    succ = pred;
-                }
-                if (succ_is_not_the_first)
-                {
-                    if (pred == free_space.end())
-                    {
-                        deallocation_error(block_pos, block_size, pred, succ);
-                        assert(pred != free_space.end());
-                    }
-                    if ((*pred).first + (*pred).second == region_pos)
-                    {
-                        // coalesce with predecessor
-                        region_size += (*pred).second;
-                        region_pos = (*pred).first;
-                        free_space.erase(pred);
-                    }
-                }
-            }
-            else
-            {
-                if ((*succ).first == region_pos + region_size)
-                {
-                    // coalesce with successor
-                    region_size += (*succ).second;
-                    free_space.erase(succ);
-                }
-            }
+            // coalesce with successor
+            region_size += succ->second;
+            erase_free(succ);
         }
     }
 
-    free_space[region_pos] = region_size;
+    insert_free(region_pos, region_size);
     free_bytes += block_size;
 
     //dump();
 }
 
+stxxl::int64 disk_allocator::new_region(stxxl::int64 bytes)
+{
+    scoped_mutex_lock lock(mutex);
+
+    sortseq::iterator space = best_fit(bytes);
+    if (space == free_space.end())
+    {
+        if (!autogrow)
+            return -1;
+
+        // appended space merges with a free region at the end of the file
+        grow_file(bytes);
+        space = best_fit(bytes);
+        assert(space != free_space.end());
+    }
+
+    stxxl::int64 region_pos = space->first;
+    stxxl::int64 region_size = space->second;
+    erase_free(space);
+    if (region_size > bytes)
+        insert_free(region_pos + bytes, region_size - bytes);
+    free_bytes -= bytes;
+
+    return region_pos;
+}
+
+bool disk_allocator::extend_region(stxxl::int64 pos, stxxl::int64 bytes)
+{
+    scoped_mutex_lock lock(mutex);
+
+    sortseq::iterator space = free_space.find(pos);
+    stxxl::int64 avail = (space == free_space.end()) ? 0 : space->second;
+
+    if (avail < bytes && autogrow && pos + avail == disk_bytes)
+    {
+        grow_file(bytes - avail);
+        space = free_space.find(pos);
+        avail = space->second;
+    }
+
+    if (avail < bytes)
+        return false;
+
+    erase_free(space);
+    if (avail > bytes)
+        insert_free(pos + bytes, avail - bytes);
+    free_bytes -= bytes;
+
+    return true;
+}
+
+void disk_allocator::delete_regions(std::vector<place>& regions)
+{
+    std::sort(regions.begin(), regions.end());
+
+    scoped_mutex_lock lock(mutex);
+
+    STXXL_VERBOSE2("disk_allocator::delete_regions(" << regions.size() <<
+                   " regions), free:" << free_bytes << " total:" << disk_bytes);
+
+    for (size_t i = 0; i < regions.size(); )
+    {
+        stxxl::int64 region_pos = regions[i].first;
+        stxxl::int64 region_size = regions[i].second;
+
+        // merge runs of adjacent blocks, e.g. of a deleted vector
+        for (++i; i < regions.size() &&
+             regions[i].first == region_pos + region_size; ++i)
+            region_size += regions[i].second;
+
+        add_free_region(region_pos, region_size);
+    }
+}
+
 STXXL_END_NAMESPACE
 // vim: et:ts=4:sw=4
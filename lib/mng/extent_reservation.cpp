@@ -0,0 +1,94 @@
+/***************************************************************************
+ *  lib/mng/extent_reservation.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <stxxl/bits/common/types.h>
+#include <stxxl/bits/mng/disk_allocator.h>
+#include <stxxl/bits/mng/extent_reservation.h>
+#include <stxxl/bits/namespace.h>
+#include <stxxl/bits/verbose.h>
+
+#include <algorithm>
+
+STXXL_BEGIN_NAMESPACE
+
+stxxl::int64 extent_reservation::take(
+    size_t disk, disk_allocator* alloc, stxxl::int64 bytes)
+{
+    if (disk >= m_extents.size())
+        m_extents.resize(disk + 1);
+
+    extent& e = m_extents[disk];
+
+    if (e.end - e.pos < bytes)
+    {
+        // the first extent holds a few requests, later ones double in size
+        if (e.next == 0)
+            e.next = std::min<stxxl::int64>(4 * bytes, STXXL_EXTENT_MAX_SIZE);
+
+        stxxl::int64 want = std::max(bytes - (e.end - e.pos), e.next);
+
+        if (e.alloc != NULL && alloc->extend_region(e.end, want))
+        {
+            e.end += want;
+        }
+        else
+        {
+            if (e.alloc != NULL && e.end > e.pos)
+                e.alloc->delete_region(e.pos, e.end - e.pos);
+
+            want = std::max(bytes, e.next);
+            stxxl::int64 pos = alloc->new_region(want);
+            if (pos < 0 && want > bytes)
+                pos = alloc->new_region(want = bytes);
+
+            if (pos < 0) {
+                STXXL_VERBOSE1("extent_reservation: no contiguous region of " <<
+                               bytes << " bytes on disk " << disk);
+                e = extent();
+                return -1;
+            }
+
+            STXXL_VERBOSE2("extent_reservation: new extent on disk " << disk <<
+                           " at " << pos << " size " << want);
+
+            e.alloc = alloc;
+            e.pos = pos;
+            e.end = pos + want;
+        }
+
+        e.next = std::min<stxxl::int64>(2 * e.next, STXXL_EXTENT_MAX_SIZE);
+    }
+
+    stxxl::int64 pos = e.pos;
+    e.pos += bytes;
+    return pos;
+}
+
+stxxl::int64 extent_reservation::get_reserved_bytes() const
+{
+    stxxl::int64 bytes = 0;
+    for (size_t i = 0; i < m_extents.size(); ++i)
+        bytes += m_extents[i].end - m_extents[i].pos;
+    return bytes;
+}
+
+void extent_reservation::release()
+{
+    for (size_t i = 0; i < m_extents.size(); ++i)
+    {
+        extent& e = m_extents[i];
+        if (e.alloc != NULL && e.end > e.pos)
+            e.alloc->delete_region(e.pos, e.end - e.pos);
+    }
+    m_extents.clear();
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
@@ -0,0 +1,247 @@
+/***************************************************************************
+ *  lib/mng/memory_manager.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <utility>
+
+#include <stxxl/bits/common/aligned_alloc.h>
+#include <stxxl/bits/common/utils.h>
+#include <stxxl/bits/io/iostats.h>
+#include <stxxl/bits/io/request.h>
+#include <stxxl/bits/mng/memory_manager.h>
+#include <stxxl/bits/verbose.h>
+
+STXXL_BEGIN_NAMESPACE
+
+memory_consumer::memory_consumer(const std::string& name)
+    : m_name(name), m_bytes(0), m_registered(true)
+{
+    memory_manager::get_instance()->add_consumer(this);
+}
+
+memory_consumer::~memory_consumer() noexcept(false)
+{
+    unregister();
+    release_all();
+}
+
+void memory_consumer::unregister()
+{
+    if (!m_registered)
+        return;
+    memory_manager::get_instance()->remove_consumer(this);
+    m_registered = false;
+}
+
+uint64 memory_consumer::acquire(uint64 bytes, uint64 min_bytes)
+{
+    return memory_manager::get_instance()->acquire(this, bytes, min_bytes);
+}
+
+void memory_consumer::release(uint64 bytes)
+{
+    if (bytes)
+        memory_manager::get_instance()->release(this, bytes);
+}
+
+void* memory_consumer::allocate(size_t bytes)
+{
+    acquire(bytes);
+    try {
+        return aligned_alloc<STXXL_BLOCK_ALIGN>(bytes);
+    }
+    catch (...) {
+        release(bytes);
+        throw;
+    }
+}
+
+void memory_consumer::deallocate(void* ptr, size_t bytes)
+{
+    aligned_dealloc<STXXL_BLOCK_ALIGN>(ptr);
+    release(bytes);
+}
+
+void memory_consumer::swap_bytes(memory_consumer& other)
+{
+    uint64 mine = m_bytes, others = other.m_bytes;
+    release(mine);
+    other.release(others);
+    // the sum was granted before
+    memory_manager* mm = memory_manager::get_instance();
+    scoped_mutex_lock lock(mm->m_mutex);
+    mm->account(this, others);
+    mm->account(&other, mine);
+}
+
+memory_manager::memory_manager()
+    : m_limit(0), m_used(0), m_peak(0)
+{ }
+
+void memory_manager::add_consumer(memory_consumer* consumer)
+{
+    scoped_mutex_lock lock(m_mutex);
+    m_consumers.insert(consumer);
+    m_usage[consumer->m_name].name = consumer->m_name;
+}
+
+void memory_manager::remove_consumer(memory_consumer* consumer)
+{
+    scoped_mutex_lock shrink_lock(m_shrink_mutex);
+    scoped_mutex_lock lock(m_mutex);
+    m_consumers.erase(consumer);
+}
+
+void memory_manager::account(memory_consumer* consumer, uint64 bytes)
+{
+    consumer->m_bytes += bytes;
+    m_used += bytes;
+    m_peak = std::max(m_peak, m_used);
+
+    memory_usage& u = m_usage[consumer->m_name];
+    u.current += bytes;
+    u.maximum = std::max(u.maximum, u.current);
+    u.total += bytes;
+}
+
+uint64 memory_manager::acquire(memory_consumer* consumer, uint64 bytes, uint64 min_bytes)
+{
+    assert(min_bytes <= bytes);
+    {
+        scoped_mutex_lock lock(m_mutex);
+        if (m_limit == 0 || m_used + bytes <= m_limit) {
+            account(consumer, bytes);
+            return bytes;
+        }
+    }
+
+    // ask the consumers holding most memory to shrink, the lock keeps them
+    // from unregistering, which they do before their destruction starts
+    scoped_mutex_lock shrink_lock(m_shrink_mutex);
+
+    typedef std::pair<uint64, memory_consumer*> candidate_type;
+    std::vector<candidate_type> candidates;
+    {
+        scoped_mutex_lock lock(m_mutex);
+        for (std::set<memory_consumer*>::const_iterator it = m_consumers.begin();
+             it != m_consumers.end(); ++it)
+        {
+            if (*it != consumer && (*it)->m_bytes > 0)
+                candidates.push_back(candidate_type((*it)->m_bytes, *it));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<candidate_type>());
+
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        memory_consumer* c = candidates[i].second;
+        uint64 excess, before;
+        {
+            scoped_mutex_lock lock(m_mutex);
+            if (m_used + bytes <= m_limit)
+                break;
+            excess = m_used + bytes - m_limit;
+            before = c->m_bytes;
+        }
+
+        STXXL_VERBOSE1("memory_manager: asking " << c->m_name << " to release " << excess << " bytes");
+        c->shrink(excess);
+
+        scoped_mutex_lock lock(m_mutex);
+        if (c->m_bytes < before)
+            m_usage[c->m_name].shrunk += before - c->m_bytes;
+    }
+
+    scoped_mutex_lock lock(m_mutex);
+    uint64 available = (m_used < m_limit) ? m_limit - m_used : 0;
+    uint64 granted = std::max(min_bytes, std::min(bytes, available));
+    if (granted > available) {
+        STXXL_VERBOSE1("memory_manager: " << consumer->m_name << " exceeds the limit by " <<
+                       (granted - available) << " bytes");
+        ++m_usage[consumer->m_name].overcommitted;
+    }
+    account(consumer, granted);
+    return granted;
+}
+
+void memory_manager::release(memory_consumer* consumer, uint64 bytes)
+{
+    scoped_mutex_lock lock(m_mutex);
+    assert(bytes <= consumer->m_bytes);
+    consumer->m_bytes -= bytes;
+    m_used -= bytes;
+    m_usage[consumer->m_name].current -= bytes;
+}
+
+void memory_manager::set_limit(uint64 bytes)
+{
+    scoped_mutex_lock lock(m_mutex);
+    m_limit = bytes;
+}
+
+uint64 memory_manager::get_limit()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_limit;
+}
+
+uint64 memory_manager::get_used()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_used;
+}
+
+uint64 memory_manager::get_peak()
+{
+    scoped_mutex_lock lock(m_mutex);
+    return m_peak;
+}
+
+std::vector<memory_usage> memory_manager::get_usage()
+{
+    scoped_mutex_lock lock(m_mutex);
+    std::vector<memory_usage> usage;
+    for (usage_map_type::const_iterator it = m_usage.begin(); it != m_usage.end(); ++it)
+        usage.push_back(it->second);
+    return usage;
+}
+
+void memory_manager::print(std::ostream& o)
+{
+#define hr add_IEC_binary_multiplier
+    std::vector<memory_usage> usage = get_usage();
+    uint64 limit = get_limit();
+
+    o << "STXXL internal memory" << std::endl;
+    o << " current / maximum usage                    : "
+      << hr(get_used(), "B") << "/ " << hr(get_peak(), "B") << std::endl;
+    if (limit)
+        o << " limit                                      : " << hr(limit, "B") << std::endl;
+    for (size_t i = 0; i < usage.size(); ++i)
+    {
+        const memory_usage& u = usage[i];
+        if (u.total == 0)
+            continue;
+
+        o << " consumer " << u.name << std::endl;
+        o << "  current / maximum / total acquired        : "
+          << hr(u.current, "B") << "/ " << hr(u.maximum, "B") << "/ "
+          << hr(u.total, "B") << std::endl;
+        if (u.shrunk || u.overcommitted)
+            o << "  released on request (over limit)          : "
+              << hr(u.shrunk, "B") << "(" << u.overcommitted << ")" << std::endl;
+    }
+#undef hr
+}
+
+STXXL_END_NAMESPACE
+// vim: et:ts=4:sw=4
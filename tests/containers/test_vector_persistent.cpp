@@ -0,0 +1,167 @@
+/***************************************************************************
+ *  tests/containers/test_vector_persistent.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example containers/test_vector_persistent.cpp
+//! This tests that a vector attached to a file with open() is restored with
+//! the size of its last sync(), also if the newest superblock is torn, and
+//! that files of other element types are refused.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <stxxl/io>
+#include <stxxl/vector>
+#include <stxxl/aligned_alloc>
+
+typedef stxxl::uint64 my_type;
+typedef stxxl::VECTOR_GENERATOR<my_type, 2, 2, 64* 1024>::result vector_type;
+
+static const stxxl::uint64 num_elements = 100000;
+
+void check(vector_type& v, stxxl::uint64 size)
+{
+    STXXL_CHECK(v.size() == size);
+    for (stxxl::uint64 i = 0; i < size; ++i)
+        STXXL_CHECK(v[i] == i * 3);
+}
+
+//! overwrite the superblock copy with the highest sequence number, as if
+//! writing it was interrupted
+void tear_newest_superblock(const std::string& path)
+{
+    const size_t slot_size = stxxl::vector_superblock::slot_size;
+
+    stxxl::syscall_file f(path, stxxl::file::RDWR | stxxl::file::DIRECT);
+    char* buffer = (char*)stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(2 * slot_size);
+    f.aread(buffer, 0, 2 * slot_size)->wait();
+
+    stxxl::vector_superblock sb[2];
+    std::memcpy(&sb[0], buffer, sizeof(sb[0]));
+    std::memcpy(&sb[1], buffer + slot_size, sizeof(sb[1]));
+    STXXL_CHECK(sb[0].valid() && sb[1].valid());
+    size_t newest = (sb[1].sequence > sb[0].sequence) ? 1 : 0;
+
+    buffer[newest * slot_size + 20] ^= 0x55;
+    f.awrite(buffer + newest * slot_size, newest * slot_size, slot_size)->wait();
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        STXXL_MSG("Usage: " << argv[0] << " tempdir");
+        return -1;
+    }
+
+    const std::string path = std::string(argv[1]) + "/persistent_vector";
+    std::remove(path.c_str());
+
+    // create and fill a new persistent vector
+    {
+        vector_type v;
+        v.open(path);
+        STXXL_CHECK(v.size() == 0);
+        for (stxxl::uint64 i = 0; i < num_elements; ++i)
+            v.push_back(i * 3);
+    }
+    {
+        vector_type v;
+        v.open(path);
+        check(v, num_elements);
+
+        // grow, commit, and grow again without committing
+        for (stxxl::uint64 i = num_elements; i < 2 * num_elements; ++i)
+            v.push_back(i * 3);
+        v.sync();
+        v.resize(num_elements / 2, true);
+        v.sync();
+        check(v, num_elements / 2);
+    }
+
+    // the file is cut to the committed blocks
+    {
+        stxxl::syscall_file f(path, stxxl::file::RDONLY);
+        STXXL_CHECK(f.size() ==
+                    (stxxl::file::offset_type)(stxxl::vector_superblock::area_size +
+                                               stxxl::div_ceil(num_elements / 2, vector_type::block_type::size) *
+                                               vector_type::block_type::raw_size));
+    }
+
+    // a torn superblock falls back to the previous sync()
+    {
+        vector_type v;
+        v.open(path);
+        check(v, num_elements / 2);
+        v.resize(num_elements);
+        for (stxxl::uint64 i = 0; i < num_elements; ++i)
+            v[i] = i * 3;
+    }
+    tear_newest_superblock(path);
+    {
+        vector_type v;
+        v.open(path);
+        check(v, num_elements / 2);
+    }
+
+    // other element types and non-empty vectors are refused
+    {
+        typedef stxxl::VECTOR_GENERATOR<double, 2, 2, 64* 1024>::result other_type;
+        other_type v;
+        bool thrown = false;
+        try {
+            v.open(path);
+        }
+        catch (stxxl::io_error& e) {
+            STXXL_MSG("expected: " << e.what());
+            thrown = true;
+        }
+        STXXL_CHECK(thrown);
+        STXXL_CHECK(v.size() == 0 && v.get_file() == NULL);
+    }
+    {
+        vector_type v(10);
+        bool thrown = false;
+        try {
+            v.open(path);
+        }
+        catch (std::invalid_argument&) {
+            thrown = true;
+        }
+        STXXL_CHECK(thrown);
+    }
+
+    // files without a superblock are refused
+    const std::string plain = path + "_plain";
+    {
+        stxxl::syscall_file f(plain, stxxl::file::RDWR | stxxl::file::CREAT);
+        vector_type v(&f);
+        v.resize(1000);
+    }
+    {
+        vector_type v;
+        bool thrown = false;
+        try {
+            v.open(plain);
+        }
+        catch (stxxl::io_error&) {
+            thrown = true;
+        }
+        STXXL_CHECK(thrown);
+    }
+
+    std::remove(path.c_str());
+    std::remove(plain.c_str());
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
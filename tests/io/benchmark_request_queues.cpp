@@ -0,0 +1,178 @@
+/***************************************************************************
+ *  tests/io/benchmark_request_queues.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/benchmark_request_queues.cpp
+//! Microbenchmark of the request queue implementations. Many threads submit
+//! small requests to a memory file, such that the running time is dominated
+//! by submitting the requests and handing them over to the queue's worker.
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/bits/common/cmdline.h>
+#include <stxxl/bits/common/timer.h>
+#include <stxxl/bits/parallel.h>
+
+using stxxl::request_ptr;
+using stxxl::unsigned_type;
+
+stxxl::request_queue * create_queue(const std::string& impl)
+{
+    if (impl == "qwqr")
+        return new stxxl::request_queue_impl_qwqr();
+    if (impl == "1q")
+        return new stxxl::request_queue_impl_1q();
+    if (impl == "elevator")
+        return new stxxl::request_queue_impl_elevator();
+#if STXXL_HAVE_FUTEX
+    if (impl == "mpsc")
+        return new stxxl::request_queue_impl_mpsc();
+#endif
+    return NULL;
+}
+
+//! each thread writes and reads back window requests of size bytes, rounds
+//! times, to its own region of the file.
+void run_thread(stxxl::request_queue* queue, stxxl::file* file,
+                unsigned_type thread, unsigned int rounds,
+                unsigned int window, unsigned int size, bool batch)
+{
+    std::vector<char> wbuf(window * size, (char)thread), rbuf(window * size);
+    std::vector<request_ptr> reqs(window);
+
+    for (unsigned int r = 0; r < rounds; ++r)
+    {
+        for (int type = 0; type < 2; ++type)
+        {
+            for (unsigned int i = 0; i < window; ++i)
+            {
+                stxxl::file::offset_type offset = (thread * window + i) * size;
+                if (type == 0)
+                    reqs[i] = new stxxl::serving_request(
+                        stxxl::completion_handler(), file, &wbuf[i * size],
+                        offset, size, stxxl::request::WRITE);
+                else
+                    reqs[i] = new stxxl::serving_request(
+                        stxxl::completion_handler(), file, &rbuf[i * size],
+                        offset, size, stxxl::request::READ);
+
+                if (!batch)
+                    queue->add_request(reqs[i]);
+            }
+
+            if (batch)
+                queue->add_requests(&reqs[0], &reqs[0] + window);
+
+            stxxl::wait_all(&reqs[0], window);
+        }
+    }
+
+    STXXL_CHECK(memcmp(&wbuf[0], &rbuf[0], window * size) == 0);
+}
+
+void run_benchmark(const std::string& impl, unsigned int num_threads,
+                   unsigned int rounds, unsigned int window,
+                   unsigned int size, bool batch)
+{
+    stxxl::request_queue* queue = create_queue(impl);
+    if (!queue) {
+        STXXL_ERRMSG("Request queue '" << impl << "' is not available "
+                     "in this compilation.");
+        return;
+    }
+
+    stxxl::mem_file file;
+    file.set_size(num_threads * window * size);
+
+    stxxl::timer timer(true);
+
+#if STXXL_PARALLEL
+#pragma omp parallel num_threads(num_threads)
+    run_thread(queue, &file, omp_get_thread_num(),
+               rounds, window, size, batch);
+#else
+    STXXL_CHECK(num_threads == 1);
+    run_thread(queue, &file, 0, rounds, window, size, batch);
+#endif
+
+    timer.stop();
+    delete queue;
+
+    double total = 2.0 * num_threads * rounds * window;
+
+    std::cout << "RESULT"
+              << " queue=" << impl
+              << " num_threads=" << num_threads
+              << " batch=" << batch
+              << " window=" << window
+              << " size=" << size
+              << " requests=" << total
+              << " time=" << timer.seconds()
+              << " time/request[ns]=" << timer.seconds() / total * 1e9
+              << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> queues;
+    unsigned int max_threads = 1;
+    unsigned int rounds = 1000, window = 16, size = 4096;
+    bool batch = false;
+
+#if STXXL_PARALLEL
+    max_threads = omp_get_max_threads();
+#endif
+
+    stxxl::cmdline_parser cp;
+    cp.set_description("Measure the overhead of the request queue "
+                       "implementations with many submitting threads.");
+
+    cp.add_stringlist('q', "queue", "impl", queues,
+                      "request queues to benchmark: qwqr, 1q, elevator or mpsc, "
+                      "default: all");
+    cp.add_uint('t', "threads", max_threads,
+                "maximum number of submitting threads, doubled starting at 1");
+    cp.add_uint('r', "rounds", rounds,
+                "number of write/read rounds per thread, default: 1000");
+    cp.add_uint('w', "window", window,
+                "number of requests in flight per thread, default: 16");
+    cp.add_uint('s', "size", size,
+                "size of each request in bytes, default: 4096");
+    cp.add_flag('b', "batch", batch,
+                "submit each window with one add_requests() call");
+
+    if (!cp.process(argc, argv))
+        return EXIT_FAILURE;
+
+    if (queues.empty()) {
+        queues.push_back("qwqr");
+        queues.push_back("1q");
+        queues.push_back("elevator");
+#if STXXL_HAVE_FUTEX
+        queues.push_back("mpsc");
+#endif
+    }
+
+#if !STXXL_PARALLEL
+    max_threads = 1;
+#endif
+
+    for (unsigned int t = 1; t <= max_threads; t *= 2)
+    {
+        for (size_t q = 0; q < queues.size(); ++q)
+            run_benchmark(queues[q], t, rounds, window, size, batch);
+    }
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -0,0 +1,198 @@
+/***************************************************************************
+ *  tests/io/test_block_checksums.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/test_block_checksums.cpp
+//! This tests the CRC-32C implementation and that a file with checksums
+//! enabled fails reads and map_read() of blocks which were changed behind
+//! its back.
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <stxxl/bits/common/crc32c.h>
+
+static const size_t block_size = 64 * 1024;
+
+void test_crc32c()
+{
+    // check value of the CRC-32C catalogue
+    STXXL_CHECK(stxxl::crc32c("123456789", 9) == 0xE3069283);
+    STXXL_CHECK(stxxl::crc32c("", 0) == 0);
+
+    // pieces of any size and alignment combine to the checksum of the whole
+    unsigned char data[256];
+    for (size_t i = 0; i < sizeof(data); ++i)
+        data[i] = (unsigned char)(i * 37 + 11);
+
+    for (size_t start = 0; start < 16; ++start)
+    {
+        const stxxl::uint32 whole = stxxl::crc32c(data + start, 200);
+        for (size_t split = 0; split <= 200; split += 7)
+        {
+            stxxl::uint32 crc = stxxl::crc32c(data + start, split);
+            crc = stxxl::crc32c(data + start + split, 200 - split, crc);
+            STXXL_CHECK(crc == whole);
+        }
+    }
+
+    // buffers long enough for the interleaved hardware path agree with a
+    // bitwise computation
+    const size_t large = 100000;
+    unsigned char* buffer = new unsigned char[large + 8];
+    for (size_t i = 0; i < large + 8; ++i)
+        buffer[i] = (unsigned char)(i * 131 + (i >> 8));
+
+    for (size_t start = 0; start < 8; start += 3)
+    {
+        stxxl::uint32 crc = ~0u;
+        for (size_t i = 0; i < large; ++i)
+        {
+            crc ^= buffer[start + i];
+            for (int k = 0; k < 8; ++k)
+                crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : (crc >> 1);
+        }
+        STXXL_CHECK(stxxl::crc32c(buffer + start, large) == ~crc);
+    }
+    delete[] buffer;
+}
+
+void test_file(const std::string& path)
+{
+    const int mode = stxxl::file::CREAT | stxxl::file::RDWR;
+
+    stxxl::syscall_file file(path, mode);
+    file.enable_checksums();
+    stxxl::block_checksums* checksums = file.get_checksums();
+    STXXL_CHECK(checksums != NULL);
+
+    char* buffer = (char*)stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(block_size);
+    for (size_t i = 0; i < block_size; ++i)
+        buffer[i] = (char)(i % 251);
+
+    file.awrite(buffer, 0, block_size)->wait();
+    file.awrite(buffer, block_size, block_size)->wait();
+
+    std::memset(buffer, 0, block_size);
+    file.aread(buffer, block_size, block_size)->wait();
+    STXXL_CHECK(buffer[1000] == (char)(1000 % 251));
+    STXXL_CHECK(checksums->get_verified() == 1);
+
+    // change the second block through another file object
+    {
+        stxxl::syscall_file other(path, stxxl::file::RDWR);
+        char byte = 42;
+        other.awrite(&byte, block_size + 1000, 1)->wait();
+    }
+
+    bool thrown = false;
+    try {
+        file.aread(buffer, block_size, block_size)->wait();
+    }
+    catch (stxxl::io_error& e) {
+        std::cout << "expected: " << e.what() << std::endl;
+        thrown = true;
+    }
+    STXXL_CHECK(thrown);
+    STXXL_CHECK(checksums->get_mismatches() == 1);
+
+    // the first block is intact, parts of blocks are not verified
+    file.aread(buffer, 0, block_size)->wait();
+    file.aread(buffer, block_size, block_size / 2)->wait();
+    STXXL_CHECK(checksums->get_verified() == 3);
+
+    // rewriting the block and freeing it replace its checksum
+    file.awrite(buffer, block_size, block_size)->wait();
+    file.aread(buffer, block_size, block_size)->wait();
+    STXXL_CHECK(checksums->get_mismatches() == 1);
+
+    checksums->forget(block_size, block_size);
+    {
+        stxxl::syscall_file other(path, stxxl::file::RDWR);
+        char byte = 43;
+        other.awrite(&byte, block_size + 1000, 1)->wait();
+    }
+    file.aread(buffer, block_size, block_size)->wait();
+    STXXL_CHECK(checksums->get_mismatches() == 1);
+
+    // a write spanning both blocks replaces both checksums
+    file.awrite(buffer, block_size / 2, block_size)->wait();
+    file.aread(buffer, 0, block_size)->wait();
+    file.aread(buffer, block_size / 2, block_size)->wait();
+    STXXL_CHECK(checksums->get_verified() == 5);
+    STXXL_CHECK(checksums->get_mismatches() == 1);
+
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+    file.close_remove();
+}
+
+#if STXXL_HAVE_MMAP_FILE
+void test_map_read(const std::string& path)
+{
+    const int mode = stxxl::file::CREAT | stxxl::file::RDWR;
+
+    stxxl::mmap_file file(path, mode);
+    file.enable_checksums();
+    stxxl::block_checksums* checksums = file.get_checksums();
+
+    char* buffer = (char*)stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(block_size);
+    for (size_t i = 0; i < block_size; ++i)
+        buffer[i] = (char)(i % 251);
+    file.awrite(buffer, 0, block_size)->wait();
+
+    // borrowed blocks are verified as well
+    const void* ptr = file.map_read(0, block_size);
+    STXXL_CHECK(ptr != NULL);
+    STXXL_CHECK(std::memcmp(ptr, buffer, block_size) == 0);
+    file.unmap_read(ptr, 0, block_size);
+    STXXL_CHECK(checksums->get_verified() == 1);
+
+    {
+        stxxl::syscall_file other(path, stxxl::file::RDWR);
+        char byte = 42;
+        other.awrite(&byte, 1000, 1)->wait();
+    }
+
+    bool thrown = false;
+    try {
+        file.map_read(0, block_size);
+    }
+    catch (stxxl::io_error& e) {
+        std::cout << "expected: " << e.what() << std::endl;
+        thrown = true;
+    }
+    STXXL_CHECK(thrown);
+    STXXL_CHECK(checksums->get_mismatches() == 1);
+
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+    file.close_remove();
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        STXXL_MSG("Usage: " << argv[0] << " tempfile");
+        return -1;
+    }
+
+    test_crc32c();
+    test_file(argv[1]);
+#if STXXL_HAVE_MMAP_FILE
+    test_map_read(argv[1]);
+#endif
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
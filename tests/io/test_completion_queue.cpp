@@ -0,0 +1,141 @@
+/***************************************************************************
+ *  tests/io/test_completion_queue.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/test_completion_queue.cpp
+//! This tests that a completion_queue returns each watched request once
+//! after it completed, that its file descriptor is readable exactly while
+//! completed requests are queued, and wait_any()/wait_all() built on it.
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/request>
+#include <stxxl/aligned_alloc>
+
+#if STXXL_HAVE_EVENTFD
+ #include <poll.h>
+#endif
+
+static const size_t block_size = 64 * 1024;
+static const size_t num_blocks = 64;
+
+bool fd_readable(stxxl::completion_queue& queue)
+{
+#if STXXL_HAVE_EVENTFD
+    struct pollfd pfd;
+    pfd.fd = queue.get_fd();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return ::poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+#else
+    STXXL_UNUSED(queue);
+    return false;
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        STXXL_MSG("Usage: " << argv[0] << " tempdir");
+        return -1;
+    }
+
+    stxxl::syscall_file file(std::string(argv[1]) + "/completion_queue",
+                             stxxl::file::CREAT | stxxl::file::RDWR | stxxl::file::DIRECT);
+    char* buffer = (char*)stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(num_blocks * block_size);
+    for (size_t i = 0; i < num_blocks * block_size; ++i)
+        buffer[i] = (char)i;
+
+    std::vector<stxxl::request_ptr> reqs(num_blocks);
+
+    // an empty queue does not block
+    {
+        stxxl::completion_queue queue;
+        STXXL_CHECK(!queue.poll());
+        STXXL_CHECK(!queue.wait());
+        STXXL_CHECK(!fd_readable(queue));
+    }
+
+    // each request is returned exactly once
+    {
+        stxxl::completion_queue queue;
+        for (size_t i = 0; i < num_blocks; ++i)
+        {
+            reqs[i] = file.awrite(buffer + i * block_size, i * block_size, block_size);
+            queue.watch(reqs[i]);
+        }
+
+        std::set<stxxl::request*> seen;
+        while (stxxl::request_ptr req = queue.wait())
+        {
+            STXXL_CHECK(req->poll());
+            STXXL_CHECK(seen.insert(req.get()).second);
+        }
+        STXXL_CHECK(seen.size() == num_blocks);
+        STXXL_CHECK(queue.num_pending() == 0 && queue.num_completed() == 0);
+        stxxl::wait_all(reqs.begin(), reqs.end());
+    }
+
+    // completed requests are queued immediately and signal the descriptor,
+    // even if it is only created afterwards
+    {
+        stxxl::completion_queue queue;
+        stxxl::request_ptr req = file.aread(buffer, 0, block_size);
+        req->wait();
+        queue.watch(req);
+        STXXL_CHECK(queue.num_completed() == 1);
+        STXXL_CHECK(!queue.unwatch(req));
+#if STXXL_HAVE_EVENTFD
+        STXXL_CHECK(queue.get_fd() >= 0);
+        STXXL_CHECK(fd_readable(queue));
+#endif
+        STXXL_CHECK(queue.poll() == req);
+        STXXL_CHECK(!fd_readable(queue));
+        STXXL_CHECK(!queue.poll());
+    }
+
+    // unwatched requests are not returned
+    {
+        stxxl::completion_queue queue;
+        stxxl::request_ptr req = file.aread(buffer, 0, block_size);
+        queue.watch(req);
+        if (queue.unwatch(req))
+            STXXL_CHECK(!queue.wait());
+        req->wait();
+    }
+
+    // wait_any() and wait_all()
+    for (size_t i = 0; i < num_blocks; ++i)
+        reqs[i] = file.aread(buffer + i * block_size, i * block_size, block_size);
+
+    std::vector<stxxl::request_ptr> pending = reqs;
+    while (!pending.empty())
+    {
+        size_t index = stxxl::wait_any(&pending[0], pending.size());
+        STXXL_CHECK(index < pending.size() && pending[index]->poll());
+        pending.erase(pending.begin() + index);
+    }
+    stxxl::wait_all(reqs.begin(), reqs.end());
+    for (size_t i = 0; i < num_blocks * block_size; ++i)
+        STXXL_CHECK(buffer[i] == (char)i);
+
+    stxxl::wait_all(reqs.begin(), reqs.begin());
+    STXXL_CHECK(stxxl::wait_any(reqs.begin(), reqs.begin()) == reqs.begin());
+
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+    file.close_remove();
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
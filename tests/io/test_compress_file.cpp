@@ -0,0 +1,141 @@
+/***************************************************************************
+ *  tests/io/test_compress_file.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/test_compress_file.cpp
+//! This tests the block compression codec and the compress_file wrapper with
+//! compressible and incompressible blocks, overwrites, partial reads and
+//! discards.
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <stxxl/random>
+#include <stxxl/bits/common/lz_codec.h>
+
+using stxxl::file;
+
+void test_codec()
+{
+    stxxl::random_number32 rnd;
+
+    for (size_t size = 0; size < 70000; size = size * 3 + 1)
+    {
+        std::vector<char> in(size), out(size + size / 255 + 16), back(size);
+
+        for (int pattern = 0; pattern < 3; ++pattern)
+        {
+            for (size_t i = 0; i < size; ++i)
+                in[i] = (pattern == 0) ? (char)0 :
+                        (pattern == 1) ? (char)(i % 7 + i / 1000) :
+                        (char)(rnd() >> 24);
+
+            size_t n = stxxl::lz_compress(in.data(), size, out.data(), out.size());
+            STXXL_CHECK(n != 0);
+            STXXL_CHECK(stxxl::lz_decompress(out.data(), n, back.data(), size));
+            STXXL_CHECK(memcmp(in.data(), back.data(), size) == 0);
+
+            // too small output buffers are detected
+            if (pattern == 2 && size > 16)
+                STXXL_CHECK(stxxl::lz_compress(in.data(), size, out.data(), size / 2) == 0);
+            if (size > 0)
+                STXXL_CHECK(!stxxl::lz_decompress(out.data(), n, back.data(), size - 1));
+        }
+    }
+}
+
+void test_file(const char* path)
+{
+    const size_t block_size = 256 * 1024, num_blocks = 16;
+
+    stxxl::compress_file<stxxl::syscall_file> file(
+        path, file::CREAT | file::RDWR | file::DIRECT);
+    file.set_size(num_blocks * block_size);
+
+    char* wbuf = (char*)stxxl::aligned_alloc<4096>(block_size);
+    char* rbuf = (char*)stxxl::aligned_alloc<4096>(block_size);
+    stxxl::random_number32 rnd;
+
+    // even blocks compress well, odd ones are random
+    stxxl::stats_data stats1(*stxxl::stats::get_instance());
+    for (size_t b = 0; b < num_blocks; ++b)
+    {
+        for (size_t i = 0; i < block_size; ++i)
+            wbuf[i] = (b % 2 == 0) ? (char)(i % 64 + b) : (char)(rnd() >> 24);
+        file.awrite(wbuf, b * block_size, block_size)->wait();
+    }
+    stxxl::stats_data stats2 = stxxl::stats_data(*stxxl::stats::get_instance()) - stats1;
+    std::cout << "Compression ratio " << stats2.get_compression_ratio() << std::endl;
+    STXXL_CHECK(stats2.get_compressed_input_volume() == (stxxl::int64)(num_blocks * block_size));
+    STXXL_CHECK(stats2.get_compression_ratio() > 1.5);
+
+    for (size_t b = 0; b < num_blocks; b += 2)
+    {
+        file.aread(rbuf, b * block_size, block_size)->wait();
+        for (size_t i = 0; i < block_size; ++i)
+            STXXL_CHECK(rbuf[i] == (char)(i % 64 + b));
+    }
+
+    // partial read of a compressed block
+    file.aread(rbuf, 2 * block_size + 4096, 8192)->wait();
+    for (size_t i = 0; i < 8192; ++i)
+        STXXL_CHECK(rbuf[i] == (char)((i + 4096) % 64 + 2));
+
+    // overwriting and discarding reuses the space in the base file, after
+    // the first round, which needs room for the out-of-place writes
+    stxxl::syscall_file base(path, file::RDONLY | file::NO_LOCK);
+    file::offset_type used = 0;
+    for (size_t round = 0; round < 4; ++round)
+    {
+        for (size_t b = 0; b < num_blocks; b += 2)
+        {
+            memset(wbuf, (int)(round + b), block_size);
+            file.awrite(wbuf, b * block_size, block_size)->wait();
+        }
+        for (size_t b = 1; b < num_blocks; b += 2)
+            file.discard(b * block_size, block_size);
+
+        if (round == 0)
+            used = base.size();
+        STXXL_CHECK(base.size() <= used);
+    }
+
+    for (size_t b = 0; b < num_blocks; ++b)
+    {
+        file.aread(rbuf, b * block_size, block_size)->wait();
+        // discarded blocks read as zeros
+        char expected = (b % 2 == 0) ? (char)(3 + b) : (char)0;
+        for (size_t i = 0; i < block_size; ++i)
+            STXXL_CHECK(rbuf[i] == expected);
+    }
+
+    stxxl::aligned_dealloc<4096>(rbuf);
+    stxxl::aligned_dealloc<4096>(wbuf);
+
+    file.close_remove();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " tempfile" << std::endl;
+        return -1;
+    }
+
+    test_codec();
+    test_file(argv[1]);
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *  tests/io/test_disk_stats.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/test_disk_stats.cpp
+//! This tests that stats accounts the I/Os of files to their device ids and
+//! that block_manager reports the bytes allocated per disk.
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/mng>
+#include <stxxl/aligned_alloc>
+
+void test_disks(const char* path)
+{
+    const size_t block_size = 64 * 1024;
+    const unsigned disk[2] = { 2, 5 };
+    const size_t num_blocks[2] = { 8, 24 };
+
+    stxxl::syscall_file file0(std::string(path) + ".0", stxxl::file::CREAT | stxxl::file::RDWR,
+                              stxxl::file::DEFAULT_QUEUE, stxxl::file::NO_ALLOCATOR, disk[0]);
+    stxxl::syscall_file file1(std::string(path) + ".1", stxxl::file::CREAT | stxxl::file::RDWR,
+                              stxxl::file::DEFAULT_QUEUE, stxxl::file::NO_ALLOCATOR, disk[1]);
+    stxxl::file* files[2] = { &file0, &file1 };
+
+    char* buffer = (char*)stxxl::aligned_alloc<4096>(block_size);
+    memset(buffer, 0, block_size);
+
+    stxxl::stats_data stats1(*stxxl::stats::get_instance());
+
+    std::vector<stxxl::request_ptr> reqs;
+    for (unsigned f = 0; f < 2; ++f)
+        for (size_t i = 0; i < num_blocks[f]; ++i)
+            reqs.push_back(files[f]->awrite(buffer, i * block_size, block_size));
+    stxxl::wait_all(reqs.begin(), reqs.end());
+    reqs.clear();
+
+    for (unsigned f = 0; f < 2; ++f)
+        for (size_t i = 0; i < num_blocks[f]; i += 2)
+            reqs.push_back(files[f]->aread(buffer, i * block_size, block_size));
+    stxxl::wait_all(reqs.begin(), reqs.end());
+
+    stxxl::stats_data stats2 = stxxl::stats_data(*stxxl::stats::get_instance()) - stats1;
+    std::cout << stats2;
+
+    STXXL_CHECK(stats2.get_disks() == disk[1] + 1);
+    stxxl::int64 written = 0, read = 0;
+    for (unsigned f = 0; f < 2; ++f)
+    {
+        const stxxl::disk_stats& ds = stats2.get_disk(disk[f]);
+        STXXL_CHECK(ds.volume_written == (stxxl::int64)(num_blocks[f] * block_size));
+        STXXL_CHECK(ds.volume_read == (stxxl::int64)(num_blocks[f] / 2 * block_size));
+        STXXL_CHECK(ds.queue_depth == 0);
+        STXXL_CHECK(ds.p_ios > 0.0 && ds.p_ios <= stats2.get_elapsed_time());
+        STXXL_CHECK(ds.t_queue > 0.0);
+        STXXL_CHECK(ds.latency.write_service.count() == num_blocks[f]);
+        written += ds.volume_written;
+        read += ds.volume_read;
+    }
+    STXXL_CHECK(stats2.get_disk(0).reads + stats2.get_disk(0).writes == 0);
+    STXXL_CHECK(stats2.get_written_volume() == written);
+    STXXL_CHECK(stats2.get_read_volume() == read);
+
+    stxxl::aligned_dealloc<4096>(buffer);
+    file0.close_remove();
+    file1.close_remove();
+}
+
+void test_block_manager()
+{
+    typedef stxxl::BID<1024* 1024> bid_type;
+    const size_t num_blocks = 16;
+
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+
+    std::vector<stxxl::uint64> allocated(bm->get_ndisks());
+    for (size_t i = 0; i < bm->get_ndisks(); ++i)
+    {
+        allocated[i] = bm->get_disk_allocated_bytes(i);
+        STXXL_CHECK(bm->get_disk_free_bytes(i) + allocated[i] ==
+                    bm->get_disk_total_bytes(i));
+    }
+
+    std::vector<bid_type> bids(num_blocks);
+    bm->new_blocks(stxxl::striping(), bids.begin(), bids.end());
+
+    stxxl::uint64 total = 0;
+    for (size_t i = 0; i < bm->get_ndisks(); ++i)
+    {
+        std::cout << "disk " << i << " (device id "
+                  << bm->get_disk_file(i)->get_device_id() << "): "
+                  << bm->get_disk_allocated_bytes(i) << " bytes allocated"
+                  << std::endl;
+        total += bm->get_disk_allocated_bytes(i) - allocated[i];
+    }
+    STXXL_CHECK(total == num_blocks * bid_type::size);
+
+    bm->delete_blocks(bids.begin(), bids.end());
+
+    for (size_t i = 0; i < bm->get_ndisks(); ++i)
+        STXXL_CHECK(bm->get_disk_allocated_bytes(i) == allocated[i]);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " tempfile" << std::endl;
+        return -1;
+    }
+
+    test_disks(argv[1]);
+    test_block_manager();
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
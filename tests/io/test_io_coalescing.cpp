@@ -0,0 +1,94 @@
+/***************************************************************************
+ *  tests/io/test_io_coalescing.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/test_io_coalescing.cpp
+//! This tests that requests for adjacent bytes, which the request queues serve
+//! with one scatter/gather operation, each transfer their own buffer.
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+
+using stxxl::file;
+using stxxl::request_ptr;
+
+void test_queue(const std::string& impl, int queue_id, const char* path)
+{
+    std::cout << "Testing request queue " << impl << std::endl;
+    stxxl::disk_queues::get_instance()->set_queue_impl(queue_id, impl);
+
+    stxxl::syscall_file file(path, file::CREAT | file::RDWR, queue_id);
+
+    // adjacent requests of varying sizes
+    const size_t num_reqs = 100;
+    std::vector<file::offset_type> offset(num_reqs + 1, 0);
+    for (size_t i = 0; i < num_reqs; ++i)
+        offset[i + 1] = offset[i] + 4096 * (i % 4 + 1);
+
+    const size_t total = (size_t)offset[num_reqs];
+    file.set_size(total);
+
+    char* wbuf = (char*)stxxl::aligned_alloc<4096>(total);
+    char* rbuf = (char*)stxxl::aligned_alloc<4096>(total);
+    std::vector<request_ptr> reqs(num_reqs);
+
+    for (size_t i = 0; i < num_reqs; ++i)
+        memset(wbuf + offset[i], (char)(i + 1), (size_t)(offset[i + 1] - offset[i]));
+    memset(rbuf, 0, total);
+
+    stxxl::stats_data stats1(*stxxl::stats::get_instance());
+
+    for (size_t i = 0; i < num_reqs; ++i)
+        reqs[i] = file.awrite(wbuf + offset[i], offset[i],
+                              (size_t)(offset[i + 1] - offset[i]));
+    stxxl::wait_all(reqs.begin(), reqs.end());
+
+    for (size_t i = 0; i < num_reqs; ++i)
+        reqs[i] = file.aread(rbuf + offset[i], offset[i],
+                             (size_t)(offset[i + 1] - offset[i]));
+    stxxl::wait_all(reqs.begin(), reqs.end());
+
+    STXXL_CHECK(memcmp(wbuf, rbuf, total) == 0);
+
+    // the number of I/O operations depends on the timing of the worker
+    stxxl::stats_data stats2 = stxxl::stats_data(*stxxl::stats::get_instance()) - stats1;
+    std::cout << "Served " << 2 * num_reqs << " requests with "
+              << stats2.get_writes() << " write and "
+              << stats2.get_reads() << " read operations" << std::endl;
+
+    stxxl::aligned_dealloc<4096>(rbuf);
+    stxxl::aligned_dealloc<4096>(wbuf);
+
+    file.close_remove();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " tempfile" << std::endl;
+        return -1;
+    }
+
+    // use queues not shared with other files
+    test_queue("qwqr", 100, argv[1]);
+    test_queue("1q", 101, argv[1]);
+    test_queue("elevator", 102, argv[1]);
+#if STXXL_HAVE_FUTEX
+    test_queue("mpsc", 103, argv[1]);
+#endif
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
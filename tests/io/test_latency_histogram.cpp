@@ -0,0 +1,125 @@
+/***************************************************************************
+ *  tests/io/test_latency_histogram.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/test_latency_histogram.cpp
+//! This tests the bucketing and percentiles of latency_histogram and that
+//! requests served by a disk queue, linuxaio and io_uring are recorded in the
+//! I/O statistics.
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+
+using stxxl::latency_histogram;
+
+void test_buckets()
+{
+    // buckets are contiguous and their bounds are within the precision
+    stxxl::uint64 prev_upper = 0;
+    for (unsigned b = 1; b < latency_histogram::num_buckets; ++b)
+    {
+        stxxl::uint64 upper = latency_histogram::bucket_upper(b);
+        STXXL_CHECK(latency_histogram::bucket(prev_upper + 1) == b);
+        STXXL_CHECK(latency_histogram::bucket(upper) == b);
+        STXXL_CHECK(upper - prev_upper <= upper / latency_histogram::sub_count + 1);
+        prev_upper = upper;
+    }
+    STXXL_CHECK(latency_histogram::bucket(prev_upper * 4) == latency_histogram::num_buckets - 1);
+
+    latency_histogram h;
+    STXXL_CHECK(h.percentile(0.5) == 0.0);
+
+    // 1 ms .. 1000 ms
+    for (unsigned i = 1; i <= 1000; ++i)
+        h.add(i * 1e-3);
+
+    STXXL_CHECK(h.count() == 1000);
+    STXXL_CHECK(std::fabs(h.percentile(0.5) - 0.5) <= 0.5 / latency_histogram::sub_count);
+    STXXL_CHECK(std::fabs(h.percentile(0.99) - 0.99) <= 0.99 / latency_histogram::sub_count);
+    STXXL_CHECK(h.percentile(1.0) >= 1.0);
+
+    latency_histogram h2 = h;
+    h2 -= h;
+    STXXL_CHECK(h2.count() == 0);
+}
+
+//! issues requests on a file with device id 7
+void test_requests(stxxl::file& file)
+{
+    const size_t block_size = 64 * 1024, num_blocks = 32;
+
+    char* buffer = (char*)stxxl::aligned_alloc<4096>(block_size);
+    memset(buffer, 0, block_size);
+
+    stxxl::stats_data stats1(*stxxl::stats::get_instance());
+
+    std::vector<stxxl::request_ptr> reqs(num_blocks);
+    for (size_t i = 0; i < num_blocks; ++i)
+        reqs[i] = file.awrite(buffer, i * block_size, block_size);
+    stxxl::wait_all(reqs.begin(), reqs.end());
+    for (size_t i = 0; i < num_blocks; ++i)
+        reqs[i] = file.aread(buffer, i * block_size, block_size);
+    stxxl::wait_all(reqs.begin(), reqs.end());
+
+    stxxl::stats_data stats2 = stxxl::stats_data(*stxxl::stats::get_instance()) - stats1;
+    std::cout << stats2;
+    stats2.print_disks(std::cout);
+
+    STXXL_CHECK(stats2.get_latency().write_service.count() == num_blocks);
+    STXXL_CHECK(stats2.get_latency().read_queue.count() == num_blocks);
+    STXXL_CHECK(stats2.get_disks() == 8);
+    STXXL_CHECK(stats2.get_disk(7).latency.read_service.count() == num_blocks);
+    // the submission times were recorded
+    STXXL_CHECK(stats2.get_latency().write_queue.percentile(1.0) < 60.0);
+
+    stxxl::aligned_dealloc<4096>(buffer);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " tempfile" << std::endl;
+        return -1;
+    }
+
+    test_buckets();
+
+    const int mode = stxxl::file::CREAT | stxxl::file::RDWR;
+    {
+        stxxl::syscall_file file(argv[1], mode, stxxl::file::DEFAULT_QUEUE,
+                                 stxxl::file::NO_ALLOCATOR, 7);
+        test_requests(file);
+        file.close_remove();
+    }
+#if STXXL_HAVE_LINUXAIO_FILE
+    {
+        stxxl::linuxaio_file file(argv[1], mode, stxxl::file::DEFAULT_LINUXAIO_QUEUE,
+                                  stxxl::file::NO_ALLOCATOR, 7);
+        test_requests(file);
+        file.close_remove();
+    }
+#endif
+#if STXXL_HAVE_IOURING_FILE
+    {
+        stxxl::iouring_file file(argv[1], mode, stxxl::file::DEFAULT_IOURING_QUEUE,
+                                 stxxl::file::NO_ALLOCATOR, 7);
+        test_requests(file);
+        file.close_remove();
+    }
+#endif
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -0,0 +1,129 @@
+/***************************************************************************
+ *  tests/io/test_mmap_file.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/test_mmap_file.cpp
+//! This tests the persistent mappings of mmap_file, borrowing pointers with
+//! map_read() and vector_bufreader reading a vector stored in an mmap disk
+//! without copies.
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/vector>
+#include <stxxl/aligned_alloc>
+
+void test_file(const char* path)
+{
+    typedef stxxl::file::offset_type offset_type;
+    const size_t block_size = 256 * 1024, num_blocks = 16;
+
+    stxxl::mmap_file file(path, stxxl::file::CREAT | stxxl::file::RDWR | stxxl::file::TRUNC);
+
+    char* buffer = (char*)stxxl::aligned_alloc<4096>(block_size);
+
+    // writes beyond the end grow the file
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+        memset(buffer, (char)i, block_size);
+        file.awrite(buffer, i * block_size, block_size)->wait();
+    }
+    STXXL_CHECK(file.size() == (offset_type)(num_blocks * block_size));
+
+    // random order reads
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+        size_t b = (i * 7) % num_blocks;
+        file.aread(buffer, b * block_size, block_size)->wait();
+        STXXL_CHECK(buffer[0] == (char)b && buffer[block_size - 1] == (char)b);
+    }
+
+    // borrowed pointers stay valid while the file is written elsewhere
+    const char* p3 = (const char*)file.map_read(3 * block_size, block_size);
+    const char* p5 = (const char*)file.map_read(5 * block_size, block_size);
+    STXXL_CHECK(p3 && p5);
+    STXXL_CHECK(p3[0] == 3 && p3[block_size - 1] == 3 && p5[17] == 5);
+
+    memset(buffer, 42, block_size);
+    file.awrite(buffer, 5 * block_size, block_size)->wait();
+    STXXL_CHECK(p5[17] == 42);
+
+    file.unmap_read(p3, 3 * block_size, block_size);
+    file.unmap_read(p5, 5 * block_size, block_size);
+
+    // nothing can be borrowed beyond the end of the file
+    STXXL_CHECK(file.map_read(num_blocks * block_size, block_size) == NULL);
+
+    // shrinking drops the mappings of the truncated part
+    file.set_size(4 * block_size);
+    STXXL_CHECK(file.size() == (offset_type)(4 * block_size));
+    file.aread(buffer, 3 * block_size, block_size)->wait();
+    STXXL_CHECK(buffer[0] == 3);
+
+    bool caught = false;
+    try {
+        file.aread(buffer, 8 * block_size, block_size)->wait();
+    }
+    catch (stxxl::io_error&) {
+        caught = true;
+    }
+    STXXL_CHECK(caught);
+
+    stxxl::aligned_dealloc<4096>(buffer);
+    file.close_remove();
+}
+
+void test_vector_bufreader(const char* path)
+{
+    typedef stxxl::VECTOR_GENERATOR<stxxl::uint64, 4, 4, 64* 1024>::result vector_type;
+
+    stxxl::disk_config disk(std::string(path) + ".disk", 64 * 1024 * 1024, "mmap");
+    disk.unlink_on_open = true;
+    stxxl::config::get_instance()->add_disk(disk);
+
+    const stxxl::uint64 size = 1000000;
+    vector_type vec(size);
+    for (stxxl::uint64 i = 0; i < size; ++i)
+        vec[i] = i * 3;
+
+    stxxl::stats_data stats1(*stxxl::stats::get_instance());
+    {
+        vector_type::bufreader_type reader(vec.begin() + 17, vec.end() - 5);
+        stxxl::uint64 i = 17;
+        for ( ; !reader.empty(); ++reader, ++i)
+            STXXL_CHECK(*reader == i * 3);
+        STXXL_CHECK(i == size - 5);
+
+        reader.rewind();
+        STXXL_CHECK(*reader == 17 * 3);
+    }
+    stxxl::stats_data stats2 = stxxl::stats_data(*stxxl::stats::get_instance()) - stats1;
+    std::cout << stats2;
+    // the blocks were read without requests to the disk queue
+    STXXL_CHECK(stats2.get_latency().read_service.count() == 0);
+    STXXL_CHECK(stats2.get_read_volume() >= (stxxl::int64)(size * sizeof(stxxl::uint64)));
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " tempfile" << std::endl;
+        return -1;
+    }
+
+    test_file(argv[1]);
+    test_vector_bufreader(argv[1]);
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
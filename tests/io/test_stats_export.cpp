@@ -0,0 +1,125 @@
+/***************************************************************************
+ *  tests/io/test_stats_export.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/test_stats_export.cpp
+//! This tests the JSON and CSV output of stats_data and the stats_sampler
+//! thread writing them periodically.
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+
+void do_io(const char* path)
+{
+    const size_t block_size = 64 * 1024, num_blocks = 16;
+
+    stxxl::syscall_file file(path, stxxl::file::CREAT | stxxl::file::RDWR,
+                             stxxl::file::DEFAULT_QUEUE, stxxl::file::NO_ALLOCATOR, 3);
+    char* buffer = (char*)stxxl::aligned_alloc<4096>(block_size);
+    memset(buffer, 0, block_size);
+
+    std::vector<stxxl::request_ptr> reqs(num_blocks);
+    for (size_t i = 0; i < num_blocks; ++i)
+        reqs[i] = file.awrite(buffer, i * block_size, block_size);
+    stxxl::wait_all(reqs.begin(), reqs.end());
+    for (size_t i = 0; i < num_blocks; ++i)
+        reqs[i] = file.aread(buffer, i * block_size, block_size);
+    stxxl::wait_all(reqs.begin(), reqs.end());
+
+    stxxl::aligned_dealloc<4096>(buffer);
+    file.close_remove();
+}
+
+size_t count_columns(const std::string& line)
+{
+    return std::count(line.begin(), line.end(), ',') + 1;
+}
+
+void test_formats(const char* path)
+{
+    stxxl::stats_data stats1(*stxxl::stats::get_instance());
+    do_io(path);
+    stxxl::stats_data stats2 = stxxl::stats_data(*stxxl::stats::get_instance()) - stats1;
+
+    std::ostringstream oss;
+    stats2.to_json(oss);
+    std::string json = oss.str();
+    std::cout << json << std::endl;
+    STXXL_CHECK(json.find("\"read_volume\":1048576,") != std::string::npos);
+    STXXL_CHECK(json.find("\"disks\":[{\"disk\":3,") != std::string::npos);
+    STXXL_CHECK(json.find("\"written_volume\":1048576,\"read_time\"") != std::string::npos);
+    STXXL_CHECK(std::count(json.begin(), json.end(), '{') ==
+                std::count(json.begin(), json.end(), '}'));
+
+    std::ostringstream csv;
+    stxxl::stats_data::csv_header(csv);
+    stats2.to_csv(csv, 1.0);
+    std::cout << csv.str();
+
+    std::istringstream lines(csv.str());
+    std::string header, total, disk;
+    STXXL_CHECK(std::getline(lines, header) && std::getline(lines, total) &&
+                std::getline(lines, disk));
+    STXXL_CHECK(total.compare(0, 6, "1,all,") == 0);
+    STXXL_CHECK(disk.compare(0, 4, "1,3,") == 0);
+    STXXL_CHECK(disk.find(",1048576,1048576,") != std::string::npos);
+    STXXL_CHECK(count_columns(total) == count_columns(header));
+    STXXL_CHECK(count_columns(disk) == count_columns(header));
+}
+
+void test_sampler(const char* path, const std::string& output)
+{
+    {
+        stxxl::stats_sampler sampler(output, 0.01);
+        do_io(path);
+    }
+
+    std::ifstream in(output.c_str());
+    std::string line;
+    size_t samples = 0, volume = 0;
+    while (std::getline(in, line))
+    {
+        STXXL_CHECK(line.compare(0, 8, "{\"time\":") == 0);
+        ++samples;
+        std::string::size_type p = line.find("\"read_volume\":");
+        STXXL_CHECK(p != std::string::npos);
+        volume += atoi(line.c_str() + p + 14);
+    }
+    std::cout << "Sampler wrote " << samples << " samples" << std::endl;
+
+    // the deltas add up to the volume read
+    STXXL_CHECK(samples >= 1);
+    STXXL_CHECK(volume == 1048576);
+
+    stxxl::file::unlink(output.c_str());
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " tempfile" << std::endl;
+        return -1;
+    }
+
+    test_formats(argv[1]);
+    test_sampler(argv[1], std::string(argv[1]) + ".stats.json");
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
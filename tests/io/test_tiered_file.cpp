@@ -0,0 +1,196 @@
+/***************************************************************************
+ *  tests/io/test_tiered_file.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/test_tiered_file.cpp
+//! This tests that tiered_file writes blocks to its fast tier, moves the
+//! least accessed ones to the slow tier while their offsets stay valid, and
+//! a vector allocated with the tiered strategy on a tiered disk, whose tiers
+//! are accounted as devices of their own.
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/mng>
+#include <stxxl/vector>
+#include <stxxl/aligned_alloc>
+
+typedef stxxl::file::offset_type offset_type;
+
+static const size_t block_size = 4096;
+
+void fill(unsigned* buffer, size_t block, unsigned version)
+{
+    for (size_t i = 0; i < block_size / sizeof(unsigned); ++i)
+        buffer[i] = (unsigned)(block * 1000003 + version * 7919 + i);
+}
+
+bool check(const unsigned* buffer, size_t block, unsigned version)
+{
+    for (size_t i = 0; i < block_size / sizeof(unsigned); ++i)
+    {
+        if (buffer[i] != (unsigned)(block * 1000003 + version * 7919 + i))
+            return false;
+    }
+    return true;
+}
+
+void test_file()
+{
+    const size_t num_blocks = 64, fast_blocks = 16;
+
+    stxxl::tiered_file file(new stxxl::mem_file(), new stxxl::mem_file(),
+                            fast_blocks * block_size, 1);
+    file.set_size((num_blocks + 2) * block_size);
+
+    unsigned* buffer = (unsigned*)stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(block_size);
+    std::vector<unsigned> version(num_blocks, 0);
+
+    // more blocks than fit on the fast tier, the mover makes room
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+        fill(buffer, i, 0);
+        file.awrite(buffer, i * block_size, block_size)->wait();
+    }
+    STXXL_CHECK(file.get_fast_bytes() <= (offset_type)(fast_blocks * block_size));
+
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+        file.aread(buffer, i * block_size, block_size)->wait();
+        STXXL_CHECK(check(buffer, i, 0));
+    }
+
+    // move everything to the slow tier
+    file.demote(0);
+    STXXL_CHECK(file.get_fast_bytes() == 0);
+
+    // rewritten blocks go to the fast tier again
+    for (size_t i = 0; i < 10; ++i)
+    {
+        fill(buffer, i, ++version[i]);
+        file.awrite(buffer, i * block_size, block_size)->wait();
+        STXXL_CHECK(file.is_fast(i * block_size));
+    }
+
+    // blocks 0..4 are hot, 5..9 are cold and are moved first
+    for (size_t r = 0; r < 20; ++r)
+    {
+        for (size_t i = 0; i < 5; ++i)
+            file.aread(buffer, i * block_size, block_size)->wait();
+    }
+    file.demote(5 * block_size);
+
+    for (size_t i = 0; i < 10; ++i)
+        STXXL_CHECK(file.is_fast(i * block_size) == (i < 5));
+
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+        file.aread(buffer, i * block_size, block_size)->wait();
+        STXXL_CHECK(check(buffer, i, version[i]));
+    }
+
+    // discarding frees the fast region
+    file.discard(0, block_size);
+    STXXL_CHECK(!file.is_fast(0));
+    STXXL_CHECK(file.get_fast_bytes() == (offset_type)(4 * block_size));
+
+    // a block rewritten with another size while it is read gets a new region
+    // after the read finished
+    const offset_type offset = num_blocks * block_size;
+    unsigned* big = (unsigned*)stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(2 * block_size);
+    fill(buffer, num_blocks, 0);
+    file.awrite(buffer, offset, block_size)->wait();
+    STXXL_CHECK(file.is_fast(offset));
+
+    fill(big, num_blocks, 1);
+    fill(big + block_size / sizeof(unsigned), num_blocks + 1, 1);
+    stxxl::request_ptr read = file.aread(buffer, offset, block_size);
+    stxxl::request_ptr write = file.awrite(big, offset, 2 * block_size);
+    read->wait();
+    write->wait();
+    STXXL_CHECK(check(buffer, num_blocks, 0));
+
+    memset(big, 0, 2 * block_size);
+    file.aread(big, offset, 2 * block_size)->wait();
+    STXXL_CHECK(check(big, num_blocks, 1));
+    STXXL_CHECK(check(big + block_size / sizeof(unsigned), num_blocks + 1, 1));
+
+    // a block discarded while it is written keeps its region until the write
+    // finished, so a new block cannot get the region earlier
+    STXXL_CHECK(file.is_fast(block_size));
+    fill(buffer, 1, ++version[1]);
+    fill(big, 20, ++version[20]);
+    stxxl::request_ptr pending = file.awrite(buffer, block_size, block_size);
+    file.discard(block_size, block_size);
+    STXXL_CHECK(!file.is_fast(block_size));
+    file.awrite(big, 20 * block_size, block_size)->wait();
+    pending->wait();
+    file.aread(big, 20 * block_size, block_size)->wait();
+    STXXL_CHECK(check(big, 20, version[20]));
+
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(big);
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+}
+
+void test_vector(const std::string& tempdir)
+{
+    typedef stxxl::VECTOR_GENERATOR<unsigned, 1, 2, block_size, stxxl::tiered>::result vector_type;
+
+    stxxl::disk_config disk(tempdir + "/tiered_slow", 16 * 1024 * 1024,
+                            "tiered fast=" + tempdir + "/tiered_fast fast_size=256KiB");
+    disk.delete_on_exit = true;
+    stxxl::config::get_instance()->add_disk(disk);
+    stxxl::config::get_instance()->add_disk(
+        stxxl::disk_config("memory", 16 * 1024 * 1024, "memory"));
+
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+    STXXL_CHECK(std::string(bm->get_disk_file(0)->io_type()) == "tiered");
+    stxxl::stats_data stats1(*stxxl::stats::get_instance());
+
+    vector_type v;
+    for (unsigned i = 0; i < 1024 * 1024; ++i)
+        v.push_back(i);
+
+    // all blocks are on the tiered disk
+    for (size_t i = 0; i < v.size() / vector_type::block_type::size; ++i)
+        STXXL_CHECK(v.begin().bid()[i].storage == bm->get_disk_file(0));
+
+    for (unsigned i = 0; i < v.size(); ++i)
+        STXXL_CHECK(v[i] == i);
+
+    // both tiers were written, each on a device of its own
+    stxxl::stats_data stats2 = stxxl::stats_data(*stxxl::stats::get_instance()) - stats1;
+    unsigned written_devices = 0;
+    for (unsigned d = 0; d < stats2.get_disks(); ++d)
+    {
+        if (stats2.get_disk(d).volume_written > 0)
+            ++written_devices;
+    }
+    STXXL_CHECK(written_devices == 2);
+    STXXL_CHECK(stats2.get_disk(stxxl::config::get_instance()->disk(0).device_id).volume_written > 0);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        STXXL_MSG("Usage: " << argv[0] << " tempdir");
+        return -1;
+    }
+
+    test_file();
+    test_vector(argv[1]);
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
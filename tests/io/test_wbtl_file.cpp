@@ -0,0 +1,132 @@
+/***************************************************************************
+ *  tests/io/test_wbtl_file.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example io/test_wbtl_file.cpp
+//! This tests the wbtl_file translation layer: blocks are overwritten at
+//! random many times more often than the backend holds segments, which only
+//! works if the segments containing dead blocks are cleaned, and the latest
+//! contents of all blocks must be read back.
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/aligned_alloc>
+#include <stxxl/bits/common/rand.h>
+
+typedef stxxl::file::offset_type offset_type;
+
+static const size_t block_size = 4096;
+static const size_t segment_size = 64 * 1024;
+static const size_t num_blocks = 256;
+
+//! fill a block with a pattern depending on its number and version
+void fill(char* buffer, size_t block, unsigned version)
+{
+    unsigned* p = (unsigned*)buffer;
+    for (size_t i = 0; i < block_size / sizeof(unsigned); ++i)
+        p[i] = (unsigned)(block * 1000003 + version * 7919 + i);
+}
+
+bool check(const char* buffer, size_t block, unsigned version)
+{
+    const unsigned* p = (const unsigned*)buffer;
+    for (size_t i = 0; i < block_size / sizeof(unsigned); ++i)
+    {
+        if (p[i] != (unsigned)(block * 1000003 + version * 7919 + i))
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    // the backend must be served by another queue than the wbtl_file, which
+    // waits for the backend's requests.
+    stxxl::mem_file* backend = new stxxl::mem_file(stxxl::file::DEFAULT_QUEUE);
+    stxxl::wbtl_file file(backend, segment_size, 3, 1);
+
+    file.set_size(num_blocks * block_size);
+    STXXL_CHECK(file.size() == (offset_type)(num_blocks * block_size));
+
+    char* buffer = (char*)stxxl::aligned_alloc<STXXL_BLOCK_ALIGN>(2 * block_size);
+    std::vector<unsigned> version(num_blocks, 0);
+
+    // sequential writes fill the whole logical size
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+        fill(buffer, i, 0);
+        file.awrite(buffer, i * block_size, block_size)->wait();
+    }
+
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+        file.aread(buffer, i * block_size, block_size)->wait();
+        STXXL_CHECK(check(buffer, i, 0));
+    }
+
+    // random overwrites: each round writes the logical size again, while
+    // the backend has only a few spare segments.
+    stxxl::random_number32_r rng(42);
+    const size_t rounds = 20;
+    for (size_t r = 0; r < rounds * num_blocks; ++r)
+    {
+        size_t i = rng() % num_blocks;
+        fill(buffer, i, ++version[i]);
+        file.awrite(buffer, i * block_size, block_size)->wait();
+
+        if (r % 97 == 0) {
+            size_t j = rng() % num_blocks;
+            file.aread(buffer, j * block_size, block_size)->wait();
+            STXXL_CHECK(check(buffer, j, version[j]));
+        }
+    }
+
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+        file.aread(buffer, i * block_size, block_size)->wait();
+        STXXL_CHECK(check(buffer, i, version[i]));
+    }
+
+    // discarding the first half frees segments once their live blocks are
+    // relocated
+    for (size_t i = 0; i < num_blocks / 2; ++i)
+        file.discard(i * block_size, block_size);
+
+    size_t free_before = file.get_free_segments();
+    while (file.clean_segment(segment_size - 1)) { }
+    size_t free_after = file.get_free_segments();
+    std::cout << "free segments: " << free_before << " before and "
+              << free_after << " after cleaning" << std::endl;
+    STXXL_CHECK(free_after >= free_before);
+    STXXL_CHECK(free_after >= (num_blocks / 2) * block_size / segment_size);
+
+    for (size_t i = num_blocks / 2; i < num_blocks; ++i)
+    {
+        file.aread(buffer, i * block_size, block_size)->wait();
+        STXXL_CHECK(check(buffer, i, version[i]));
+    }
+
+    // a block of another size at the start of the discarded range is kept
+    // beside the radix table
+    fill(buffer, 0, 1);
+    fill(buffer + block_size, 1, 1);
+    file.awrite(buffer, 0, 2 * block_size)->wait();
+    memset(buffer, 0, 2 * block_size);
+    file.aread(buffer, 0, 2 * block_size)->wait();
+    STXXL_CHECK(check(buffer, 0, 1) && check(buffer + block_size, 1, 1));
+
+    stxxl::aligned_dealloc<STXXL_BLOCK_ALIGN>(buffer);
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -0,0 +1,173 @@
+/***************************************************************************
+ *  tests/mng/benchmark_disk_allocator.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example mng/benchmark_disk_allocator.cpp
+//! Stress test and microbenchmark of the disk_allocator. Many threads
+//! allocate runs of blocks of random length and free random earlier runs,
+//! which fragments the free space, then the live blocks are checked to be
+//! disjoint and all space must coalesce again once everything is freed.
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <stxxl/io>
+#include <stxxl/mng>
+#include <stxxl/bits/common/cmdline.h>
+#include <stxxl/bits/common/rand.h>
+#include <stxxl/bits/common/timer.h>
+#include <stxxl/bits/parallel.h>
+
+using stxxl::unsigned_type;
+
+static const unsigned block_size = 4096;
+
+typedef stxxl::BID<block_size> bid_type;
+typedef stxxl::BIDArray<block_size> bid_array_type;
+typedef stxxl::disk_allocator::place place;
+
+//! each thread keeps about live runs of up to max_run blocks allocated and
+//! replaces a random one of them rounds times.
+void run_thread(stxxl::disk_allocator* alloc, unsigned_type thread,
+                unsigned int rounds, unsigned int live, unsigned int max_run,
+                bool batch, std::vector<place>& out)
+{
+    stxxl::random_number32_r rng((unsigned)thread + 1);
+    std::vector<bid_array_type*> runs;
+
+    for (unsigned int r = 0; r < rounds + live; ++r)
+    {
+        if (runs.size() >= live)
+        {
+            size_t victim = rng() % runs.size();
+            bid_array_type* run = runs[victim];
+            runs[victim] = runs.back();
+            runs.pop_back();
+
+            if (batch) {
+                std::vector<place> regions;
+                for (unsigned_type i = 0; i < run->size(); ++i)
+                    regions.push_back(place((*run)[i].offset, block_size));
+                alloc->delete_regions(regions);
+            }
+            else {
+                for (unsigned_type i = 0; i < run->size(); ++i)
+                    alloc->delete_block((*run)[i]);
+            }
+            delete run;
+        }
+
+        bid_array_type* run = new bid_array_type(1 + rng() % max_run);
+        alloc->new_blocks(*run);
+        runs.push_back(run);
+    }
+
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        for (unsigned_type i = 0; i < runs[r]->size(); ++i)
+            out.push_back(place((*runs[r])[i].offset, block_size));
+        delete runs[r];
+    }
+}
+
+void run_benchmark(unsigned int num_threads, unsigned int rounds,
+                   unsigned int live, unsigned int max_run, bool batch)
+{
+    // the memory file only touches pages that are written, which the
+    // allocator never does.
+    stxxl::mem_file file;
+    stxxl::disk_config cfg("memory", (stxxl::uint64)num_threads * live *
+                           max_run * block_size, "memory");
+    cfg.autogrow = true;
+    stxxl::disk_allocator alloc(&file, cfg);
+
+    std::vector<std::vector<place> > blocks(num_threads);
+
+    stxxl::timer timer(true);
+
+#if STXXL_PARALLEL
+#pragma omp parallel num_threads(num_threads)
+    run_thread(&alloc, omp_get_thread_num(), rounds, live, max_run, batch,
+               blocks[omp_get_thread_num()]);
+#else
+    STXXL_CHECK(num_threads == 1);
+    run_thread(&alloc, 0, rounds, live, max_run, batch, blocks[0]);
+#endif
+
+    timer.stop();
+
+    // check that the remaining blocks are disjoint and accounted for
+    std::vector<place> all;
+    for (size_t t = 0; t < blocks.size(); ++t)
+        all.insert(all.end(), blocks[t].begin(), blocks[t].end());
+    std::sort(all.begin(), all.end());
+
+    for (size_t i = 1; i < all.size(); ++i)
+        STXXL_CHECK(all[i - 1].first + all[i - 1].second <= all[i].first);
+
+    STXXL_CHECK(alloc.get_used_bytes() ==
+                (stxxl::int64)(all.size() * block_size));
+
+    alloc.delete_regions(all);
+    STXXL_CHECK(alloc.get_free_bytes() == alloc.get_total_bytes());
+
+    double total = 2.0 * num_threads * rounds;
+
+    std::cout << "RESULT"
+              << " num_threads=" << num_threads
+              << " batch=" << batch
+              << " live=" << live
+              << " max_run=" << max_run
+              << " operations=" << total
+              << " total_bytes=" << alloc.get_total_bytes()
+              << " time=" << timer.seconds()
+              << " time/operation[ns]=" << timer.seconds() / total * 1e9
+              << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int max_threads = 1;
+    unsigned int rounds = 100000, live = 1000, max_run = 16;
+    bool batch = false;
+
+#if STXXL_PARALLEL
+    max_threads = omp_get_max_threads();
+#endif
+
+    stxxl::cmdline_parser cp;
+    cp.set_description("Stress the disk_allocator with random allocations "
+                       "and deallocations of block runs from many threads.");
+
+    cp.add_uint('t', "threads", max_threads,
+                "maximum number of threads, doubled starting at 1");
+    cp.add_uint('r', "rounds", rounds,
+                "number of allocate/free rounds per thread, default: 100000");
+    cp.add_uint('l', "live", live,
+                "number of runs each thread keeps allocated, default: 1000");
+    cp.add_uint('m', "max-run", max_run,
+                "maximum number of blocks per run, default: 16");
+    cp.add_flag('b', "batch", batch,
+                "free each run with one delete_regions() call");
+
+    if (!cp.process(argc, argv))
+        return EXIT_FAILURE;
+
+#if !STXXL_PARALLEL
+    max_threads = 1;
+#endif
+
+    for (unsigned int t = 1; t <= max_threads; t *= 2)
+        run_benchmark(t, rounds, live, max_run, batch);
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -58,6 +58,53 @@ void test_aligned_alloc()
     stxxl::aligned_dealloc<1024>(r);
 }
 
+typedef stxxl::typed_block<2 * 1024 * 1024, type> huge_block_type;
+
+void test_huge_pages()
+{
+    const size_t mapped = stxxl::get_huge_pages_mapped(stxxl::HUGE_PAGES_TRANSPARENT);
+
+    // explicit huge pages fall back to transparent ones if none are reserved
+    huge_block_type* a = new (stxxl::HUGE_PAGES_TRANSPARENT) huge_block_type;
+    huge_block_type* b = new (stxxl::HUGE_PAGES_2MIB) huge_block_type;
+    (*a)[0].i = 1;
+    (*b)[huge_block_type::size - 1].i = 2;
+#if STXXL_HAVE_HUGE_PAGES
+    STXXL_CHECK((size_t)a % huge_block_type::raw_size == 0);
+    STXXL_CHECK(stxxl::get_huge_pages_mapped(stxxl::HUGE_PAGES_TRANSPARENT) >=
+                mapped + huge_block_type::raw_size);
+#endif
+
+    // pages larger than the allocation are not used
+    huge_block_type* d = new (stxxl::HUGE_PAGES_1GIB) huge_block_type;
+    (*d)[0].i = 5;
+#if STXXL_HAVE_HUGE_PAGES
+    STXXL_CHECK((size_t)d % huge_block_type::raw_size == 0);
+#endif
+    STXXL_CHECK(stxxl::get_huge_pages_mapped(stxxl::HUGE_PAGES_1GIB) == 0);
+
+    // the process-wide setting applies to blocks and arrays of blocks, but not
+    // to smaller allocations
+    stxxl::set_huge_pages(stxxl::HUGE_PAGES_TRANSPARENT);
+    huge_block_type* A = new huge_block_type[3];
+    block_type* c = new block_type;
+    A[2][huge_block_type::size - 1].i = 3;
+    (*c)[0].i = 4;
+#if STXXL_HAVE_HUGE_PAGES
+    STXXL_CHECK(stxxl::get_huge_pages_mapped(stxxl::HUGE_PAGES_TRANSPARENT) >=
+                mapped + 5 * huge_block_type::raw_size);
+#endif
+    stxxl::set_huge_pages(stxxl::HUGE_PAGES_NONE);
+
+    delete a;
+    delete b;
+    delete[] A;
+    delete c;
+    delete d;
+    STXXL_CHECK(stxxl::get_huge_pages_mapped(stxxl::HUGE_PAGES_TRANSPARENT) == mapped);
+    STXXL_CHECK(stxxl::get_huge_pages_mapped(stxxl::HUGE_PAGES_2MIB) == 0);
+}
+
 void test_typed_block_vector()
 {
     std::vector<block_type> v1(2);
@@ -68,6 +115,7 @@ int main()
 {
     test_typed_block();
     test_aligned_alloc();
+    test_huge_pages();
     test_typed_block_vector();
 
     return 0;
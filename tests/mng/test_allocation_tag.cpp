@@ -0,0 +1,122 @@
+/***************************************************************************
+ *  tests/mng/test_allocation_tag.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example mng/test_allocation_tag.cpp
+//! This tests that blocks allocated within a scoped_allocation_tag are
+//! accounted to the tag until they are deleted, that exceeding the tag's
+//! quota throws bad_ext_alloc without allocating, and that the counters are
+//! reported by stats.
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <stxxl/mng>
+#include <stxxl/vector>
+
+static const unsigned block_size = 64 * 1024;
+
+typedef stxxl::BID<block_size> bid_type;
+
+int main()
+{
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+
+    stxxl::allocation_tag tag("test", 16 * block_size);
+    stxxl::allocation_tag other("other");
+
+    std::vector<bid_type> bids(10), untagged(4), nested(2);
+    {
+        stxxl::scoped_allocation_tag scope(tag);
+        bm->new_blocks(stxxl::striping(), bids.begin(), bids.end());
+        {
+            stxxl::scoped_allocation_tag inner(other);
+            bm->new_blocks(stxxl::striping(), nested.begin(), nested.end());
+        }
+        STXXL_CHECK(stxxl::allocation_tag::current() == &tag);
+    }
+    STXXL_CHECK(stxxl::allocation_tag::current() == NULL);
+    bm->new_blocks(stxxl::striping(), untagged.begin(), untagged.end());
+
+    STXXL_CHECK(tag.get_stats().current == 10 * block_size);
+    STXXL_CHECK(other.get_stats().current == 2 * block_size);
+
+    // exceeding the quota is refused before any block is allocated
+    {
+        stxxl::scoped_allocation_tag scope(tag);
+        const stxxl::uint64 free_bytes = bm->get_free_bytes();
+        std::vector<bid_type> more(7);
+        bool thrown = false;
+        try {
+            bm->new_blocks(stxxl::striping(), more.begin(), more.end());
+        }
+        catch (stxxl::bad_ext_alloc& e) {
+            std::cout << "expected: " << e.what() << std::endl;
+            thrown = true;
+        }
+        STXXL_CHECK(thrown);
+        STXXL_CHECK(bm->get_free_bytes() == free_bytes);
+        STXXL_CHECK(tag.get_stats().current == 10 * block_size);
+        STXXL_CHECK(tag.get_stats().refused == 1);
+
+        // up to the quota is fine
+        more.resize(6);
+        bm->new_blocks(stxxl::striping(), more.begin(), more.end());
+        STXXL_CHECK(tag.get_stats().current == 16 * block_size);
+        bm->delete_blocks(more.begin(), more.end());
+    }
+
+    // deleting outside of the scope is accounted to the tag of the block
+    bm->delete_block(bids[0]);
+    bm->delete_blocks(bids.begin() + 1, bids.end());
+    bm->delete_blocks(untagged.begin(), untagged.end());
+    STXXL_CHECK(tag.get_stats().current == 0);
+    STXXL_CHECK(tag.get_stats().maximum == 16 * block_size);
+    STXXL_CHECK(tag.get_stats().total == 16 * block_size);
+    STXXL_CHECK(other.get_stats().current == 2 * block_size);
+
+    // the counters outlive the tag and are shared by tags of the same name
+    bm->delete_blocks(nested.begin(), nested.end());
+    {
+        stxxl::allocation_tag again("other");
+        STXXL_CHECK(again.get_id() == other.get_id());
+        STXXL_CHECK(again.get_stats().current == 0);
+        STXXL_CHECK(again.get_stats().total == 2 * block_size);
+    }
+
+    // a vector allocates all its blocks with the tag
+    {
+        typedef stxxl::VECTOR_GENERATOR<unsigned, 2, 2, block_size>::result vector_type;
+        stxxl::allocation_tag vtag("vector");
+        {
+            vector_type v;
+            stxxl::scoped_allocation_tag scope(vtag);
+            for (unsigned i = 0; i < 10 * vector_type::block_type::size; ++i)
+                v.push_back(i);
+            v.flush();
+            STXXL_CHECK(vtag.get_stats().current == 10 * block_size);
+        }
+        STXXL_CHECK(vtag.get_stats().current == 0);
+    }
+
+    stxxl::stats_data s(*stxxl::stats::get_instance());
+    STXXL_CHECK(s.get_allocation_tags() >= 3);
+    STXXL_CHECK(s.get_allocation(tag.get_id()).name == "test");
+    STXXL_CHECK(s.get_allocation(tag.get_id()).maximum == 16 * block_size);
+    std::cout << s;
+
+    std::ostringstream json;
+    s.to_json(json);
+    STXXL_CHECK(json.str().find("\"tag\":\"vector\"") != std::string::npos);
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -14,6 +14,7 @@
 //! This is an example of use of \c stxxl::buf_istream and \c stxxl::buf_ostream
 
 #include <iostream>
+#include <stxxl/timer>
 #include <stxxl/mng>
 #include <stxxl/bits/mng/buf_ostream.h>
 #include <stxxl/bits/mng/buf_istream.h>
@@ -72,6 +73,33 @@ int main()
             STXXL_CHECK(prevalue == value);
         }
     }
+    {
+        // adaptive read-ahead: a consumer that does not work on the blocks
+        // waits for every read, more buffers are used
+        buf_istream_type in(bids.begin(), bids.end(), 2, 16);
+        const stxxl::int_type initial = in.num_buffers();
+        stxxl::int_type largest = initial;
+        for (unsigned i = 0; i < nblocks / 2; i++)
+        {
+            STXXL_CHECK(in.block()[0] == i * block_type::size);
+            largest = std::max(largest, in.num_buffers());
+            in.next_block();
+        }
+        STXXL_MSG("adaptive buf_istream: " << initial << " -> " << largest << " buffers");
+        STXXL_CHECK(largest > initial && largest <= 16);
+
+        // a slow consumer finds its blocks read, fewer buffers are used
+        for (unsigned i = nblocks / 2; i < nblocks; i++)
+        {
+            STXXL_CHECK(in.block()[0] == i * block_type::size);
+            const double start = stxxl::timestamp();
+            while (stxxl::timestamp() < start + 0.005) { }
+            if (i + 1 < nblocks)
+                in.next_block();
+        }
+        STXXL_MSG("adaptive buf_istream: shrunk to " << in.num_buffers() << " buffers");
+        STXXL_CHECK(in.num_buffers() < largest);
+    }
     bm->delete_blocks(bids.begin(), bids.end());
 
     return 0;
@@ -0,0 +1,144 @@
+/***************************************************************************
+ *  tests/mng/test_concurrent_pools.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example mng/test_concurrent_pools.cpp
+//! This tests the bid_hash_table against std::map, and a
+//! concurrent_write_pool and concurrent_prefetch_pool shared by several
+//! threads writing, hinting, invalidating and reading blocks.
+
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <stxxl/mng>
+#include <stxxl/bits/common/rand.h>
+#include <stxxl/bits/mng/bid_hash_table.h>
+#include <stxxl/bits/mng/prefetch_pool.h>
+#include <stxxl/bits/mng/write_pool.h>
+#include <stxxl/bits/parallel.h>
+
+static const unsigned block_size = 64 * 1024;
+static const int num_threads = 4;
+static const unsigned blocks_per_thread = 64;
+
+typedef stxxl::typed_block<block_size, unsigned> block_type;
+typedef block_type::bid_type bid_type;
+
+void test_hash_table()
+{
+    typedef stxxl::bid_hash_table<bid_type, unsigned> table_type;
+    typedef std::map<stxxl::int64, unsigned> map_type;
+
+    // fake files, the table only compares the pointers
+    stxxl::file* files[2] = { (stxxl::file*)16, (stxxl::file*)32 };
+
+    table_type table;
+    table.reserve(64);
+    STXXL_CHECK(table.capacity() == 128);
+    map_type map[2];
+    stxxl::random_number32 rnd;
+
+    for (unsigned i = 0; i < 100000; ++i)
+    {
+        unsigned f = rnd() % 2;
+        // few distinct offsets, so elements are found and erased often
+        stxxl::int64 offset = stxxl::int64(rnd() % 100) * block_size;
+        bid_type bid(files[f], offset);
+
+        if (rnd() % 2 && map[f].size() + map[1 - f].size() < 64)
+        {
+            table.insert(bid, i);
+            map[f][offset] = i;
+        }
+        else
+        {
+            STXXL_CHECK(table.erase(bid) == (map[f].erase(offset) == 1));
+        }
+
+        STXXL_CHECK(table.size() == map[0].size() + map[1].size());
+        unsigned* value = table.find(bid);
+        map_type::iterator it = map[f].find(offset);
+        STXXL_CHECK((value == NULL) == (it == map[f].end()));
+        if (value)
+            STXXL_CHECK(*value == it->second);
+    }
+
+    // reserved slots were never exceeded
+    STXXL_CHECK(table.capacity() == 128);
+    table.clear();
+    STXXL_CHECK(table.empty());
+}
+
+void test_pools(std::vector<bid_type>& bids)
+{
+    stxxl::concurrent_write_pool<block_type> w_pool(num_threads);
+    stxxl::concurrent_prefetch_pool<block_type> p_pool(num_threads * 2);
+
+#if STXXL_PARALLEL
+#pragma omp parallel for num_threads(num_threads)
+#endif
+    for (int t = 0; t < num_threads; ++t)
+    {
+        const unsigned begin = t * blocks_per_thread;
+
+        // write the thread's blocks, waiting for free blocks in steal()
+        for (unsigned i = begin; i < begin + blocks_per_thread; ++i)
+        {
+            block_type* block = w_pool.steal();
+            (*block)[0] = i;
+            w_pool.write(block, bids[i]);
+        }
+
+        // read them back, partly hinted and partly still in the write pool
+        for (unsigned i = begin; i < begin + blocks_per_thread; i += 2)
+        {
+            p_pool.hint(bids[i], w_pool);
+            p_pool.hint(bids[i + 1], w_pool);
+
+            block_type* block = w_pool.steal();
+            p_pool.read(block, bids[i], w_pool)->wait();
+            STXXL_CHECK((*block)[0] == i);
+            p_pool.read(block, bids[i + 1], w_pool)->wait();
+            STXXL_CHECK((*block)[0] == i + 1);
+            w_pool.add(block);
+        }
+
+        // invalidate a hint while other threads grow the pool
+        p_pool.hint(bids[begin]);
+        block_type* block = new block_type;
+        p_pool.add(block);
+        p_pool.invalidate(bids[begin]);
+    }
+
+    STXXL_CHECK(p_pool.size() == num_threads * 3);
+    STXXL_CHECK(p_pool.busy_size() == 0);
+    STXXL_CHECK(w_pool.size() == num_threads);
+
+    w_pool.resize(0);
+    p_pool.resize(0);
+    STXXL_CHECK(w_pool.size() == 0);
+    STXXL_CHECK(p_pool.size() == 0);
+}
+
+int main()
+{
+    test_hash_table();
+
+    std::vector<bid_type> bids(num_threads * blocks_per_thread);
+    stxxl::block_manager::get_instance()->new_blocks(stxxl::striping(), bids.begin(), bids.end());
+
+    for (unsigned round = 0; round < 4; ++round)
+        test_pools(bids);
+
+    stxxl::block_manager::get_instance()->delete_blocks(bids.begin(), bids.end());
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -34,6 +34,39 @@ void test1()
     STXXL_CHECK_EQUAL(cfg.fileio_string(), "wincall delete_on_exit direct=on queue=5");
     STXXL_CHECK_EQUAL(cfg.queue, 5);
     STXXL_CHECK_EQUAL(cfg.direct, stxxl::disk_config::DIRECT_ON);
+    STXXL_CHECK_EQUAL(cfg.numa_node, -1);
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , syscall numa=1");
+
+    STXXL_CHECK_EQUAL(cfg.fileio_string(), "syscall numa=1");
+    STXXL_CHECK_EQUAL(cfg.numa_node, 1);
+
+    cfg.parse_line("disk=/dev/sdb1, 0 , syscall discard");
+
+    STXXL_CHECK_EQUAL(cfg.fileio_string(), "syscall delete_on_exit discard");
+    STXXL_CHECK(cfg.discard);
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , linuxaio discard=off");
+
+    STXXL_CHECK(!cfg.discard);
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , syscall checksum");
+
+    STXXL_CHECK_EQUAL(cfg.fileio_string(), "syscall checksum");
+    STXXL_CHECK(cfg.checksum);
+
+    cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB , tiered fast=/dev/shm/stxxl.fast fast_size=2GiB");
+
+    STXXL_CHECK_EQUAL(cfg.fast_path, "/dev/shm/stxxl.fast");
+    STXXL_CHECK_EQUAL(cfg.fast_size, 2 * 1024 * 1024 * stxxl::uint64(1024));
+    STXXL_CHECK_EQUAL(cfg.fileio_string(), "tiered fast=/dev/shm/stxxl.fast fast_size=2147483648B");
+
+    // the tiers survive a round trip through fileio_string()
+    stxxl::disk_config tiered(cfg.path, cfg.size, cfg.fileio_string());
+
+    STXXL_CHECK_EQUAL(tiered.fast_path, cfg.fast_path);
+    STXXL_CHECK_EQUAL(tiered.fast_size, cfg.fast_size);
+    STXXL_CHECK_EQUAL(tiered.fileio_string(), cfg.fileio_string());
 
     // bad configurations
 
@@ -46,6 +79,16 @@ void test1()
         cfg.parse_line("disk=/var/tmp/stxxl.tmp,0x,syscall"),
         std::runtime_error
         );
+
+    STXXL_CHECK_THROW(
+        cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, syscall numa=first"),
+        std::runtime_error
+        );
+
+    STXXL_CHECK_THROW(
+        cfg.parse_line("disk=/var/tmp/stxxl.tmp, 100 GiB, memory discard"),
+        std::runtime_error
+        );
 }
 
 void test2()
@@ -0,0 +1,110 @@
+/***************************************************************************
+ *  tests/mng/test_discard.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example mng/test_discard.cpp
+//! This tests that blocks freed on a disk with the discard option are
+//! punched out of the file in the background and returned to the allocator
+//! afterwards, and that reallocated blocks hold what is written to them.
+
+#include <iostream>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <stxxl/mng>
+
+static const unsigned block_size = 1024 * 1024;
+static const size_t num_blocks = 32;
+
+typedef stxxl::typed_block<block_size, unsigned> block_type;
+typedef block_type::bid_type bid_type;
+
+//! return the number of bytes allocated to the file on disk
+stxxl::uint64 allocated_bytes(const char* path)
+{
+    struct stat st;
+    STXXL_CHECK(::stat(path, &st) == 0);
+    return (stxxl::uint64)st.st_blocks * 512;
+}
+
+void write_blocks(std::vector<bid_type>& bids, unsigned seed)
+{
+    block_type* block = new block_type;
+    for (size_t i = 0; i < bids.size(); ++i)
+    {
+        for (unsigned j = 0; j < block_type::size; ++j)
+            (*block)[j] = seed + (unsigned)i + j;
+        block->write(bids[i])->wait();
+    }
+    delete block;
+}
+
+void check_blocks(std::vector<bid_type>& bids, unsigned seed)
+{
+    block_type* block = new block_type;
+    for (size_t i = 0; i < bids.size(); ++i)
+    {
+        block->read(bids[i])->wait();
+        for (unsigned j = 0; j < block_type::size; ++j)
+            STXXL_CHECK((*block)[j] == seed + (unsigned)i + j);
+    }
+    delete block;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        STXXL_MSG("Usage: " << argv[0] << " tempdir");
+        return -1;
+    }
+
+    std::string path = std::string(argv[1]) + "/discard";
+
+    stxxl::disk_config disk(path, 64 * 1024 * 1024, "syscall discard");
+    disk.delete_on_exit = true;
+    stxxl::config::get_instance()->add_disk(disk);
+
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+    const stxxl::uint64 free_bytes = bm->get_free_bytes();
+
+    std::vector<bid_type> bids(num_blocks);
+    bm->new_blocks(stxxl::striping(), bids.begin(), bids.end());
+    write_blocks(bids, 1);
+    check_blocks(bids, 1);
+
+    const stxxl::uint64 before = allocated_bytes(path.c_str());
+    STXXL_CHECK(before >= num_blocks * block_size);
+
+    bm->delete_blocks(bids.begin(), bids.end());
+    bm->wait_discards();
+    STXXL_CHECK(bm->get_free_bytes() == free_bytes);
+
+    const stxxl::uint64 after = allocated_bytes(path.c_str());
+    std::cout << "allocated file space: " << before << " bytes before and "
+              << after << " bytes after deleting the blocks" << std::endl;
+    STXXL_CHECK(after + num_blocks * block_size <= before);
+
+    // the discarded space is handed out again and written normally
+    bm->new_blocks(stxxl::striping(), bids.begin(), bids.end());
+    write_blocks(bids, 2);
+    check_blocks(bids, 2);
+
+    // single blocks take the same path
+    for (size_t i = 0; i < bids.size(); ++i)
+        bm->delete_block(bids[i]);
+    bm->wait_discards();
+    STXXL_CHECK(bm->get_free_bytes() == free_bytes);
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -0,0 +1,122 @@
+/***************************************************************************
+ *  tests/mng/test_extent_reservation.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example mng/test_extent_reservation.cpp
+//! This tests that blocks allocated one at a time through an
+//! extent_reservation get adjacent offsets on each disk, even if two
+//! containers grow at the same time, and that reserved space is returned.
+
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <stxxl/mng>
+#include <stxxl/vector>
+
+static const unsigned block_size = 4096;
+
+typedef stxxl::BID<block_size> bid_type;
+typedef stxxl::VECTOR_GENERATOR<int, 1, 1, block_size>::result vector_type;
+
+//! count the blocks which do not directly follow the previous block on the
+//! same disk.
+template <typename BIDIterator>
+size_t count_breaks(BIDIterator begin, BIDIterator end)
+{
+    std::map<stxxl::file*, stxxl::int64> next;
+    size_t breaks = 0;
+    for ( ; begin != end; ++begin)
+    {
+        if (next.count(begin->storage) && next[begin->storage] != begin->offset)
+            ++breaks;
+        next[begin->storage] = begin->offset + begin->size;
+    }
+    return breaks;
+}
+
+void test_block_manager()
+{
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+    const stxxl::uint64 free_bytes = bm->get_free_bytes();
+
+    stxxl::extent_reservation extents;
+    std::vector<bid_type> bids(64);
+
+    // allocate block by block, interleaved with blocks without reservation
+    std::vector<bid_type> others(bids.size());
+    for (size_t i = 0; i < bids.size(); ++i)
+    {
+        bm->new_blocks(stxxl::striping(), bids.begin() + i, bids.begin() + i + 1,
+                       i, extents);
+        bm->new_blocks(stxxl::striping(), others.begin() + i, others.begin() + i + 1, i);
+    }
+
+    size_t breaks = count_breaks(bids.begin(), bids.end());
+    std::cout << "blocks with reservation: " << breaks << " breaks" << std::endl;
+    STXXL_CHECK(breaks <= 4 * bm->get_ndisks());
+
+    STXXL_CHECK(bm->get_free_bytes() + extents.get_reserved_bytes() +
+                2 * bids.size() * block_size == free_bytes);
+
+    extents.release();
+    STXXL_CHECK(extents.get_reserved_bytes() == 0);
+
+    bm->delete_blocks(bids.begin(), bids.end());
+    bm->delete_blocks(others.begin(), others.end());
+    STXXL_CHECK(bm->get_free_bytes() == free_bytes);
+}
+
+void test_vector()
+{
+    stxxl::block_manager* bm = stxxl::block_manager::get_instance();
+    const stxxl::uint64 free_bytes = bm->get_free_bytes();
+    const size_t num_blocks = 512;
+
+    {
+        vector_type v1, v2;
+        for (size_t i = 0; i < num_blocks * vector_type::block_type::size; ++i)
+        {
+            v1.push_back((int)i);
+            v2.push_back((int)i);
+        }
+
+        size_t breaks1 = count_breaks(v1.begin().bid(), v1.begin().bid() + num_blocks);
+        size_t breaks2 = count_breaks(v2.begin().bid(), v2.begin().bid() + num_blocks);
+        std::cout << "growing vectors: " << breaks1 << " and " << breaks2
+                  << " breaks in " << num_blocks << " blocks" << std::endl;
+
+        // one break per extent, which double in size
+        STXXL_CHECK(breaks1 <= 8 * bm->get_ndisks());
+        STXXL_CHECK(breaks2 <= 8 * bm->get_ndisks());
+
+        for (size_t i = 0; i < v1.size(); ++i)
+            STXXL_CHECK(v1[i] == (int)i && v2[i] == (int)i);
+    }
+
+    STXXL_CHECK(bm->get_free_bytes() == free_bytes);
+}
+
+int main()
+{
+    stxxl::config* config = stxxl::config::get_instance();
+
+    for (int i = 0; i < 2; ++i)
+    {
+        stxxl::disk_config disk("memory", 16 * 1024 * 1024, "memory autogrow");
+        config->add_disk(disk);
+    }
+
+    test_block_manager();
+    test_vector();
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -0,0 +1,221 @@
+/***************************************************************************
+ *  tests/mng/test_memory_manager.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example mng/test_memory_manager.cpp
+//! This tests the accounting of the memory_manager and of the containers,
+//! that consumers are asked to shrink when the limit is exceeded, and that a
+//! vector releases its pages for a sorter at its next page fault, keeping
+//! the page accessed last.
+
+#include <functional>
+#include <iostream>
+#include <limits>
+
+#include <stxxl/map>
+#include <stxxl/mng>
+#include <stxxl/priority_queue>
+#include <stxxl/sorter>
+#include <stxxl/unordered_map>
+#include <stxxl/vector>
+
+static const stxxl::uint64 MiB = 1024 * 1024;
+
+//! a consumer giving back memory on request
+class shrinking_consumer : public stxxl::memory_consumer
+{
+public:
+    unsigned shrink_calls;
+
+    shrinking_consumer()
+        : stxxl::memory_consumer("test shrinking"), shrink_calls(0)
+    { }
+
+    ~shrinking_consumer()
+    {
+        unregister();
+    }
+
+    void shrink(stxxl::uint64 bytes)
+    {
+        ++shrink_calls;
+        release(std::min(bytes, get_bytes()));
+    }
+};
+
+struct cmp_uint64 : public std::less<stxxl::uint64>
+{
+    stxxl::uint64 min_value() const
+    {
+        return std::numeric_limits<stxxl::uint64>::min();
+    }
+    stxxl::uint64 max_value() const
+    {
+        return std::numeric_limits<stxxl::uint64>::max();
+    }
+};
+
+struct cmp_int : public std::less<int>
+{
+    static int min_value()
+    {
+        return std::numeric_limits<int>::min();
+    }
+    static int max_value()
+    {
+        return std::numeric_limits<int>::max();
+    }
+};
+
+struct hash_int
+{
+    size_t operator () (int key) const
+    {
+        return (size_t)(key * 2654435761u);
+    }
+};
+
+stxxl::memory_usage usage_of(const std::string& name)
+{
+    std::vector<stxxl::memory_usage> usage = stxxl::memory_manager::get_instance()->get_usage();
+    for (size_t i = 0; i < usage.size(); ++i)
+    {
+        if (usage[i].name == name)
+            return usage[i];
+    }
+    return stxxl::memory_usage();
+}
+
+void test_consumers()
+{
+    stxxl::memory_manager* mm = stxxl::memory_manager::get_instance();
+    const stxxl::uint64 used = mm->get_used();
+
+    {
+        stxxl::memory_consumer fixed("test fixed");
+        shrinking_consumer shrinking;
+
+        // without a limit everything is granted
+        STXXL_CHECK(fixed.acquire(4 * MiB) == 4 * MiB);
+        STXXL_CHECK(shrinking.acquire(8 * MiB) == 8 * MiB);
+        STXXL_CHECK(mm->get_used() == used + 12 * MiB);
+        STXXL_CHECK(usage_of("test fixed").current == 4 * MiB);
+
+        // the shrinking consumer makes room
+        mm->set_limit(used + 14 * MiB);
+        STXXL_CHECK(fixed.acquire(4 * MiB) == 4 * MiB);
+        STXXL_CHECK(shrinking.shrink_calls == 1);
+        STXXL_CHECK(shrinking.get_bytes() == 6 * MiB);
+        STXXL_CHECK(usage_of("test shrinking").shrunk == 2 * MiB);
+
+        // the fixed consumer does not, less is granted, and at least the
+        // minimum
+        shrinking.release_all();
+        STXXL_CHECK(shrinking.acquire(8 * MiB, 1 * MiB) == 6 * MiB);
+        STXXL_CHECK(shrinking.acquire(2 * MiB, 1 * MiB) == 1 * MiB);
+        STXXL_CHECK(usage_of("test shrinking").overcommitted == 1);
+        STXXL_CHECK(mm->get_used() == used + 15 * MiB);
+
+        // an unregistered consumer is not asked anymore, but stays accounted
+        shrinking.unregister();
+        STXXL_CHECK(fixed.acquire(1 * MiB, 0) == 0);
+        STXXL_CHECK(shrinking.shrink_calls == 1);
+        STXXL_CHECK(usage_of("test shrinking").current == 7 * MiB);
+
+        fixed.release(8 * MiB);
+        STXXL_CHECK(usage_of("test fixed").current == 0);
+        STXXL_CHECK(usage_of("test fixed").maximum == 8 * MiB);
+    }
+
+    // destroyed consumers return their memory
+    STXXL_CHECK(mm->get_used() == used);
+    mm->set_limit(0);
+}
+
+void test_vector_and_sorter()
+{
+    typedef stxxl::VECTOR_GENERATOR<stxxl::uint64, 4, 8, 256* 1024>::result vector_type;
+    typedef stxxl::sorter<stxxl::uint64, cmp_uint64> sorter_type;
+
+    stxxl::memory_manager* mm = stxxl::memory_manager::get_instance();
+
+    const stxxl::uint64 n = 4 * MiB;
+    vector_type v(n);
+    for (stxxl::uint64 i = 0; i < n; ++i)
+        v[i] = i;
+
+    const stxxl::uint64 cache = usage_of("vector").current;
+    STXXL_CHECK(cache == 4 * 8 * vector_type::block_type::raw_size);
+
+    // the sorter's runs only fit if the vector drops its cache, which it
+    // does at its next page fault
+    const stxxl::uint64& last = v[n - 1];
+    mm->set_limit(mm->get_used() + 1 * MiB);
+    {
+        sorter_type sorter(cmp_uint64(), 16 * MiB);
+        STXXL_CHECK(usage_of("vector").current == cache);
+
+        // the page accessed last is kept, references to it stay valid
+        STXXL_CHECK(v[0] == 0);
+        STXXL_CHECK(usage_of("vector").current == 2 * 4 * vector_type::block_type::raw_size);
+        STXXL_CHECK(last == n - 1);
+
+        for (stxxl::uint64 i = 0; i < n; ++i)
+            sorter.push(n - i);
+        sorter.sort();
+        for (stxxl::uint64 i = 1; i <= n; ++i, ++sorter)
+            STXXL_CHECK(*sorter == i);
+    }
+    mm->set_limit(0);
+
+    // the cache is allocated again and the data is still there
+    for (stxxl::uint64 i = 0; i < n; i += 1000)
+        STXXL_CHECK(v[i] == i);
+    STXXL_CHECK(usage_of("vector").current == cache);
+
+    mm->print(std::cout);
+}
+
+void test_containers()
+{
+    typedef stxxl::map<int, int, cmp_int, 4096, 4096> map_type;
+    typedef stxxl::unordered_map<int, int, hash_int, cmp_int, 4* 1024, 4> hash_map_type;
+    typedef stxxl::PRIORITY_QUEUE_GENERATOR<
+            stxxl::uint64, cmp_uint64, 16* MiB, 1024* 1024>::result pq_type;
+
+    {
+        map_type map(1 * MiB, 1 * MiB);
+        STXXL_CHECK(usage_of("map").current == 2 * MiB);
+
+        hash_map_type hash_map;
+        STXXL_CHECK(usage_of("hash_map").current > 0);
+
+        // the pools and the segments of the priority queue
+        pq_type pq(4 * MiB, 4 * MiB);
+        const stxxl::uint64 pq_bytes = usage_of("priority_queue").current;
+        STXXL_CHECK(pq_bytes >= 8 * MiB);
+        for (stxxl::uint64 i = 0; i < 1024 * 1024; ++i)
+            pq.push(i + 1);
+        STXXL_CHECK(usage_of("priority_queue").current > pq_bytes);
+    }
+
+    STXXL_CHECK(usage_of("map").current == 0);
+    STXXL_CHECK(usage_of("hash_map").current == 0);
+    STXXL_CHECK(usage_of("priority_queue").current == 0);
+}
+
+int main()
+{
+    test_consumers();
+    test_containers();
+    test_vector_and_sorter();
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
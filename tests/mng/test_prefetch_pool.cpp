@@ -36,6 +36,10 @@ int main()
     pool.resize(10);
     pool.resize(5);
 
+    // grow with blocks preferring the first NUMA node
+    pool.set_numa_node(0);
+    pool.resize(8);
+
     block_type* blk = new block_type;
     (*blk)[0].integer = 42;
     block_type::bid_type bids[2];
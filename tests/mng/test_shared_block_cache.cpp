@@ -0,0 +1,271 @@
+/***************************************************************************
+ *  tests/mng/test_shared_block_cache.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+//! \example mng/test_shared_block_cache.cpp
+//! This tests the shared_block_cache: pinning, write back of dirty blocks on
+//! replacement and flush(), prefetching, discarding, concurrent clients, and
+//! two hash maps and two vectors sharing one cache.
+
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <stxxl/mng>
+#include <stxxl/unordered_map>
+#include <stxxl/vector>
+#include <stxxl/bits/mng/shared_block_cache.h>
+#include <stxxl/bits/parallel.h>
+
+static const unsigned block_size = 64 * 1024;
+static const unsigned num_blocks = 32;
+static const unsigned cache_blocks = 8;
+
+typedef stxxl::typed_block<block_size, unsigned> block_type;
+typedef block_type::bid_type bid_type;
+typedef stxxl::shared_block_cache<block_size> cache_type;
+
+unsigned read_first(const bid_type& bid)
+{
+    block_type* block = new block_type;
+    block->read(bid)->wait();
+    unsigned value = (*block)[0];
+    delete block;
+    return value;
+}
+
+void test_blocks(std::vector<bid_type>& bids)
+{
+    cache_type cache(cache_blocks * block_size);
+    cache_type::owner_type owner = cache.new_owner();
+    STXXL_CHECK(cache.size() == cache_blocks);
+
+    // modify all blocks, which replaces and writes back most of them
+    for (unsigned i = 0; i < num_blocks; ++i)
+    {
+        block_type* block = cache.pin<block_type>(bids[i], owner);
+        STXXL_CHECK((*block)[0] == i);
+        (*block)[0] = i + 1000;
+        STXXL_CHECK(cache.unpin(bids[i], true));
+        STXXL_CHECK(!cache.unpin(bids[i]));
+    }
+    STXXL_CHECK(read_first(bids[0]) == 1000);
+    STXXL_CHECK(cache.is_cached(bids[num_blocks - 1]));
+    STXXL_CHECK(read_first(bids[num_blocks - 1]) == num_blocks - 1);
+    cache.flush(owner);
+    STXXL_CHECK(read_first(bids[num_blocks - 1]) == num_blocks - 1 + 1000);
+
+    // pinned blocks stay cached, at the same address
+    block_type* pinned = cache.pin<block_type>(bids[0], owner);
+    for (unsigned i = 1; i < num_blocks; ++i)
+    {
+        cache.pin<block_type>(bids[i], owner);
+        cache.unpin(bids[i]);
+    }
+    STXXL_CHECK(cache.pin_cached<block_type>(bids[0]) == pinned);
+    STXXL_CHECK((*pinned)[0] == 1000);
+    cache.unpin(bids[0]);
+    cache.unpin(bids[0]);
+
+    // pinning more blocks than the cache holds fails
+    bool thrown = false;
+    try {
+        for (unsigned i = 0; i <= cache_blocks; ++i)
+            cache.pin<block_type>(bids[i], owner);
+    }
+    catch (std::runtime_error&) {
+        thrown = true;
+    }
+    STXXL_CHECK(thrown);
+    for (unsigned i = 0; i < cache_blocks; ++i)
+        STXXL_CHECK(cache.unpin(bids[i]));
+
+    // prefetched blocks are found
+    cache.discard_owner(owner);
+    STXXL_CHECK(!cache.is_cached(bids[5]));
+    STXXL_CHECK(cache.pin_cached<block_type>(bids[5]) == NULL);
+    cache.prefetch(bids[5], owner);
+    STXXL_CHECK(cache.is_cached(bids[5]));
+    STXXL_CHECK((*cache.pin_cached<block_type>(bids[5]))[0] == 1005);
+    cache.unpin(bids[5]);
+
+    // discarded blocks are not written
+    cache.pin<block_type>(bids[6], owner, false);
+    cache.unpin(bids[6], true);
+    cache.discard(bids[6]);
+    STXXL_CHECK(!cache.is_cached(bids[6]));
+    cache.flush();
+    STXXL_CHECK(read_first(bids[6]) == 1006);
+
+    cache.print_statistics(std::cout);
+}
+
+void test_threads(std::vector<bid_type>& bids)
+{
+    cache_type cache(cache_blocks * block_size);
+
+#if STXXL_PARALLEL
+#pragma omp parallel for num_threads(4)
+#endif
+    for (int t = 0; t < 4; ++t)
+    {
+        cache_type::owner_type owner = cache.new_owner();
+        for (unsigned round = 0; round < 10; ++round)
+        {
+            for (unsigned i = t; i < num_blocks; i += 4)
+            {
+                block_type* block = cache.pin<block_type>(bids[i], owner);
+                // other threads only read this element
+                ++(*block)[1];
+                STXXL_CHECK((*block)[0] == i + 1000);
+                cache.unpin(bids[i], true);
+                cache.prefetch(bids[(i + 1) % num_blocks], owner);
+            }
+        }
+    }
+    cache.flush();
+
+    block_type* block = new block_type;
+    for (unsigned i = 0; i < num_blocks; ++i)
+    {
+        block->read(bids[i])->wait();
+        STXXL_CHECK((*block)[1] == 10);
+    }
+    delete block;
+}
+
+struct hash_int
+{
+    size_t operator () (int key) const
+    {
+        return (size_t)(key * 2654435761u);
+    }
+};
+
+struct cmp_int : public std::less<int>
+{
+    int min_value() const { return std::numeric_limits<int>::min(); }
+    int max_value() const { return std::numeric_limits<int>::max(); }
+};
+
+void test_hash_maps()
+{
+    typedef stxxl::unordered_map<int, int, hash_int, cmp_int, 4* 1024, 4> map_type;
+
+    map_type::shared_cache_type cache(6 * map_type::shared_cache_type::raw_size);
+    // small buffers, so values are moved to external blocks early
+    map_type a(1024, hash_int(), cmp_int(), 64 * 1024), b(1024, hash_int(), cmp_int(), 64 * 1024);
+    a.use_shared_cache(&cache);
+    b.use_shared_cache(&cache);
+
+    const int n = 10000;
+    for (int i = 0; i < n; ++i)
+    {
+        a.insert(std::make_pair(i, 2 * i));
+        b.insert(std::make_pair(i, 3 * i));
+    }
+    for (int i = 0; i < n; i += 7)
+    {
+        STXXL_CHECK(a.find(i)->second == 2 * i);
+        STXXL_CHECK(b.find(i)->second == 3 * i);
+        b[i] = 4 * i;
+    }
+    for (int i = 0; i < n; i += 7)
+        STXXL_CHECK(b.find(i)->second == 4 * i);
+    STXXL_CHECK(a.find(n) == a.end());
+
+    // modify values in external blocks
+    size_t count = 0;
+    for (map_type::iterator it = a.begin(); it != a.end(); ++it, ++count)
+        it->second += 1;
+    STXXL_CHECK(count == (size_t)n);
+    for (int i = 0; i < n; ++i)
+        STXXL_CHECK(a.find(i)->second == 2 * i + 1);
+
+    a.print_statistics(std::cout);
+}
+
+void test_vectors()
+{
+    typedef stxxl::VECTOR_GENERATOR<int, 2, 2, 16* 1024>::result vector_type;
+
+    vector_type::shared_cache_type cache(10 * vector_type::shared_cache_type::raw_size);
+    const int n = 100000;
+    vector_type a(n), b(n);
+    a.use_shared_cache(&cache);
+    b.use_shared_cache(&cache);
+
+    for (int i = 0; i < n; ++i)
+    {
+        a[i] = i;
+        b[i] = 2 * i;
+    }
+    // pages of both vectors are referenced at once
+    for (int i = 0; i < n; i += 3)
+        a[i] = b[n - 1 - i];
+    for (int i = 0; i < n; ++i)
+    {
+        STXXL_CHECK(a[i] == ((i % 3 == 0) ? 2 * (n - 1 - i) : i));
+        STXXL_CHECK(b[i] == 2 * i);
+    }
+
+    // the blocks on disk are current after flush()
+    b.flush();
+    int j = 0;
+    for (vector_type::bufreader_type reader(b); !reader.empty(); ++reader, ++j)
+        STXXL_CHECK(*reader == 2 * j);
+    STXXL_CHECK(j == n);
+
+    // and external writes are seen afterwards
+    {
+        vector_type::bufwriter_type writer(b);
+        for (int i = 0; i < n; ++i)
+            writer << 5 * i;
+    }
+    for (int i = 0; i < n; i += 7)
+        STXXL_CHECK(b[i] == 5 * i);
+
+    b.resize(n / 2, true);
+    b.resize(n);
+    for (int i = 0; i < n / 2; ++i)
+        STXXL_CHECK(b[i] == 5 * i);
+
+    // back to its own cache
+    a.use_shared_cache(NULL);
+    for (int i = 0; i < n; i += 3)
+        STXXL_CHECK(a[i] == 2 * (n - 1 - i));
+
+    b.clear();
+    cache.print_statistics(std::cout);
+}
+
+int main()
+{
+    std::vector<bid_type> bids(num_blocks);
+    stxxl::block_manager::get_instance()->new_blocks(stxxl::striping(), bids.begin(), bids.end());
+    block_type* block = new block_type;
+    for (unsigned i = 0; i < num_blocks; ++i)
+    {
+        (*block)[0] = i;
+        (*block)[1] = 0;
+        block->write(bids[i])->wait();
+    }
+    delete block;
+
+    test_blocks(bids);
+    test_threads(bids);
+    test_hash_maps();
+    test_vectors();
+
+    stxxl::block_manager::get_instance()->delete_blocks(bids.begin(), bids.end());
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
@@ -41,4 +41,55 @@ int main()
     stxxl::block_manager::get_instance()->new_block(stxxl::single_disk(), bid);
     pool.write(blk, bid)->wait();
     delete blk;
+
+    // write a range of blocks with one batch and read them back
+    const unsigned nblocks = 4;
+    block_type* blks[nblocks];
+    block_type::bid_type bids[nblocks];
+    stxxl::block_manager::get_instance()->new_blocks(stxxl::striping(), bids + 0, bids + nblocks);
+    for (unsigned i = 0; i < nblocks; ++i)
+    {
+        blks[i] = pool.steal();
+        (*blks[i])[0].integer = i;
+    }
+    pool.write(blks, bids, nblocks);
+    pool.resize(0); // waits for all writes
+
+    block_type* check = new block_type[nblocks];
+    stxxl::request_ptr reqs[nblocks];
+    {
+        stxxl::request_batch batch;
+        for (unsigned i = 0; i < nblocks; ++i)
+            check[i].read(bids[i], batch, reqs[i]);
+    }
+    stxxl::wait_all(reqs, nblocks);
+    for (unsigned i = 0; i < nblocks; ++i)
+        STXXL_CHECK(check[i][0].integer == (int)i);
+    delete[] check;
+
+    // of a bid written twice in one batch only the last block is written,
+    // the first one returns to the pool
+    pool.resize(nblocks);
+    block_type::bid_type twice[nblocks] = { bids[0], bids[1], bids[0], bids[1] };
+    for (unsigned i = 0; i < nblocks; ++i)
+    {
+        blks[i] = pool.steal();
+        (*blks[i])[0].integer = 10 + i;
+    }
+    pool.write(blks, twice, nblocks);
+    STXXL_CHECK(pool.size() == nblocks);
+    std::pair<block_type*, stxxl::request_ptr> pending = pool.steal_request(bids[0]);
+    STXXL_CHECK(pending.first && (*pending.first)[0].integer == 12);
+    pending.second->wait();
+    pool.add(pending.first);
+    pool.resize(0);
+
+    check = new block_type[2];
+    check[0].read(bids[0])->wait();
+    check[1].read(bids[1])->wait();
+    STXXL_CHECK(check[0][0].integer == 12);
+    STXXL_CHECK(check[1][0].integer == 13);
+    delete[] check;
+
+    stxxl::block_manager::get_instance()->delete_blocks(bids + 0, bids + nblocks);
 }
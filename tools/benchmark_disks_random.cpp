@@ -209,7 +209,7 @@ int benchmark_disks_random(int argc, char* argv[])
     stxxl::cmdline_parser cp;
 
     stxxl::uint64 span, block_size = 8 * MiB, worksize = 0;
-    std::string optirw = "irw", allocstr;
+    std::string optirw = "irw", allocstr, queue_impl;
 
     cp.add_param_bytes(
         "span", span,
@@ -226,6 +226,11 @@ int benchmark_disks_random(int argc, char* argv[])
     cp.add_opt_param_string(
         "alloc", allocstr,
         "Block allocation strategy: RC, SR, FR, striping (default: RC).");
+    cp.add_string(
+        'q', "queue", "impl", queue_impl,
+        "Request queue of all disks: qwqr, 1q, elevator or mpsc "
+        "(default: queue_impl of the disk config). With 'elevator' the "
+        "random requests are served in offset order.");
 
     cp.set_description(
         "This program will benchmark _random_ block access on the disks "
@@ -238,6 +243,25 @@ int benchmark_disks_random(int argc, char* argv[])
     if (!cp.process(argc, argv))
         return -1;
 
+    if (queue_impl.size())
+    {
+        if (!stxxl::disk_queues::is_valid_queue_impl(queue_impl))
+        {
+            std::cout << "Unknown request queue '" << queue_impl << "'" << std::endl;
+            cp.print_usage();
+            return -1;
+        }
+
+        // the queues are created when the block_manager opens the disks
+        stxxl::config* config = stxxl::config::get_instance();
+        for (size_t i = 0; i < config->disks_number(); ++i)
+        {
+            stxxl::disk_config& cfg = config->disk(i);
+            if (cfg.io_impl != "linuxaio" && cfg.io_impl != "io_uring")
+                cfg.queue_impl = queue_impl;
+        }
+    }
+
 #define run_alloc(alloc) benchmark_disks_random_alloc<alloc>(span, block_size, worksize, optirw)
     if (allocstr.size())
     {
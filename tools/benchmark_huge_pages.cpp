@@ -0,0 +1,256 @@
+/***************************************************************************
+ *  tools/benchmark_huge_pages.cpp
+ *
+ *  Part of the STXXL. See http://stxxl.sourceforge.net
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ **************************************************************************/
+
+static const char* description =
+    "Benchmark the effect of backing block buffers with huge pages on "
+    "stxxl::stream::sort and the priority queue. Both are run once for each "
+    "huge page mode, which is set process-wide with stxxl::set_huge_pages(). "
+    "Modes that cannot be mapped fall back to smaller pages, hence the bytes "
+    "actually mapped with each mode are reported. The priority queue uses "
+    "128 MiB of RAM and 2 MiB blocks, such that its block buffers are mapped "
+    "with huge pages as well.";
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <stxxl/cmdline>
+#include <stxxl/priority_queue>
+#include <stxxl/random>
+#include <stxxl/stream>
+#include <stxxl/timer>
+#include <stxxl/bits/common/huge_pages.h>
+#include <stxxl/bits/common/tuple.h>
+
+using stxxl::uint64;
+using stxxl::unsigned_type;
+
+#define MiB (1024 * 1024)
+
+typedef stxxl::tuple<uint64, uint64> value_type;
+
+struct value_less
+{
+    bool operator () (const value_type& a, const value_type& b) const
+    {
+        return a.first < b.first;
+    }
+
+    value_type min_value() const
+    { return value_type::min_value(); }
+
+    value_type max_value() const
+    { return value_type::max_value(); }
+};
+
+struct value_greater
+{
+    // the PQ is a max priority queue, compare greater to pop the smallest
+    bool operator () (const value_type& a, const value_type& b) const
+    {
+        return a.first > b.first;
+    }
+
+    value_type min_value() const
+    { return value_type::max_value(); }
+};
+
+struct random_stream
+{
+    typedef ::value_type value_type;
+
+    stxxl::random_number64 m_rng;
+    value_type m_value;
+    uint64 m_counter;
+
+    random_stream(uint64 size)
+        : m_counter(size)
+    {
+        m_value.first = m_rng();
+        m_value.second = m_counter;
+    }
+
+    const value_type& operator * () const
+    {
+        return m_value;
+    }
+
+    random_stream& operator ++ ()
+    {
+        --m_counter;
+        m_value.first = m_rng();
+        m_value.second = m_counter;
+        return *this;
+    }
+
+    bool empty() const
+    {
+        return (m_counter == 0);
+    }
+};
+
+//! results of one huge page mode
+struct huge_pages_result
+{
+    stxxl::huge_pages_mode mode;
+    double sort_seconds, pq_seconds;
+    //! peak bytes mapped per mode, sampled after run formation and after
+    //! filling the priority queue
+    size_t mapped[stxxl::HUGE_PAGES_1GIB + 1];
+};
+
+static void record_mapped(huge_pages_result& r)
+{
+    for (int m = stxxl::HUGE_PAGES_TRANSPARENT; m <= stxxl::HUGE_PAGES_1GIB; ++m)
+        r.mapped[m] = std::max(r.mapped[m], stxxl::get_huge_pages_mapped(stxxl::huge_pages_mode(m)));
+}
+
+static double run_stream_sort(uint64 nelements, unsigned_type memsize, huge_pages_result& r)
+{
+    typedef stxxl::stream::sort<random_stream, value_less> sort_type;
+
+    stxxl::timer timer(true);
+    {
+        stxxl::scoped_print_timer ptimer("stxxl::stream::sort", nelements * sizeof(value_type));
+
+        random_stream input(nelements);
+        sort_type sorted(input, value_less(), memsize);
+
+        record_mapped(r);
+
+        value_type prev = value_type::min_value();
+        for ( ; !sorted.empty(); ++sorted)
+        {
+            STXXL_CHECK(!value_less()(*sorted, prev));
+            prev = *sorted;
+        }
+    }
+    return timer.seconds();
+}
+
+static double run_pqueue(uint64 nelements, huge_pages_result& r)
+{
+    typedef stxxl::PRIORITY_QUEUE_GENERATOR<
+            value_type, value_greater, 128 * MiB, 16 * MiB / sizeof(value_type)
+            > pq_gen;
+    // the generator picks blocks below the 2 MiB threshold of huge pages,
+    // keep its internal layout but use 2 MiB external blocks
+    typedef stxxl::priority_queue<
+            stxxl::priority_queue_config<
+                value_type, value_greater, pq_gen::Buffer1Size, pq_gen::N,
+                pq_gen::AI, 2, 2 * MiB, 16, 2>
+            > pq_type;
+
+    stxxl::timer timer(true);
+    {
+        stxxl::scoped_print_timer ptimer("priority_queue fill and drain", nelements * sizeof(value_type));
+
+        pq_type pq(64 * MiB, 64 * MiB);
+        random_stream input(nelements);
+        for ( ; !input.empty(); ++input)
+            pq.push(*input);
+
+        record_mapped(r);
+
+        // the smallest values are on top
+        value_type prev = value_type::min_value();
+        for (uint64 i = 0; i < nelements; ++i)
+        {
+            STXXL_CHECK(!(pq.top().first < prev.first));
+            prev = pq.top();
+            pq.pop();
+        }
+    }
+    return timer.seconds();
+}
+
+int benchmark_huge_pages(int argc, char* argv[])
+{
+    // parse command line
+    stxxl::cmdline_parser cp;
+
+    cp.set_description(description);
+
+    uint64 size = 0;
+    cp.add_param_bytes("size", size,
+                       "Amount of data to sort and insert (e.g. 4GiB)");
+
+    unsigned_type memsize = 256 * MiB;
+    cp.add_bytes('M', "ram", memsize,
+                 "Amount of RAM to use when sorting, default: 256 MiB");
+
+    std::vector<std::string> modes;
+    cp.add_stringlist('m', "mode", modes,
+                      "Huge page modes to compare: none, thp, 2m, 1g. "
+                      "Can be given multiple times, default: all.");
+
+    if (!cp.process(argc, argv))
+        return -1;
+
+    if (modes.empty()) {
+        modes.push_back("none");
+        modes.push_back("thp");
+        modes.push_back("2m");
+        modes.push_back("1g");
+    }
+
+    const uint64 nelements = size / sizeof(value_type);
+    std::vector<huge_pages_result> results;
+
+    for (size_t i = 0; i < modes.size(); ++i)
+    {
+        huge_pages_result r;
+        std::fill(r.mapped, r.mapped + stxxl::HUGE_PAGES_1GIB + 1, 0);
+        if (modes[i] == "none")
+            r.mode = stxxl::HUGE_PAGES_NONE;
+        else if (modes[i] == "thp")
+            r.mode = stxxl::HUGE_PAGES_TRANSPARENT;
+        else if (modes[i] == "2m")
+            r.mode = stxxl::HUGE_PAGES_2MIB;
+        else if (modes[i] == "1g")
+            r.mode = stxxl::HUGE_PAGES_1GIB;
+        else {
+            STXXL_ERRMSG("Unknown huge page mode " << modes[i] << ".");
+            return -1;
+        }
+
+        STXXL_MSG("# huge pages: " << stxxl::get_huge_pages_name(r.mode));
+        stxxl::set_huge_pages(r.mode);
+
+        r.sort_seconds = run_stream_sort(nelements, memsize, r);
+        r.pq_seconds = run_pqueue(nelements, r);
+        results.push_back(r);
+    }
+    stxxl::set_huge_pages(stxxl::HUGE_PAGES_NONE);
+
+    std::cout << std::endl
+              << std::setw(12) << "huge pages"
+              << std::setw(14) << "sort MiB/s"
+              << std::setw(14) << "pqueue MiB/s"
+              << "  mapped MiB (thp/2m/1g)" << std::endl;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const huge_pages_result& r = results[i];
+        std::cout << std::setw(12) << stxxl::get_huge_pages_name(r.mode)
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(14) << (double)size / MiB / r.sort_seconds
+                  << std::setw(14) << (double)size / MiB / r.pq_seconds
+                  << "  " << r.mapped[stxxl::HUGE_PAGES_TRANSPARENT] / MiB
+                  << "/" << r.mapped[stxxl::HUGE_PAGES_2MIB] / MiB
+                  << "/" << r.mapped[stxxl::HUGE_PAGES_1GIB] / MiB
+                  << std::endl;
+    }
+
+    return 0;
+}
+
+// vim: et:ts=4:sw=4
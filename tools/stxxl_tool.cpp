@@ -49,6 +49,7 @@ extern int benchmark_files(int argc, char* argv[]);
 extern int benchmark_sort(int argc, char* argv[]);
 extern int benchmark_disks_random(int argc, char* argv[]);
 extern int benchmark_pqueue(int argc, char* argv[]);
+extern int benchmark_huge_pages(int argc, char* argv[]);
 extern int do_mlock(int argc, char* argv[]);
 extern int do_mallinfo(int argc, char* argv[]);
 
@@ -91,6 +92,11 @@ struct SubTool subtools[] = {
         "benchmark_pqueue", &benchmark_pqueue, false,
         "Benchmark priority queue implementation using sequence of operations."
     },
+    {
+        "benchmark_huge_pages", &benchmark_huge_pages, false,
+        "Benchmark stream::sort and the priority queue with block buffers "
+        "backed by normal and huge pages."
+    },
     {
         "mlock", &do_mlock, true,
         "Lock physical memory."